@@ -0,0 +1,397 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBExploredLayer.h"
+
+#include "OBVisibilityGrid.h"
+#include "Serialization/Archive.h"
+
+namespace OBExploredLayerPrivate
+{
+	// Phiên bản định dạng của Serialize.
+	constexpr uint32 SerializeVersion = 1;
+
+	// Cách lưu một tile.
+	enum class ETileEncoding : uint8
+	{
+		Full,
+		Raw,
+		RunLength
+	};
+
+	constexpr int32 BitsPerTile = FOBExploredLayer::TileSize * FOBExploredLayer::TileSize;
+
+	bool GetTileBit(const uint64* Rows, const int32 BitIndex)
+	{
+		return (Rows[BitIndex >> 6] >> (BitIndex & 63)) & 1;
+	}
+
+	/** Độ dài các đoạn bit liên tiếp, xen kẽ 0/1 và luôn bắt đầu bằng đoạn 0 (có thể dài 0). */
+	void EncodeRuns(const uint64* Rows, TArray<uint16, TInlineAllocator<64>>& OutRuns)
+	{
+		OutRuns.Reset();
+		bool bCurrent = false;
+		int32 RunLength = 0;
+		for (int32 BitIndex = 0; BitIndex < BitsPerTile; ++BitIndex)
+		{
+			if (GetTileBit(Rows, BitIndex) != bCurrent)
+			{
+				OutRuns.Add(static_cast<uint16>(RunLength));
+				bCurrent = !bCurrent;
+				RunLength = 0;
+			}
+			++RunLength;
+		}
+		OutRuns.Add(static_cast<uint16>(RunLength));
+	}
+
+	void DecodeRuns(TConstArrayView<uint16> Runs, uint64* OutRows)
+	{
+		FMemory::Memzero(OutRows, sizeof(uint64) * FOBExploredLayer::TileSize);
+		int32 BitIndex = 0;
+		for (int32 RunIndex = 0; RunIndex < Runs.Num(); ++RunIndex)
+		{
+			const int32 End = FMath::Min(BitIndex + Runs[RunIndex], BitsPerTile);
+			if (RunIndex & 1)
+			{
+				for (; BitIndex < End; ++BitIndex)
+				{
+					OutRows[BitIndex >> 6] |= uint64(1) << (BitIndex & 63);
+				}
+			}
+			BitIndex = End;
+		}
+	}
+}
+
+void FOBExploredLayer::Initialize(const FOBVisibilityGrid& Grid)
+{
+	Dimensions = Grid.GetDimensions();
+	NumTiles = FIntPoint(FMath::DivideAndRoundUp(Dimensions.X, TileSize),
+	                     FMath::DivideAndRoundUp(Dimensions.Y, TileSize));
+
+	TileSlots.Init(EmptyTile, NumTiles.X * NumTiles.Y);
+	Tiles.Reset();
+	FreeTiles.Reset();
+	DirtyTiles.Reset();
+	DirtyFlags.Init(false, TileSlots.Num());
+
+	// Nội dung ban đầu của texture chưa xác định, nên lần upload đầu ghi mọi tile
+	for (int32 TileIndex = 0; TileIndex < TileSlots.Num(); ++TileIndex)
+	{
+		MarkTileDirty(TileIndex);
+	}
+}
+
+int32 FOBExploredLayer::Accumulate(const FOBVisibilityGrid& Grid, const FIntRect& Rect)
+{
+	if (!IsInitialized() || Grid.GetDimensions() != Dimensions || Rect.IsEmpty())
+	{
+		return 0;
+	}
+
+	const TConstArrayView<uint64> Words = Grid.GetWords();
+	const int32 WordsPerRow = Grid.GetWordsPerRow();
+	const int32 MinTileX = Rect.Min.X / TileSize;
+	const int32 MaxTileX = (Rect.Max.X - 1) / TileSize;
+	const int32 MinTileY = Rect.Min.Y / TileSize;
+	const int32 MaxTileY = (Rect.Max.Y - 1) / TileSize;
+
+	int32 NumChangedTiles = 0;
+	for (int32 TileY = MinTileY; TileY <= MaxTileY; ++TileY)
+	{
+		for (int32 TileX = MinTileX; TileX <= MaxTileX; ++TileX)
+		{
+			const int32 TileIndex = TileY * NumTiles.X + TileX;
+			if (TileSlots[TileIndex] == FullTile)
+			{
+				continue;
+			}
+
+			// Cột TileX của tile trùng với word TileX trong mỗi hàng của lưới
+			const int32 MinY = FMath::Max(Rect.Min.Y, TileY * TileSize);
+			const int32 MaxY = FMath::Min(Rect.Max.Y, (TileY + 1) * TileSize);
+			FTile* Tile = TileSlots[TileIndex] >= 0 ? &Tiles[TileSlots[TileIndex]] : nullptr;
+			bool bChanged = false;
+			for (int32 Y = MinY; Y < MaxY; ++Y)
+			{
+				const uint64 Visible = Words[Y * WordsPerRow + TileX];
+				if (!Visible)
+				{
+					continue;
+				}
+
+				if (!Tile)
+				{
+					Tile = GetOrAllocateTile(TileIndex);
+				}
+				uint64& Row = Tile->Rows[Y - TileY * TileSize];
+				if ((Row | Visible) != Row)
+				{
+					Row |= Visible;
+					bChanged = true;
+				}
+			}
+
+			if (bChanged)
+			{
+				++NumChangedTiles;
+				MarkTileDirty(TileIndex);
+				CompactTile(TileIndex);
+			}
+		}
+	}
+	return NumChangedTiles;
+}
+
+bool FOBExploredLayer::IsCellExplored(const FIntPoint& Cell) const
+{
+	if (Cell.X < 0 || Cell.Y < 0 || Cell.X >= Dimensions.X || Cell.Y >= Dimensions.Y)
+	{
+		return false;
+	}
+
+	const int32 Slot = TileSlots[(Cell.Y / TileSize) * NumTiles.X + Cell.X / TileSize];
+	if (Slot < 0)
+	{
+		return Slot == FullTile;
+	}
+	return (Tiles[Slot].Rows[Cell.Y % TileSize] >> (Cell.X % TileSize)) & 1;
+}
+
+void FOBExploredLayer::ConsumeDirtyTiles(TArray<int32>& OutTiles)
+{
+	OutTiles.Reset();
+	OutTiles.Append(DirtyTiles);
+	for (const int32 TileIndex : DirtyTiles)
+	{
+		DirtyFlags[TileIndex] = false;
+	}
+	DirtyTiles.Reset();
+}
+
+FIntRect FOBExploredLayer::GetTileRect(const int32 TileIndex) const
+{
+	const FIntPoint Min((TileIndex % NumTiles.X) * TileSize, (TileIndex / NumTiles.X) * TileSize);
+	return FIntRect(Min, FIntPoint(FMath::Min(Min.X + TileSize, Dimensions.X), FMath::Min(Min.Y + TileSize, Dimensions.Y)));
+}
+
+void FOBExploredLayer::AppendRectBytes(const FIntRect& Rect, TArray<uint8>& OutBytes) const
+{
+	const int32 Offset = OutBytes.Num();
+	OutBytes.AddUninitialized(Rect.Area());
+	uint8* Dest = OutBytes.GetData() + Offset;
+	for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; ++Y)
+	{
+		for (int32 X = Rect.Min.X; X < Rect.Max.X; ++X)
+		{
+			*Dest++ = IsCellExplored(FIntPoint(X, Y)) ? 255 : 0;
+		}
+	}
+}
+
+void FOBExploredLayer::Serialize(FArchive& Ar)
+{
+	using namespace OBExploredLayerPrivate;
+
+	uint32 Version = SerializeVersion;
+	FIntPoint SavedDimensions = Dimensions;
+	Ar << Version;
+	Ar << SavedDimensions;
+
+	if (Ar.IsSaving())
+	{
+		int32 NumSavedTiles = 0;
+		for (const int32 Slot : TileSlots)
+		{
+			NumSavedTiles += Slot != EmptyTile ? 1 : 0;
+		}
+		Ar << NumSavedTiles;
+
+		TArray<uint16, TInlineAllocator<64>> Runs;
+		for (int32 TileIndex = 0; TileIndex < TileSlots.Num(); ++TileIndex)
+		{
+			const int32 Slot = TileSlots[TileIndex];
+			if (Slot == EmptyTile)
+			{
+				continue;
+			}
+
+			Ar << TileIndex;
+			if (Slot == FullTile)
+			{
+				ETileEncoding Encoding = ETileEncoding::Full;
+				Ar << Encoding;
+				continue;
+			}
+
+			// Chọn dạng nhỏ hơn: run-length cho vùng liền mạch, bitmap thô cho vùng lốm đốm
+			FTile& Tile = Tiles[Slot];
+			EncodeRuns(Tile.Rows, Runs);
+			if (static_cast<int32>(sizeof(uint16)) * (Runs.Num() + 1) < static_cast<int32>(sizeof(FTile)))
+			{
+				ETileEncoding Encoding = ETileEncoding::RunLength;
+				uint16 NumRuns = static_cast<uint16>(Runs.Num());
+				Ar << Encoding;
+				Ar << NumRuns;
+				for (uint16& Run : Runs)
+				{
+					Ar << Run;
+				}
+			}
+			else
+			{
+				ETileEncoding Encoding = ETileEncoding::Raw;
+				Ar << Encoding;
+				for (uint64& Row : Tile.Rows)
+				{
+					Ar << Row;
+				}
+			}
+		}
+		return;
+	}
+
+	// --- NẠP ---
+	const bool bApply = Version == SerializeVersion && SavedDimensions == Dimensions && IsInitialized();
+	if (Version != SerializeVersion || SavedDimensions != Dimensions)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FOBExploredLayer: Bỏ qua dữ liệu không tương thích (phiên bản %u, lưới %dx%d)."),
+		       Version, SavedDimensions.X, SavedDimensions.Y);
+	}
+	if (Version != SerializeVersion)
+	{
+		return;
+	}
+
+	int32 NumSavedTiles = 0;
+	Ar << NumSavedTiles;
+
+	TArray<uint16, TInlineAllocator<64>> Runs;
+	FTile LoadedTile;
+	for (int32 Index = 0; Index < NumSavedTiles && !Ar.IsError(); ++Index)
+	{
+		int32 TileIndex = INDEX_NONE;
+		ETileEncoding Encoding = ETileEncoding::Full;
+		Ar << TileIndex;
+		Ar << Encoding;
+
+		if (Encoding == ETileEncoding::RunLength)
+		{
+			uint16 NumRuns = 0;
+			Ar << NumRuns;
+			Runs.SetNumUninitialized(NumRuns);
+			for (uint16& Run : Runs)
+			{
+				Ar << Run;
+			}
+			DecodeRuns(Runs, LoadedTile.Rows);
+		}
+		else if (Encoding == ETileEncoding::Raw)
+		{
+			for (uint64& Row : LoadedTile.Rows)
+			{
+				Ar << Row;
+			}
+		}
+		else if (Encoding != ETileEncoding::Full)
+		{
+			Ar.SetError();
+			break;
+		}
+
+		if (!bApply || !TileSlots.IsValidIndex(TileIndex) || TileSlots[TileIndex] == FullTile)
+		{
+			continue;
+		}
+
+		if (Encoding == ETileEncoding::Full)
+		{
+			if (TileSlots[TileIndex] >= 0)
+			{
+				FreeTiles.Add(TileSlots[TileIndex]);
+			}
+			TileSlots[TileIndex] = FullTile;
+		}
+		else
+		{
+			// Bỏ các bit ngoài lưới (tile ở mép phải/dưới), để dữ liệu hỏng không lọt vào tile
+			// rồi bị ghi lại ở lần lưu sau; Accumulate cũng không bao giờ đặt các bit đó
+			const uint64 ColumnMask = GetValidColumnMask(TileIndex % NumTiles.X);
+			const int32 NumRows = GetNumValidRows(TileIndex / NumTiles.X);
+			FTile* Tile = GetOrAllocateTile(TileIndex);
+			for (int32 Row = 0; Row < NumRows; ++Row)
+			{
+				Tile->Rows[Row] |= LoadedTile.Rows[Row] & ColumnMask;
+			}
+			CompactTile(TileIndex);
+		}
+		MarkTileDirty(TileIndex);
+	}
+}
+
+uint64 FOBExploredLayer::GetValidColumnMask(const int32 TileX) const
+{
+	const int32 NumColumns = FMath::Min(TileSize, Dimensions.X - TileX * TileSize);
+	return NumColumns >= 64 ? ~uint64(0) : (uint64(1) << NumColumns) - 1;
+}
+
+int32 FOBExploredLayer::GetNumValidRows(const int32 TileY) const
+{
+	return FMath::Min(TileSize, Dimensions.Y - TileY * TileSize);
+}
+
+FOBExploredLayer::FTile* FOBExploredLayer::GetOrAllocateTile(const int32 TileIndex)
+{
+	int32& Slot = TileSlots[TileIndex];
+	if (Slot == FullTile)
+	{
+		return nullptr;
+	}
+
+	if (Slot == EmptyTile)
+	{
+		if (FreeTiles.Num() > 0)
+		{
+			Slot = FreeTiles.Pop();
+		}
+		else
+		{
+			Slot = Tiles.AddUninitialized();
+		}
+		FMemory::Memzero(Tiles[Slot].Rows, sizeof(FTile::Rows));
+	}
+	return &Tiles[Slot];
+}
+
+void FOBExploredLayer::CompactTile(const int32 TileIndex)
+{
+	const int32 Slot = TileSlots[TileIndex];
+	if (Slot < 0)
+	{
+		return;
+	}
+
+	const uint64 ColumnMask = GetValidColumnMask(TileIndex % NumTiles.X);
+	const int32 NumRows = GetNumValidRows(TileIndex / NumTiles.X);
+	const FTile& Tile = Tiles[Slot];
+	for (int32 Row = 0; Row < NumRows; ++Row)
+	{
+		if ((Tile.Rows[Row] & ColumnMask) != ColumnMask)
+		{
+			return;
+		}
+	}
+
+	FreeTiles.Add(Slot);
+	TileSlots[TileIndex] = FullTile;
+}
+
+void FOBExploredLayer::MarkTileDirty(const int32 TileIndex)
+{
+	if (!DirtyFlags[TileIndex])
+	{
+		DirtyFlags[TileIndex] = true;
+		DirtyTiles.Add(TileIndex);
+	}
+}
@@ -0,0 +1,189 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBLineOfSightSolver.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+
+namespace OBLineOfSightSolverPrivate
+{
+	// Sai lệch (cm) của mắt hoặc khoảng cách một tia dưới ngưỡng này không làm đa giác đổi Revision.
+	constexpr float PolygonTolerance = 1.0f;
+	// Sai lệch (radian) của góc tia đầu tiên dưới ngưỡng này được xem là không đổi.
+	constexpr float YawTolerance = 1.0e-4f;
+
+	bool IsPolygonNearlyEqual(const FOBVisibilityPolygon& A, const FOBVisibilityPolygon& B)
+	{
+		if (A.Distances.Num() != B.Distances.Num() || A.YawStep != B.YawStep
+			|| !FMath::IsNearlyEqual(A.StartYaw, B.StartYaw, YawTolerance)
+			|| !A.Origin.Equals(B.Origin, PolygonTolerance))
+		{
+			return false;
+		}
+
+		for (int32 RayIndex = 0; RayIndex < A.Distances.Num(); ++RayIndex)
+		{
+			if (!FMath::IsNearlyEqual(A.Distances[RayIndex], B.Distances[RayIndex], PolygonTolerance))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+float FOBVisibilityPolygon::GetDistanceAtYaw(const float Yaw) const
+{
+	if (Distances.IsEmpty() || YawStep <= 0.0f)
+	{
+		return Distances.IsEmpty() ? 0.0f : Distances[0];
+	}
+
+	float Delta = FMath::Fmod(Yaw - StartYaw, UE_TWO_PI);
+	if (Delta < 0.0f)
+	{
+		Delta += UE_TWO_PI;
+	}
+
+	// Góc nằm ngoài quạt được kẹp về tia ở mép gần nhất
+	if (const float FanAngle = YawStep * (Distances.Num() - 1); Delta > FanAngle)
+	{
+		Delta = Delta - FanAngle < UE_TWO_PI - Delta ? FanAngle : 0.0f;
+	}
+
+	const float RayPosition = Delta / YawStep;
+	const int32 RayIndex = FMath::Min(FMath::FloorToInt32(RayPosition), Distances.Num() - 2);
+	if (RayIndex < 0)
+	{
+		return Distances[0];
+	}
+	return FMath::Lerp(Distances[RayIndex], Distances[RayIndex + 1], RayPosition - RayIndex);
+}
+
+void FOBLineOfSightSolver::Configure(const int32 InRaysPerSource, const ECollisionChannel InTraceChannel)
+{
+	RaysPerSource = FMath::Max(InRaysPerSource, 0);
+	TraceChannel = InTraceChannel;
+	PendingHandles.Reset();
+	PendingPolygons.Reset();
+	Polygons.Reset();
+}
+
+void FOBLineOfSightSolver::Kick(UWorld* World, const TConstArrayView<FTeammateVisionData> Sources,
+                                const TConstArrayView<TObjectKey<AActor>> SourceActors, const FOBVisionRules& Rules)
+{
+	if (!World || RaysPerSource < 2)
+	{
+		return;
+	}
+
+	const float HalfAngle = FMath::DegreesToRadians(FMath::Clamp(Rules.VisionAngleDegrees * 0.5f, 0.0f, 180.0f));
+	// Quạt 360 độ không lặp lại tia cuối trùng với tia đầu
+	const float YawStep = HalfAngle >= UE_PI
+		                      ? UE_TWO_PI / RaysPerSource
+		                      : (2.0f * HalfAngle) / (RaysPerSource - 1);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(FogOfWarLineOfSight), false);
+
+	PendingHandles.Reset(Sources.Num() * RaysPerSource);
+	PendingPolygons.SetNum(Sources.Num());
+	for (int32 SourceIndex = 0; SourceIndex < Sources.Num(); ++SourceIndex)
+	{
+		const FTeammateVisionData& Source = Sources[SourceIndex];
+		FOBVisibilityPolygon& Polygon = PendingPolygons[SourceIndex];
+		Polygon.Origin = Source.EyeLocation;
+		Polygon.StartYaw = FMath::Atan2(Source.ForwardVector.Y, Source.ForwardVector.X) - HalfAngle;
+		Polygon.YawStep = YawStep;
+		Polygon.SourceActor = SourceActors.IsValidIndex(SourceIndex) ? SourceActors[SourceIndex] : TObjectKey<AActor>();
+
+		// Tia của nguồn không bị chặn bởi chính actor mang nó; tham số được sao chép vào từng trace
+		QueryParams.ClearIgnoredActors();
+		if (const AActor* SourceActor = Polygon.SourceActor.ResolveObjectPtr())
+		{
+			QueryParams.AddIgnoredActor(SourceActor);
+		}
+
+		for (int32 RayIndex = 0; RayIndex < RaysPerSource; ++RayIndex)
+		{
+			float Sin, Cos;
+			FMath::SinCos(&Sin, &Cos, Polygon.StartYaw + RayIndex * YawStep);
+			const FVector End = Source.EyeLocation + FVector(Cos, Sin, 0.0f) * Rules.VisionDistance;
+			PendingHandles.Add(World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Source.EyeLocation, End,
+			                                                  TraceChannel, QueryParams));
+		}
+
+		Polygon.Distances.Init(Rules.VisionDistance, RaysPerSource);
+	}
+
+	PendingFrame = GFrameCounter;
+}
+
+bool FOBLineOfSightSolver::Gather(UWorld* World)
+{
+	if (!World || PendingHandles.IsEmpty() || PendingFrame == GFrameCounter)
+	{
+		return false;
+	}
+
+	// Kết quả trace bất đồng bộ chỉ được giữ trong một frame; nếu quá hạn thì bỏ cả batch
+	FTraceDatum TraceData;
+	for (int32 HandleIndex = 0; HandleIndex < PendingHandles.Num(); ++HandleIndex)
+	{
+		if (!World->QueryTraceData(PendingHandles[HandleIndex], TraceData))
+		{
+			PendingHandles.Reset();
+			return false;
+		}
+
+		if (!TraceData.OutHits.IsEmpty() && TraceData.OutHits[0].bBlockingHit)
+		{
+			FOBVisibilityPolygon& Polygon = PendingPolygons[HandleIndex / RaysPerSource];
+			Polygon.Distances[HandleIndex % RaysPerSource] = TraceData.OutHits[0].Distance;
+		}
+	}
+	PendingHandles.Reset();
+
+	// Đa giác được so với lần trước của cùng nguồn: theo actor, hoặc theo vị trí khi nguồn không có actor.
+	// Nguồn không đổi quá ngưỡng giữ dữ liệu cũ (để sai lệch nhỏ không cộng dồn) và Revision cũ, nên lưới
+	// không vẽ lại nguồn đứng yên chỉ vì batch tia được bắn lại.
+	bool bChanged = PendingPolygons.Num() != Polygons.Num();
+	for (int32 SourceIndex = 0; SourceIndex < PendingPolygons.Num(); ++SourceIndex)
+	{
+		FOBVisibilityPolygon& Polygon = PendingPolygons[SourceIndex];
+		int32 PreviousIndex = INDEX_NONE;
+		if (Polygon.SourceActor != TObjectKey<AActor>())
+		{
+			PreviousIndex = Polygons.IndexOfByPredicate([&Polygon](const FOBVisibilityPolygon& Candidate)
+			{
+				return Candidate.SourceActor == Polygon.SourceActor;
+			});
+		}
+		else if (Polygons.IsValidIndex(SourceIndex) && Polygons[SourceIndex].SourceActor == TObjectKey<AActor>())
+		{
+			PreviousIndex = SourceIndex;
+		}
+
+		if (PreviousIndex != INDEX_NONE
+			&& OBLineOfSightSolverPrivate::IsPolygonNearlyEqual(Polygons[PreviousIndex], Polygon))
+		{
+			const FOBVisibilityPolygon& Previous = Polygons[PreviousIndex];
+			Polygon.Origin = Previous.Origin;
+			Polygon.StartYaw = Previous.StartYaw;
+			FMemory::Memcpy(Polygon.Distances.GetData(), Previous.Distances.GetData(),
+			                Polygon.Distances.Num() * sizeof(float));
+			Polygon.Revision = Previous.Revision;
+			// Nguồn đổi chỗ trong danh sách vẫn là thay đổi với người đọc theo chỉ số
+			bChanged |= PreviousIndex != SourceIndex;
+		}
+		else
+		{
+			Polygon.Revision = NextRevision++;
+			bChanged = true;
+		}
+	}
+
+	// Hoán đổi thay vì di chuyển để mảng Distances của cả hai phía được tái sử dụng ở lần sau
+	Swap(Polygons, PendingPolygons);
+	return bChanged;
+}
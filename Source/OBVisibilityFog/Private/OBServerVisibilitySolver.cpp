@@ -0,0 +1,100 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBServerVisibilitySolver.h"
+
+void FOBServerVisibilitySolver::Solve(const TConstArrayView<FSource> Sources, const TConstArrayView<FTarget> Targets,
+                                      TArray<uint64>& OutVisibleTeamMasks)
+{
+	const int32 NumTargets = Targets.Num();
+	OutVisibleTeamMasks.Reset();
+	OutVisibleTeamMasks.AddZeroed(NumTargets);
+	LastNumTests = 0;
+
+	// --- BƯỚC 1: BĂM MỤC TIÊU VÀO LƯỚI ---
+	// Team sở hữu luôn nhìn thấy mục tiêu của mình
+	TargetCells.Reset();
+	TargetCells.AddUninitialized(NumTargets);
+	SortedTargets.Reset();
+	SortedTargets.AddUninitialized(NumTargets);
+	for (int32 Index = 0; Index < NumTargets; ++Index)
+	{
+		TargetCells[Index] = ToCell(Targets[Index].Location);
+		SortedTargets[Index] = Index;
+		if (Targets[Index].TeamIndex >= 0 && Targets[Index].TeamIndex < MaxTeams)
+		{
+			OutVisibleTeamMasks[Index] = uint64(1) << Targets[Index].TeamIndex;
+		}
+	}
+
+	SortedTargets.Sort([this](const int32 A, const int32 B)
+	{
+		const FIntPoint& CellA = TargetCells[A];
+		const FIntPoint& CellB = TargetCells[B];
+		return CellA.Y != CellB.Y ? CellA.Y < CellB.Y : CellA.X < CellB.X;
+	});
+
+	CellRanges.Reset();
+	for (int32 Start = 0; Start < NumTargets;)
+	{
+		const FIntPoint Cell = TargetCells[SortedTargets[Start]];
+		int32 End = Start + 1;
+		while (End < NumTargets && TargetCells[SortedTargets[End]] == Cell)
+		{
+			++End;
+		}
+		CellRanges.Add(Cell, FIntPoint(Start, End - Start));
+		Start = End;
+	}
+
+	// --- BƯỚC 2: MỖI NGUỒN CHỈ KIỂM TRA CÁC Ô MÀ TẦM NHÌN CỦA NÓ CHẠM TỚI ---
+	for (const FSource& Source : Sources)
+	{
+		if (Source.TeamIndex < 0 || Source.TeamIndex >= MaxTeams)
+		{
+			continue;
+		}
+
+		const uint64 TeamBit = uint64(1) << Source.TeamIndex;
+		const float VisionConeCos = Source.Rules.GetVisionConeCos();
+
+		// Vùng bao 2D của hình nón (đặt ở mắt) và hình trụ bán kính xung quanh (đặt ở mặt đất)
+		const float ConeReach = Source.Rules.VisionDistance;
+		const float ProximityReach = Source.Rules.ProximityRadius;
+		const FVector2D Min(FMath::Min(Source.Vision.EyeLocation.X - ConeReach, Source.Vision.GroundLocation.X - ProximityReach),
+		                    FMath::Min(Source.Vision.EyeLocation.Y - ConeReach, Source.Vision.GroundLocation.Y - ProximityReach));
+		const FVector2D Max(FMath::Max(Source.Vision.EyeLocation.X + ConeReach, Source.Vision.GroundLocation.X + ProximityReach),
+		                    FMath::Max(Source.Vision.EyeLocation.Y + ConeReach, Source.Vision.GroundLocation.Y + ProximityReach));
+		const FIntPoint MinCell = ToCell(FVector(Min, 0.0f));
+		const FIntPoint MaxCell = ToCell(FVector(Max, 0.0f));
+
+		for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; ++CellY)
+		{
+			for (int32 CellX = MinCell.X; CellX <= MaxCell.X; ++CellX)
+			{
+				const FIntPoint* Range = CellRanges.Find(FIntPoint(CellX, CellY));
+				if (!Range)
+				{
+					continue;
+				}
+
+				for (int32 Slot = Range->X; Slot < Range->X + Range->Y; ++Slot)
+				{
+					const int32 TargetIndex = SortedTargets[Slot];
+					uint64& Mask = OutVisibleTeamMasks[TargetIndex];
+					// Team đã nhìn thấy mục tiêu qua một nguồn khác thì bỏ qua
+					if (Mask & TeamBit)
+					{
+						continue;
+					}
+
+					++LastNumTests;
+					if (Source.Rules.IsLocationVisible(Source.Vision, Targets[TargetIndex].Location, VisionConeCos))
+					{
+						Mask |= TeamBit;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,319 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBServerVisibilitySubsystem.h"
+
+#include "OBVisibilityFogStats.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Server Visibility Tests"), STAT_OBFogServerVisibilityTests, STATGROUP_OBVisibilityFog);
+
+void UOBServerVisibilitySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	Solver.SetCellSize(HashCellSize);
+}
+
+bool UOBServerVisibilitySubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UOBServerVisibilitySubsystem::RegisterVisionSource(AActor* Source, const int32 TeamId, const FOBVisionRules& Rules)
+{
+	if (!IsValid(Source) || FindOrAddTeamIndex(TeamId) == INDEX_NONE)
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	if (const int32* ExistingIndex = SourceIndices.Find(Source))
+	{
+		Sources[*ExistingIndex].Rules = Rules;
+		Sources[*ExistingIndex].TeamId = TeamId;
+	}
+	else
+	{
+		SourceIndices.Add(Source, Sources.Num());
+		Sources.Add({Source, Source, Rules, TeamId});
+	}
+
+	RegisterVisibilityTarget(Source, TeamId);
+}
+
+void UOBServerVisibilitySubsystem::UnregisterVisionSource(AActor* Source)
+{
+	int32 Index;
+	if (!SourceIndices.RemoveAndCopyValue(Source, Index))
+	{
+		return;
+	}
+
+	// Mục được hoán đổi vào chỗ trống có thể là actor đã bị hủy, nên chỉ mục dùng Key chứ không dùng Actor.Get()
+	Sources.RemoveAtSwap(Index);
+	if (Sources.IsValidIndex(Index))
+	{
+		SourceIndices.Add(Sources[Index].Key, Index);
+	}
+
+	UnregisterVisibilityTarget(Source);
+}
+
+void UOBServerVisibilitySubsystem::RegisterVisibilityTarget(AActor* Target, const int32 TeamId)
+{
+	if (!IsValid(Target))
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	if (TeamId != INDEX_NONE)
+	{
+		FindOrAddTeamIndex(TeamId);
+	}
+
+	if (const int32* ExistingIndex = TargetIndices.Find(Target))
+	{
+		Targets[*ExistingIndex].TeamId = TeamId;
+		return;
+	}
+
+	// Mục tiêu mới được xem là chưa ai nhìn thấy (trừ team sở hữu) cho tới lần cập nhật kế tiếp
+	FRegisteredTarget& NewTarget = Targets.AddDefaulted_GetRef();
+	NewTarget.Actor = Target;
+	NewTarget.Key = Target;
+	NewTarget.TeamId = TeamId;
+	if (const int32* TeamIndex = TeamIndices.Find(TeamId))
+	{
+		NewTarget.VisibleTeamMask = uint64(1) << *TeamIndex;
+	}
+	TargetIndices.Add(Target, Targets.Num() - 1);
+}
+
+void UOBServerVisibilitySubsystem::UnregisterVisibilityTarget(AActor* Target)
+{
+	int32 Index;
+	if (!TargetIndices.RemoveAndCopyValue(Target, Index))
+	{
+		return;
+	}
+
+	Targets.RemoveAtSwap(Index);
+	if (Targets.IsValidIndex(Index))
+	{
+		TargetIndices.Add(Targets[Index].Key, Index);
+	}
+}
+
+void UOBServerVisibilitySubsystem::SetViewerTeam(const AActor* Viewer, const int32 TeamId)
+{
+	if (!Viewer)
+	{
+		return;
+	}
+
+	if (TeamId == INDEX_NONE)
+	{
+		ViewerTeams.Remove(Viewer);
+		return;
+	}
+
+	FindOrAddTeamIndex(TeamId);
+	ViewerTeams.Add(Viewer, TeamId);
+}
+
+bool UOBServerVisibilitySubsystem::IsActorVisibleToTeam(const AActor* Target, const int32 TeamId) const
+{
+	const int32* TargetIndex = TargetIndices.Find(Target);
+	if (!TargetIndex)
+	{
+		return true;
+	}
+
+	const int32* TeamIndex = TeamIndices.Find(TeamId);
+	return TeamIndex && (Targets[*TargetIndex].VisibleTeamMask >> *TeamIndex) & 1;
+}
+
+bool UOBServerVisibilitySubsystem::ResolveViewerTeam(const AActor* RealViewer, const AActor* ViewTarget,
+                                                     int32& OutTeamId) const
+{
+	const APawn* ControlledPawn = nullptr;
+	if (const AController* Controller = Cast<AController>(RealViewer))
+	{
+		ControlledPawn = Controller->GetPawn();
+	}
+
+	for (const AActor* Candidate : {RealViewer, ViewTarget, static_cast<const AActor*>(ControlledPawn)})
+	{
+		if (!Candidate)
+		{
+			continue;
+		}
+		if (const int32* ViewerTeam = ViewerTeams.Find(Candidate))
+		{
+			OutTeamId = *ViewerTeam;
+			return true;
+		}
+		if (const int32* SourceIndex = SourceIndices.Find(Candidate))
+		{
+			OutTeamId = Sources[*SourceIndex].TeamId;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UOBServerVisibilitySubsystem::IsNetRelevantForViewer(const AActor* Target, const AActor* RealViewer,
+                                                          const AActor* ViewTarget) const
+{
+	int32 ViewerTeamId;
+	if (!ResolveViewerTeam(RealViewer, ViewTarget, ViewerTeamId))
+	{
+		return true;
+	}
+	return IsActorVisibleToTeam(Target, ViewerTeamId);
+}
+
+bool UOBServerVisibilitySubsystem::IsFogNetRelevantFor(const AActor* Target, const AActor* RealViewer,
+                                                       const AActor* ViewTarget)
+{
+	const UWorld* World = Target ? Target->GetWorld() : nullptr;
+	const UOBServerVisibilitySubsystem* Subsystem = World ? World->GetSubsystem<UOBServerVisibilitySubsystem>() : nullptr;
+	return !Subsystem || Subsystem->IsNetRelevantForViewer(Target, RealViewer, ViewTarget);
+}
+
+void UOBServerVisibilitySubsystem::GetActorsVisibleToTeam(const int32 TeamId, TArray<AActor*>& OutActors) const
+{
+	OutActors.Reset();
+	const int32* TeamIndex = TeamIndices.Find(TeamId);
+	if (!TeamIndex)
+	{
+		return;
+	}
+
+	for (const FRegisteredTarget& Target : Targets)
+	{
+		if ((Target.VisibleTeamMask >> *TeamIndex) & 1)
+		{
+			if (AActor* Actor = Target.Actor.Get())
+			{
+				OutActors.Add(Actor);
+			}
+		}
+	}
+}
+
+int32 UOBServerVisibilitySubsystem::FindOrAddTeamIndex(const int32 TeamId)
+{
+	if (const int32* TeamIndex = TeamIndices.Find(TeamId))
+	{
+		return *TeamIndex;
+	}
+
+	if (TeamIndices.Num() >= FOBServerVisibilitySolver::MaxTeams)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UOBServerVisibilitySubsystem: Vượt quá %d team, team %d sẽ bị bỏ qua."),
+		       FOBServerVisibilitySolver::MaxTeams, TeamId);
+		return INDEX_NONE;
+	}
+
+	return TeamIndices.Add(TeamId, TeamIndices.Num());
+}
+
+void UOBServerVisibilitySubsystem::UpdateVisibility()
+{
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	// --- BƯỚC 1: TẬP HỢP NGUỒN VÀ MỤC TIÊU, LOẠI BỎ ACTOR ĐÃ BỊ HỦY ---
+	if (Sources.RemoveAllSwap([](const FRegisteredSource& Source) { return !Source.Actor.IsValid(); }) > 0)
+	{
+		SourceIndices.Reset();
+		for (int32 Index = 0; Index < Sources.Num(); ++Index)
+		{
+			SourceIndices.Add(Sources[Index].Key, Index);
+		}
+	}
+
+	if (Targets.RemoveAllSwap([](const FRegisteredTarget& Target) { return !Target.Actor.IsValid(); }) > 0)
+	{
+		TargetIndices.Reset();
+		for (int32 Index = 0; Index < Targets.Num(); ++Index)
+		{
+			TargetIndices.Add(Targets[Index].Key, Index);
+		}
+	}
+
+	SolverSources.Reset();
+	for (const FRegisteredSource& Source : Sources)
+	{
+		const AActor* Actor = Source.Actor.Get();
+		FOBServerVisibilitySolver::FSource& SolverSource = SolverSources.AddDefaulted_GetRef();
+
+		// Giống với UOBVisibilityFogComponent::UpdateData: hướng nhìn theo actor, vùng bán kính đặt ở vị trí actor
+		FRotator EyeRotation;
+		Actor->GetActorEyesViewPoint(SolverSource.Vision.EyeLocation, EyeRotation);
+		SolverSource.Vision.ForwardVector = Actor->GetActorForwardVector();
+		SolverSource.Vision.GroundLocation = Actor->GetActorLocation();
+		SolverSource.Rules = Source.Rules;
+		SolverSource.TeamIndex = TeamIndices.FindChecked(Source.TeamId);
+	}
+
+	SolverTargets.Reset();
+	for (const FRegisteredTarget& Target : Targets)
+	{
+		FOBServerVisibilitySolver::FTarget& SolverTarget = SolverTargets.AddDefaulted_GetRef();
+		SolverTarget.Location = Target.Actor->GetActorLocation();
+		const int32* TeamIndex = TeamIndices.Find(Target.TeamId);
+		SolverTarget.TeamIndex = TeamIndex ? *TeamIndex : INDEX_NONE;
+	}
+
+	// --- BƯỚC 2: TÍNH TẬP TẦM NHÌN ---
+	Solver.SetCellSize(HashCellSize);
+	Solver.Solve(SolverSources, SolverTargets, SolverMasks);
+	INC_DWORD_STAT_BY(STAT_OBFogServerVisibilityTests, Solver.GetLastNumTests());
+
+	// --- BƯỚC 3: ÁP DỤNG KẾT QUẢ, BÁO NETDRIVER VỀ CÁC MỤC TIÊU ĐÃ THAY ĐỔI ---
+	for (int32 Index = 0; Index < Targets.Num(); ++Index)
+	{
+		FRegisteredTarget& Target = Targets[Index];
+		if (Target.VisibleTeamMask != SolverMasks[Index])
+		{
+			Target.VisibleTeamMask = SolverMasks[Index];
+			if (bForceNetUpdateOnChange)
+			{
+				Target.Actor->ForceNetUpdate();
+			}
+		}
+	}
+}
+
+void UOBServerVisibilitySubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Client không có thẩm quyền về tầm nhìn
+	const UWorld* World = GetWorld();
+	if (!World || World->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	// Tần số cố định, không bù các lượt bị lỡ để chi phí mỗi frame luôn bị chặn
+	TimeSinceLastUpdate += DeltaTime;
+	if (UpdateRateHz > 0.0f && TimeSinceLastUpdate < 1.0f / UpdateRateHz)
+	{
+		return;
+	}
+	TimeSinceLastUpdate = UpdateRateHz > 0.0f ? FMath::Fmod(TimeSinceLastUpdate, 1.0f / UpdateRateHz) : 0.0f;
+
+	UpdateVisibility();
+}
+
+TStatId UOBServerVisibilitySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UOBServerVisibilitySubsystem, STATGROUP_Tickables);
+}
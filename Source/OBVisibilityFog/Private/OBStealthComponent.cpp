@@ -0,0 +1,32 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBStealthComponent.h"
+
+#include "OBVisibilityFogSubsystem.h"
+
+bool UOBStealthComponent::IsRevealedToTeam(const int32 InTeamId) const
+{
+	const UOBVisibilityFogSubsystem* FogSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>() : nullptr;
+	return FogSubsystem && FogSubsystem->IsStealthComponentRevealedToTeam(this, InTeamId);
+}
+
+void UOBStealthComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->RegisterStealthComponent(this);
+	}
+}
+
+void UOBStealthComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->UnregisterStealthComponent(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
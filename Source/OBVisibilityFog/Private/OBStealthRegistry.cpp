@@ -0,0 +1,161 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBStealthRegistry.h"
+
+namespace OBStealthRegistryPrivate
+{
+	// Vị trí của các làn đệm: đủ xa để không nằm trong tầm nhìn nào, đủ nhỏ để bình phương không tràn float.
+	constexpr float PaddingCoordinate = 1.0e18f;
+
+	// Dữ liệu của một nguồn đã được nhân bản ra 4 làn, tính một lần trước vòng lặp chính.
+	struct FSourceLanes
+	{
+		VectorRegister4Float EyeX, EyeY, EyeZ;
+		VectorRegister4Float ForwardX, ForwardY, ForwardZ;
+		VectorRegister4Float GroundX, GroundY, GroundZ;
+	};
+
+	VectorRegister4Float Splat(const FVector::FReal Value)
+	{
+		return VectorSetFloat1(static_cast<float>(Value));
+	}
+}
+
+int32 FOBStealthRegistry::Add(const FVector& Location)
+{
+	using namespace OBStealthRegistryPrivate;
+
+	const int32 Index = NumEntries++;
+	const int32 PaddedNum = Align(NumEntries, 4);
+	while (X.Num() < PaddedNum)
+	{
+		X.Add(PaddingCoordinate);
+		Y.Add(PaddingCoordinate);
+		Z.Add(PaddingCoordinate);
+	}
+
+	SetLocation(Index, Location);
+	return Index;
+}
+
+void FOBStealthRegistry::RemoveAtSwap(const int32 Index)
+{
+	using namespace OBStealthRegistryPrivate;
+
+	check(Index >= 0 && Index < NumEntries);
+	const int32 LastIndex = --NumEntries;
+	X[Index] = X[LastIndex];
+	Y[Index] = Y[LastIndex];
+	Z[Index] = Z[LastIndex];
+	X[LastIndex] = Y[LastIndex] = Z[LastIndex] = PaddingCoordinate;
+
+	const int32 PaddedNum = Align(NumEntries, 4);
+	if (X.Num() > PaddedNum)
+	{
+		const int32 NumToRemove = X.Num() - PaddedNum;
+		X.RemoveAt(PaddedNum, NumToRemove);
+		Y.RemoveAt(PaddedNum, NumToRemove);
+		Z.RemoveAt(PaddedNum, NumToRemove);
+	}
+}
+
+void FOBStealthRegistry::Evaluate(const TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+                                  TArray<uint8>& OutRevealed) const
+{
+	using namespace OBStealthRegistryPrivate;
+
+	const int32 NumPadded = X.Num();
+	OutRevealed.Reset();
+	OutRevealed.AddZeroed(NumEntries);
+	if (NumEntries == 0)
+	{
+		return;
+	}
+
+	const VectorRegister4Float ConeCos = VectorSetFloat1(Rules.GetVisionConeCos());
+	const VectorRegister4Float VisionDistanceSquared = VectorSetFloat1(FMath::Square(Rules.VisionDistance));
+	const VectorRegister4Float ProximityRadiusSquared = VectorSetFloat1(FMath::Square(Rules.ProximityRadius));
+	const VectorRegister4Float ProximityMaxHeight = VectorSetFloat1(Rules.ProximityMaxHeight);
+
+	TArray<FSourceLanes, TInlineAllocator<64>> SourceLanes;
+	SourceLanes.SetNumUninitialized(Sources.Num());
+	for (int32 Index = 0; Index < Sources.Num(); ++Index)
+	{
+		const FTeammateVisionData& Source = Sources[Index];
+		SourceLanes[Index] = {
+			Splat(Source.EyeLocation.X), Splat(Source.EyeLocation.Y), Splat(Source.EyeLocation.Z),
+			Splat(Source.ForwardVector.X), Splat(Source.ForwardVector.Y), Splat(Source.ForwardVector.Z),
+			Splat(Source.GroundLocation.X), Splat(Source.GroundLocation.Y), Splat(Source.GroundLocation.Z)
+		};
+	}
+
+	const float* RESTRICT XData = X.GetData();
+	const float* RESTRICT YData = Y.GetData();
+	const float* RESTRICT ZData = Z.GetData();
+	uint8* RESTRICT Revealed = OutRevealed.GetData();
+
+	// Vòng ngoài theo nhóm 4 vật thể để kết quả của một nhóm nằm trong thanh ghi qua mọi nguồn
+	for (int32 Base = 0; Base < NumPadded; Base += 4)
+	{
+		const VectorRegister4Float PosX = VectorLoadAligned(XData + Base);
+		const VectorRegister4Float PosY = VectorLoadAligned(YData + Base);
+		const VectorRegister4Float PosZ = VectorLoadAligned(ZData + Base);
+		VectorRegister4Float Visible = VectorZeroFloat();
+
+		for (const FSourceLanes& Source : SourceLanes)
+		{
+			// Hình nón: khoảng cách tới mắt <= VisionDistance và dot(Forward, ToTarget) >= cos * |ToTarget|
+			const VectorRegister4Float ToX = VectorSubtract(PosX, Source.EyeX);
+			const VectorRegister4Float ToY = VectorSubtract(PosY, Source.EyeY);
+			const VectorRegister4Float ToZ = VectorSubtract(PosZ, Source.EyeZ);
+			const VectorRegister4Float DistanceSquared = VectorMultiplyAdd(
+				ToX, ToX, VectorMultiplyAdd(ToY, ToY, VectorMultiply(ToZ, ToZ)));
+			const VectorRegister4Float Dot = VectorMultiplyAdd(
+				ToX, Source.ForwardX, VectorMultiplyAdd(ToY, Source.ForwardY, VectorMultiply(ToZ, Source.ForwardZ)));
+			const VectorRegister4Float InCone = VectorBitwiseAnd(
+				VectorCompareLE(DistanceSquared, VisionDistanceSquared),
+				VectorCompareGE(Dot, VectorMultiply(ConeCos, VectorSqrt(DistanceSquared))));
+
+			// Hình trụ bán kính xung quanh đặt ở mặt đất
+			const VectorRegister4Float GroundX = VectorSubtract(PosX, Source.GroundX);
+			const VectorRegister4Float GroundY = VectorSubtract(PosY, Source.GroundY);
+			const VectorRegister4Float GroundZ = VectorSubtract(PosZ, Source.GroundZ);
+			const VectorRegister4Float InProximity = VectorBitwiseAnd(
+				VectorCompareLE(VectorMultiplyAdd(GroundX, GroundX, VectorMultiply(GroundY, GroundY)),
+				                ProximityRadiusSquared),
+				VectorCompareLE(VectorAbs(GroundZ), ProximityMaxHeight));
+
+			Visible = VectorBitwiseOr(Visible, VectorBitwiseOr(InCone, InProximity));
+		}
+
+		// Nhóm cuối có thể chứa làn đệm, không ghi ra ngoài NumEntries
+		const int32 Mask = VectorMaskBits(Visible);
+		const int32 NumLanes = FMath::Min(4, NumEntries - Base);
+		for (int32 Lane = 0; Lane < NumLanes; ++Lane)
+		{
+			Revealed[Base + Lane] = (Mask >> Lane) & 1;
+		}
+	}
+}
+
+void FOBStealthRegistry::EvaluateScalar(const TConstArrayView<FTeammateVisionData> Sources,
+                                        const FOBVisionRules& Rules, TArray<uint8>& OutRevealed) const
+{
+	OutRevealed.Reset();
+	OutRevealed.AddZeroed(NumEntries);
+
+	const float VisionConeCos = Rules.GetVisionConeCos();
+	for (int32 Index = 0; Index < NumEntries; ++Index)
+	{
+		const FVector Location = GetLocation(Index);
+		for (const FTeammateVisionData& Source : Sources)
+		{
+			if (Rules.IsLocationVisible(Source, Location, VisionConeCos))
+			{
+				OutRevealed[Index] = 1;
+				break;
+			}
+		}
+	}
+}
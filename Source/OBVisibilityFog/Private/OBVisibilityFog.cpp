@@ -2,11 +2,18 @@
 
 #include "OBVisibilityFog.h"
 
+#include "OBVisibilityFogStats.h"
+
 #define LOCTEXT_NAMESPACE "FOBVisibilityFogModule"
 
+LLM_DEFINE_TAG(OBVisibilityFog);
+DEFINE_STAT(STAT_OBFogBytesUploaded);
+CSV_DEFINE_CATEGORY(OBVisibilityFog, true);
+
 void FOBVisibilityFogModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	// Thư mục Shaders của plugin được ánh xạ bởi module OBVisibilityFogShaders (PostConfigInit)
 }
 
 void FOBVisibilityFogModule::ShutdownModule()
@@ -0,0 +1,563 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+// Các lệnh console đo hiệu năng của plugin. Chạy được headless, ví dụ:
+//   UnrealEditor-Cmd <Project> -game -nullrhi -ExecCmds="OBFog.Bench.SourcePacking 2000, Quit"
+// OBFog.Bench.UpdateData cần một map có UOBVisibilityFogComponent đã BeginPlay, ví dụ:
+//   UnrealEditor-Cmd <Project> <Map> -game -nullrhi -ExecCmds="OBFog.Bench.UpdateData 1000 8 200, Quit"
+
+#include "CoreMinimal.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/OverlapResult.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "OBServerVisibilitySolver.h"
+#include "OBStealthRegistry.h"
+#include "OBVisibilityFogComponent.h"
+#include "OBVisibilityReplay.h"
+#include "OBVisionSourceBuffer.h"
+#include "OBVisionSpatialIndex.h"
+#include "UObject/UObjectIterator.h"
+
+namespace OBVisibilityFogBenchmark
+{
+	// Tạo danh sách nguồn tầm nhìn ngẫu nhiên nhưng lặp lại được.
+	void MakeRandomSources(FRandomStream& Random, const int32 NumSources, TArray<FTeammateVisionData>& OutSources)
+	{
+		OutSources.SetNum(NumSources);
+		for (FTeammateVisionData& Source : OutSources)
+		{
+			Source.GroundLocation = FVector(Random.FRandRange(-50000.0f, 50000.0f),
+			                                Random.FRandRange(-50000.0f, 50000.0f), Random.FRandRange(-1000.0f, 1000.0f));
+			Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, Random.FRandRange(50.0f, 200.0f));
+			Source.ForwardVector = Random.GetUnitVector();
+		}
+	}
+
+	// OBFog.Bench.SourcePacking [Iterations]: đo thời gian đóng gói và số byte upload từ 8 tới 256 nguồn.
+	void RunSourcePacking(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+		FRandomStream Random(1337);
+		TArray<FTeammateVisionData> Sources;
+		TArray<FLinearColor> PackedData;
+
+		for (const EOBVisionSourceLayout Layout : {EOBVisionSourceLayout::Legacy, EOBVisionSourceLayout::Packed})
+		{
+			for (int32 NumSources = 8; NumSources <= 256; NumSources *= 2)
+			{
+				MakeRandomSources(Random, NumSources, Sources);
+				const FVector Origin = FOBVisionSourceBuffer::ComputePackOrigin(Sources);
+
+				const double StartTime = FPlatformTime::Seconds();
+				for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+				{
+					FOBVisionSourceBuffer::Pack(Layout, Sources, NumSources, Origin, PackedData);
+				}
+				const double PackMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+				UE_LOG(LogTemp, Display, TEXT("OBFog.Bench.SourcePacking: Layout=%s Sources=%d UploadBytes=%d PackTimeUs=%.3f"),
+				       *StaticEnum<EOBVisionSourceLayout>()->GetNameStringByValue(static_cast<int64>(Layout)),
+				       NumSources, PackedData.Num() * static_cast<int32>(sizeof(FLinearColor)), PackMicroseconds);
+			}
+		}
+	}
+
+	FAutoConsoleCommand SourcePackingCommand(
+		TEXT("OBFog.Bench.SourcePacking"),
+		TEXT("Đo thời gian đóng gói và số byte upload của dữ liệu nguồn tầm nhìn (8 - 256 nguồn). Tham số: [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunSourcePacking));
+
+	// OBFog.Bench.ServerVisibility [Players] [Teams] [Iterations]: đo một lượt tính tầm nhìn trên server,
+	// mỗi người chơi vừa là nguồn vừa là mục tiêu, so sánh số phép kiểm tra với cách duyệt mọi cặp.
+	void RunServerVisibility(const TArray<FString>& Args)
+	{
+		const int32 NumPlayers = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100;
+		const int32 NumTeams = Args.Num() > 1
+			                       ? FMath::Clamp(FCString::Atoi(*Args[1]), 1, FOBServerVisibilitySolver::MaxTeams)
+			                       : 2;
+		const int32 Iterations = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 100;
+
+		FRandomStream Random(1337);
+		TArray<FTeammateVisionData> Players;
+		MakeRandomSources(Random, NumPlayers, Players);
+
+		TArray<FOBServerVisibilitySolver::FSource> Sources;
+		TArray<FOBServerVisibilitySolver::FTarget> Targets;
+		for (int32 Index = 0; Index < NumPlayers; ++Index)
+		{
+			FOBServerVisibilitySolver::FSource& Source = Sources.AddDefaulted_GetRef();
+			Source.Vision = Players[Index];
+			Source.TeamIndex = Index % NumTeams;
+			Targets.Add({Players[Index].GroundLocation, Source.TeamIndex});
+		}
+
+		FOBServerVisibilitySolver Solver;
+		TArray<uint64> Masks;
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Solver.Solve(Sources, Targets, Masks);
+		}
+		const double SolveMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+		int32 NumVisiblePairs = 0;
+		for (const uint64 Mask : Masks)
+		{
+			NumVisiblePairs += FMath::CountBits(Mask);
+		}
+
+		UE_LOG(LogTemp, Display,
+		       TEXT("OBFog.Bench.ServerVisibility: Players=%d Teams=%d Tests=%d BruteForceTests=%d VisibleTeamPairs=%d SolveTimeUs=%.3f"),
+		       NumPlayers, NumTeams, Solver.GetLastNumTests(), NumPlayers * NumPlayers, NumVisiblePairs,
+		       SolveMicroseconds);
+	}
+
+	FAutoConsoleCommand ServerVisibilityCommand(
+		TEXT("OBFog.Bench.ServerVisibility"),
+		TEXT("Đo thời gian tính tầm nhìn có thẩm quyền trên server. Tham số: [Players] [Teams] [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunServerVisibility));
+
+	// OBFog.Bench.Stealth [Actors] [Sources] [Iterations]: đo đánh giá theo lô của registry tàng hình (SoA, 4 làn)
+	// so với kiểm tra vô hướng từng cặp bằng FOBVisionRules::IsLocationVisible.
+	void RunStealth(const TArray<FString>& Args)
+	{
+		const int32 NumActors = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10000;
+		const int32 NumSources = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 64;
+		const int32 Iterations = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 100;
+
+		FRandomStream Random(1337);
+		TArray<FTeammateVisionData> Sources;
+		TArray<FTeammateVisionData> Actors;
+		MakeRandomSources(Random, NumSources, Sources);
+		MakeRandomSources(Random, NumActors, Actors);
+
+		FOBStealthRegistry Registry;
+		for (const FTeammateVisionData& Actor : Actors)
+		{
+			Registry.Add(Actor.GroundLocation);
+		}
+
+		// Vùng ngẫu nhiên rất rộng, nên dùng tầm nhìn lớn để có một tỉ lệ vật thể bị phát hiện đáng kể
+		FOBVisionRules Rules;
+		Rules.VisionDistance = 10000.0f;
+		Rules.ProximityRadius = 2000.0f;
+
+		TArray<uint8> Revealed;
+		TArray<uint8> RevealedScalar;
+
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Registry.Evaluate(Sources, Rules, Revealed);
+		}
+		const double BatchMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Registry.EvaluateScalar(Sources, Rules, RevealedScalar);
+		}
+		const double ScalarMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+		int32 NumRevealed = 0;
+		for (const uint8 bRevealed : Revealed)
+		{
+			NumRevealed += bRevealed;
+		}
+
+		UE_LOG(LogTemp, Display,
+		       TEXT("OBFog.Bench.Stealth: Actors=%d Sources=%d Revealed=%d BatchTimeUs=%.3f ScalarTimeUs=%.3f"),
+		       NumActors, NumSources, NumRevealed, BatchMicroseconds, ScalarMicroseconds);
+	}
+
+	FAutoConsoleCommand StealthCommand(
+		TEXT("OBFog.Bench.Stealth"),
+		TEXT("Đo đánh giá theo lô của registry tàng hình (mặc định 10k vật thể x 64 nguồn). Tham số: [Actors] [Sources] [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunStealth));
+
+	// Một dòng kết quả của OBFog.Bench.UpdateData.
+	struct FStageResult
+	{
+		const TCHAR* Name;
+		double AverageMicroseconds;
+	};
+
+	// Ghi kết quả ra Saved/Profiling/OBVisibilityFog dưới dạng CSV và JSON để so sánh giữa các build.
+	void WriteUpdateDataResults(const int32 NumActors, const int32 NumSources, const int32 Iterations,
+	                            TConstArrayView<FStageResult> Stages)
+	{
+		const FString Timestamp = FDateTime::UtcNow().ToString(TEXT("%Y%m%d-%H%M%S"));
+		const FString BasePath = FPaths::ProfilingDir() / TEXT("OBVisibilityFog") / (TEXT("UpdateData-") + Timestamp);
+
+		FString Csv = TEXT("Timestamp,Actors,Sources,Iterations,Stage,AverageUs\n");
+		FString JsonStages;
+		for (const FStageResult& Stage : Stages)
+		{
+			Csv += FString::Printf(TEXT("%s,%d,%d,%d,%s,%.3f\n"), *Timestamp, NumActors, NumSources, Iterations,
+			                       Stage.Name, Stage.AverageMicroseconds);
+			JsonStages += FString::Printf(TEXT("%s\"%s\":%.3f"), JsonStages.IsEmpty() ? TEXT("") : TEXT(","),
+			                              Stage.Name, Stage.AverageMicroseconds);
+		}
+		const FString Json = FString::Printf(
+			TEXT("{\"timestamp\":\"%s\",\"actors\":%d,\"sources\":%d,\"iterations\":%d,\"stagesUs\":{%s}}\n"),
+			*Timestamp, NumActors, NumSources, Iterations, *JsonStages);
+
+		FFileHelper::SaveStringToFile(Csv, *(BasePath + TEXT(".csv")));
+		FFileHelper::SaveStringToFile(Json, *(BasePath + TEXT(".json")));
+		UE_LOG(LogTemp, Display, TEXT("OBFog.Bench.UpdateData: Đã ghi kết quả vào %s.{csv,json}"), *BasePath);
+	}
+
+	// OBFog.Bench.UpdateData [Actors] [Sources] [Iterations]: tạo N actor tĩnh lặp lại được quanh component
+	// đầu tiên trong World, gọi UpdateData với M nguồn và đo từng giai đoạn. Tính đúng đắn được kiểm tra
+	// trong các automation test OBVisibilityFog.Component.*, lệnh này chỉ đo hiệu năng.
+	void RunUpdateData(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumActors = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 0) : 1000;
+		const int32 NumSources = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 8;
+		const int32 Iterations = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 200;
+
+		UOBVisibilityFogComponent* Component = nullptr;
+		for (TObjectIterator<UOBVisibilityFogComponent> It; It; ++It)
+		{
+			if (It->GetWorld() == World && It->HasBegunPlay() && It->GetOwner())
+			{
+				Component = *It;
+				break;
+			}
+		}
+		if (!World || !Component || !Component->DepthCaptureComponent || !Component->DepthRenderTarget)
+		{
+			UE_LOG(LogTemp, Error, TEXT("OBFog.Bench.UpdateData: Không tìm thấy UOBVisibilityFogComponent đã khởi tạo trong World."));
+			return;
+		}
+
+		// --- DỰNG CẢNH LẶP LẠI ĐƯỢC ---
+		FRandomStream Random(1337);
+		const FVector Center = Component->GetOwner()->GetActorLocation();
+		const float SceneRadius = Component->VisionDistance * 1.5f;
+		UStaticMesh* CubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+		TArray<AStaticMeshActor*> SpawnedActors;
+		for (int32 Index = 0; Index < NumActors; ++Index)
+		{
+			const FVector Location = Center + FVector(Random.FRandRange(-SceneRadius, SceneRadius),
+			                                          Random.FRandRange(-SceneRadius, SceneRadius), 0.0f);
+			if (AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator))
+			{
+				Actor->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+				Actor->GetStaticMeshComponent()->SetStaticMesh(CubeMesh);
+				SpawnedActors.Add(Actor);
+			}
+		}
+
+		TArray<FTeammateVisionData> Teammates;
+		MakeRandomSources(Random, NumSources - 1, Teammates);
+		for (FTeammateVisionData& Teammate : Teammates)
+		{
+			// Đưa đồng đội về gần component để dữ liệu giống một trận đấu thật
+			const FVector Offset = Teammate.GroundLocation * (SceneRadius / 50000.0f);
+			Teammate.EyeLocation = Center + Offset + (Teammate.EyeLocation - Teammate.GroundLocation);
+			Teammate.GroundLocation = Center + Offset;
+		}
+
+		// --- ĐO ---
+		// Cache ứng viên bị vô hiệu mỗi lần để giai đoạn truy vấn vật lý luôn được đo
+		Component->UpdateData(Teammates);
+		Component->ResetStageTimings();
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Component->InvalidateCandidateCache();
+			Component->UpdateData(Teammates);
+		}
+		const uint64 TotalCycles = FPlatformTime::Cycles64() - StartCycles;
+
+		// Đóng gói texture chạy trong Tick của subsystem ở chế độ chia sẻ, nên được đo riêng
+		TArray<FTeammateVisionData> AllSources = Teammates;
+		FTeammateVisionData& Self = AllSources.InsertDefaulted_GetRef(0);
+		Self.EyeLocation = Component->DepthCaptureComponent->GetComponentLocation();
+		Self.ForwardVector = Component->GetOwner()->GetActorForwardVector();
+		Self.GroundLocation = Center;
+		TArray<FLinearColor> PackedData;
+		const uint64 PackStartCycles = FPlatformTime::Cycles64();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			FOBVisionSourceBuffer::Pack(Component->SourceDataLayout, AllSources, NumSources,
+			                            FOBVisionSourceBuffer::ComputePackOrigin(AllSources), PackedData);
+		}
+		const uint64 PackCycles = FPlatformTime::Cycles64() - PackStartCycles;
+
+		const FOBUpdateDataStageTimings& Timings = Component->GetStageTimings();
+		const double ToMicroseconds = 1.0e6 / FMath::Max(Timings.NumUpdates, 1);
+		const FStageResult Stages[] = {
+			{TEXT("SourceSubmit"), FPlatformTime::ToSeconds64(Timings.SourceSubmitCycles) * ToMicroseconds},
+			{TEXT("OverlapQuery"), FPlatformTime::ToSeconds64(Timings.OverlapQueryCycles) * ToMicroseconds},
+			{TEXT("ConeFilter"), FPlatformTime::ToSeconds64(Timings.ConeFilterCycles) * ToMicroseconds},
+			{TEXT("CaptureSubmit"), FPlatformTime::ToSeconds64(Timings.CaptureSubmitCycles) * ToMicroseconds},
+			{TEXT("MPCWrites"), FPlatformTime::ToSeconds64(Timings.MPCWriteCycles) * ToMicroseconds},
+			{TEXT("TexturePacking"), FPlatformTime::ToSeconds64(PackCycles) * 1.0e6 / Iterations},
+			{TEXT("UpdateDataTotal"), FPlatformTime::ToSeconds64(TotalCycles) * 1.0e6 / Iterations},
+		};
+		for (const FStageResult& Stage : Stages)
+		{
+			UE_LOG(LogTemp, Display, TEXT("OBFog.Bench.UpdateData: Actors=%d Sources=%d %s=%.3fus"), NumActors,
+			       NumSources, Stage.Name, Stage.AverageMicroseconds);
+		}
+
+		WriteUpdateDataResults(NumActors, NumSources, Iterations, Stages);
+
+		for (AStaticMeshActor* Actor : SpawnedActors)
+		{
+			Actor->Destroy();
+		}
+		Component->InvalidateCandidateCache();
+	}
+
+	FAutoConsoleCommand UpdateDataCommand(
+		TEXT("OBFog.Bench.UpdateData"),
+		TEXT("Đo từng giai đoạn của UpdateData trên component đầu tiên trong World với N actor tĩnh và M nguồn, ghi CSV/JSON vào Saved/Profiling. Tham số: [Actors] [Sources] [Iterations]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunUpdateData));
+
+	// Đo một cấu hình của OBFog.Bench.SpatialIndex: N actor với mật độ cố định (một actor mỗi 4 m x 4 m).
+	void RunSpatialIndexCase(UWorld* World, UStaticMesh* CubeMesh, const int32 NumActors, const int32 NumQueries)
+	{
+		FRandomStream Random(1337);
+		const float SceneHalfExtent = 200.0f * FMath::Sqrt(static_cast<float>(NumActors));
+		TArray<AStaticMeshActor*> SpawnedActors;
+		for (int32 Index = 0; Index < NumActors; ++Index)
+		{
+			const FVector Location(Random.FRandRange(-SceneHalfExtent, SceneHalfExtent),
+			                       Random.FRandRange(-SceneHalfExtent, SceneHalfExtent), 0.0f);
+			if (AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator))
+			{
+				Actor->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+				Actor->GetStaticMeshComponent()->SetStaticMesh(CubeMesh);
+				SpawnedActors.Add(Actor);
+			}
+		}
+
+		// Chỉ mục riêng của benchmark, để không lẫn với các actor đã đăng ký vào subsystem
+		FOBVisionSpatialIndex VisionIndex;
+		TArray<int32> EntryIndices;
+		double StartTime = FPlatformTime::Seconds();
+		for (AStaticMeshActor* Actor : SpawnedActors)
+		{
+			EntryIndices.Add(VisionIndex.Add(Actor, Actor->GetStaticMeshComponent()));
+		}
+		const double BuildMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6;
+
+		// Di chuyển 10% actor rồi đo lượt cập nhật bounds theo lô
+		for (int32 Index = 0; Index < SpawnedActors.Num(); Index += 10)
+		{
+			SpawnedActors[Index]->SetActorLocation(SpawnedActors[Index]->GetActorLocation() + FVector(300.0f, 0.0f, 0.0f));
+			VisionIndex.MarkDirty(EntryIndices[Index]);
+		}
+		StartTime = FPlatformTime::Seconds();
+		VisionIndex.Flush();
+		const double FlushMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6;
+
+		// Cấu hình mặc định của UOBVisibilityFogComponent: 2000 cm, 90 độ
+		constexpr float VisionDistance = 2000.0f;
+		const float HalfAngle = FMath::DegreesToRadians(45.0f);
+
+		struct FQuery
+		{
+			FVector Eye;
+			FVector Forward;
+		};
+		TArray<FQuery> Queries;
+		for (int32 Index = 0; Index < NumQueries; ++Index)
+		{
+			const FVector Eye(Random.FRandRange(-SceneHalfExtent, SceneHalfExtent),
+			                  Random.FRandRange(-SceneHalfExtent, SceneHalfExtent), 170.0f);
+			Queries.Add({Eye, FRotator(0.0f, Random.FRandRange(0.0f, 360.0f), 0.0f).Vector()});
+		}
+
+		TArray<FOverlapResult> OverlapResults;
+		const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(FogOfWarTrace), false);
+		int64 NumPhysicsCandidates = 0;
+		StartTime = FPlatformTime::Seconds();
+		for (const FQuery& Query : Queries)
+		{
+			OverlapResults.Reset();
+			// Hình cầu VisionDistance quanh mắt, giống RefreshCandidateCache khi không có lề của cache
+			World->OverlapMultiByChannel(OverlapResults, Query.Eye, FQuat::Identity, ECC_WorldStatic,
+			                             FCollisionShape::MakeSphere(VisionDistance), QueryParams);
+			NumPhysicsCandidates += OverlapResults.Num();
+		}
+		const double PhysicsMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumQueries;
+
+		TArray<int32> IndexResults;
+		int64 NumIndexCandidates = 0;
+		int64 NumNodeTests = 0;
+		int64 NumElementTests = 0;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < NumQueries; ++Index)
+		{
+			const FOBVisionCone Cone(Queries[Index].Eye, Queries[Index].Forward, HalfAngle, VisionDistance, 0.0f);
+			VisionIndex.QueryCone(Cone, IndexResults);
+			NumIndexCandidates += IndexResults.Num();
+			NumNodeTests += VisionIndex.GetLastNumNodeTests();
+			NumElementTests += VisionIndex.GetLastNumElementTests();
+		}
+		const double IndexMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumQueries;
+
+		UE_LOG(LogTemp, Display,
+		       TEXT("OBFog.Bench.SpatialIndex: Actors=%d Queries=%d PhysicsTimeUs=%.3f IndexTimeUs=%.3f PhysicsCandidates=%.1f IndexCandidates=%.1f NodeTests=%.1f ElementTests=%.1f BuildTimeUs=%.1f FlushTimeUs=%.1f"),
+		       SpawnedActors.Num(), NumQueries, PhysicsMicroseconds, IndexMicroseconds,
+		       static_cast<double>(NumPhysicsCandidates) / NumQueries, static_cast<double>(NumIndexCandidates) / NumQueries,
+		       static_cast<double>(NumNodeTests) / NumQueries, static_cast<double>(NumElementTests) / NumQueries,
+		       BuildMicroseconds, FlushMicroseconds);
+
+		for (AStaticMeshActor* Actor : SpawnedActors)
+		{
+			Actor->Destroy();
+		}
+	}
+
+	// OBFog.Bench.SpatialIndex [Actors] [Queries]: so sánh truy vấn hình nón trên loose octree với
+	// OverlapMultiByChannel (hình cầu VisionDistance quanh mắt) cho cùng tập actor; không có [Actors] thì chạy 1k, 10k và 50k.
+	void RunSpatialIndex(const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World)
+		{
+			UE_LOG(LogTemp, Error, TEXT("OBFog.Bench.SpatialIndex: Không có World."));
+			return;
+		}
+
+		const int32 NumQueries = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 200;
+		UStaticMesh* CubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+		if (Args.Num() > 0)
+		{
+			RunSpatialIndexCase(World, CubeMesh, FMath::Max(FCString::Atoi(*Args[0]), 1), NumQueries);
+			return;
+		}
+		for (const int32 NumActors : {1000, 10000, 50000})
+		{
+			RunSpatialIndexCase(World, CubeMesh, NumActors, NumQueries);
+		}
+	}
+
+	FAutoConsoleCommand SpatialIndexCommand(
+		TEXT("OBFog.Bench.SpatialIndex"),
+		TEXT("So sánh truy vấn hình nón của chỉ mục không gian với OverlapMultiByChannel (mặc định 1k, 10k, 50k actor). Tham số: [Actors] [Queries]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunSpatialIndex));
+
+	// OBFog.Bench.Replay [Minutes] [Sources] [UpdateRate]: mô phỏng các nguồn đi lại và xoay ngẫu nhiên giữa 2000 vật thể,
+	// ghi replay với ngân sách mặc định của component, rồi đo tốc độ đọc, tua và đánh giá lại.
+	void RunReplay(const TArray<FString>& Args)
+	{
+		const float Minutes = Args.Num() > 0 ? FMath::Max(FCString::Atof(*Args[0]), 0.1f) : 5.0f;
+		const int32 NumSources = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 5;
+		const float UpdateRate = Args.Num() > 2 ? FMath::Max(FCString::Atof(*Args[2]), 1.0f) : 30.0f;
+		const int32 NumFrames = FMath::CeilToInt(Minutes * 60.0f * UpdateRate);
+		constexpr float ArenaHalfExtent = 10000.0f;
+
+		FRandomStream Random(1337);
+		FOBStealthRegistry Targets;
+		for (int32 Index = 0; Index < 2000; ++Index)
+		{
+			Targets.Add(FVector(Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent),
+			                    Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent), 0.0f));
+		}
+
+		TArray<FTeammateVisionData> Sources;
+		TArray<float> Headings;
+		for (int32 Index = 0; Index < NumSources; ++Index)
+		{
+			FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+			Source.GroundLocation = FVector(Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent),
+			                                Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent), 0.0f);
+			Headings.Add(Random.FRandRange(0.0f, 360.0f));
+		}
+
+		FOBVisionRules Rules;
+		FOBVisibilityReplayWriter Writer;
+		Writer.Reset(5.0f, 64 * 1024);
+
+		TArray<uint8> Revealed;
+		TArray<int32> ActorsInCone;
+		uint64 RecordCycles = 0;
+		const float DeltaTime = 1.0f / UpdateRate;
+		for (int32 FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+		{
+			// Đi bộ 400 cm/s và đổi hướng tối đa 90 độ/s, giữ trong đấu trường
+			for (int32 Index = 0; Index < NumSources; ++Index)
+			{
+				FTeammateVisionData& Source = Sources[Index];
+				Headings[Index] += Random.FRandRange(-90.0f, 90.0f) * DeltaTime;
+				Source.ForwardVector = FRotator(0.0f, Headings[Index], 0.0f).Vector();
+				Source.GroundLocation = (Source.GroundLocation + Source.ForwardVector * 400.0f * DeltaTime)
+					.BoundToCube(ArenaHalfExtent);
+				Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+			}
+
+			// ActorsInCone của nguồn đầu tiên, giống component của người chơi ghi replay
+			Targets.Evaluate(MakeArrayView(Sources.GetData(), 1), Rules, Revealed);
+			ActorsInCone.Reset();
+			for (int32 Index = 0; Index < Revealed.Num(); ++Index)
+			{
+				if (Revealed[Index])
+				{
+					ActorsInCone.Add(Index);
+				}
+			}
+
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			Writer.RecordFrame(FrameIndex * DeltaTime, Sources, Rules, ActorsInCone);
+			RecordCycles += FPlatformTime::Cycles64() - StartCycles;
+		}
+		Writer.FlushPendingGap();
+
+		FOBVisibilityReplayReader Reader;
+		const int32 StreamBytes = Writer.GetData().Num();
+		double StartTime = FPlatformTime::Seconds();
+		const bool bOpened = Reader.Open(Writer.GetData());
+		const double OpenMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1.0e6;
+
+		// Đọc tuần tự toàn bộ luồng
+		int32 NumDecoded = 0;
+		StartTime = FPlatformTime::Seconds();
+		while (bOpened && Reader.ReadNextFrame())
+		{
+			++NumDecoded;
+		}
+		const double DecodeSeconds = FPlatformTime::Seconds() - StartTime;
+
+		// Tua tới các thời điểm ngẫu nhiên rồi đánh giá lại mọi vật thể với nguồn của frame đó
+		constexpr int32 NumSeeks = 100;
+		double SeekSeconds = 0.0;
+		double EvaluateSeconds = 0.0;
+		for (int32 Index = 0; Index < NumSeeks && bOpened; ++Index)
+		{
+			const double SeekTime = Random.FRandRange(Reader.GetStartTime(), Reader.GetEndTime());
+			StartTime = FPlatformTime::Seconds();
+			Reader.SeekToTime(SeekTime);
+			SeekSeconds += FPlatformTime::Seconds() - StartTime;
+
+			StartTime = FPlatformTime::Seconds();
+			Reader.EvaluateLocations(Targets, Revealed);
+			EvaluateSeconds += FPlatformTime::Seconds() - StartTime;
+		}
+
+		UE_LOG(LogTemp, Display,
+		       TEXT("OBFog.Bench.Replay: Minutes=%.1f Sources=%d Frames=%d Written=%d Dropped=%d QuantizationLevel=%d KeyframeInterval=%.1f BytesPerMinute=%.0f RecordTimeUs=%.3f OpenTimeUs=%.1f DecodeFramesPerSecond=%.0f SeekTimeUs=%.3f EvaluateTimeUs=%.3f"),
+		       Minutes, NumSources, NumFrames, Writer.GetNumFramesWritten(), Writer.GetNumFramesDropped(),
+		       Writer.GetQuantizationLevel(), Writer.GetKeyframeInterval(),
+		       StreamBytes / Minutes, FPlatformTime::ToSeconds64(RecordCycles) * 1.0e6 / NumFrames, OpenMicroseconds,
+		       NumDecoded / FMath::Max(DecodeSeconds, UE_SMALL_NUMBER), SeekSeconds * 1.0e6 / NumSeeks,
+		       EvaluateSeconds * 1.0e6 / NumSeeks);
+	}
+
+	FAutoConsoleCommand ReplayCommand(
+		TEXT("OBFog.Bench.Replay"),
+		TEXT("Ghi và đọc lại một replay tầm nhìn mô phỏng (mặc định 5 phút, 5 nguồn, 30 lần/giây), báo byte mỗi phút và tốc độ đọc. Tham số: [Minutes] [Sources] [UpdateRate]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunReplay));
+}
@@ -2,18 +2,47 @@
 
 
 #include "OBVisibilityFogComponent.h"
+#include "OBServerVisibilitySubsystem.h"
+#include "OBVisibilityFogStats.h"
+#include "OBVisibilityFogSubsystem.h"
 #include "TimerManager.h"
 
+#include "Components/PrimitiveComponent.h"
 #include "Components/SceneCaptureComponent2D.h"
+#include "Engine/Engine.h"
 #include "Engine/OverlapResult.h"
 #include "Engine/TextureRenderTarget2D.h"
-#include "Kismet/KismetMaterialLibrary.h"
+#include "Misc/App.h"
 #include "Materials/MaterialParameterCollection.h"
-#include "Rendering/Texture2DResource.h"
+#include "RHI.h"
+
+DECLARE_CYCLE_STAT(TEXT("UpdateData"), STAT_OBFogUpdateData, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: Source Submit"), STAT_OBFogSourceSubmit, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: Overlap Query"), STAT_OBFogOverlapQuery, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: Cone Filter"), STAT_OBFogConeFilter, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: Capture Submit"), STAT_OBFogCaptureSubmit, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: MPC Writes"), STAT_OBFogMPCWrites, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("UpdateData: Replay Record"), STAT_OBFogReplayRecord, STATGROUP_OBVisibilityFog);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Captures Issued"), STAT_OBFogCapturesIssued, STATGROUP_OBVisibilityFog);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Captures Skipped"), STAT_OBFogCapturesSkipped, STATGROUP_OBVisibilityFog);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Overlaps Found"), STAT_OBFogOverlapsFound, STATGROUP_OBVisibilityFog);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Actors In Cone"), STAT_OBFogActorsInCone, STATGROUP_OBVisibilityFog);
+
+namespace OBVisibilityFogComponentPrivate
+{
+	// Bình phương khoảng cách từ Point tới điểm xa nhất của Box.
+	FVector::FReal FarthestPointDistSquared(const FVector& Point, const FBox& Box)
+	{
+		const FVector Farthest = FVector::Max(Point - Box.Min, Box.Max - Point);
+		return Farthest.SizeSquared();
+	}
+}
 
 UOBVisibilityFogComponent::UOBVisibilityFogComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
+	// Chạy sau khi camera đã cập nhật để capture và MPC khớp với góc nhìn được render trong frame này
+	PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
 }
 
 void UOBVisibilityFogComponent::InitializeFogComponents(USceneCaptureComponent2D* CaptureComponent,
@@ -28,8 +57,18 @@ void UOBVisibilityFogComponent::InitializeFogComponents(USceneCaptureComponent2D
 void UOBVisibilityFogComponent::BeginPlay()
 {
 	Super::BeginPlay();
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
 	SetComponentTickEnabled(false);
 
+	// Tầm nhìn trên server không cần capture hay post process, nên đăng ký trước khi kiểm tra dependency
+	if (bRegisterServerVisionSource && GetOwner()->HasAuthority())
+	{
+		if (UOBServerVisibilitySubsystem* ServerVisibility = GetWorld()->GetSubsystem<UOBServerVisibilitySubsystem>())
+		{
+			ServerVisibility->RegisterVisionSource(GetOwner(), TeamId, GetVisionRules());
+		}
+	}
+
 	// --- BƯỚC 1: KIỂM TRA CÁC ĐỐI TƯỢNG PHỤ THUỘC ---
 	if (!IsValid(DepthCaptureComponent) || !IsValid(DepthRenderTarget) || !IsValid(VisionMPC) || !
 		IsValid(FogPostProcessComponent) || !IsValid(FogPostProcessMaterial))
@@ -50,11 +89,18 @@ void UOBVisibilityFogComponent::BeginPlay()
 	DepthCaptureComponent->bRenderInMainRenderer = true; // ???
 
 	// --- BƯỚC 3: TẠO DATA TEXTURE ĐỂ GỬI VÀO SHADER ---
-	const int32 TextureWidth = MaxTeamSize * DataPointsPerPlayer;
-	SourceDataTexture = UTexture2D::CreateTransient(TextureWidth, 1, PF_A32B32G32R32F);
-	if (SourceDataTexture)
+	// Ở chế độ chia sẻ, texture thuộc về team trong UOBVisibilityFogSubsystem
+	if (bUseSharedTeamVision)
+	{
+		if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+		{
+			FogSubsystem->RegisterFogComponent(this, TeamId);
+		}
+	}
+	else
 	{
-		SourceDataTexture->UpdateResource();
+		SourceBuffer.Initialize(FMath::Min(FOBVisionSourceBuffer::DefaultMaxSources, MaxVisionSources),
+		                        MaxVisionSources, SourceDataLayout);
 	}
 
 	// --- BƯỚC 4: CẤU HÌNH POST PROCESS ---
@@ -68,7 +114,7 @@ void UOBVisibilityFogComponent::BeginPlay()
 
 	// Gán các texture và tham số cố định vào MID
 	PostProcessMID->SetTextureParameterValue(FName("DepthMap"), DepthRenderTarget);
-	PostProcessMID->SetTextureParameterValue(FName("TeamDataTex"), SourceDataTexture);
+	BindSourceDataTexture();
 
 	// Thêm MID vào PostProcessComponent để nó được áp dụng
 	FogPostProcessComponent->Settings.AddBlendable(PostProcessMID, 1.0f);
@@ -89,23 +135,619 @@ void UOBVisibilityFogComponent::BeginPlay()
 	Settings.VignetteIntensity = 0.0f;
 
 	DepthCaptureComponent->HiddenActors.Add(GetOwner());
+	MPCDeltaWriter.Initialize(GetWorld(), VisionMPC);
+	BaseCaptureResolution = FIntPoint(DepthRenderTarget->SizeX, DepthRenderTarget->SizeY);
+
+	if (bUseDepthAtlas)
+	{
+		if (DepthAtlas.Initialize(GetOwner(), AtlasTileSize, AtlasTilesPerRow))
+		{
+			PostProcessMID->SetTextureParameterValue(FName("DepthAtlas"), DepthAtlas.GetAtlasTexture());
+			PostProcessMID->SetTextureParameterValue(FName("AtlasTileData"), DepthAtlas.GetTileDataTexture());
+			PostProcessMID->SetScalarParameterValue(FName("AtlasTilesPerRow"), DepthAtlas.GetTilesPerRow());
+			PostProcessMID->SetScalarParameterValue(FName("AtlasNumTiles"), 0.0f);
+			BoundAtlasTiles = 0;
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UOBVisibilityFogComponent: Không thể tạo depth atlas trên Actor '%s'."),
+			       *GetOwner()->GetName());
+		}
+	}
 
 	FTimerHandle TimerHandle;
 	GetWorld()->GetTimerManager().SetTimer(TimerHandle, [this]()
 	{
 		bIsReadyToUpdate = true;
-		SetComponentTickEnabled(true);
+		SetComponentTickEnabled(bAutoUpdate);
 	}, 1.0f, false);
 }
 
+void UOBVisibilityFogComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	DepthAtlas.Release();
+
+	if (bUseSharedTeamVision)
+	{
+		if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+		{
+			FogSubsystem->UnregisterFogComponent(this, TeamId);
+		}
+	}
+
+	if (bRegisterServerVisionSource)
+	{
+		if (UOBServerVisibilitySubsystem* ServerVisibility = GetWorld()->GetSubsystem<UOBServerVisibilitySubsystem>())
+		{
+			ServerVisibility->UnregisterVisionSource(GetOwner());
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void UOBVisibilityFogComponent::TickComponent(float DeltaTime, ELevelTick TickType,
                                               FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-	// Logic chính được gọi từ bên ngoài thông qua hàm UpdateData
+
+	// Khi bAutoUpdate tắt, logic chính được gọi từ bên ngoài thông qua hàm UpdateData
+	if (!bAutoUpdate)
+	{
+		return;
+	}
+
+	// Bước cố định: component vẫn tick mỗi frame và tích lũy thời gian, chỉ cập nhật khi đủ một bước.
+	// Phần dư được giữ lại để tần số trung bình đúng bằng FixedUpdateRate (tick interval thì trễ dần theo frame),
+	// và bị kẹp ở một bước để một frame dài không sinh ra chuỗi cập nhật bù
+	if (FixedUpdateRate > 0.0f)
+	{
+		const float FixedStep = 1.0f / FixedUpdateRate;
+		FixedUpdateAccumulator += DeltaTime;
+		if (FixedUpdateAccumulator < FixedStep)
+		{
+			return;
+		}
+		FixedUpdateAccumulator = FMath::Min(FixedUpdateAccumulator - FixedStep, FixedStep);
+	}
+
+	const UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+	if (!FogSubsystem)
+	{
+		return;
+	}
+
+	// Nguồn của Owner (nếu có) được thay bằng mắt đọc lại ở đầu UpdateData
+	GatheredTeammateData.Reset();
+	GatheredTeammateActors.Reset();
+	for (const FOBGatheredVisionSource& Source : FogSubsystem->GetGatheredVisionSources())
+	{
+		if (Source.TeamId == TeamId && Source.Owner != GetOwner())
+		{
+			GatheredTeammateData.Add(Source.Data);
+			GatheredTeammateActors.Add(Source.Owner);
+		}
+	}
+
+	UpdateDataInternal(GatheredTeammateData, GatheredTeammateActors);
+}
+
+TArray<AActor*> UOBVisibilityFogComponent::GetActorsInCone() const
+{
+	TArray<AActor*> Result;
+	Result.Reserve(ActorsInCone.Num());
+	for (const TWeakObjectPtr<AActor>& Actor : ActorsInCone)
+	{
+		if (AActor* ResolvedActor = Actor.Get())
+		{
+			Result.Add(ResolvedActor);
+		}
+	}
+	return Result;
+}
+
+void UOBVisibilityFogComponent::SetTeamId(const int32 NewTeamId)
+{
+	if (NewTeamId == TeamId)
+	{
+		return;
+	}
+
+	if (bRegisterServerVisionSource && HasBegunPlay() && GetOwner()->HasAuthority())
+	{
+		if (UOBServerVisibilitySubsystem* ServerVisibility = GetWorld()->GetSubsystem<UOBServerVisibilitySubsystem>())
+		{
+			ServerVisibility->RegisterVisionSource(GetOwner(), NewTeamId, GetVisionRules());
+		}
+	}
+
+	if (bUseSharedTeamVision && HasBegunPlay())
+	{
+		if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+		{
+			FogSubsystem->UnregisterFogComponent(this, TeamId);
+			FogSubsystem->RegisterFogComponent(this, NewTeamId);
+		}
+		TeamId = NewTeamId;
+		BindSourceDataTexture();
+		return;
+	}
+
+	TeamId = NewTeamId;
+}
+
+void UOBVisibilityFogComponent::BindSourceDataTexture()
+{
+	const FOBVisionSourceBuffer* Buffer = GetSourceBuffer();
+	if (PostProcessMID && Buffer)
+	{
+		PostProcessMID->SetTextureParameterValue(FName("TeamDataTex"), Buffer->GetTexture());
+		PostProcessMID->SetScalarParameterValue(FName("SourceCapacity"), Buffer->GetMaxSources());
+		PostProcessMID->SetScalarParameterValue(FName("SourceTexelsPerSource"),
+		                                        FOBVisionSourceBuffer::GetTexelsPerSource(Buffer->GetLayout()));
+	}
+
+	if (PostProcessMID && bUseSharedTeamVision && bUseVisibilityGridTexture)
+	{
+		const UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+		const FOBVisibilityGrid* Grid = FogSubsystem ? FogSubsystem->GetTeamVisibilityGrid(TeamId) : nullptr;
+		UTexture2D* GridTexture = FogSubsystem ? FogSubsystem->GetTeamVisibilityGridTexture(TeamId) : nullptr;
+		if (Grid && GridTexture)
+		{
+			PostProcessMID->SetTextureParameterValue(FName("VisibilityGridTex"), GridTexture);
+			// XY: góc lưới, Z: kích thước ô; XY: số ô
+			PostProcessMID->SetVectorParameterValue(FName("VisibilityGridOrigin"),
+			                                        FLinearColor(Grid->GetOrigin().X, Grid->GetOrigin().Y,
+			                                                     Grid->GetCellSize(), 0.0f));
+			PostProcessMID->SetVectorParameterValue(FName("VisibilityGridDimensions"),
+			                                        FLinearColor(Grid->GetDimensions().X, Grid->GetDimensions().Y,
+			                                                     0.0f, 0.0f));
+		}
+		PostProcessMID->SetScalarParameterValue(FName("UseVisibilityGrid"), Grid && GridTexture ? 1.0f : 0.0f);
+
+		// Lớp đã khám phá dùng cùng góc và kích thước ô với lưới tầm nhìn
+		UTexture2D* ExploredTexture = FogSubsystem ? FogSubsystem->GetTeamExploredTexture(TeamId) : nullptr;
+		if (ExploredTexture)
+		{
+			PostProcessMID->SetTextureParameterValue(FName("ExploredTex"), ExploredTexture);
+		}
+		PostProcessMID->SetScalarParameterValue(FName("UseExploredLayer"), Grid && ExploredTexture ? 1.0f : 0.0f);
+	}
+}
+
+void UOBVisibilityFogComponent::StartReplayRecording()
+{
+	ReplayWriter.Reset(ReplayKeyframeInterval, ReplayMaxBytesPerMinute);
+	bIsRecordingReplay = true;
+}
+
+void UOBVisibilityFogComponent::StopReplayRecording()
+{
+	if (bIsRecordingReplay)
+	{
+		ReplayWriter.FlushPendingGap();
+	}
+	bIsRecordingReplay = false;
+}
+
+bool UOBVisibilityFogComponent::GetReplayData(TArray<uint8>& OutData) const
+{
+	OutData = ReplayWriter.GetData();
+	return ReplayWriter.GetNumFramesWritten() > 0;
+}
+
+bool UOBVisibilityFogComponent::DrainReplayData(TArray<uint8>& OutData)
+{
+	const bool bHasNewData = !ReplayWriter.GetData().IsEmpty();
+	ReplayWriter.DrainData(OutData);
+	return bHasNewData;
+}
+
+FOBVisionRules UOBVisibilityFogComponent::GetVisionRules() const
+{
+	FOBVisionRules Rules;
+	Rules.VisionDistance = VisionDistance;
+	Rules.VisionAngleDegrees = VisionAngleDegrees;
+	Rules.ProximityRadius = ProximityRadius;
+	Rules.ProximityMaxHeight = ProximityMaxHeight;
+	return Rules;
+}
+
+const FOBVisionSourceBuffer* UOBVisibilityFogComponent::GetSourceBuffer() const
+{
+	if (bUseSharedTeamVision)
+	{
+		const UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+		return FogSubsystem ? FogSubsystem->GetTeamSourceBuffer(TeamId) : nullptr;
+	}
+	return &SourceBuffer;
+}
+
+void UOBVisibilityFogComponent::InvalidateCandidateCache()
+{
+	bCandidateCacheValid = false;
+}
+
+void UOBVisibilityFogComponent::RefreshCandidateCache(const FVector& EyeLocation, const FVector& ForwardVector)
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float RequeryDistance = bUseCandidateCache ? CandidateRequeryDistance : 0.0f;
+	const float RequeryAngleRadians = bUseCandidateCache ? FMath::DegreesToRadians(CandidateRequeryAngleDegrees) : 0.0f;
+
+	// Cache vẫn còn hợp lệ nếu mắt chưa vượt ngưỡng di chuyển/xoay và cấu hình hình nón không đổi.
+	// Truy vấn vật lý là hình cầu quanh mắt nên không phụ thuộc hướng nhìn, chỉ chỉ mục không gian cần ngưỡng xoay
+	const bool bQueryDependsOnForward = CandidateQuery == EOBVisionCandidateQuery::SpatialIndex;
+	if (bUseCandidateCache && bCandidateCacheValid
+		&& CandidateQueryDistance == VisionDistance && CandidateQueryAngle == VisionAngleDegrees
+		&& FVector::DistSquared(EyeLocation, CandidateQueryEye) <= FMath::Square(RequeryDistance)
+		&& (!bQueryDependsOnForward
+			|| FVector::DotProduct(ForwardVector, CandidateQueryForward) >= FMath::Cos(RequeryAngleRadians))
+		&& (CandidateCacheMaxAge <= 0.0f || Now - CandidateQueryTime <= CandidateCacheMaxAge))
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_OBFogOverlapQuery);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_OverlapQuery);
+
+	CandidateQueryEye = EyeLocation;
+	CandidateQueryForward = ForwardVector;
+	CandidateQueryDistance = VisionDistance;
+	CandidateQueryAngle = VisionAngleDegrees;
+	CandidateQueryTime = Now;
+	bCandidateCacheValid = true;
+
+	if (CandidateQuery == EOBVisionCandidateQuery::SpatialIndex)
+	{
+		QuerySpatialIndexCandidates(EyeLocation, ForwardVector, RequeryDistance, RequeryAngleRadians);
+		return;
+	}
+
+	// Cùng hình cầu VisionDistance quanh mắt với truy vấn gốc, cộng ngưỡng di chuyển để hình cầu của mọi vị trí
+	// mắt trong ngưỡng vẫn nằm trọn trong vùng truy vấn
+	OverlapResults.Reset();
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(FogOfWarTrace), false, GetOwner());
+	GetWorld()->OverlapMultiByChannel(OverlapResults, EyeLocation, FQuat::Identity, VisionTraceChannel,
+	                                  FCollisionShape::MakeSphere(VisionDistance + RequeryDistance), QueryParams);
+	INC_DWORD_STAT_BY(STAT_OBFogOverlapsFound, OverlapResults.Num());
+	CSV_CUSTOM_STAT(OBVisibilityFog, OverlapsFound, OverlapResults.Num(), ECsvCustomStatOp::Accumulate);
+
+	CandidateCache.Reset(OverlapResults.Num());
+	for (const FOverlapResult& Result : OverlapResults)
+	{
+		if (AActor* OverlappedActor = Result.GetActor(); IsValid(OverlappedActor))
+		{
+			CandidateCache.Add({OverlappedActor, Result.GetComponent()});
+		}
+	}
+}
+
+void UOBVisibilityFogComponent::QuerySpatialIndexCandidates(const FVector& EyeLocation, const FVector& ForwardVector,
+                                                            const float RequeryDistance, const float RequeryAngleRadians)
+{
+	CandidateCache.Reset();
+	UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+	if (!FogSubsystem)
+	{
+		return;
+	}
+
+	// Nón rộng thêm góc xoay cho phép, và lề bằng quãng di chuyển cho phép: mọi hình nón hợp lệ
+	// trong ngưỡng truy vấn lại đều nằm trọn trong vùng này
+	const float HalfAngle = FMath::DegreesToRadians(FMath::Clamp(VisionAngleDegrees * 0.5f, 0.0f, 180.0f));
+	const FOBVisionCone Cone(EyeLocation, ForwardVector, HalfAngle + RequeryAngleRadians, VisionDistance,
+	                         RequeryDistance);
+
+	FOBVisionSpatialIndex& VisionIndex = FogSubsystem->GetVisionIndex();
+	VisionIndex.QueryCone(Cone, SpatialIndexScratch);
+	INC_DWORD_STAT_BY(STAT_OBFogOverlapsFound, SpatialIndexScratch.Num());
+	CSV_CUSTOM_STAT(OBVisibilityFog, OverlapsFound, SpatialIndexScratch.Num(), ECsvCustomStatOp::Accumulate);
+
+	const AActor* MyOwner = GetOwner();
+	CandidateCache.Reserve(SpatialIndexScratch.Num());
+	for (const int32 EntryIndex : SpatialIndexScratch)
+	{
+		if (AActor* IndexedActor = VisionIndex.GetActor(EntryIndex); IsValid(IndexedActor) && IndexedActor != MyOwner)
+		{
+			CandidateCache.Add({IndexedActor, VisionIndex.GetComponent(EntryIndex)});
+		}
+	}
+}
+
+bool UOBVisibilityFogComponent::UpdateActorsInCone(const FVector& EyeLocation, const FVector& ForwardVector)
+{
+	SCOPE_CYCLE_COUNTER(STAT_OBFogConeFilter);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_ConeFilter);
+
+	const float VisionConeCos = FMath::Cos(FMath::DegreesToRadians(VisionAngleDegrees * 0.5f));
+	const FVector::FReal VisionDistanceSquared = FMath::Square(VisionDistance);
+	const FCollisionShape VisionSphere = FCollisionShape::MakeSphere(VisionDistance);
+	// Chỉ mục không gian chỉ biết bounds, nên ở chế độ đó bounds là hình dạng được so với hình cầu
+	const bool bTestCollisionShape = CandidateQuery == EOBVisionCandidateQuery::PhysicsOverlap;
+
+	TSet<TWeakObjectPtr<AActor>>& NewActorsInCone = ActorsInConeScratch;
+	NewActorsInCone.Reset();
+
+	for (const FVisionCandidate& Candidate : CandidateCache)
+	{
+		AActor* CandidateActor = Candidate.Actor.Get();
+		if (!IsValid(CandidateActor) || NewActorsInCone.Contains(CandidateActor))
+		{
+			continue;
+		}
+
+		// Góc được kiểm tra theo pivot của actor như truy vấn gốc, và rẻ nhất nên đứng trước
+		if (const FVector DirectionToActor = (CandidateActor->GetActorLocation() - EyeLocation).GetSafeNormal();
+			FVector::DotProduct(ForwardVector, DirectionToActor) < VisionConeCos)
+		{
+			continue;
+		}
+
+		const UPrimitiveComponent* Primitive = Candidate.Component.Get();
+		if (!Primitive)
+		{
+			continue;
+		}
+		const FBox Bounds = Primitive->Bounds.GetBox();
+		if (!FMath::SphereAABBIntersection(EyeLocation, VisionDistanceSquared, Bounds))
+		{
+			continue;
+		}
+
+		// Truy vấn gốc so hình dạng va chạm chứ không phải bounds với hình cầu VisionDistance quanh mắt.
+		// Bounds nằm trọn trong hình cầu thì chắc chắn chạm, chỉ primitive cắt ngang mặt cầu mới cần kiểm tra chính xác
+		if (bTestCollisionShape
+			&& OBVisibilityFogComponentPrivate::FarthestPointDistSquared(EyeLocation, Bounds) > VisionDistanceSquared
+			&& !Primitive->OverlapComponent(EyeLocation, FQuat::Identity, VisionSphere))
+		{
+			continue;
+		}
+
+		NewActorsInCone.Add(CandidateActor);
+	}
+
+	// Chỉ cập nhật phần chênh lệch ở rìa hình nón thay vì dựng lại ShowOnlyActors từ đầu
+	bool bChanged = false;
+	TArray<TWeakObjectPtr<AActor>>& ShowOnlyActors = DepthCaptureComponent->ShowOnlyActors;
+	for (int32 Index = ShowOnlyActors.Num() - 1; Index >= 0; --Index)
+	{
+		if (!NewActorsInCone.Contains(ShowOnlyActors[Index]))
+		{
+			ShowOnlyActors.RemoveAtSwap(Index);
+			bChanged = true;
+		}
+	}
+	for (const TWeakObjectPtr<AActor>& Actor : NewActorsInCone)
+	{
+		if (!ActorsInCone.Contains(Actor))
+		{
+			ShowOnlyActors.Add(Actor);
+			bChanged = true;
+		}
+	}
+
+	// Hoán đổi để bộ nhớ của cả hai tập được tái sử dụng ở lần sau
+	Swap(ActorsInCone, ActorsInConeScratch);
+	INC_DWORD_STAT_BY(STAT_OBFogActorsInCone, ActorsInCone.Num());
+	CSV_CUSTOM_STAT(OBVisibilityFog, ActorsInCone, ActorsInCone.Num(), ECsvCustomStatOp::Accumulate);
+	return bChanged;
+}
+
+bool UOBVisibilityFogComponent::ShouldCapture(const FVector& EyeLocation, const FVector& ForwardVector,
+                                              const bool bActorsInConeChanged)
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	// Giới hạn tần suất được áp dụng trước, kể cả khi góc nhìn đã thay đổi
+	if (bHasCaptured && MaxCaptureRate > 0.0f && Now - LastCaptureTime < 1.0 / MaxCaptureRate)
+	{
+		return false;
+	}
+
+	const uint32 ActorsSignature = ComputeShowOnlyActorsSignature();
+	const bool bIsStable = bHasCaptured && !bActorsInConeChanged
+		&& LastCaptureDistance == VisionDistance && LastCaptureAngle == VisionAngleDegrees
+		&& FVector::DistSquared(EyeLocation, LastCaptureEye) <= FMath::Square(CaptureLocationTolerance)
+		&& FVector::DotProduct(ForwardVector, LastCaptureForward)
+		>= FMath::Cos(FMath::DegreesToRadians(CaptureAngleToleranceDegrees))
+		&& ActorsSignature == LastCaptureActorsSignature;
+
+	if (bSkipCaptureWhenStable && bIsStable)
+	{
+		return false;
+	}
+
+	LastCaptureEye = EyeLocation;
+	LastCaptureForward = ForwardVector;
+	LastCaptureDistance = VisionDistance;
+	LastCaptureAngle = VisionAngleDegrees;
+	LastCaptureActorsSignature = ActorsSignature;
+	LastCaptureTime = Now;
+	bHasCaptured = true;
+	return true;
+}
+
+uint32 UOBVisibilityFogComponent::ComputeShowOnlyActorsSignature() const
+{
+	// Thứ tự trong ShowOnlyActors có thể đổi do RemoveAtSwap, nên cộng các hash để chữ ký không phụ thuộc thứ tự
+	uint32 Signature = 0;
+	for (const TWeakObjectPtr<AActor>& Actor : DepthCaptureComponent->ShowOnlyActors)
+	{
+		if (const AActor* ResolvedActor = Actor.Get())
+		{
+			const FTransform& Transform = ResolvedActor->GetActorTransform();
+			Signature += HashCombine(GetTypeHash(ResolvedActor),
+			                         HashCombine(GetTypeHash(Transform.GetLocation()),
+			                                     HashCombine(GetTypeHash(Transform.GetRotation().Euler()),
+			                                                 GetTypeHash(Transform.GetScale3D()))));
+		}
+	}
+	return Signature;
+}
+
+bool UOBVisibilityFogComponent::UpdateCaptureResolution()
+{
+	if (!bDynamicCaptureResolution || BaseCaptureResolution.X <= 0 || BaseCaptureResolution.Y <= 0)
+	{
+		return false;
+	}
+
+	// Ưu tiên thời gian GPU; khi không có (vd: -nullrhi) thì dùng thời gian frame của game thread
+	const uint32 GPUFrameCycles = RHIGetGPUFrameCycles();
+	const double FrameTimeMs = GPUFrameCycles > 0
+		                           ? FPlatformTime::ToMilliseconds(GPUFrameCycles)
+		                           : FApp::GetDeltaTime() * 1000.0;
+
+	if (FrameTimeMs > CaptureFrameTimeBudgetMs)
+	{
+		CaptureResolutionScale = FMath::Max(CaptureResolutionScale * 0.9f, MinCaptureResolutionScale);
+	}
+	else if (FrameTimeMs < CaptureFrameTimeBudgetMs * 0.85f)
+	{
+		CaptureResolutionScale = FMath::Min(CaptureResolutionScale * 1.05f, 1.0f);
+	}
+
+	// Chỉ đổi kích thước khi chênh lệch đủ lớn để tránh tạo lại render target liên tục. Khi tải đã giảm và tỉ lệ
+	// về lại 1, luôn trả về đúng kích thước gốc, kể cả khi chỉ lệch dưới ngưỡng đó
+	const bool bFullResolution = CaptureResolutionScale >= 1.0f;
+	const int32 TargetSizeX = bFullResolution
+		                          ? BaseCaptureResolution.X
+		                          : FMath::Max(FMath::RoundToInt32(BaseCaptureResolution.X * CaptureResolutionScale), 16);
+	const int32 TargetSizeY = bFullResolution
+		                          ? BaseCaptureResolution.Y
+		                          : FMath::Max(FMath::RoundToInt32(BaseCaptureResolution.Y * CaptureResolutionScale), 16);
+	if (TargetSizeX == DepthRenderTarget->SizeX && TargetSizeY == DepthRenderTarget->SizeY)
+	{
+		return false;
+	}
+	if (!bFullResolution && FMath::Abs(TargetSizeX - DepthRenderTarget->SizeX) < 16
+		&& FMath::Abs(TargetSizeY - DepthRenderTarget->SizeY) < 16)
+	{
+		return false;
+	}
+
+	// bDynamicCaptureResolution có thể được bật sau BeginPlay, nên bản sao riêng chỉ được tạo ở lần đổi kích thước đầu
+	UseOwnDepthRenderTarget();
+	DepthRenderTarget->ResizeTarget(TargetSizeX, TargetSizeY);
+	return true;
+}
+
+void UOBVisibilityFogComponent::UseOwnDepthRenderTarget()
+{
+	if (bOwnsDepthRenderTarget)
+	{
+		return;
+	}
+
+	// Độ phân giải động đổi kích thước render target, nên component dùng bản sao tạm của riêng mình
+	// thay vì resize asset dùng chung (vd: RT_PlayerVisionDepth) của mọi component khác
+	const UTextureRenderTarget2D* SharedRenderTarget = DepthRenderTarget;
+	UTextureRenderTarget2D* OwnRenderTarget = NewObject<UTextureRenderTarget2D>(this, NAME_None, RF_Transient);
+	OwnRenderTarget->RenderTargetFormat = SharedRenderTarget->RenderTargetFormat;
+	OwnRenderTarget->ClearColor = SharedRenderTarget->ClearColor;
+	OwnRenderTarget->AddressX = SharedRenderTarget->AddressX;
+	OwnRenderTarget->AddressY = SharedRenderTarget->AddressY;
+	OwnRenderTarget->Filter = SharedRenderTarget->Filter;
+	OwnRenderTarget->InitCustomFormat(SharedRenderTarget->SizeX, SharedRenderTarget->SizeY,
+	                                  SharedRenderTarget->GetFormat(), SharedRenderTarget->bForceLinearGamma);
+	DepthRenderTarget = OwnRenderTarget;
+	bOwnsDepthRenderTarget = true;
+
+	DepthCaptureComponent->TextureTarget = DepthRenderTarget;
+	PostProcessMID->SetTextureParameterValue(FName("DepthMap"), DepthRenderTarget);
+}
+
+FMatrix UOBVisibilityFogComponent::ComputeVisionViewProjection(const FVector& EyeLocation, const FVector& ForwardVector,
+                                                               const float InVisionAngleDegrees,
+                                                               const float InVisionDistance, const float AspectRatio)
+{
+	// SỬA LỖI: Sử dụng cách tính ma trận chính xác hơn
+	// const FMatrix ViewMatrix = FViewMatrix(EyeLocation, EyeLocation + ForwardVector, FVector::UpVector);
+	const FMatrix ViewMatrix = FLookFromMatrix(EyeLocation, ForwardVector, FVector::UpVector);
+	const float HorizontalFOVRadians = FMath::DegreesToRadians(InVisionAngleDegrees);
+	// FReversedZPerspectiveMatrix nhận nửa FOV ngang và tự suy ra trục dọc từ Width/Height, giống SceneCapture
+	// (FOVAngle là góc ngang); truyền nửa FOV dọc sẽ làm hẹp cả hai trục khi render target không vuông.
+	// SỬA LỖI: Dùng VisionDistance cho far plane thay vì GNearClippingPlane
+	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(HorizontalFOVRadians * 0.5f, AspectRatio, 1.0f,
+	                                                             InVisionDistance);
+	return ViewMatrix * ProjectionMatrix;
+}
+
+const FMatrix& UOBVisibilityFogComponent::GetCachedViewProjection(const FVector& EyeLocation,
+                                                                  const FVector& ForwardVector)
+{
+	const float AspectRatio = static_cast<float>(DepthRenderTarget->SizeX) / static_cast<float>(DepthRenderTarget->
+		SizeY);
+
+	// Đường tắt cho frame không đổi: không tính lại FLookFromMatrix/FReversedZPerspectiveMatrix
+	if (!bHasCachedViewProjection || CachedViewProjectionEye != EyeLocation
+		|| CachedViewProjectionForward != ForwardVector || CachedViewProjectionAngle != VisionAngleDegrees
+		|| CachedViewProjectionDistance != VisionDistance || CachedViewProjectionAspect != AspectRatio)
+	{
+		CachedViewProjection = ComputeVisionViewProjection(EyeLocation, ForwardVector, VisionAngleDegrees,
+		                                                   VisionDistance, AspectRatio);
+		CachedViewProjectionEye = EyeLocation;
+		CachedViewProjectionForward = ForwardVector;
+		CachedViewProjectionAngle = VisionAngleDegrees;
+		CachedViewProjectionDistance = VisionDistance;
+		CachedViewProjectionAspect = AspectRatio;
+		bHasCachedViewProjection = true;
+	}
+	return CachedViewProjection;
+}
+
+void UOBVisibilityFogComponent::UpdateDepthAtlas(const FTeammateVisionData& MyData,
+                                                 const TConstArrayView<FTeammateVisionData> InTeammateData)
+{
+	AtlasSources.Reset();
+
+	// Hình nón của người chơi local đã có depth capture chính, chỉ cần tile khi nó quá rộng cho capture đó
+	if (VisionAngleDegrees > FOBVisionDepthAtlas::MaxPerspectiveTileAngle)
+	{
+		AtlasSources.Add({MyData, GetOwner(), true});
+	}
+
+	// Nguồn tự thu thập mang theo Owner và cờ nhìn mọi hướng; mảng từ UpdateData chỉ có dữ liệu tầm nhìn
+	const UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+	if (bAutoUpdate && FogSubsystem)
+	{
+		for (const FOBGatheredVisionSource& Source : FogSubsystem->GetGatheredVisionSources())
+		{
+			if (Source.TeamId == TeamId && Source.Owner != GetOwner())
+			{
+				AtlasSources.Add({Source.Data, Source.Owner, Source.bOmnidirectional});
+			}
+		}
+	}
+	else
+	{
+		for (const FTeammateVisionData& Teammate : InTeammateData)
+		{
+			AtlasSources.Add({Teammate, nullptr, false});
+		}
+	}
+
+	DepthAtlas.Update(AtlasSources, GetVisionRules(), MaxAtlasCapturesPerFrame);
+	if (DepthAtlas.GetNumTiles() != BoundAtlasTiles)
+	{
+		BoundAtlasTiles = DepthAtlas.GetNumTiles();
+		PostProcessMID->SetScalarParameterValue(FName("AtlasNumTiles"), BoundAtlasTiles);
+	}
+}
+
+void UOBVisibilityFogComponent::GetCaptureStats(int32& OutCapturesIssued, int32& OutCapturesSkipped) const
+{
+	OutCapturesIssued = NumCapturesIssued;
+	OutCapturesSkipped = NumCapturesSkipped;
 }
 
 void UOBVisibilityFogComponent::UpdateData(const TArray<FTeammateVisionData>& InTeammateData)
+{
+	UpdateDataInternal(InTeammateData);
+}
+
+void UOBVisibilityFogComponent::UpdateDataInternal(const TConstArrayView<FTeammateVisionData> InTeammateData,
+                                                   const TConstArrayView<const AActor*> InTeammateActors)
 {
 	// Chỉ thực thi nếu component đã được khởi tạo thành công và đang trong game
 	if (!bIsReadyToUpdate || !HasBegunPlay())
@@ -113,9 +755,19 @@ void UOBVisibilityFogComponent::UpdateData(const TArray<FTeammateVisionData>& In
 		return;
 	}
 
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+	SCOPE_CYCLE_COUNTER(STAT_OBFogUpdateData);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_UpdateData);
+	CSV_SCOPED_TIMING_STAT(OBVisibilityFog, UpdateData);
+#if !UE_BUILD_SHIPPING
+	const uint64 UpdateStartCycles = FPlatformTime::Cycles64();
+#endif
+
 	// --- BƯỚC 1: KIỂM TRA CÁC ĐỐI TƯỢNG CẦN THIẾT TRƯỚC KHI UPDATE ---
 	// Dù đã kiểm tra ở BeginPlay, kiểm tra lại để đảm bảo an toàn
-	if (!VisionMPC || !DepthCaptureComponent || !DepthRenderTarget || !PostProcessMID || !SourceDataTexture)
+	UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+	if (!VisionMPC || !DepthCaptureComponent || !DepthRenderTarget || !PostProcessMID
+		|| (bUseSharedTeamVision ? !FogSubsystem : !SourceBuffer.GetTexture()))
 	{
 		return;
 	}
@@ -124,8 +776,7 @@ void UOBVisibilityFogComponent::UpdateData(const TArray<FTeammateVisionData>& In
 	const AActor* OwnerActor = GetOwner();
 	if (!IsValid(OwnerActor)) return;
 
-	TArray<FTeammateVisionData> AllSourcesData;
-	AllSourcesData.Reserve(InTeammateData.Num() + 1);
+	AllSourcesData.Reset(InTeammateData.Num() + 1);
 
 	// Thêm dữ liệu của chính người chơi local vào đầu danh sách
 	FTeammateVisionData MyData;
@@ -136,134 +787,156 @@ void UOBVisibilityFogComponent::UpdateData(const TArray<FTeammateVisionData>& In
 	AllSourcesData.Add(MyData);
 
 	// Thêm dữ liệu của các đồng đội
-	AllSourcesData.Append(InTeammateData);
+	AllSourcesData.Append(InTeammateData.GetData(), InTeammateData.Num());
 
-	const int32 NumSources = FMath::Min(AllSourcesData.Num(), MaxTeamSize);
+	// Actor của từng nguồn (nếu biết), để che khuất của team bỏ qua chính nguồn đó
+	AllSourceActors.Reset();
+	AllSourceActors.Add(OwnerActor);
+	AllSourceActors.Append(InTeammateActors.GetData(), InTeammateActors.Num());
 
 	// --- BƯỚC 3: CẬP NHẬT DATA TEXTURE VỚI DỮ LIỆU MỚI (THREAD-SAFE) ---
-	const int32 TextureWidth = MaxTeamSize * DataPointsPerPlayer;
-	// Tạo một bản sao dữ liệu để gửi sang Render Thread
-	TArray<FLinearColor>* TextureDataCopy = new TArray<FLinearColor>();
-	TextureDataCopy->SetNumZeroed(TextureWidth);
-
-	for (int32 i = 0; i < NumSources; ++i)
+	uint64 StageStartCycles = FPlatformTime::Cycles64();
+	// Ở chế độ chia sẻ, subsystem chỉ đóng gói và upload một lần cho cả team trong frame này
+	int32 NumSources;
+	FVector SourceOrigin;
 	{
-		const FTeammateVisionData& Source = AllSourcesData[i];
-		// Dữ liệu 1: Vị trí mắt (XYZ), Vị trí mặt đất (W là Z)
-		(*TextureDataCopy)[i * DataPointsPerPlayer + 0] = FLinearColor(Source.EyeLocation.X, Source.EyeLocation.Y,
-		                                                               Source.EyeLocation.Z, Source.GroundLocation.Z);
-		// Dữ liệu 2: Hướng nhìn (XYZ)
-		(*TextureDataCopy)[i * DataPointsPerPlayer + 1] = FLinearColor(Source.ForwardVector.X, Source.ForwardVector.Y,
-		                                                               Source.ForwardVector.Z, 0.0f);
-	}
-
-	if (FTexture2DResource* TextureResource = static_cast<FTexture2DResource*>(SourceDataTexture->GetResource()))
-	{
-		ENQUEUE_RENDER_COMMAND(UpdateTeamDataTexture)(
-			[TextureResource, TextureDataCopy, TextureWidth](FRHICommandListImmediate& RHICmdList)
+		SCOPE_CYCLE_COUNTER(STAT_OBFogSourceSubmit);
+		TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_SourceSubmit);
+		if (bUseSharedTeamVision)
+		{
+			NumSources = FogSubsystem->SubmitTeamSources(TeamId, AllSourcesData, GetVisionRules(), AllSourceActors);
+			SourceOrigin = FOBVisionSourceBuffer::ComputePackOrigin(FogSubsystem->GetTeamSources(TeamId));
+		}
+		else
+		{
+			// Texture tự tăng sức chứa khi có thêm nguồn, chỉ cần gán lại vào MID chứ không tạo lại material
+			if (SourceBuffer.EnsureCapacity(AllSourcesData.Num()))
 			{
-				const int32 DataSize = TextureWidth * sizeof(FLinearColor);
-				const FUpdateTextureRegion2D Region(0, 0, 0, 0, TextureWidth, 1);
-				RHICmdList.UpdateTexture2D(TextureResource->GetTexture2DRHI(), 0, Region, DataSize,
-				                           reinterpret_cast<const uint8*>(TextureDataCopy->GetData()));
-				// Quan trọng: Giải phóng bộ nhớ sau khi đã sử dụng xong trên Render Thread
-				delete TextureDataCopy;
+				BindSourceDataTexture();
 			}
-		);
-	}
-	else
-	{
-		// Nếu không thể gửi lệnh, vẫn phải giải phóng bộ nhớ để tránh memory leak
-		delete TextureDataCopy;
-	}
+			NumSources = SourceBuffer.Upload(AllSourcesData);
+			SourceOrigin = SourceBuffer.GetPackOrigin();
+		}
+
+		// --- BƯỚC 4: CẬP NHẬT CÁC THAM SỐ MATERIAL CHO LOCAL PLAYER ---
 
-	// --- BƯỚC 4: CẬP NHẬT CÁC THAM SỐ MATERIAL CHO LOCAL PLAYER ---
+		// 4.1. Cập nhật các tham số trên MID của Post Process
+		PostProcessMID->SetScalarParameterValue(FName("NumSources"), NumSources);
+		PostProcessMID->SetVectorParameterValue(FName("SourceOrigin"), FLinearColor(SourceOrigin));
+	}
 
-	// 4.1. Cập nhật các tham số trên MID của Post Process
-	PostProcessMID->SetScalarParameterValue(FName("NumSources"), NumSources);
+	uint64 StageEndCycles = FPlatformTime::Cycles64();
+	StageTimings.SourceSubmitCycles += StageEndCycles - StageStartCycles;
 
-	// 4.1. Tìm tất cả các actor trong tầm nhìn bằng Sphere Overlap và kiểm tra góc
-	TArray<FOverlapResult> OverlapResults;
-	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(FogOfWarTrace), false, OwnerActor);
-	GetWorld()->OverlapMultiByChannel(OverlapResults, MyData.EyeLocation, FQuat::Identity, VisionTraceChannel,
-	                                  FCollisionShape::MakeSphere(VisionDistance), QueryParams);
+	// 4.1. Tìm tất cả các actor trong tầm nhìn từ cache ứng viên và kiểm tra góc
+	StageStartCycles = StageEndCycles;
+	RefreshCandidateCache(MyData.EyeLocation, MyData.ForwardVector);
+	StageEndCycles = FPlatformTime::Cycles64();
+	StageTimings.OverlapQueryCycles += StageEndCycles - StageStartCycles;
 
-	TSet<AActor*> ActorsInCone;
+	StageStartCycles = StageEndCycles;
+	const bool bActorsInConeChanged = UpdateActorsInCone(MyData.EyeLocation, MyData.ForwardVector);
+	StageEndCycles = FPlatformTime::Cycles64();
+	StageTimings.ConeFilterCycles += StageEndCycles - StageStartCycles;
 	const float VisionConeCos = FMath::Cos(FMath::DegreesToRadians(VisionAngleDegrees * 0.5f));
 
-	for (const FOverlapResult& Result : OverlapResults)
+	// 4.2. Ghi lại Depth Map từ góc nhìn người chơi local, chỉ khi bộ lập lịch cho phép
+	// ShowOnlyActors được giữ nguyên giữa các frame và chỉ cập nhật phần chênh lệch trong UpdateActorsInCone
+	StageStartCycles = StageEndCycles;
+	bool bCaptureIssued = false;
 	{
-		if (AActor* OverlappedActor = Result.GetActor(); IsValid(OverlappedActor) && !ActorsInCone.Contains(
-			OverlappedActor))
+		SCOPE_CYCLE_COUNTER(STAT_OBFogCaptureSubmit);
+		TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_CaptureSubmit);
+		if (UpdateCaptureResolution())
 		{
-			if (const FVector DirectionToActor = (OverlappedActor->GetActorLocation() - MyData.EyeLocation).
-					GetSafeNormal();
-				FVector::DotProduct(MyData.ForwardVector, DirectionToActor) >= VisionConeCos)
-			{
-				ActorsInCone.Add(OverlappedActor);
-			}
+			// Render target vừa được tạo lại, nội dung cũ không còn hợp lệ
+			bHasCaptured = false;
+		}
+
+		if (!ShouldCapture(MyData.EyeLocation, MyData.ForwardVector, bActorsInConeChanged))
+		{
+			++NumCapturesSkipped;
+			INC_DWORD_STAT(STAT_OBFogCapturesSkipped);
 		}
+		else
+		{
+			++NumCapturesIssued;
+			INC_DWORD_STAT(STAT_OBFogCapturesIssued);
+			bCaptureIssued = true;
+
+			DepthCaptureComponent->SetWorldLocationAndRotation(MyData.EyeLocation, MyData.ForwardVector.Rotation());
+			DepthCaptureComponent->FOVAngle = VisionAngleDegrees;
+			DepthCaptureComponent->CaptureScene();
+
+			// 4.3. Tính toán ma trận View-Projection để gửi vào shader
+			// Ma trận chỉ được cập nhật cùng với capture để luôn khớp với depth map đang có
+			CapturedViewProjection = GetCachedViewProjection(MyData.EyeLocation, MyData.ForwardVector);
+			MPCDeltaWriter.SetMatrix(CapturedViewProjection);
+			MPCDeltaWriter.SetVector(FOBVisionMPCDeltaWriter::CaptureEyePosition, FLinearColor(MyData.EyeLocation));
+		}
+
+		if (bUseDepthAtlas && DepthAtlas.IsInitialized())
+		{
+			UpdateDepthAtlas(MyData, InTeammateData);
+		}
+
+		// Ma trận của góc nhìn hiện tại được gửi riêng mỗi lần cập nhật, để material đọc depth map bằng ma trận
+		// của lần capture (không bị trôi khi capture chạy chậm) và giới hạn vùng nhìn theo hướng mới nhất
+		MPCDeltaWriter.SetMatrix(GetCachedViewProjection(MyData.EyeLocation, MyData.ForwardVector),
+		                    FOBVisionMPCDeltaWriter::CurrentMatrixRow0);
 	}
+	CSV_CUSTOM_STAT(OBVisibilityFog, CapturesIssued, bCaptureIssued ? 1 : 0, ECsvCustomStatOp::Accumulate);
 
-	// 4.2. Chỉ thị cho SceneCapture chỉ render những actor đã tìm thấy
-	DepthCaptureComponent->ShowOnlyActors = ActorsInCone.Array();
+	StageEndCycles = FPlatformTime::Cycles64();
+	StageTimings.CaptureSubmitCycles += StageEndCycles - StageStartCycles;
 
-	// 4.2. Ghi lại Depth Map từ góc nhìn người chơi local
-	DepthCaptureComponent->SetWorldLocationAndRotation(MyData.EyeLocation, MyData.ForwardVector.Rotation());
-	DepthCaptureComponent->FOVAngle = VisionAngleDegrees;
-	DepthCaptureComponent->CaptureScene();
+	// 4.4. Gửi ma trận và các tham số khác vào Material Parameter Collection (MPC),
+	// chỉ các giá trị đã thay đổi mới thực sự được ghi
+	StageStartCycles = StageEndCycles;
+	{
+		SCOPE_CYCLE_COUNTER(STAT_OBFogMPCWrites);
+		TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_MPCWrites);
+		if (!MPCDeltaWriter.IsInitialized())
+		{
+			MPCDeltaWriter.Initialize(GetWorld(), VisionMPC);
+		}
+		MPCDeltaWriter.SetScalar(FOBVisionMPCDeltaWriter::VisionConeCosine, VisionConeCos);
+		MPCDeltaWriter.SetScalar(FOBVisionMPCDeltaWriter::VisionMaxDistance, VisionDistance);
+		MPCDeltaWriter.SetScalar(FOBVisionMPCDeltaWriter::ProximityRadius, ProximityRadius);
+		MPCDeltaWriter.SetScalar(FOBVisionMPCDeltaWriter::ProximityMaxHeight, ProximityMaxHeight);
+		// Gửi thêm các dữ liệu của local player vào MPC để shader không cần đọc lại từ texture
+		MPCDeltaWriter.SetVector(FOBVisionMPCDeltaWriter::PlayerPosition, FLinearColor(MyData.EyeLocation));
+		MPCDeltaWriter.SetVector(FOBVisionMPCDeltaWriter::PlayerForwardVector, FLinearColor(MyData.ForwardVector));
+		MPCDeltaWriter.SetVector(FOBVisionMPCDeltaWriter::PlayerGroundPosition, FLinearColor(MyData.GroundLocation));
+		MPCDeltaWriter.WriteChanged();
+	}
+	StageTimings.MPCWriteCycles += FPlatformTime::Cycles64() - StageStartCycles;
+	++StageTimings.NumUpdates;
 
-	DepthCaptureComponent->ShowOnlyActors.Empty();
+	// Ghi lại đúng những gì người chơi nhìn thấy ở lần cập nhật này (nguồn đầu tiên là bản thân)
+	if (bIsRecordingReplay)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_OBFogReplayRecord);
+		TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_ReplayRecord);
+		ReplayWriter.RecordFrame(GetWorld()->GetTimeSeconds(), AllSourcesData, GetVisionRules(), ActorsInCone);
+	}
 
-	// 4.3. Tính toán ma trận View-Projection để gửi vào shader
-	// SỬA LỖI: Sử dụng cách tính ma trận chính xác hơn
-	// const FMatrix ViewMatrix = FViewMatrix(MyData.EyeLocation, MyData.EyeLocation + MyData.ForwardVector, FVector::UpVector);
-	const FMatrix ViewMatrix = FLookFromMatrix(MyData.EyeLocation, MyData.ForwardVector, FVector::UpVector);
-	const float AspectRatio = static_cast<float>(DepthRenderTarget->SizeX) / static_cast<float>(DepthRenderTarget->
-		SizeY);
-	const float HorizontalFOVRadians = FMath::DegreesToRadians(VisionAngleDegrees);
-	// Chuyển đổi FOV ngang sang dọc
-	const float VerticalFOVRadians = 2.0f * FMath::Atan(FMath::Tan(HorizontalFOVRadians * 0.5f) / AspectRatio);
-	// SỬA LỖI: Dùng VisionDistance cho far plane thay vì GNearClippingPlane
-	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(VerticalFOVRadians * 0.5f, AspectRatio, 1.0f,
-	                                                             VisionDistance);
-	const FMatrix ViewProjectionMatrix = ViewMatrix * ProjectionMatrix;
-
-	// 4.4. Gửi ma trận và các tham số khác vào Material Parameter Collection (MPC)
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("MatrixRow0"),
-	                                                FLinearColor(ViewProjectionMatrix.M[0][0],
-	                                                             ViewProjectionMatrix.M[0][1],
-	                                                             ViewProjectionMatrix.M[0][2],
-	                                                             ViewProjectionMatrix.M[0][3]));
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("MatrixRow1"),
-	                                                FLinearColor(ViewProjectionMatrix.M[1][0],
-	                                                             ViewProjectionMatrix.M[1][1],
-	                                                             ViewProjectionMatrix.M[1][2],
-	                                                             ViewProjectionMatrix.M[1][3]));
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("MatrixRow2"),
-	                                                FLinearColor(ViewProjectionMatrix.M[2][0],
-	                                                             ViewProjectionMatrix.M[2][1],
-	                                                             ViewProjectionMatrix.M[2][2],
-	                                                             ViewProjectionMatrix.M[2][3]));
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("MatrixRow3"),
-	                                                FLinearColor(ViewProjectionMatrix.M[3][0],
-	                                                             ViewProjectionMatrix.M[3][1],
-	                                                             ViewProjectionMatrix.M[3][2],
-	                                                             ViewProjectionMatrix.M[3][3]));
-
-	// const float VisionConeCos = FMath::Cos(FMath::DegreesToRadians(VisionAngleDegrees * 0.5f));
-	UKismetMaterialLibrary::SetScalarParameterValue(GetWorld(), VisionMPC, FName("VisionConeCosine"), VisionConeCos);
-	UKismetMaterialLibrary::SetScalarParameterValue(GetWorld(), VisionMPC, FName("VisionMaxDistance"), VisionDistance);
-	UKismetMaterialLibrary::SetScalarParameterValue(GetWorld(), VisionMPC, FName("ProximityRadius"), ProximityRadius);
-	UKismetMaterialLibrary::SetScalarParameterValue(GetWorld(), VisionMPC, FName("ProximityMaxHeight"),
-	                                                ProximityMaxHeight);
-	// Gửi thêm các dữ liệu của local player vào MPC để shader không cần đọc lại từ texture
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("PlayerPosition"),
-	                                                FLinearColor(MyData.EyeLocation));
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("PlayerForwardVector"),
-	                                                FLinearColor(MyData.ForwardVector));
-	UKismetMaterialLibrary::SetVectorParameterValue(GetWorld(), VisionMPC, FName("PlayerGroundPosition"),
-	                                                FLinearColor(MyData.GroundLocation));
+#if !UE_BUILD_SHIPPING
+	// Tóm tắt chi phí của lần cập nhật này trên màn hình, mỗi component một dòng riêng
+	if (bIsShowDebugMessage && GEngine)
+	{
+		const double UpdateMilliseconds = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - UpdateStartCycles);
+		// Ở chế độ chia sẻ, subsystem upload buffer của team (có thể ở Tick kế tiếp): báo lần upload gần nhất của nó
+		const FOBVisionSourceBuffer* ActiveSourceBuffer = GetSourceBuffer();
+		GEngine->AddOnScreenDebugMessage(
+			static_cast<uint64>(GetUniqueID()), 0.0f, FColor::Yellow,
+			FString::Printf(TEXT("[Fog] %s: %d sources, %d overlaps, %d in cone, captures %d/%d (issued/skipped), %d bytes uploaded%s, %.3f ms"),
+			                *GetNameSafe(OwnerActor), NumSources, OverlapResults.Num(), ActorsInCone.Num(),
+			                NumCapturesIssued, NumCapturesSkipped,
+			                ActiveSourceBuffer ? ActiveSourceBuffer->GetLastUploadBytes() : 0,
+			                bUseSharedTeamVision ? TEXT(" by team") : TEXT(""), UpdateMilliseconds));
+	}
+#endif
 
 	// --- BƯỚC 5: VẼ DEBUG (NẾU ĐƯỢC BẬT) ---
 #if ENABLE_DRAW_DEBUG
@@ -277,8 +950,10 @@ void UOBVisibilityFogComponent::UpdateData(const TArray<FTeammateVisionData>& In
 		                  MyData.GroundLocation + FVector(0, 0, ProximityMaxHeight), ProximityRadius, 32, FColor::Blue,
 		                  false, 0.0f, 0, 1.0f);
 
-		// Vẽ debug cho đồng đội
-		for (int i = 1; i < NumSources; ++i)
+		// Vẽ debug cho đồng đội của component này. Ở chế độ chia sẻ NumSources là số nguồn của cả team
+		// (do component nộp đầu tiên trong frame quyết định) nên có thể lớn hơn AllSourcesData
+		const int32 NumDebugSources = FMath::Min(NumSources, AllSourcesData.Num());
+		for (int32 i = 1; i < NumDebugSources; ++i)
 		{
 			const FTeammateVisionData& Teammate = AllSourcesData[i];
 			DrawDebugCone(GetWorld(), Teammate.EyeLocation, Teammate.ForwardVector, VisionDistance,
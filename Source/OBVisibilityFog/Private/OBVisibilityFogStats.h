@@ -0,0 +1,28 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "HAL/LowLevelMemTracker.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+
+// "stat OBVisibilityFog": cycle counter của từng bước trong UpdateData và Tick của subsystem, cùng các bộ đếm.
+DECLARE_STATS_GROUP(TEXT("OBVisibilityFog"), STATGROUP_OBVisibilityFog, STATCAT_Advanced);
+
+// Số byte được upload lên texture (nguồn tầm nhìn, lưới tầm nhìn, lớp đã khám phá) trong frame.
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Uploaded"), STAT_OBFogBytesUploaded, STATGROUP_OBVisibilityFog, );
+
+// Category của CSV profiler ("csvprofile start"); vẫn có trong build Test, nơi stats bị tắt.
+CSV_DECLARE_CATEGORY_EXTERN(OBVisibilityFog);
+
+// Ghi nhận số byte upload vào cả stats và CSV profiler.
+#define OB_FOG_RECORD_UPLOAD_BYTES(NumBytes) \
+	INC_DWORD_STAT_BY(STAT_OBFogBytesUploaded, NumBytes); \
+	CSV_CUSTOM_STAT(OBVisibilityFog, BytesUploaded, static_cast<int32>(NumBytes), ECsvCustomStatOp::Accumulate)
+
+// Tag LLM cho mọi cấp phát của plugin, dùng để xác nhận UpdateData không cấp phát ở trạng thái ổn định
+// (chạy với -llm và xem "stat LLMFULL" hoặc file csv của LLM; test OBVisibilityFog.Component.SteadyStateAllocations).
+// Cấp phát duy nhất còn lại mỗi lần upload là đối tượng lệnh của ENQUEUE_RENDER_COMMAND, do engine quản lý và
+// được giải phóng trên Render Thread ngay sau khi lệnh chạy, nên tag không tăng dần theo thời gian.
+LLM_DECLARE_TAG(OBVisibilityFog);
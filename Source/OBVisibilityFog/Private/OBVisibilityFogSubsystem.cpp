@@ -0,0 +1,864 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisibilityFogSubsystem.h"
+
+#include "OBStealthComponent.h"
+#include "OBVisibilityFogComponent.h"
+#include "OBVisibilityFogStats.h"
+#include "OBVisionSourceComponent.h"
+#include "Async/ParallelFor.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Texture2D.h"
+#include "Rendering/Texture2DResource.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Subsystem Tick"), STAT_OBFogSubsystemTick, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("Visibility Grid Update"), STAT_OBFogGridUpdate, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("Explored Layer Update"), STAT_OBFogExploredUpdate, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("Stealth Evaluation"), STAT_OBFogStealthEvaluation, STATGROUP_OBVisibilityFog);
+DECLARE_CYCLE_STAT(TEXT("Vision Source Gather"), STAT_OBFogSourceGather, STATGROUP_OBVisibilityFog);
+
+namespace OBVisibilityFogSubsystemPrivate
+{
+	// Dưới ngưỡng này chi phí phân việc cho worker lớn hơn chi phí đọc transform.
+	constexpr int32 MinSourcesForParallelGather = 64;
+}
+
+void FOBVisionGatherTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType,
+                                              ENamedThreads::Type CurrentThread,
+                                              const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Subsystem)
+	{
+		Subsystem->GatherVisionSources();
+	}
+}
+
+FString FOBVisionGatherTickFunction::DiagnosticMessage()
+{
+	return TEXT("FOBVisionGatherTickFunction");
+}
+
+void UOBVisibilityFogSubsystem::RegisterFogComponent(UOBVisibilityFogComponent* Component, const int32 TeamId)
+{
+	if (!IsValid(Component))
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FOBTeamVisionState& Team = Teams.FindOrAdd(TeamId);
+	if (!Team.SourceBuffer.GetTexture())
+	{
+		if (!Team.SourceBuffer.Initialize(FMath::Min(FOBVisionSourceBuffer::DefaultMaxSources,
+		                                             Component->MaxVisionSources),
+		                                  Component->MaxVisionSources, Component->SourceDataLayout))
+		{
+			UE_LOG(LogTemp, Error, TEXT("UOBVisibilityFogSubsystem: Không thể tạo texture dữ liệu cho team %d."),
+			       TeamId);
+		}
+	}
+	else
+	{
+		if (Team.SourceBuffer.GetLayout() != Component->SourceDataLayout)
+		{
+			UE_LOG(LogTemp, Warning,
+			       TEXT("UOBVisibilityFogSubsystem: Component '%s' dùng layout khác với team %d, sẽ dùng layout của team."),
+			       *Component->GetName(), TeamId);
+		}
+		Team.SourceBuffer.SetCapacityLimit(FMath::Max(Team.SourceBuffer.GetCapacityLimit(),
+		                                              Component->MaxVisionSources));
+	}
+
+	Team.Subscribers.AddUnique(Component);
+}
+
+void UOBVisibilityFogSubsystem::UnregisterFogComponent(UOBVisibilityFogComponent* Component, const int32 TeamId)
+{
+	FOBTeamVisionState* Team = Teams.Find(TeamId);
+	if (!Team)
+	{
+		return;
+	}
+
+	Team->Subscribers.RemoveAll([Component](const TWeakObjectPtr<UOBVisibilityFogComponent>& Subscriber)
+	{
+		return !Subscriber.IsValid() || Subscriber.Get() == Component;
+	});
+
+	// Giữ lại team có lưới tầm nhìn để gameplay vẫn truy vấn được
+	if (Team->Subscribers.IsEmpty() && !Team->VisibilityGrid.IsInitialized())
+	{
+		Teams.Remove(TeamId);
+	}
+}
+
+int32 UOBVisibilityFogSubsystem::SubmitTeamSources(const int32 TeamId,
+                                                  const TConstArrayView<FTeammateVisionData> Sources,
+                                                  const FOBVisionRules& Rules,
+                                                  const TConstArrayView<const AActor*> SourceActors)
+{
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FOBTeamVisionState* Team = Teams.Find(TeamId);
+	if (!Team)
+	{
+		return 0;
+	}
+
+	// Team đã có dữ liệu cho frame này (vd: người chơi split-screen khác đã nộp trước)
+	if (Team->LastSubmitFrame != GFrameCounter)
+	{
+		Team->LastSubmitFrame = GFrameCounter;
+		Team->Sources.Reset();
+		Team->Sources.Append(Sources.GetData(), Sources.Num());
+		Team->SourceActors.Reset(Sources.Num());
+		for (int32 Index = 0; Index < Sources.Num(); ++Index)
+		{
+			Team->SourceActors.Add(TObjectKey<AActor>(SourceActors.IsValidIndex(Index) ? SourceActors[Index] : nullptr));
+		}
+		Team->Rules = Rules;
+		Team->bPendingUpload = true;
+		Team->bPendingGridUpdate = true;
+
+		if (Team->SourceBuffer.EnsureCapacity(Sources.Num()))
+		{
+			RebindSubscribers(*Team);
+		}
+
+		// Tick của frame này đã chạy (component cập nhật ở TG_PostUpdateWork), upload ngay để shader
+		// không bị trễ một frame so với MPC; lưới vẫn được cập nhật ở Tick kế tiếp
+		if (LastTickFrame == GFrameCounter)
+		{
+			Team->SourceBuffer.Upload(Team->Sources);
+			Team->bPendingUpload = false;
+		}
+	}
+
+	return FMath::Min(Team->Sources.Num(), Team->SourceBuffer.GetMaxSources());
+}
+
+UTexture2D* UOBVisibilityFogSubsystem::GetTeamDataTexture(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? Team->SourceBuffer.GetTexture() : nullptr;
+}
+
+const FOBVisionSourceBuffer* UOBVisibilityFogSubsystem::GetTeamSourceBuffer(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? &Team->SourceBuffer : nullptr;
+}
+
+void UOBVisibilityFogSubsystem::ConfigureTeamVisibilityGrid(const int32 TeamId, const FVector2D Origin,
+                                                            const float CellSize, const FIntPoint Dimensions,
+                                                            const bool bUploadTexture)
+{
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FOBTeamVisionState& Team = Teams.FindOrAdd(TeamId);
+	Team.VisibilityGrid.Initialize(Origin, CellSize, Dimensions);
+	Team.VisibilityGrid.Update(Team.Sources, Team.Rules, Team.LineOfSight.GetPolygons(), Team.SourceActors);
+
+	Team.VisibilityGridTexture = bUploadTexture ? CreateGridTexture(Team) : nullptr;
+	if (Team.VisibilityGridTexture)
+	{
+		Team.VisibilityGridStaging = MakeShared<TOBUploadRing<uint8>, ESPMode::ThreadSafe>();
+	}
+
+	// Lớp đã khám phá gắn với kích thước lưới, nên bị xóa khi lưới được cấu hình lại
+	Team.Explored = FOBExploredLayer();
+	Team.ExploredTexture = nullptr;
+
+	RebindSubscribers(Team);
+}
+
+void UOBVisibilityFogSubsystem::ConfigureTeamExploredLayer(const int32 TeamId, const bool bUploadTexture)
+{
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FOBTeamVisionState* Team = Teams.Find(TeamId);
+	if (!Team || !Team->VisibilityGrid.IsInitialized())
+	{
+		UE_LOG(LogTemp, Warning,
+		       TEXT("UOBVisibilityFogSubsystem: Team %d chưa có lưới tầm nhìn, cần gọi ConfigureTeamVisibilityGrid trước."),
+		       TeamId);
+		return;
+	}
+
+	Team->Explored.Initialize(Team->VisibilityGrid);
+	Team->Explored.Accumulate(Team->VisibilityGrid, FIntRect(FIntPoint::ZeroValue, Team->VisibilityGrid.GetDimensions()));
+
+	Team->ExploredTexture = bUploadTexture ? CreateGridTexture(*Team) : nullptr;
+	if (Team->ExploredTexture)
+	{
+		Team->ExploredStaging = MakeShared<TOBUploadRing<uint8>, ESPMode::ThreadSafe>();
+		UploadExploredLayer(*Team);
+	}
+
+	RebindSubscribers(*Team);
+}
+
+bool UOBVisibilityFogSubsystem::IsLocationExploredByTeam(const int32 TeamId, const FVector& Location) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	FIntPoint Cell;
+	return Team && Team->Explored.IsInitialized() && Team->VisibilityGrid.WorldToCell(Location, Cell)
+		&& Team->Explored.IsCellExplored(Cell);
+}
+
+void UOBVisibilityFogSubsystem::SerializeTeamExplored(const int32 TeamId, FArchive& Ar)
+{
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FOBTeamVisionState* Team = Teams.Find(TeamId);
+	if (Team && Team->Explored.IsInitialized())
+	{
+		Team->Explored.Serialize(Ar);
+	}
+}
+
+bool UOBVisibilityFogSubsystem::SaveTeamExplored(const int32 TeamId, TArray<uint8>& OutData)
+{
+	OutData.Reset();
+	if (!GetTeamExploredLayer(TeamId))
+	{
+		return false;
+	}
+
+	FMemoryWriter Writer(OutData);
+	SerializeTeamExplored(TeamId, Writer);
+	return !Writer.IsError();
+}
+
+bool UOBVisibilityFogSubsystem::LoadTeamExplored(const int32 TeamId, const TArray<uint8>& Data)
+{
+	if (!GetTeamExploredLayer(TeamId))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Data);
+	SerializeTeamExplored(TeamId, Reader);
+	return !Reader.IsError();
+}
+
+const FOBExploredLayer* UOBVisibilityFogSubsystem::GetTeamExploredLayer(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team && Team->Explored.IsInitialized() ? &Team->Explored : nullptr;
+}
+
+UTexture2D* UOBVisibilityFogSubsystem::GetTeamExploredTexture(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? Team->ExploredTexture : nullptr;
+}
+
+UTexture2D* UOBVisibilityFogSubsystem::CreateGridTexture(const FOBTeamVisionState& Team)
+{
+	const FIntPoint& GridSize = Team.VisibilityGrid.GetDimensions();
+	UTexture2D* GridTexture = UTexture2D::CreateTransient(GridSize.X, GridSize.Y, PF_G8);
+	if (GridTexture)
+	{
+		GridTexture->SRGB = false;
+		GridTexture->Filter = TF_Nearest;
+		GridTexture->UpdateResource();
+	}
+	return GridTexture;
+}
+
+void UOBVisibilityFogSubsystem::ConfigureTeamLineOfSight(const int32 TeamId, const int32 RaysPerSource,
+                                                         const TEnumAsByte<ECollisionChannel> TraceChannel)
+{
+	FOBTeamVisionState& Team = Teams.FindOrAdd(TeamId);
+	Team.LineOfSight.Configure(RaysPerSource > 1 ? RaysPerSource : 0, TraceChannel);
+}
+
+TConstArrayView<FOBVisibilityPolygon> UOBVisibilityFogSubsystem::GetTeamVisibilityPolygons(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? Team->LineOfSight.GetPolygons() : TConstArrayView<FOBVisibilityPolygon>();
+}
+
+bool UOBVisibilityFogSubsystem::IsLocationVisibleToTeam(const int32 TeamId, const FVector& Location) const
+{
+	const FOBVisibilityGrid* Grid = GetTeamVisibilityGrid(TeamId);
+	return Grid && Grid->IsLocationVisible(Location);
+}
+
+void UOBVisibilityFogSubsystem::AreLocationsVisibleToTeam(const int32 TeamId, const TArray<FVector>& Locations,
+                                                          TArray<bool>& OutVisible) const
+{
+	if (const FOBVisibilityGrid* Grid = GetTeamVisibilityGrid(TeamId))
+	{
+		Grid->AreLocationsVisible(Locations, OutVisible);
+	}
+	else
+	{
+		OutVisible.Init(false, Locations.Num());
+	}
+}
+
+const FOBVisibilityGrid* UOBVisibilityFogSubsystem::GetTeamVisibilityGrid(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team && Team->VisibilityGrid.IsInitialized() ? &Team->VisibilityGrid : nullptr;
+}
+
+UTexture2D* UOBVisibilityFogSubsystem::GetTeamVisibilityGridTexture(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? Team->VisibilityGridTexture : nullptr;
+}
+
+void UOBVisibilityFogSubsystem::UploadVisibilityGrid(FOBTeamVisionState& Team)
+{
+	FIntRect DirtyRect;
+	if (!Team.VisibilityGridTexture || !Team.VisibilityGrid.ConsumeDirtyRect(DirtyRect) || DirtyRect.IsEmpty())
+	{
+		return;
+	}
+
+	FTexture2DResource* TextureResource = static_cast<FTexture2DResource*>(Team.VisibilityGridTexture->GetResource());
+	if (!TextureResource)
+	{
+		return;
+	}
+
+	// Chỉ gửi vùng đã thay đổi sang Render Thread, qua slot staging được tái sử dụng
+	uint64 Sequence;
+	TArray<uint8>& RegionData = Team.VisibilityGridStaging->AcquireSlot(Sequence);
+	Team.VisibilityGrid.CopyRectToBytes(DirtyRect, RegionData);
+	OB_FOG_RECORD_UPLOAD_BYTES(RegionData.Num());
+
+	// Lambda chỉ giữ giá trị nhỏ và một tham chiếu tới ring; bản thân lệnh render vẫn là một cấp phát của engine
+	// mỗi lần upload, được giải phóng trên Render Thread sau khi chạy
+	ENQUEUE_RENDER_COMMAND(UpdateVisibilityGridTexture)(
+		[TextureResource, Ring = Team.VisibilityGridStaging, Sequence, DirtyRect](FRHICommandListImmediate& RHICmdList)
+		{
+			const FUpdateTextureRegion2D Region(DirtyRect.Min.X, DirtyRect.Min.Y, 0, 0, DirtyRect.Width(),
+			                                    DirtyRect.Height());
+			RHICmdList.UpdateTexture2D(TextureResource->GetTexture2DRHI(), 0, Region, DirtyRect.Width(),
+			                           Ring->GetSlot(Sequence).GetData());
+			Ring->MarkConsumed(Sequence);
+		}
+	);
+}
+
+void UOBVisibilityFogSubsystem::UploadExploredLayer(FOBTeamVisionState& Team)
+{
+	if (!Team.ExploredTexture)
+	{
+		return;
+	}
+
+	FTexture2DResource* TextureResource = static_cast<FTexture2DResource*>(Team.ExploredTexture->GetResource());
+	if (!TextureResource)
+	{
+		return;
+	}
+
+	Team.Explored.ConsumeDirtyTiles(Team.ExploredDirtyTiles);
+	if (Team.ExploredDirtyTiles.IsEmpty())
+	{
+		return;
+	}
+
+	// Các tile dirty được ghi liền nhau trong một slot staging và upload trong một lệnh Render Thread.
+	// Đầu slot là danh sách FIntRect của các tile, nên số tile dirty không giới hạn mà không cần mảng riêng cấp phát
+	// trên heap để gửi kèm lệnh
+	uint64 Sequence;
+	TArray<uint8>& TileData = Team.ExploredStaging->AcquireSlot(Sequence);
+	const int32 NumTiles = Team.ExploredDirtyTiles.Num();
+	TileData.SetNumUninitialized(NumTiles * sizeof(FIntRect));
+	FIntRect* TileRects = reinterpret_cast<FIntRect*>(TileData.GetData());
+	for (int32 Index = 0; Index < NumTiles; ++Index)
+	{
+		TileRects[Index] = Team.Explored.GetTileRect(Team.ExploredDirtyTiles[Index]);
+	}
+	for (int32 Index = 0; Index < NumTiles; ++Index)
+	{
+		// Sao chép rect ra trước vì AppendRectBytes có thể cấp phát lại slot khi nó lớn lên
+		const FIntRect TileRect = reinterpret_cast<const FIntRect*>(TileData.GetData())[Index];
+		Team.Explored.AppendRectBytes(TileRect, TileData);
+	}
+	OB_FOG_RECORD_UPLOAD_BYTES(TileData.Num() - NumTiles * sizeof(FIntRect));
+
+	// Lệnh render tự nó vẫn là một cấp phát nhỏ của engine mỗi lần upload (được giải phóng trên Render Thread)
+	ENQUEUE_RENDER_COMMAND(UpdateExploredTexture)(
+		[TextureResource, Ring = Team.ExploredStaging, Sequence, NumTiles](FRHICommandListImmediate& RHICmdList)
+		{
+			const uint8* Slot = Ring->GetSlot(Sequence).GetData();
+			const FIntRect* SlotTileRects = reinterpret_cast<const FIntRect*>(Slot);
+			const uint8* Data = Slot + NumTiles * sizeof(FIntRect);
+			for (int32 Index = 0; Index < NumTiles; ++Index)
+			{
+				const FIntRect& TileRect = SlotTileRects[Index];
+				const FUpdateTextureRegion2D Region(TileRect.Min.X, TileRect.Min.Y, 0, 0, TileRect.Width(),
+				                                    TileRect.Height());
+				RHICmdList.UpdateTexture2D(TextureResource->GetTexture2DRHI(), 0, Region, TileRect.Width(), Data);
+				Data += TileRect.Area();
+			}
+			Ring->MarkConsumed(Sequence);
+		}
+	);
+}
+
+void UOBVisibilityFogSubsystem::RebindSubscribers(const FOBTeamVisionState& Team)
+{
+	for (const TWeakObjectPtr<UOBVisibilityFogComponent>& Subscriber : Team.Subscribers)
+	{
+		if (UOBVisibilityFogComponent* Component = Subscriber.Get())
+		{
+			Component->BindSourceDataTexture();
+		}
+	}
+}
+
+TConstArrayView<FTeammateVisionData> UOBVisibilityFogSubsystem::GetTeamSources(const int32 TeamId) const
+{
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team ? TConstArrayView<FTeammateVisionData>(Team->Sources) : TConstArrayView<FTeammateVisionData>();
+}
+
+void UOBVisibilityFogSubsystem::RegisterStealthComponent(UOBStealthComponent* Component)
+{
+	if (!IsValid(Component) || Component->RegistryIndex != INDEX_NONE || !Component->GetOwner())
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	Component->RegistryIndex = StealthRegistry.Add(Component->GetOwner()->GetActorLocation());
+	StealthComponents.Add(Component);
+	for (TPair<int32, FOBTeamVisionState>& Pair : Teams)
+	{
+		Pair.Value.StealthRevealed.Add(false);
+	}
+}
+
+void UOBVisibilityFogSubsystem::UnregisterStealthComponent(UOBStealthComponent* Component)
+{
+	if (!Component || !StealthComponents.IsValidIndex(Component->RegistryIndex)
+		|| StealthComponents[Component->RegistryIndex].Get() != Component)
+	{
+		return;
+	}
+
+	// Xóa kiểu swap ở mọi mảng song song, rồi cập nhật chỉ số của component bị chuyển chỗ
+	const int32 Index = Component->RegistryIndex;
+	StealthRegistry.RemoveAtSwap(Index);
+	StealthComponents.RemoveAtSwap(Index);
+	for (TPair<int32, FOBTeamVisionState>& Pair : Teams)
+	{
+		if (Pair.Value.StealthRevealed.IsValidIndex(Index))
+		{
+			Pair.Value.StealthRevealed.RemoveAtSwap(Index);
+		}
+	}
+	if (StealthComponents.IsValidIndex(Index))
+	{
+		if (UOBStealthComponent* Moved = StealthComponents[Index].Get())
+		{
+			Moved->RegistryIndex = Index;
+		}
+	}
+	Component->RegistryIndex = INDEX_NONE;
+}
+
+bool UOBVisibilityFogSubsystem::IsStealthComponentRevealedToTeam(const UOBStealthComponent* Component,
+                                                                 const int32 TeamId) const
+{
+	if (!Component)
+	{
+		return false;
+	}
+	if (Component->TeamId == TeamId)
+	{
+		return true;
+	}
+
+	const FOBTeamVisionState* Team = Teams.Find(TeamId);
+	return Team && Team->StealthRevealed.IsValidIndex(Component->RegistryIndex)
+		&& Team->StealthRevealed[Component->RegistryIndex];
+}
+
+void UOBVisibilityFogSubsystem::UpdateStealth()
+{
+	SCOPE_CYCLE_COUNTER(STAT_OBFogStealthEvaluation);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_StealthEvaluation);
+
+	// Loại bỏ component đã bị hủy mà không kịp EndPlay (vd: World bị dọn)
+	for (int32 Index = StealthComponents.Num() - 1; Index >= 0; --Index)
+	{
+		if (!StealthComponents[Index].IsValid() || !StealthComponents[Index]->GetOwner())
+		{
+			StealthRegistry.RemoveAtSwap(Index);
+			StealthComponents.RemoveAtSwap(Index);
+			for (TPair<int32, FOBTeamVisionState>& Pair : Teams)
+			{
+				if (Pair.Value.StealthRevealed.IsValidIndex(Index))
+				{
+					Pair.Value.StealthRevealed.RemoveAtSwap(Index);
+				}
+			}
+			if (StealthComponents.IsValidIndex(Index) && StealthComponents[Index].IsValid())
+			{
+				StealthComponents[Index]->RegistryIndex = Index;
+			}
+		}
+	}
+
+	const int32 NumStealth = StealthRegistry.Num();
+	if (NumStealth == 0)
+	{
+		return;
+	}
+
+	for (int32 Index = 0; Index < NumStealth; ++Index)
+	{
+		StealthRegistry.SetLocation(Index, StealthComponents[Index]->GetOwner()->GetActorLocation());
+	}
+
+	// Đánh giá theo lô cho từng team, chỉ ghi lại những vật thể đổi trạng thái
+	StealthEvents.Reset();
+	for (TPair<int32, FOBTeamVisionState>& Pair : Teams)
+	{
+		FOBTeamVisionState& Team = Pair.Value;
+		if (Team.StealthRevealed.Num() != NumStealth)
+		{
+			Team.StealthRevealed.Init(false, NumStealth);
+		}
+
+		StealthRegistry.Evaluate(Team.Sources, Team.Rules, StealthScratch);
+		for (int32 Index = 0; Index < NumStealth; ++Index)
+		{
+			// Team sở hữu luôn nhìn thấy vật thể của mình, không cần sự kiện
+			UOBStealthComponent* Component = StealthComponents[Index].Get();
+			if (Component->TeamId == Pair.Key)
+			{
+				continue;
+			}
+
+			const bool bRevealed = StealthScratch[Index] != 0;
+			if (Team.StealthRevealed[Index] != bRevealed)
+			{
+				Team.StealthRevealed[Index] = bRevealed;
+				StealthEvents.Add({Component, Pair.Key, bRevealed});
+			}
+		}
+	}
+
+	// Phát sự kiện sau khi đã duyệt xong, vì người nghe có thể đăng ký hoặc hủy vật thể tàng hình
+	for (const FStealthEvent& Event : StealthEvents)
+	{
+		UOBStealthComponent* Component = Event.Component.Get();
+		if (!Component)
+		{
+			continue;
+		}
+
+		if (Event.bRevealed)
+		{
+			Component->OnRevealed.Broadcast(Event.TeamId);
+			OnStealthActorRevealed.Broadcast(Component->GetOwner(), Event.TeamId);
+		}
+		else
+		{
+			Component->OnHidden.Broadcast(Event.TeamId);
+			OnStealthActorHidden.Broadcast(Component->GetOwner(), Event.TeamId);
+		}
+	}
+}
+
+void UOBVisibilityFogSubsystem::RegisterVisionRelevantActor(AActor* Actor)
+{
+	if (!IsValid(Actor) || IndexedActors.Contains(Actor))
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+
+	FIndexedActor& Indexed = IndexedActors.Add(Actor);
+	Indexed.RescanSlot = RescanOrder.Add(Actor);
+	RescanIndexedActor(*Actor, Indexed);
+}
+
+void UOBVisibilityFogSubsystem::UnregisterVisionRelevantActor(AActor* Actor)
+{
+	RemoveIndexedActor(Actor);
+}
+
+void UOBVisibilityFogSubsystem::RefreshVisionRelevantActor(AActor* Actor)
+{
+	FIndexedActor* Indexed = IndexedActors.Find(Actor);
+	if (!Indexed)
+	{
+		return;
+	}
+
+	if (IsValid(Actor))
+	{
+		LLM_SCOPE_BYTAG(OBVisibilityFog);
+		RescanIndexedActor(*Actor, *Indexed);
+	}
+	else
+	{
+		RemoveIndexedActor(Actor);
+	}
+}
+
+void UOBVisibilityFogSubsystem::RescanIndexedActor(AActor& Actor, FIndexedActor& Indexed)
+{
+	// Bỏ primitive đã bị hủy, đã hủy đăng ký hoặc đã chuyển sang actor khác
+	Indexed.Primitives.RemoveAllSwap([this, &Actor](const FIndexedPrimitive& Primitive)
+	{
+		const UPrimitiveComponent* Component = Primitive.Component.Get();
+		if (Component && Component->IsRegistered() && Component->GetOwner() == &Actor)
+		{
+			return false;
+		}
+
+		UnindexPrimitive(Primitive);
+		return true;
+	});
+
+	Actor.ForEachComponent<UPrimitiveComponent>(false, [this, &Actor, &Indexed](UPrimitiveComponent* Primitive)
+	{
+		if (!Primitive->IsRegistered() || Indexed.Primitives.ContainsByPredicate(
+			[Primitive](const FIndexedPrimitive& Existing) { return Existing.Component == Primitive; }))
+		{
+			return;
+		}
+
+		FIndexedPrimitive& NewPrimitive = Indexed.Primitives.AddDefaulted_GetRef();
+		NewPrimitive.Component = Primitive;
+		NewPrimitive.EntryIndex = VisionIndex.Add(&Actor, Primitive);
+		// Primitive tĩnh không bao giờ di chuyển, không cần theo dõi transform
+		if (Primitive->Mobility != EComponentMobility::Static)
+		{
+			NewPrimitive.MovedHandle = Primitive->TransformUpdated.AddUObject(
+				this, &UOBVisibilityFogSubsystem::OnIndexedPrimitiveMoved, NewPrimitive.EntryIndex);
+		}
+	});
+}
+
+void UOBVisibilityFogSubsystem::UnindexPrimitive(const FIndexedPrimitive& Primitive)
+{
+	if (UPrimitiveComponent* Component = Primitive.Component.Get())
+	{
+		Component->TransformUpdated.Remove(Primitive.MovedHandle);
+	}
+	// Flush có thể đã tự bỏ entry của primitive bị hủy và cấp slot đó cho primitive khác
+	if (VisionIndex.IsEntryOf(Primitive.EntryIndex, Primitive.Component))
+	{
+		VisionIndex.Remove(Primitive.EntryIndex);
+	}
+}
+
+void UOBVisibilityFogSubsystem::RemoveIndexedActor(const TObjectKey<AActor>& Key)
+{
+	FIndexedActor Indexed;
+	if (!IndexedActors.RemoveAndCopyValue(Key, Indexed))
+	{
+		return;
+	}
+
+	for (const FIndexedPrimitive& Primitive : Indexed.Primitives)
+	{
+		UnindexPrimitive(Primitive);
+	}
+
+	RescanOrder.RemoveAtSwap(Indexed.RescanSlot);
+	if (RescanOrder.IsValidIndex(Indexed.RescanSlot))
+	{
+		IndexedActors[RescanOrder[Indexed.RescanSlot]].RescanSlot = Indexed.RescanSlot;
+	}
+}
+
+void UOBVisibilityFogSubsystem::RescanVisionRelevantActors(const int32 MaxActors)
+{
+	const int32 NumToScan = FMath::Min(MaxActors, RescanOrder.Num());
+	for (int32 Count = 0; Count < NumToScan && !RescanOrder.IsEmpty(); ++Count)
+	{
+		if (RescanCursor >= RescanOrder.Num())
+		{
+			RescanCursor = 0;
+		}
+
+		const TObjectKey<AActor> Key = RescanOrder[RescanCursor];
+		if (AActor* Actor = Key.ResolveObjectPtr(); IsValid(Actor))
+		{
+			RescanIndexedActor(*Actor, IndexedActors[Key]);
+			++RescanCursor;
+		}
+		else
+		{
+			// Actor bị hủy mà không qua EndPlay; actor cuối được đổi vào vị trí này nên con trỏ đứng yên
+			RemoveIndexedActor(Key);
+		}
+	}
+}
+
+void UOBVisibilityFogSubsystem::OnIndexedPrimitiveMoved(USceneComponent* Component,
+                                                        EUpdateTransformFlags UpdateTransformFlags,
+                                                        ETeleportType Teleport, const int32 EntryIndex)
+{
+	VisionIndex.MarkDirty(EntryIndex);
+}
+
+void UOBVisibilityFogSubsystem::RegisterVisionSourceComponent(UOBVisionSourceComponent* Component)
+{
+	if (IsValid(Component))
+	{
+		LLM_SCOPE_BYTAG(OBVisibilityFog);
+		VisionSourceComponents.AddUnique(Component);
+	}
+}
+
+void UOBVisibilityFogSubsystem::UnregisterVisionSourceComponent(UOBVisionSourceComponent* Component)
+{
+	VisionSourceComponents.RemoveAllSwap([Component](const TWeakObjectPtr<UOBVisionSourceComponent>& Source)
+	{
+		return !Source.IsValid() || Source.Get() == Component;
+	});
+}
+
+void UOBVisibilityFogSubsystem::GatherVisionSources()
+{
+	using namespace OBVisibilityFogSubsystemPrivate;
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+	SCOPE_CYCLE_COUNTER(STAT_OBFogSourceGather);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_SourceGather);
+
+	// Giải weak pointer trên game thread, worker chỉ đọc transform
+	GatherScratch.Reset();
+	for (const TWeakObjectPtr<UOBVisionSourceComponent>& Source : VisionSourceComponents)
+	{
+		if (UOBVisionSourceComponent* Component = Source.Get())
+		{
+			GatherScratch.Add(Component);
+		}
+	}
+
+	GatheredVisionSources.Reset();
+	GatheredVisionSources.AddUninitialized(GatherScratch.Num());
+	ParallelFor(GatherScratch.Num(), [this](const int32 Index)
+	{
+		const UOBVisionSourceComponent* Component = GatherScratch[Index];
+		FOBGatheredVisionSource& Gathered = GatheredVisionSources[Index];
+		Gathered.Data = Component->GetVisionData();
+		Gathered.Owner = Component->GetOwner();
+		Gathered.TeamId = Component->GetTeamId();
+		Gathered.bOmnidirectional = Component->bOmnidirectional;
+	}, GatherScratch.Num() < MinSourcesForParallelGather ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+}
+
+void UOBVisibilityFogSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	GatherTickFunction.Subsystem = this;
+	GatherTickFunction.bCanEverTick = true;
+	GatherTickFunction.bStartWithTickEnabled = true;
+	// Sau vật lý và di chuyển của frame này, để hình nón đồng đội không trễ một frame so với component
+	// cập nhật ở TG_PostUpdateWork
+	GatherTickFunction.TickGroup = TG_PostPhysics;
+	GatherTickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+void UOBVisibilityFogSubsystem::Deinitialize()
+{
+	if (GatherTickFunction.IsTickFunctionRegistered())
+	{
+		GatherTickFunction.UnRegisterTickFunction();
+	}
+	GatherTickFunction.Subsystem = nullptr;
+
+	// Gỡ delegate khỏi các primitive còn sống để chúng không gọi vào subsystem đã bị hủy
+	for (const TPair<TObjectKey<AActor>, FIndexedActor>& Pair : IndexedActors)
+	{
+		for (const FIndexedPrimitive& Indexed : Pair.Value.Primitives)
+		{
+			if (UPrimitiveComponent* Primitive = Indexed.Component.Get())
+			{
+				Primitive->TransformUpdated.Remove(Indexed.MovedHandle);
+			}
+		}
+	}
+	IndexedActors.Reset();
+	RescanOrder.Reset();
+
+	Super::Deinitialize();
+}
+
+void UOBVisibilityFogSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+	SCOPE_CYCLE_COUNTER(STAT_OBFogSubsystemTick);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_SubsystemTick);
+	CSV_SCOPED_TIMING_STAT(OBVisibilityFog, SubsystemTick);
+
+	// Mỗi team chỉ có một lần đóng gói và một lệnh upload sang Render Thread mỗi frame
+	for (TPair<int32, FOBTeamVisionState>& Pair : Teams)
+	{
+		FOBTeamVisionState& Team = Pair.Value;
+		if (Team.bPendingUpload)
+		{
+			Team.SourceBuffer.Upload(Team.Sources);
+			Team.bPendingUpload = false;
+		}
+		const bool bNewSources = Team.bPendingGridUpdate;
+		Team.bPendingGridUpdate = false;
+
+		// Thu kết quả các tia đã gửi ở frame trước
+		const bool bNewOcclusion = Team.LineOfSight.IsConfigured() && Team.LineOfSight.Gather(GetWorld());
+
+		if (Team.VisibilityGrid.IsInitialized() && (bNewSources || bNewOcclusion))
+		{
+			{
+				SCOPE_CYCLE_COUNTER(STAT_OBFogGridUpdate);
+				TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_GridUpdate);
+				Team.VisibilityGrid.Update(Team.Sources, Team.Rules, Team.LineOfSight.GetPolygons(),
+				                           Team.SourceActors);
+				UploadVisibilityGrid(Team);
+			}
+
+			// Chỉ cộng dồn vùng vừa được vẽ lại, phần còn lại của lưới đã có trong lớp đã khám phá
+			FIntRect UpdatedRect;
+			if (Team.Explored.IsInitialized() && Team.VisibilityGrid.GetLastUpdateRect(UpdatedRect))
+			{
+				SCOPE_CYCLE_COUNTER(STAT_OBFogExploredUpdate);
+				TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_ExploredUpdate);
+				Team.Explored.Accumulate(Team.VisibilityGrid, UpdatedRect);
+			}
+		}
+
+		if (Team.Explored.IsInitialized())
+		{
+			UploadExploredLayer(Team);
+		}
+
+		if (Team.LineOfSight.IsConfigured() && bNewSources)
+		{
+			Team.LineOfSight.Kick(GetWorld(), Team.Sources, Team.SourceActors, Team.Rules);
+		}
+	}
+
+	UpdateStealth();
+	RescanVisionRelevantActors(VisionRelevantRescansPerTick);
+	LastTickFrame = GFrameCounter;
+}
+
+TStatId UOBVisibilityFogSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UOBVisibilityFogSubsystem, STATGROUP_Tickables);
+}
@@ -0,0 +1,275 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisibilityGrid.h"
+
+#include "Async/ParallelFor.h"
+#include "OBLineOfSightSolver.h"
+
+namespace OBVisibilityGridPrivate
+{
+	bool AreSourcesEqual(const FTeammateVisionData& A, const FTeammateVisionData& B)
+	{
+		return A.EyeLocation == B.EyeLocation && A.ForwardVector == B.ForwardVector
+			&& A.GroundLocation == B.GroundLocation;
+	}
+
+	// Đa giác của nguồn thứ Index: theo actor, hoặc cùng chỉ số khi cả nguồn và đa giác đều không có actor.
+	const FOBVisibilityPolygon* FindPolygon(const TConstArrayView<FOBVisibilityPolygon> Occlusion,
+	                                        const TObjectKey<AActor>& SourceActor, const int32 Index)
+	{
+		if (SourceActor != TObjectKey<AActor>())
+		{
+			return Occlusion.FindByPredicate([&SourceActor](const FOBVisibilityPolygon& Polygon)
+			{
+				return Polygon.SourceActor == SourceActor;
+			});
+		}
+		return Occlusion.IsValidIndex(Index) && Occlusion[Index].SourceActor == TObjectKey<AActor>()
+			       ? &Occlusion[Index]
+			       : nullptr;
+	}
+}
+
+void FOBVisibilityGrid::Initialize(const FVector2D& InOrigin, const float InCellSize, const FIntPoint& InDimensions)
+{
+	Origin = InOrigin;
+	CellSize = FMath::Max(InCellSize, 1.0f);
+	InvCellSize = 1.0f / CellSize;
+	Dimensions = FIntPoint(FMath::Max(InDimensions.X, 1), FMath::Max(InDimensions.Y, 1));
+	WordsPerRow = FMath::DivideAndRoundUp(Dimensions.X, 64);
+	// SetNumZeroed chỉ xóa phần mới thêm, nên bỏ hết bit của lần khởi tạo trước
+	Bits.Reset();
+	Bits.SetNumZeroed(WordsPerRow * Dimensions.Y);
+
+	PreviousSources.Reset();
+	PreviousRects.Reset();
+	PreviousRevisions.Reset();
+	MarkDirty(FIntRect(FIntPoint::ZeroValue, Dimensions));
+}
+
+void FOBVisibilityGrid::Update(const TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+                               const TConstArrayView<FOBVisibilityPolygon> Occlusion,
+                               const TConstArrayView<TObjectKey<AActor>> SourceActors)
+{
+	if (!IsInitialized())
+	{
+		return;
+	}
+
+	bHasLastUpdateRect = false;
+
+	TArray<FSourceRaster, TInlineAllocator<16>> Rasters;
+	TArray<uint32, TInlineAllocator<16>> Revisions;
+	Rasters.SetNum(Sources.Num());
+	Revisions.SetNum(Sources.Num());
+	for (int32 Index = 0; Index < Sources.Num(); ++Index)
+	{
+		const FTeammateVisionData& Source = Sources[Index];
+		FSourceRaster& Raster = Rasters[Index];
+		Raster.Eye = FVector2D(Source.EyeLocation);
+		Raster.Ground = FVector2D(Source.GroundLocation);
+		Raster.Forward = FVector2D(Source.ForwardVector).GetSafeNormal();
+		Raster.Rect = GetSourceRect(Source, Rules);
+		// Nguồn có thể đã đổi chỗ hoặc được thêm/bớt từ khi batch tia được gửi, nên không khớp theo chỉ số
+		Raster.Polygon = OBVisibilityGridPrivate::FindPolygon(
+			Occlusion, SourceActors.IsValidIndex(Index) ? SourceActors[Index] : TObjectKey<AActor>(), Index);
+		Revisions[Index] = Raster.Polygon ? Raster.Polygon->Revision : 0;
+	}
+
+	if (Sources.Num() != PreviousSources.Num() || Rules != PreviousRules)
+	{
+		// Cấu trúc thay đổi: vẽ lại toàn bộ lưới
+		RedrawRect(FIntRect(FIntPoint::ZeroValue, Dimensions), Rasters, Rules);
+	}
+	else
+	{
+		// Chỉ vẽ lại vùng cũ và mới của những nguồn đã di chuyển, xoay hoặc có đa giác che khuất mới
+		for (int32 Index = 0; Index < Sources.Num(); ++Index)
+		{
+			if (Revisions[Index] == PreviousRevisions[Index]
+				&& OBVisibilityGridPrivate::AreSourcesEqual(Sources[Index], PreviousSources[Index]))
+			{
+				continue;
+			}
+
+			const FIntRect& OldRect = PreviousRects[Index];
+			const FIntRect& NewRect = Rasters[Index].Rect;
+			if (OldRect.Intersect(NewRect))
+			{
+				FIntRect Union = OldRect;
+				Union.Union(NewRect);
+				RedrawRect(Union, Rasters, Rules);
+			}
+			else
+			{
+				RedrawRect(OldRect, Rasters, Rules);
+				RedrawRect(NewRect, Rasters, Rules);
+			}
+		}
+	}
+
+	PreviousSources.Reset(Sources.Num());
+	PreviousSources.Append(Sources.GetData(), Sources.Num());
+	PreviousRects.Reset(Rasters.Num());
+	for (const FSourceRaster& Raster : Rasters)
+	{
+		PreviousRects.Add(Raster.Rect);
+	}
+	PreviousRevisions.Reset(Revisions.Num());
+	PreviousRevisions.Append(Revisions);
+	PreviousRules = Rules;
+}
+
+void FOBVisibilityGrid::AreLocationsVisible(const TConstArrayView<FVector> Locations, TArray<bool>& OutVisible) const
+{
+	OutVisible.SetNumUninitialized(Locations.Num());
+	for (int32 Index = 0; Index < Locations.Num(); ++Index)
+	{
+		OutVisible[Index] = IsLocationVisible(Locations[Index]);
+	}
+}
+
+void FOBVisibilityGrid::CopyRectToBytes(const FIntRect& Rect, TArray<uint8>& OutBytes) const
+{
+	OutBytes.Reset();
+	OutBytes.AddUninitialized(Rect.Area());
+	uint8* Dest = OutBytes.GetData();
+	for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; ++Y)
+	{
+		for (int32 X = Rect.Min.X; X < Rect.Max.X; ++X)
+		{
+			*Dest++ = IsCellVisible(FIntPoint(X, Y)) ? 255 : 0;
+		}
+	}
+}
+
+bool FOBVisibilityGrid::ConsumeDirtyRect(FIntRect& OutRect)
+{
+	if (!bHasDirtyRect)
+	{
+		return false;
+	}
+
+	OutRect = DirtyRect;
+	bHasDirtyRect = false;
+	return true;
+}
+
+FIntRect FOBVisibilityGrid::GetSourceRect(const FTeammateVisionData& Source, const FOBVisionRules& Rules) const
+{
+	const FBox2D ConeBounds(FVector2D(Source.EyeLocation) - FVector2D(Rules.VisionDistance),
+	                        FVector2D(Source.EyeLocation) + FVector2D(Rules.VisionDistance));
+	const FBox2D ProximityBounds(FVector2D(Source.GroundLocation) - FVector2D(Rules.ProximityRadius),
+	                             FVector2D(Source.GroundLocation) + FVector2D(Rules.ProximityRadius));
+	const FBox2D Bounds = ConeBounds + ProximityBounds;
+
+	FIntRect Rect(FMath::FloorToInt32((Bounds.Min.X - Origin.X) * InvCellSize),
+	              FMath::FloorToInt32((Bounds.Min.Y - Origin.Y) * InvCellSize),
+	              FMath::FloorToInt32((Bounds.Max.X - Origin.X) * InvCellSize) + 1,
+	              FMath::FloorToInt32((Bounds.Max.Y - Origin.Y) * InvCellSize) + 1);
+	Rect.Clip(FIntRect(FIntPoint::ZeroValue, Dimensions));
+	return Rect;
+}
+
+void FOBVisibilityGrid::RedrawRect(const FIntRect& Rect, const TConstArrayView<FSourceRaster> Rasters,
+                                   const FOBVisionRules& Rules)
+{
+	if (Rect.IsEmpty())
+	{
+		return;
+	}
+
+	// Mỗi hàng nằm trọn trong các word riêng nên có thể vẽ song song
+	const EParallelForFlags Flags = Rect.Area() >= ParallelCellThreshold
+		                                ? EParallelForFlags::None
+		                                : EParallelForFlags::ForceSingleThread;
+	ParallelFor(Rect.Height(), [this, &Rect, Rasters, &Rules](const int32 RowIndex)
+	{
+		const int32 Y = Rect.Min.Y + RowIndex;
+
+		// Xóa các bit trong vùng, theo từng word khi có thể
+		uint64* Row = &Bits[Y * WordsPerRow];
+		for (int32 X = Rect.Min.X; X < Rect.Max.X;)
+		{
+			const int32 Bit = X & 63;
+			const int32 Count = FMath::Min(64 - Bit, Rect.Max.X - X);
+			const uint64 Mask = (Count == 64 ? ~uint64(0) : ((uint64(1) << Count) - 1)) << Bit;
+			Row[X >> 6] &= ~Mask;
+			X += Count;
+		}
+
+		for (const FSourceRaster& Raster : Rasters)
+		{
+			if (Y < Raster.Rect.Min.Y || Y >= Raster.Rect.Max.Y)
+			{
+				continue;
+			}
+
+			const int32 MinX = FMath::Max(Rect.Min.X, Raster.Rect.Min.X);
+			const int32 MaxX = FMath::Min(Rect.Max.X, Raster.Rect.Max.X);
+			if (MinX < MaxX)
+			{
+				RasterizeRow(Raster, Rules, Y, MinX, MaxX);
+			}
+		}
+	}, Flags);
+
+	MarkDirty(Rect);
+}
+
+void FOBVisibilityGrid::RasterizeRow(const FSourceRaster& Raster, const FOBVisionRules& Rules, const int32 Y,
+                                     const int32 MinX, const int32 MaxX)
+{
+	const double VisionConeCos = Rules.GetVisionConeCos();
+	const double VisionDistanceSquared = FMath::Square(Rules.VisionDistance);
+	const double ProximityRadiusSquared = FMath::Square(Rules.ProximityRadius);
+	const double CellY = Origin.Y + (Y + 0.5) * CellSize;
+	uint64* Row = &Bits[Y * WordsPerRow];
+
+	for (int32 X = MinX; X < MaxX; ++X)
+	{
+		const FVector2D Cell(Origin.X + (X + 0.5) * CellSize, CellY);
+
+		const FVector2D ToCell = Cell - Raster.Eye;
+		const double DistanceSquared = ToCell.SizeSquared();
+		bool bVisible = FVector2D::DistSquared(Cell, Raster.Ground) <= ProximityRadiusSquared;
+
+		if (!bVisible && DistanceSquared <= VisionDistanceSquared
+			&& FVector2D::DotProduct(Raster.Forward, ToCell) >= VisionConeCos * FMath::Sqrt(DistanceSquared))
+		{
+			// Ô trong hình nón, kiểm tra thêm đa giác che khuất nếu có
+			bVisible = !Raster.Polygon
+				|| FMath::Square(Raster.Polygon->GetDistanceAtYaw(FMath::Atan2(ToCell.Y, ToCell.X)))
+				>= DistanceSquared;
+		}
+
+		if (bVisible)
+		{
+			Row[X >> 6] |= uint64(1) << (X & 63);
+		}
+	}
+}
+
+void FOBVisibilityGrid::MarkDirty(const FIntRect& Rect)
+{
+	if (bHasLastUpdateRect)
+	{
+		LastUpdateRect.Union(Rect);
+	}
+	else
+	{
+		LastUpdateRect = Rect;
+		bHasLastUpdateRect = true;
+	}
+
+	if (bHasDirtyRect)
+	{
+		DirtyRect.Union(Rect);
+	}
+	else
+	{
+		DirtyRect = Rect;
+		bHasDirtyRect = true;
+	}
+}
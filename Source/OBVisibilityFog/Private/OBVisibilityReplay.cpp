@@ -0,0 +1,900 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisibilityReplay.h"
+
+#include "OBStealthRegistry.h"
+#include "Algo/BinarySearch.h"
+
+namespace OBVisibilityReplayPrivate
+{
+	// "OBFR" và phiên bản định dạng, ghi ở đầu luồng. Phiên bản 2 thêm mức lượng tử hóa và bản ghi khoảng trống;
+	// luồng phiên bản 1 không có hai thứ đó nên vẫn đọc được như luồng mức 0 không khoảng trống.
+	constexpr uint32 StreamMagic = 0x5246424F;
+	constexpr uint32 StreamVersion = 2;
+	constexpr int32 HeaderSize = 8;
+
+	enum class ERecordTag : uint8
+	{
+		// Id và path name (UTF-8) của một actor, luôn đứng trước frame đầu tiên dùng id đó.
+		ActorName = 1,
+		// Frame đầy đủ, không phụ thuộc frame trước.
+		Keyframe = 2,
+		// Phần chênh lệch so với frame ngay trước.
+		DeltaFrame = 3,
+		// Số frame bị bỏ vì ngân sách, thời điểm của frame bị bỏ đầu tiên và độ dài khoảng (ms); đứng trước frame
+		// được ghi kế tiếp.
+		Gap = 4
+	};
+
+	constexpr uint8 FrameHasRules = 1 << 0;
+	constexpr uint8 FrameSourcesUnchanged = 1 << 1;
+	// Một byte mức lượng tử hóa theo sau cờ; luôn có ở keyframe, ở frame delta khi mức đổi.
+	constexpr uint8 FrameHasQuantization = 1 << 2;
+
+	// Hướng nhìn lượng tử hóa 12 bit mỗi thành phần (sai số khoảng 0.01 độ), để delta khi xoay chậm chỉ 1-2 byte.
+	constexpr double ForwardScale = 4095.0;
+
+	// Ngân sách chưa dùng được dồn tối đa 10 giây, để một đợt thay đổi ngắn không phải hạ chất lượng.
+	constexpr double BudgetBurstSeconds = 10.0;
+
+	// Dưới 1/4 ngân sách dồn được thì hạ chất lượng một bậc, trên 3/4 thì nâng lại, mỗi lần cách nhau ít nhất 1 giây.
+	// Frame không vừa ngân sách hạ chất lượng ngay, không chờ.
+	constexpr double LowBudgetFraction = 0.25;
+	constexpr double HighBudgetFraction = 0.75;
+	constexpr double QualityChangeSeconds = 1.0;
+
+	void WriteVarint(TArray<uint8>& Out, uint64 Value)
+	{
+		while (Value >= 0x80)
+		{
+			Out.Add(static_cast<uint8>(Value | 0x80));
+			Value >>= 7;
+		}
+		Out.Add(static_cast<uint8>(Value));
+	}
+
+	// Zigzag: số âm nhỏ cũng chỉ tốn ít byte.
+	void WriteSigned(TArray<uint8>& Out, const int64 Value)
+	{
+		WriteVarint(Out, (static_cast<uint64>(Value) << 1) ^ static_cast<uint64>(Value >> 63));
+	}
+
+	void WriteUint32(TArray<uint8>& Out, const uint32 Value)
+	{
+		for (int32 Shift = 0; Shift < 32; Shift += 8)
+		{
+			Out.Add(static_cast<uint8>(Value >> Shift));
+		}
+	}
+
+	void WriteFloat(TArray<uint8>& Out, const float Value)
+	{
+		uint32 Bits;
+		FMemory::Memcpy(&Bits, &Value, sizeof(Bits));
+		WriteUint32(Out, Bits);
+	}
+
+	void WriteVector(TArray<uint8>& Out, const FInt64Vector& Value, const FInt64Vector& Predicted)
+	{
+		WriteSigned(Out, Value.X - Predicted.X);
+		WriteSigned(Out, Value.Y - Predicted.Y);
+		WriteSigned(Out, Value.Z - Predicted.Z);
+	}
+
+	// Danh sách id tăng dần: số phần tử, rồi khoảng cách giữa hai id liên tiếp.
+	void WriteIdList(TArray<uint8>& Out, const TConstArrayView<int32> Ids)
+	{
+		WriteVarint(Out, Ids.Num());
+		int32 Previous = -1;
+		for (const int32 Id : Ids)
+		{
+			WriteVarint(Out, Id - Previous - 1);
+			Previous = Id;
+		}
+	}
+
+	// Đọc tuần tự trong [Offset, End); lỗi (hết dữ liệu, varint hỏng) được ghi nhận thay vì đọc tràn.
+	struct FByteReader
+	{
+		const uint8* Bytes = nullptr;
+		int32 End = 0;
+		int32 Offset = 0;
+		bool bError = false;
+
+		uint8 ReadByte()
+		{
+			if (Offset >= End)
+			{
+				bError = true;
+				return 0;
+			}
+			return Bytes[Offset++];
+		}
+
+		uint64 ReadVarint()
+		{
+			uint64 Value = 0;
+			for (int32 Shift = 0; Shift < 64; Shift += 7)
+			{
+				const uint8 Byte = ReadByte();
+				Value |= static_cast<uint64>(Byte & 0x7F) << Shift;
+				if (!(Byte & 0x80) || bError)
+				{
+					return Value;
+				}
+			}
+			bError = true;
+			return 0;
+		}
+
+		int64 ReadSigned()
+		{
+			const uint64 Value = ReadVarint();
+			return static_cast<int64>(Value >> 1) ^ -static_cast<int64>(Value & 1);
+		}
+
+		uint32 ReadUint32()
+		{
+			uint32 Value = 0;
+			for (int32 Shift = 0; Shift < 32; Shift += 8)
+			{
+				Value |= static_cast<uint32>(ReadByte()) << Shift;
+			}
+			return Value;
+		}
+
+		float ReadFloat()
+		{
+			const uint32 Bits = ReadUint32();
+			float Value;
+			FMemory::Memcpy(&Value, &Bits, sizeof(Value));
+			return Value;
+		}
+
+		FInt64Vector ReadVector(const FInt64Vector& Predicted)
+		{
+			const int64 X = ReadSigned();
+			const int64 Y = ReadSigned();
+			const int64 Z = ReadSigned();
+			return FInt64Vector(Predicted.X + X, Predicted.Y + Y, Predicted.Z + Z);
+		}
+
+		template <typename AllocatorType>
+		void ReadIdList(TArray<int32, AllocatorType>& OutIds)
+		{
+			OutIds.Reset();
+			const uint64 NumIds = ReadVarint();
+			// Mỗi id tốn ít nhất 1 byte, chặn số phần tử giả trước khi cấp phát
+			if (NumIds > static_cast<uint64>(End - Offset))
+			{
+				bError = true;
+				return;
+			}
+			int64 Previous = -1;
+			for (uint64 Index = 0; Index < NumIds && !bError; ++Index)
+			{
+				Previous += static_cast<int64>(ReadVarint()) + 1;
+				if (Previous > MAX_int32)
+				{
+					bError = true;
+					return;
+				}
+				OutIds.Add(static_cast<int32>(Previous));
+			}
+		}
+	};
+
+	FInt64Vector Quantize(const FVector& Value, const double Scale)
+	{
+		return FInt64Vector(FMath::RoundToInt64(Value.X * Scale), FMath::RoundToInt64(Value.Y * Scale),
+		                    FMath::RoundToInt64(Value.Z * Scale));
+	}
+
+	FVector Dequantize(const FInt64Vector& Value, const double Scale)
+	{
+		return FVector(Value.X / Scale, Value.Y / Scale, Value.Z / Scale);
+	}
+
+	// Số đơn vị lượng tử mỗi cm và mỗi đơn vị hướng ở một mức: mỗi mức thô gấp đôi mức trước.
+	double PositionScale(const int32 Level)
+	{
+		return 1.0 / static_cast<double>(int64(1) << Level);
+	}
+
+	double DirectionScale(const int32 Level)
+	{
+		return ForwardScale / static_cast<double>(int64(1) << Level);
+	}
+
+	FOBReplayQuantizedSource QuantizeSource(const FTeammateVisionData& Source, const int32 Level)
+	{
+		FOBReplayQuantizedSource Quantized;
+		Quantized.Eye = Quantize(Source.EyeLocation, PositionScale(Level));
+		Quantized.Forward = Quantize(Source.ForwardVector, DirectionScale(Level));
+		Quantized.GroundOffset = Quantize(Source.GroundLocation, PositionScale(Level)) - Quantized.Eye;
+		return Quantized;
+	}
+
+	void DequantizeSource(const FOBReplayQuantizedSource& Source, const int32 Level, FTeammateVisionData& OutSource)
+	{
+		OutSource.EyeLocation = Dequantize(Source.Eye, PositionScale(Level));
+		OutSource.ForwardVector = Dequantize(Source.Forward, DirectionScale(Level)).GetSafeNormal();
+		OutSource.GroundLocation = Dequantize(Source.Eye + Source.GroundOffset, PositionScale(Level));
+	}
+
+	int64 RescaleValue(const int64 Value, const int32 FromLevel, const int32 ToLevel)
+	{
+		if (ToLevel > FromLevel)
+		{
+			const int32 Shift = ToLevel - FromLevel;
+			return (Value + (int64(1) << (Shift - 1))) >> Shift;
+		}
+		return Value * (int64(1) << (FromLevel - ToLevel));
+	}
+
+	FInt64Vector RescaleVector(const FInt64Vector& Value, const int32 FromLevel, const int32 ToLevel)
+	{
+		return FInt64Vector(RescaleValue(Value.X, FromLevel, ToLevel), RescaleValue(Value.Y, FromLevel, ToLevel),
+		                    RescaleValue(Value.Z, FromLevel, ToLevel));
+	}
+
+	// Đổi giá trị dự đoán sang mức mới chỉ bằng phép tính số nguyên, để writer và reader ra cùng một kết quả.
+	FOBReplayQuantizedSource RescaleSource(const FOBReplayQuantizedSource& Source, const int32 FromLevel,
+	                                       const int32 ToLevel)
+	{
+		FOBReplayQuantizedSource Rescaled;
+		Rescaled.Eye = RescaleVector(Source.Eye, FromLevel, ToLevel);
+		Rescaled.Forward = RescaleVector(Source.Forward, FromLevel, ToLevel);
+		Rescaled.GroundOffset = RescaleVector(Source.GroundOffset, FromLevel, ToLevel);
+		return Rescaled;
+	}
+}
+
+FOBVisibilityReplayWriter::FOBVisibilityReplayWriter()
+{
+	Reset(KeyframeInterval, MaxBytesPerMinute);
+}
+
+void FOBVisibilityReplayWriter::Reset(const float InKeyframeInterval, const int32 InMaxBytesPerMinute)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	Data.Reset();
+	WriteUint32(Data, StreamMagic);
+	WriteUint32(Data, StreamVersion);
+	NumBytesDrained = 0;
+
+	BaseKeyframeInterval = FMath::Max(InKeyframeInterval, 0.0f);
+	MaxBytesPerMinute = FMath::Max(InMaxBytesPerMinute, 0);
+	KeyframeInterval = BaseKeyframeInterval;
+	QuantizationLevel = 0;
+	LastQualityChangeTime = 0.0;
+	PrevSources.Reset();
+	PrevActors.Reset();
+	PrevRules = FOBVisionRules();
+	PrevQuantizationLevel = 0;
+	PrevTimeMs = 0;
+	LastKeyframeTime = 0.0;
+	bHasKeyframe = false;
+	BudgetTokens = 0.0;
+	BudgetTime = 0.0;
+	PendingGapFrames = 0;
+	PendingGapStartMs = 0;
+	PendingGapEndMs = 0;
+	ActorIds.Reset();
+	PendingNames.Reset();
+	NumFramesWritten = 0;
+	NumFramesDropped = 0;
+}
+
+void FOBVisibilityReplayWriter::DrainData(TArray<uint8>& OutData)
+{
+	OutData.Append(Data);
+	NumBytesDrained += Data.Num();
+	Data.Empty();
+}
+
+void FOBVisibilityReplayWriter::FlushPendingGap()
+{
+	WritePendingGap(Data);
+	PendingGapFrames = 0;
+}
+
+void FOBVisibilityReplayWriter::WritePendingGap(TArray<uint8>& Out) const
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	if (PendingGapFrames > 0)
+	{
+		Out.Add(static_cast<uint8>(ERecordTag::Gap));
+		WriteVarint(Out, PendingGapFrames);
+		WriteSigned(Out, PendingGapStartMs);
+		WriteSigned(Out, PendingGapEndMs - PendingGapStartMs);
+	}
+}
+
+bool FOBVisibilityReplayWriter::DecreaseQuality(const double Time)
+{
+	// Giãn khoảng keyframe trước vì không mất độ chính xác, rồi mới lượng tử hóa thô hơn
+	const float MaxKeyframeInterval = BaseKeyframeInterval * MaxKeyframeIntervalScale;
+	if (KeyframeInterval < MaxKeyframeInterval)
+	{
+		KeyframeInterval = FMath::Min(KeyframeInterval * 2.0f, MaxKeyframeInterval);
+	}
+	else if (QuantizationLevel < MaxQuantizationLevel)
+	{
+		++QuantizationLevel;
+	}
+	else
+	{
+		return false;
+	}
+	LastQualityChangeTime = Time;
+	return true;
+}
+
+bool FOBVisibilityReplayWriter::IncreaseQuality(const double Time)
+{
+	if (QuantizationLevel > 0)
+	{
+		--QuantizationLevel;
+	}
+	else if (KeyframeInterval > BaseKeyframeInterval)
+	{
+		KeyframeInterval = FMath::Max(KeyframeInterval * 0.5f, BaseKeyframeInterval);
+	}
+	else
+	{
+		return false;
+	}
+	LastQualityChangeTime = Time;
+	return true;
+}
+
+bool FOBVisibilityReplayWriter::RecordFrame(const double Time, const TConstArrayView<FTeammateVisionData> Sources,
+                                            const FOBVisionRules& Rules,
+                                            const TSet<TWeakObjectPtr<AActor>>& ActorsInCone)
+{
+	CurrentActors.Reset();
+	for (const TWeakObjectPtr<AActor>& Actor : ActorsInCone)
+	{
+		if (const AActor* ResolvedActor = Actor.Get())
+		{
+			CurrentActors.Add(GetOrAddActorId(ResolvedActor));
+		}
+	}
+	CurrentActors.Sort();
+
+	return CommitFrame(Time, Sources, Rules);
+}
+
+bool FOBVisibilityReplayWriter::RecordFrame(const double Time, const TConstArrayView<FTeammateVisionData> Sources,
+                                            const FOBVisionRules& Rules, const TConstArrayView<int32> ActorIdsInCone)
+{
+	CurrentActors.Reset();
+	CurrentActors.Append(ActorIdsInCone.GetData(), ActorIdsInCone.Num());
+	CurrentActors.Sort();
+
+	return CommitFrame(Time, Sources, Rules);
+}
+
+int32 FOBVisibilityReplayWriter::GetOrAddActorId(const AActor* Actor)
+{
+	if (const int32* ExistingId = ActorIds.Find(Actor))
+	{
+		return *ExistingId;
+	}
+
+	const int32 NewId = ActorIds.Num();
+	ActorIds.Add(Actor, NewId);
+	PendingNames.Emplace(NewId, Actor->GetPathName());
+	return NewId;
+}
+
+bool FOBVisibilityReplayWriter::CommitFrame(const double Time, const TConstArrayView<FTeammateVisionData> Sources,
+                                            const FOBVisionRules& Rules)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	const int64 TimeMs = FMath::RoundToInt64(Time * 1000.0);
+	const bool bKeyframe = !bHasKeyframe || Time - LastKeyframeTime >= KeyframeInterval;
+
+	if (MaxBytesPerMinute > 0)
+	{
+		const double BytesPerSecond = MaxBytesPerMinute / 60.0;
+		const double MaxTokens = BytesPerSecond * BudgetBurstSeconds;
+		BudgetTokens = bHasKeyframe
+			               ? FMath::Min(BudgetTokens + FMath::Max(Time - BudgetTime, 0.0) * BytesPerSecond, MaxTokens)
+			               : MaxTokens;
+		BudgetTime = Time;
+
+		if (Time - LastQualityChangeTime >= QualityChangeSeconds)
+		{
+			if (BudgetTokens < MaxTokens * LowBudgetFraction)
+			{
+				DecreaseQuality(Time);
+			}
+			else if (BudgetTokens > MaxTokens * HighBudgetFraction)
+			{
+				IncreaseQuality(Time);
+			}
+		}
+	}
+
+	EncodeRecord(Sources, Rules, TimeMs, bKeyframe);
+
+	if (MaxBytesPerMinute > 0)
+	{
+		// Frame delta không vừa ngân sách: hạ chất lượng tới khi vừa; chỉ bỏ frame khi đã ở bậc thấp nhất.
+		// Keyframe luôn được ghi và có thể làm ngân sách âm
+		while (!bKeyframe && BudgetTokens < HeaderScratch.Num() + FrameScratch.Num())
+		{
+			const int32 OldLevel = QuantizationLevel;
+			if (!DecreaseQuality(Time))
+			{
+				break;
+			}
+			if (QuantizationLevel != OldLevel)
+			{
+				EncodeRecord(Sources, Rules, TimeMs, bKeyframe);
+			}
+		}
+
+		const int32 RecordBytes = HeaderScratch.Num() + FrameScratch.Num();
+		if (!bKeyframe && BudgetTokens < RecordBytes)
+		{
+			// Frame sau vẫn đúng vì luôn so với frame đã ghi; khoảng bị bỏ được ghi cùng frame kế tiếp
+			if (PendingGapFrames == 0)
+			{
+				PendingGapStartMs = TimeMs;
+			}
+			PendingGapEndMs = TimeMs;
+			++PendingGapFrames;
+			++NumFramesDropped;
+			return false;
+		}
+		BudgetTokens -= RecordBytes;
+	}
+
+	Data.Append(HeaderScratch);
+	Data.Append(FrameScratch);
+	PendingNames.Reset();
+	PendingGapFrames = 0;
+
+	PrevSources = CurrentSources;
+	PrevActors = CurrentActors;
+	PrevRules = Rules;
+	PrevQuantizationLevel = QuantizationLevel;
+	PrevTimeMs = TimeMs;
+	if (bKeyframe)
+	{
+		LastKeyframeTime = Time;
+		bHasKeyframe = true;
+	}
+	++NumFramesWritten;
+	return true;
+}
+
+void FOBVisibilityReplayWriter::EncodeRecord(const TConstArrayView<FTeammateVisionData> Sources,
+                                             const FOBVisionRules& Rules, const int64 TimeMs, const bool bKeyframe)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	CurrentSources.Reset();
+	for (const FTeammateVisionData& Source : Sources)
+	{
+		CurrentSources.Add(QuantizeSource(Source, QuantizationLevel));
+	}
+
+	// Frame delta dự đoán bằng frame đã ghi trước, đổi sang mức lượng tử hóa hiện tại nếu mức vừa đổi
+	PredictedSources.Reset();
+	for (const FOBReplayQuantizedSource& Source : PrevSources)
+	{
+		PredictedSources.Add(RescaleSource(Source, PrevQuantizationLevel, QuantizationLevel));
+	}
+	EncodeFrame(TimeMs, Rules, bKeyframe);
+
+	// Tên của các actor mới, khoảng trống đang chờ, rồi tag và độ dài của frame
+	HeaderScratch.Reset();
+	for (const TPair<int32, FString>& Name : PendingNames)
+	{
+		const FTCHARToUTF8 Utf8Name(*Name.Value);
+		HeaderScratch.Add(static_cast<uint8>(ERecordTag::ActorName));
+		WriteVarint(HeaderScratch, Name.Key);
+		WriteVarint(HeaderScratch, Utf8Name.Length());
+		HeaderScratch.Append(reinterpret_cast<const uint8*>(Utf8Name.Get()), Utf8Name.Length());
+	}
+	WritePendingGap(HeaderScratch);
+	HeaderScratch.Add(static_cast<uint8>(bKeyframe ? ERecordTag::Keyframe : ERecordTag::DeltaFrame));
+	WriteVarint(HeaderScratch, FrameScratch.Num());
+}
+
+void FOBVisibilityReplayWriter::EncodeFrame(const int64 TimeMs, const FOBVisionRules& Rules, const bool bKeyframe)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	FrameScratch.Reset();
+	WriteSigned(FrameScratch, bKeyframe ? TimeMs : TimeMs - PrevTimeMs);
+
+	const bool bWriteRules = bKeyframe || Rules != PrevRules;
+	const bool bWriteQuantization = bKeyframe || QuantizationLevel != PrevQuantizationLevel;
+	const bool bSourcesUnchanged = !bKeyframe && CurrentSources == PredictedSources;
+	FrameScratch.Add((bWriteRules ? FrameHasRules : 0) | (bSourcesUnchanged ? FrameSourcesUnchanged : 0)
+		| (bWriteQuantization ? FrameHasQuantization : 0));
+
+	if (bWriteQuantization)
+	{
+		FrameScratch.Add(static_cast<uint8>(QuantizationLevel));
+	}
+
+	if (bWriteRules)
+	{
+		WriteFloat(FrameScratch, Rules.VisionDistance);
+		WriteFloat(FrameScratch, Rules.VisionAngleDegrees);
+		WriteFloat(FrameScratch, Rules.ProximityRadius);
+		WriteFloat(FrameScratch, Rules.ProximityMaxHeight);
+	}
+
+	// Mỗi nguồn được dự đoán bằng nguồn cùng chỉ số ở frame trước; keyframe dự đoán bằng 0
+	if (!bSourcesUnchanged)
+	{
+		WriteVarint(FrameScratch, CurrentSources.Num());
+		for (int32 Index = 0; Index < CurrentSources.Num(); ++Index)
+		{
+			const FOBReplayQuantizedSource& Source = CurrentSources[Index];
+			const FOBReplayQuantizedSource Predicted = !bKeyframe && PredictedSources.IsValidIndex(Index)
+				                                          ? PredictedSources[Index]
+				                                          : FOBReplayQuantizedSource();
+			WriteVector(FrameScratch, Source.Eye, Predicted.Eye);
+			WriteVector(FrameScratch, Source.Forward, Predicted.Forward);
+			WriteVector(FrameScratch, Source.GroundOffset, Predicted.GroundOffset);
+		}
+	}
+
+	if (bKeyframe)
+	{
+		WriteIdList(FrameScratch, CurrentActors);
+		return;
+	}
+
+	// Frame delta chỉ ghi các actor rời khỏi và đi vào hình nón (hai danh sách đã sắp xếp được trộn một lượt)
+	TArray<int32, TInlineAllocator<32>> Removed;
+	TArray<int32, TInlineAllocator<32>> Added;
+	int32 PrevIndex = 0;
+	int32 CurrentIndex = 0;
+	while (PrevIndex < PrevActors.Num() || CurrentIndex < CurrentActors.Num())
+	{
+		if (CurrentIndex == CurrentActors.Num()
+			|| (PrevIndex < PrevActors.Num() && PrevActors[PrevIndex] < CurrentActors[CurrentIndex]))
+		{
+			Removed.Add(PrevActors[PrevIndex++]);
+		}
+		else if (PrevIndex == PrevActors.Num() || CurrentActors[CurrentIndex] < PrevActors[PrevIndex])
+		{
+			Added.Add(CurrentActors[CurrentIndex++]);
+		}
+		else
+		{
+			++PrevIndex;
+			++CurrentIndex;
+		}
+	}
+	WriteIdList(FrameScratch, Removed);
+	WriteIdList(FrameScratch, Added);
+}
+
+bool FOBVisibilityReplayReader::Open(TArray<uint8> InData)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	Data = MoveTemp(InData);
+	ActorNames.Reset();
+	Keyframes.Reset();
+	Gaps.Reset();
+	NumFrames = 0;
+	NumFramesDropped = 0;
+	EndTimeMs = 0;
+	ReadOffset = HeaderSize;
+	FrameTimeMs = 0;
+	QuantizationLevel = 0;
+	bHasFrame = false;
+	Sources.Reset();
+	Frame = FOBVisibilityReplayFrame();
+
+	FByteReader Header{Data.GetData(), Data.Num(), 0};
+	const uint32 Magic = Header.ReadUint32();
+	const uint32 Version = Header.ReadUint32();
+	if (Header.bError || Magic != StreamMagic || Version < 1 || Version > StreamVersion)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FOBVisibilityReplayReader: Luồng replay không hợp lệ (phiên bản %u)."), Version);
+		Data.Reset();
+		return false;
+	}
+
+	// Quét một lượt: tên actor, khoảng trống, chỉ mục keyframe và số frame.
+	// Bản ghi hỏng hoặc bị cắt ngang kết thúc luồng
+	int32 Offset = HeaderSize;
+	int64 TimeMs = 0;
+	while (Offset < Data.Num())
+	{
+		FByteReader Reader{Data.GetData(), Data.Num(), Offset};
+		const ERecordTag Tag = static_cast<ERecordTag>(Reader.ReadByte());
+		if (Tag == ERecordTag::ActorName)
+		{
+			const uint64 ActorId = Reader.ReadVarint();
+			const uint64 Length = Reader.ReadVarint();
+			if (Reader.bError || ActorId >= static_cast<uint64>(Data.Num())
+				|| Length > static_cast<uint64>(Reader.End - Reader.Offset))
+			{
+				break;
+			}
+			const int32 NameIndex = static_cast<int32>(ActorId);
+			if (ActorNames.Num() <= NameIndex)
+			{
+				ActorNames.SetNum(NameIndex + 1);
+			}
+			ActorNames[NameIndex] = FString(FUTF8ToTCHAR(reinterpret_cast<const ANSICHAR*>(Data.GetData() + Reader.Offset),
+			                                           static_cast<int32>(Length)));
+			Offset = Reader.Offset + static_cast<int32>(Length);
+			continue;
+		}
+
+		if (Tag == ERecordTag::Gap)
+		{
+			const uint64 NumDropped = Reader.ReadVarint();
+			const int64 GapStartMs = Reader.ReadSigned();
+			const int64 GapDurationMs = Reader.ReadSigned();
+			if (Reader.bError || NumDropped > static_cast<uint64>(MAX_int32 - NumFramesDropped))
+			{
+				break;
+			}
+			Gaps.Add({GapStartMs / 1000.0, (GapStartMs + GapDurationMs) / 1000.0, static_cast<int32>(NumDropped)});
+			NumFramesDropped += static_cast<int32>(NumDropped);
+			Offset = Reader.Offset;
+			continue;
+		}
+
+		if (Tag != ERecordTag::Keyframe && Tag != ERecordTag::DeltaFrame)
+		{
+			break;
+		}
+		const uint64 Length = Reader.ReadVarint();
+		if (Reader.bError || Length > static_cast<uint64>(Reader.End - Reader.Offset)
+			|| (Tag == ERecordTag::DeltaFrame && Keyframes.IsEmpty()))
+		{
+			break;
+		}
+
+		FByteReader Payload{Data.GetData(), Reader.Offset + static_cast<int32>(Length), Reader.Offset};
+		const int64 TimeField = Payload.ReadSigned();
+		TimeMs = Tag == ERecordTag::Keyframe ? TimeField : TimeMs + TimeField;
+		if (Tag == ERecordTag::Keyframe)
+		{
+			Keyframes.Add({TimeMs, Offset});
+		}
+		++NumFrames;
+		EndTimeMs = TimeMs;
+		Offset = Payload.End;
+	}
+
+	// Phần sau bản ghi đầy đủ cuối cùng không bao giờ được đọc
+	Data.SetNum(Offset);
+
+	if (!Gaps.IsEmpty())
+	{
+		UE_LOG(LogTemp, Warning,
+		       TEXT("FOBVisibilityReplayReader: Thiếu %d frame trong %d khoảng trống (vượt ngân sách)."),
+		       NumFramesDropped, Gaps.Num());
+	}
+	return true;
+}
+
+int32 FOBVisibilityReplayReader::SkipToFrameRecord(int32 Offset, int32* OutNumFramesDropped) const
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	// Tên actor và khoảng trống đã được đọc hết trong Open
+	while (Offset < Data.Num())
+	{
+		FByteReader Reader{Data.GetData(), Data.Num(), Offset};
+		const ERecordTag Tag = static_cast<ERecordTag>(Reader.ReadByte());
+		if (Tag == ERecordTag::ActorName)
+		{
+			Reader.ReadVarint();
+			const int32 Length = static_cast<int32>(Reader.ReadVarint());
+			Offset = Reader.Offset + Length;
+		}
+		else if (Tag == ERecordTag::Gap)
+		{
+			const int32 NumDropped = static_cast<int32>(Reader.ReadVarint());
+			Reader.ReadSigned();
+			Reader.ReadSigned();
+			if (OutNumFramesDropped)
+			{
+				*OutNumFramesDropped += NumDropped;
+			}
+			Offset = Reader.Offset;
+		}
+		else
+		{
+			return Offset;
+		}
+	}
+	return INDEX_NONE;
+}
+
+int32 FOBVisibilityReplayReader::DecodeFrameRecord(const int32 Offset)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	FByteReader Reader{Data.GetData(), Data.Num(), Offset};
+	const bool bKeyframe = static_cast<ERecordTag>(Reader.ReadByte()) == ERecordTag::Keyframe;
+	const int32 Length = static_cast<int32>(Reader.ReadVarint());
+	if (!bKeyframe && !bHasFrame)
+	{
+		return INDEX_NONE;
+	}
+
+	// Open đã kiểm tra độ dài của mọi bản ghi còn lại trong Data
+	FByteReader Payload{Data.GetData(), Reader.Offset + Length, Reader.Offset};
+	const int64 TimeField = Payload.ReadSigned();
+	FrameTimeMs = bKeyframe ? TimeField : FrameTimeMs + TimeField;
+
+	const uint8 Flags = Payload.ReadByte();
+	int32 Level = bKeyframe ? 0 : QuantizationLevel;
+	if (Flags & FrameHasQuantization)
+	{
+		Level = Payload.ReadByte();
+		if (Level > FOBVisibilityReplayWriter::MaxQuantizationLevel)
+		{
+			return INDEX_NONE;
+		}
+	}
+
+	// Mức đổi giữa hai frame delta: đổi giá trị dự đoán sang mức mới giống hệt writer, kể cả khi nguồn không đổi
+	if (!bKeyframe && Level != QuantizationLevel)
+	{
+		for (int32 Index = 0; Index < Sources.Num(); ++Index)
+		{
+			Sources[Index] = RescaleSource(Sources[Index], QuantizationLevel, Level);
+			DequantizeSource(Sources[Index], Level, Frame.Sources[Index]);
+		}
+	}
+	QuantizationLevel = Level;
+
+	if (Flags & FrameHasRules)
+	{
+		Frame.Rules.VisionDistance = Payload.ReadFloat();
+		Frame.Rules.VisionAngleDegrees = Payload.ReadFloat();
+		Frame.Rules.ProximityRadius = Payload.ReadFloat();
+		Frame.Rules.ProximityMaxHeight = Payload.ReadFloat();
+	}
+
+	if (!(Flags & FrameSourcesUnchanged))
+	{
+		// Mỗi nguồn tốn ít nhất 9 byte
+		const uint64 NumSources = Payload.ReadVarint();
+		if (NumSources > static_cast<uint64>(Payload.End - Payload.Offset) / 9)
+		{
+			return INDEX_NONE;
+		}
+
+		const int32 NumPredicted = bKeyframe ? 0 : Sources.Num();
+		Sources.SetNum(static_cast<int32>(NumSources));
+		Frame.Sources.SetNum(Sources.Num());
+		for (int32 Index = 0; Index < Sources.Num(); ++Index)
+		{
+			FOBReplayQuantizedSource& Source = Sources[Index];
+			const FOBReplayQuantizedSource Predicted = Index < NumPredicted ? Source : FOBReplayQuantizedSource();
+			Source.Eye = Payload.ReadVector(Predicted.Eye);
+			Source.Forward = Payload.ReadVector(Predicted.Forward);
+			Source.GroundOffset = Payload.ReadVector(Predicted.GroundOffset);
+			DequantizeSource(Source, Level, Frame.Sources[Index]);
+		}
+	}
+
+	if (bKeyframe)
+	{
+		Payload.ReadIdList(Frame.ActorsInCone);
+	}
+	else
+	{
+		// Bỏ các actor đã rời hình nón (cả hai danh sách đều tăng dần), rồi thêm các actor mới
+		Payload.ReadIdList(ActorScratch);
+		int32 RemovedIndex = 0;
+		Frame.ActorsInCone.RemoveAll([this, &RemovedIndex](const int32 ActorId)
+		{
+			while (RemovedIndex < ActorScratch.Num() && ActorScratch[RemovedIndex] < ActorId)
+			{
+				++RemovedIndex;
+			}
+			return RemovedIndex < ActorScratch.Num() && ActorScratch[RemovedIndex] == ActorId;
+		});
+
+		Payload.ReadIdList(ActorScratch);
+		if (!ActorScratch.IsEmpty())
+		{
+			Frame.ActorsInCone.Append(ActorScratch);
+			Frame.ActorsInCone.Sort();
+		}
+	}
+
+	if (Payload.bError)
+	{
+		return INDEX_NONE;
+	}
+
+	Frame.Time = FrameTimeMs / 1000.0;
+	Frame.QuantizationLevel = Level;
+	bHasFrame = true;
+	return Payload.End;
+}
+
+bool FOBVisibilityReplayReader::ReadNextFrame()
+{
+	int32 NumDropped = 0;
+	const int32 RecordOffset = SkipToFrameRecord(ReadOffset, &NumDropped);
+	if (RecordOffset == INDEX_NONE)
+	{
+		return false;
+	}
+
+	const int32 NextOffset = DecodeFrameRecord(RecordOffset);
+	if (NextOffset == INDEX_NONE)
+	{
+		ReadOffset = Data.Num();
+		return false;
+	}
+	ReadOffset = NextOffset;
+	Frame.NumFramesDroppedBefore = NumDropped;
+	return true;
+}
+
+bool FOBVisibilityReplayReader::SeekToTime(const double Time)
+{
+	using namespace OBVisibilityReplayPrivate;
+
+	if (Keyframes.IsEmpty())
+	{
+		return false;
+	}
+
+	// Keyframe cuối cùng không muộn hơn Time (hoặc keyframe đầu tiên nếu Time ở trước luồng)
+	const int64 TargetMs = FMath::RoundToInt64(Time * 1000.0);
+	const int32 KeyframeIndex = FMath::Max(Algo::UpperBoundBy(Keyframes, TargetMs, &FKeyframe::TimeMs) - 1, 0);
+	ReadOffset = Keyframes[KeyframeIndex].Offset;
+	bHasFrame = false;
+	if (!ReadNextFrame())
+	{
+		return false;
+	}
+
+	// Giải mã tiếp tới khi frame kế tiếp muộn hơn Time; chỉ đọc thời điểm của nó để quyết định
+	while (true)
+	{
+		const int32 RecordOffset = SkipToFrameRecord(ReadOffset);
+		if (RecordOffset == INDEX_NONE)
+		{
+			return true;
+		}
+
+		FByteReader Reader{Data.GetData(), Data.Num(), RecordOffset};
+		const bool bKeyframe = static_cast<ERecordTag>(Reader.ReadByte()) == ERecordTag::Keyframe;
+		Reader.ReadVarint();
+		const int64 TimeField = Reader.ReadSigned();
+		if ((bKeyframe ? TimeField : FrameTimeMs + TimeField) > TargetMs)
+		{
+			return true;
+		}
+		if (!ReadNextFrame())
+		{
+			return true;
+		}
+	}
+}
+
+void FOBVisibilityReplayReader::EvaluateLocations(const FOBStealthRegistry& Targets, TArray<uint8>& OutRevealed) const
+{
+	Targets.Evaluate(Frame.Sources, Frame.Rules, OutRevealed);
+}
@@ -0,0 +1,266 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionDepthAtlas.h"
+
+#include "OBVisibilityFogStats.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "RHICommandList.h"
+#include "TextureResource.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Atlas Tiles Captured"), STAT_OBFogAtlasTilesCaptured, STATGROUP_OBVisibilityFog);
+
+namespace OBVisionDepthAtlasPrivate
+{
+	// Hướng nhìn và hướng lên của 6 mặt cube; hướng lên của mặt trên/dưới không được song song với hướng nhìn.
+	const FVector CubeFaceForward[6] = {
+		FVector(1, 0, 0), FVector(-1, 0, 0), FVector(0, 1, 0), FVector(0, -1, 0), FVector(0, 0, 1), FVector(0, 0, -1)
+	};
+	const FVector CubeFaceUp[6] = {
+		FVector(0, 0, 1), FVector(0, 0, 1), FVector(0, 0, 1), FVector(0, 0, 1), FVector(-1, 0, 0), FVector(1, 0, 0)
+	};
+
+	UTextureRenderTarget2D* CreateDepthTarget(UObject* Outer, const int32 Width, const int32 Height)
+	{
+		UTextureRenderTarget2D* Target = NewObject<UTextureRenderTarget2D>(Outer);
+		// Cùng định dạng cho tile và atlas để CopyTexture không cần chuyển đổi
+		Target->InitCustomFormat(Width, Height, PF_R32_FLOAT, true);
+		Target->UpdateResourceImmediate(true);
+		return Target;
+	}
+}
+
+bool FOBVisionDepthAtlas::Initialize(AActor* Owner, const int32 InTileSize, const int32 InTilesPerRow)
+{
+	using namespace OBVisionDepthAtlasPrivate;
+
+	if (!IsValid(Owner))
+	{
+		return false;
+	}
+
+	Release();
+
+	TileSize = FMath::Clamp(InTileSize, 16, MaxAtlasSize);
+	TilesPerRow = FMath::Clamp(InTilesPerRow, 1, MaxAtlasSize / TileSize);
+	if (TileSize != InTileSize || TilesPerRow != InTilesPerRow)
+	{
+		UE_LOG(LogTemp, Warning,
+		       TEXT("FOBVisionDepthAtlas: atlas %d tile x %d px vượt giới hạn %d px, giảm còn %d tile x %d px"),
+		       InTilesPerRow, InTileSize, MaxAtlasSize, TilesPerRow, TileSize);
+	}
+	const int32 MaxTiles = TilesPerRow * TilesPerRow;
+
+	AtlasTarget = CreateDepthTarget(Owner, TileSize * TilesPerRow, TileSize * TilesPerRow);
+	TileTarget = CreateDepthTarget(Owner, TileSize, TileSize);
+
+	CaptureComponent = NewObject<USceneCaptureComponent2D>(Owner, NAME_None, RF_Transient);
+	CaptureComponent->TextureTarget = TileTarget;
+	CaptureComponent->CaptureSource = SCS_SceneDepth;
+	CaptureComponent->ProjectionType = ECameraProjectionMode::Perspective;
+	CaptureComponent->bCaptureEveryFrame = false;
+	CaptureComponent->bCaptureOnMovement = false;
+	// Capture phải được render ngay để lệnh copy theo sau đọc đúng nội dung của tile
+	CaptureComponent->bRenderInMainRenderer = false;
+	CaptureComponent->SetUsingAbsoluteLocation(true);
+	CaptureComponent->SetUsingAbsoluteRotation(true);
+	CaptureComponent->RegisterComponent();
+
+	Tiles.Reset();
+	Tiles.AddDefaulted(MaxTiles);
+	NumActiveTiles = 0;
+	RoundRobinCursor = 0;
+	bTileDataDirty = true;
+
+	return AtlasTarget && TileTarget && TileDataBuffer.InitializeTexels(MaxTiles, TexelsPerTile);
+}
+
+void FOBVisionDepthAtlas::Release()
+{
+	if (CaptureComponent)
+	{
+		CaptureComponent->DestroyComponent();
+		CaptureComponent = nullptr;
+	}
+	AtlasTarget = nullptr;
+	TileTarget = nullptr;
+	Tiles.Reset();
+	NumActiveTiles = 0;
+}
+
+FMatrix FOBVisionDepthAtlas::ComputeTileViewProjection(const FVector& EyeLocation, const FVector& ForwardVector,
+                                                       const FVector& UpVector, const float FOVDegrees,
+                                                       const float Distance)
+{
+	const FMatrix ViewMatrix = FLookFromMatrix(EyeLocation, ForwardVector, UpVector);
+	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(FMath::DegreesToRadians(FOVDegrees) * 0.5f, 1.0f,
+	                                                             1.0f, Distance);
+	return ViewMatrix * ProjectionMatrix;
+}
+
+int32 FOBVisionDepthAtlas::Update(const TConstArrayView<FOBDepthAtlasSource> Sources, const FOBVisionRules& Rules,
+                                  const int32 MaxCapturesPerFrame)
+{
+	using namespace OBVisionDepthAtlasPrivate;
+
+	if (!IsInitialized())
+	{
+		return 0;
+	}
+
+	LLM_SCOPE_BYTAG(OBVisibilityFog);
+	TRACE_CPUPROFILER_EVENT_SCOPE(OBFog_DepthAtlasUpdate);
+
+	// --- GÁN TILE: mỗi nguồn một tile phối cảnh hoặc 6 tile cube, theo thứ tự nguồn ---
+	const bool bWideVision = Rules.VisionAngleDegrees > MaxPerspectiveTileAngle;
+	int32 NumTiles = 0;
+	for (int32 SourceIndex = 0; SourceIndex < Sources.Num(); ++SourceIndex)
+	{
+		const FOBDepthAtlasSource& Source = Sources[SourceIndex];
+		const int32 NumFaces = Source.bOmnidirectional || bWideVision ? 6 : 1;
+		if (NumTiles + NumFaces > Tiles.Num())
+		{
+			break;
+		}
+
+		for (int32 FaceIndex = 0; FaceIndex < NumFaces; ++FaceIndex)
+		{
+			FTile& Tile = Tiles[NumTiles++];
+			const int32 Face = NumFaces == 6 ? FaceIndex : INDEX_NONE;
+			// Nguồn không có Owner chỉ được nhận diện qua chỉ số của nó
+			const int32 SourceKey = Source.Owner ? INDEX_NONE : SourceIndex;
+			if (Tile.Owner != Source.Owner || Tile.SourceKey != SourceKey || Tile.Face != Face)
+			{
+				Tile.Owner = Source.Owner;
+				Tile.SourceKey = SourceKey;
+				Tile.Face = Face;
+				Tile.bCaptured = false;
+				bTileDataDirty = true;
+			}
+			if (Tile.SourceIndex != SourceIndex)
+			{
+				Tile.SourceIndex = SourceIndex;
+				bTileDataDirty = true;
+			}
+		}
+	}
+	if (NumTiles != NumActiveTiles)
+	{
+		NumActiveTiles = NumTiles;
+		RoundRobinCursor = NumActiveTiles > 0 ? RoundRobinCursor % NumActiveTiles : 0;
+		bTileDataDirty = true;
+	}
+
+	// --- CAPTURE: tile chưa có dữ liệu trước, phần ngân sách còn lại xoay vòng ---
+	int32 NumCaptures = 0;
+	auto Capture = [&](const int32 TileIndex)
+	{
+		const float FOV = Tiles[TileIndex].Face == INDEX_NONE
+			                  ? FMath::Min(Rules.VisionAngleDegrees, MaxPerspectiveTileAngle)
+			                  : 90.0f;
+		CaptureTile(TileIndex, Sources[Tiles[TileIndex].SourceIndex], FOV, Rules.VisionDistance);
+		++NumCaptures;
+	};
+
+	for (int32 TileIndex = 0; TileIndex < NumActiveTiles && NumCaptures < MaxCapturesPerFrame; ++TileIndex)
+	{
+		if (!Tiles[TileIndex].bCaptured)
+		{
+			Capture(TileIndex);
+		}
+	}
+	for (int32 Step = 0; Step < NumActiveTiles && NumCaptures < MaxCapturesPerFrame; ++Step)
+	{
+		const int32 TileIndex = (RoundRobinCursor + Step) % NumActiveTiles;
+		if (Tiles[TileIndex].LastCaptureFrame != GFrameCounter)
+		{
+			Capture(TileIndex);
+			RoundRobinCursor = (TileIndex + 1) % NumActiveTiles;
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_OBFogAtlasTilesCaptured, NumCaptures);
+
+	// --- UPLOAD: ma trận tại lần capture của từng tile, chỉ khi có thay đổi ---
+	if (bTileDataDirty)
+	{
+		TileTexels.Reset();
+		TileTexels.AddUninitialized(FMath::Max(NumActiveTiles, 1) * TexelsPerTile);
+		FMemory::Memzero(TileTexels.GetData(), TileTexels.Num() * sizeof(FLinearColor));
+		for (int32 TileIndex = 0; TileIndex < NumActiveTiles; ++TileIndex)
+		{
+			const FTile& Tile = Tiles[TileIndex];
+			FLinearColor* Texels = &TileTexels[TileIndex * TexelsPerTile];
+			for (int32 Row = 0; Row < 4; ++Row)
+			{
+				Texels[Row] = FLinearColor(Tile.ViewProjection.M[Row][0], Tile.ViewProjection.M[Row][1],
+				                           Tile.ViewProjection.M[Row][2], Tile.ViewProjection.M[Row][3]);
+			}
+			Texels[4] = FLinearColor(TileIndex % TilesPerRow, TileIndex / TilesPerRow, Tile.SourceIndex,
+			                         Tile.bCaptured ? 1.0f : 0.0f);
+		}
+		TileDataBuffer.UploadTexels(TileTexels);
+		bTileDataDirty = false;
+	}
+
+	return NumCaptures;
+}
+
+void FOBVisionDepthAtlas::CaptureTile(const int32 TileIndex, const FOBDepthAtlasSource& Source, const float FOVDegrees,
+                                      const float Distance)
+{
+	using namespace OBVisionDepthAtlasPrivate;
+
+	FTile& Tile = Tiles[TileIndex];
+	const FVector Forward = Tile.Face == INDEX_NONE ? Source.Data.ForwardVector.GetSafeNormal() : CubeFaceForward[Tile.Face];
+	// Hướng lên của tile phối cảnh là trục Z của world, giống depth capture chính
+	const FVector Up = Tile.Face == INDEX_NONE
+		                   ? (FMath::Abs(Forward.Z) > 0.99f ? FVector::ForwardVector : FVector::UpVector)
+		                   : CubeFaceUp[Tile.Face];
+
+	CaptureComponent->SetWorldLocationAndRotation(Source.Data.EyeLocation, FRotationMatrix::MakeFromXZ(Forward, Up).Rotator());
+	CaptureComponent->FOVAngle = FOVDegrees;
+	CaptureComponent->HiddenActors.Reset();
+	if (Source.Owner)
+	{
+		CaptureComponent->HiddenActors.Add(Source.Owner);
+	}
+	CaptureComponent->CaptureScene();
+
+	Tile.ViewProjection = ComputeTileViewProjection(Source.Data.EyeLocation, Forward, Up, FOVDegrees, Distance);
+	Tile.LastCaptureFrame = GFrameCounter;
+	Tile.bCaptured = true;
+	bTileDataDirty = true;
+
+	// Copy tile vừa render vào đúng ô của atlas, sau lệnh render của CaptureScene trên Render Thread
+	FTextureRenderTargetResource* SourceResource = TileTarget->GameThread_GetRenderTargetResource();
+	FTextureRenderTargetResource* DestResource = AtlasTarget->GameThread_GetRenderTargetResource();
+	if (!SourceResource || !DestResource)
+	{
+		return;
+	}
+
+	const FIntVector DestPosition((TileIndex % TilesPerRow) * TileSize, (TileIndex / TilesPerRow) * TileSize, 0);
+	const int32 Size = TileSize;
+	ENQUEUE_RENDER_COMMAND(OBCopyDepthAtlasTile)(
+		[SourceResource, DestResource, DestPosition, Size](FRHICommandListImmediate& RHICmdList)
+		{
+			FRHITexture* SourceTexture = SourceResource->GetRenderTargetTexture();
+			FRHITexture* DestTexture = DestResource->GetRenderTargetTexture();
+
+			FRHICopyTextureInfo CopyInfo;
+			CopyInfo.Size = FIntVector(Size, Size, 1);
+			CopyInfo.DestPosition = DestPosition;
+
+			RHICmdList.Transition({
+				FRHITransitionInfo(SourceTexture, ERHIAccess::Unknown, ERHIAccess::CopySrc),
+				FRHITransitionInfo(DestTexture, ERHIAccess::Unknown, ERHIAccess::CopyDest)
+			});
+			RHICmdList.CopyTexture(SourceTexture, DestTexture, CopyInfo);
+			RHICmdList.Transition({
+				FRHITransitionInfo(SourceTexture, ERHIAccess::CopySrc, ERHIAccess::SRVMask),
+				FRHITransitionInfo(DestTexture, ERHIAccess::CopyDest, ERHIAccess::SRVMask)
+			});
+		}
+	);
+}
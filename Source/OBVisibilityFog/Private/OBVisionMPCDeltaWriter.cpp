@@ -0,0 +1,105 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionMPCDeltaWriter.h"
+
+#include "Engine/World.h"
+#include "Materials/MaterialParameterCollection.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
+
+namespace OBVisionMPCDeltaWriterPrivate
+{
+	const FName& GetVectorParamName(const FOBVisionMPCDeltaWriter::EVectorParam Param)
+	{
+		static const FName Names[FOBVisionMPCDeltaWriter::NumVectorParams] = {
+			FName("MatrixRow0"), FName("MatrixRow1"), FName("MatrixRow2"), FName("MatrixRow3"),
+			FName("PlayerPosition"), FName("PlayerForwardVector"), FName("PlayerGroundPosition"),
+			FName("CurrentMatrixRow0"), FName("CurrentMatrixRow1"), FName("CurrentMatrixRow2"),
+			FName("CurrentMatrixRow3"), FName("CaptureEyePosition")
+		};
+		return Names[Param];
+	}
+
+	const FName& GetScalarParamName(const FOBVisionMPCDeltaWriter::EScalarParam Param)
+	{
+		static const FName Names[FOBVisionMPCDeltaWriter::NumScalarParams] = {
+			FName("VisionConeCosine"), FName("VisionMaxDistance"), FName("ProximityRadius"), FName("ProximityMaxHeight")
+		};
+		return Names[Param];
+	}
+}
+
+bool FOBVisionMPCDeltaWriter::Initialize(UWorld* World, UMaterialParameterCollection* Collection)
+{
+	using namespace OBVisionMPCDeltaWriterPrivate;
+
+	Instance = World && Collection ? World->GetParameterCollectionInstance(Collection) : nullptr;
+	if (!Instance.IsValid())
+	{
+		return false;
+	}
+
+	// Tham số không có trong collection sẽ bị bỏ qua thay vì tra cứu (và cảnh báo) mỗi frame
+	for (int32 Index = 0; Index < NumVectorParams; ++Index)
+	{
+		const EVectorParam Param = static_cast<EVectorParam>(Index);
+		VectorSlots[Index] = TSlot<FLinearColor>();
+		VectorSlots[Index].bExists = Collection->GetVectorParameterByName(GetVectorParamName(Param)) != nullptr;
+	}
+	for (int32 Index = 0; Index < NumScalarParams; ++Index)
+	{
+		const EScalarParam Param = static_cast<EScalarParam>(Index);
+		ScalarSlots[Index] = TSlot<float>();
+		ScalarSlots[Index].bExists = Collection->GetScalarParameterByName(GetScalarParamName(Param)) != nullptr;
+	}
+	return true;
+}
+
+void FOBVisionMPCDeltaWriter::SetMatrix(const FMatrix& Matrix, const EVectorParam FirstRow)
+{
+	for (int32 Row = 0; Row < 4; ++Row)
+	{
+		SetVector(static_cast<EVectorParam>(FirstRow + Row),
+		          FLinearColor(Matrix.M[Row][0], Matrix.M[Row][1], Matrix.M[Row][2], Matrix.M[Row][3]));
+	}
+}
+
+int32 FOBVisionMPCDeltaWriter::WriteChanged()
+{
+	using namespace OBVisionMPCDeltaWriterPrivate;
+
+	UMaterialParameterCollectionInstance* CollectionInstance = Instance.Get();
+	if (!CollectionInstance)
+	{
+		return 0;
+	}
+
+	// Collection instance chỉ đẩy dữ liệu sang Render Thread một lần ở cuối frame dù được ghi bao nhiêu lần,
+	// nên phần tiết kiệm được là các lời gọi cho giá trị không đổi và việc frame tĩnh không làm nó bị dirty.
+	int32 NumWritten = 0;
+	for (int32 Index = 0; Index < NumVectorParams; ++Index)
+	{
+		TSlot<FLinearColor>& Slot = VectorSlots[Index];
+		if (Slot.bExists && Slot.bStaged && (!Slot.bCommitted || Slot.Staged != Slot.Committed))
+		{
+			CollectionInstance->SetVectorParameterValue(GetVectorParamName(static_cast<EVectorParam>(Index)),
+			                                            Slot.Staged);
+			Slot.Committed = Slot.Staged;
+			Slot.bCommitted = true;
+			++NumWritten;
+		}
+	}
+	for (int32 Index = 0; Index < NumScalarParams; ++Index)
+	{
+		TSlot<float>& Slot = ScalarSlots[Index];
+		if (Slot.bExists && Slot.bStaged && (!Slot.bCommitted || Slot.Staged != Slot.Committed))
+		{
+			CollectionInstance->SetScalarParameterValue(GetScalarParamName(static_cast<EScalarParam>(Index)),
+			                                            Slot.Staged);
+			Slot.Committed = Slot.Staged;
+			Slot.bCommitted = true;
+			++NumWritten;
+		}
+	}
+	return NumWritten;
+}
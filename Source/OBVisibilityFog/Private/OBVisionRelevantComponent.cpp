@@ -0,0 +1,26 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionRelevantComponent.h"
+
+#include "OBVisibilityFogSubsystem.h"
+
+void UOBVisionRelevantComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->RegisterVisionRelevantActor(GetOwner());
+	}
+}
+
+void UOBVisionRelevantComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->UnregisterVisionRelevantActor(GetOwner());
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,47 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionReprojection.h"
+
+namespace OBVisionReprojectionPrivate
+{
+	// Clip space -> UV của render target, cùng quy ước với shader (V hướng xuống).
+	bool ClipToUV(const FVector4& Clip, FVector2D& OutUV, float& OutDeviceZ)
+	{
+		if (Clip.W <= UE_SMALL_NUMBER)
+		{
+			return false;
+		}
+
+		const FVector4::FReal InvW = 1.0 / Clip.W;
+		const FVector4::FReal NdcX = Clip.X * InvW;
+		const FVector4::FReal NdcY = Clip.Y * InvW;
+		OutDeviceZ = static_cast<float>(Clip.Z * InvW);
+		OutUV = FVector2D(NdcX * 0.5 + 0.5, 0.5 - NdcY * 0.5);
+
+		// Chỉ giới hạn theo XY: ma trận reversed-Z của ComputeVisionViewProjection không có far plane và đặt
+		// near plane ở VisionDistance, nên DeviceZ > 1 với mọi điểm gần hơn VisionDistance
+		return FMath::Abs(NdcX) <= 1.0 && FMath::Abs(NdcY) <= 1.0;
+	}
+}
+
+bool FOBVisionReprojection::ProjectToUV(const FMatrix& ViewProjection, const FVector& WorldLocation,
+                                        FVector2D& OutUV, float& OutDeviceZ)
+{
+	return OBVisionReprojectionPrivate::ClipToUV(ViewProjection.TransformFVector4(FVector4(WorldLocation, 1.0)),
+	                                             OutUV, OutDeviceZ);
+}
+
+FMatrix FOBVisionReprojection::ComputeCurrentToCaptured(const FMatrix& CurrentViewProjection,
+                                                        const FMatrix& CapturedViewProjection)
+{
+	// Quy ước vector hàng của FMatrix: Clip = World * VP, nên World = Clip * Inverse(VP)
+	return CurrentViewProjection.Inverse() * CapturedViewProjection;
+}
+
+bool FOBVisionReprojection::ReprojectClipToCapturedUV(const FMatrix& CurrentToCaptured, const FVector4& CurrentClip,
+                                                      FVector2D& OutUV)
+{
+	float DeviceZ;
+	return OBVisionReprojectionPrivate::ClipToUV(CurrentToCaptured.TransformFVector4(CurrentClip), OutUV, DeviceZ);
+}
@@ -0,0 +1,230 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionSourceBuffer.h"
+
+#include "OBVisibilityFogStats.h"
+#include "Engine/Texture2D.h"
+#include "Math/Float16.h"
+#include "Rendering/Texture2DResource.h"
+
+namespace OBVisionSourceBufferPrivate
+{
+	// Mã hóa vector đơn vị sang tọa độ bát diện trong [-1, 1]^2.
+	FVector2f EncodeOctahedron(const FVector& Direction)
+	{
+		const FVector3f N = FVector3f(Direction.GetSafeNormal());
+		const float L1Norm = FMath::Abs(N.X) + FMath::Abs(N.Y) + FMath::Abs(N.Z);
+		if (L1Norm <= UE_SMALL_NUMBER)
+		{
+			return FVector2f::ZeroVector;
+		}
+
+		FVector2f Oct(N.X / L1Norm, N.Y / L1Norm);
+		if (N.Z < 0.0f)
+		{
+			Oct = FVector2f((1.0f - FMath::Abs(Oct.Y)) * (Oct.X >= 0.0f ? 1.0f : -1.0f),
+			                (1.0f - FMath::Abs(Oct.X)) * (Oct.Y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return Oct;
+	}
+
+	// Lượng tử hóa một trục vị trí thành số nguyên có dấu PositionBits bit.
+	uint64 QuantizeAxis(const double Value)
+	{
+		constexpr int64 MaxValue = (int64(1) << (FOBVisionSourceBuffer::PositionBits - 1)) - 1;
+		const int64 Quantized = FMath::Clamp<int64>(
+			FMath::RoundToInt64(Value / FOBVisionSourceBuffer::PositionQuantizationStep), -MaxValue, MaxValue);
+		return static_cast<uint64>(Quantized) & ((uint64(1) << FOBVisionSourceBuffer::PositionBits) - 1);
+	}
+}
+
+bool FOBVisionSourceBuffer::Initialize(const int32 InMaxSources, const int32 InCapacityLimit,
+                                       const EOBVisionSourceLayout InLayout)
+{
+	Layout = InLayout;
+	return InitializeTexels(InMaxSources, GetTexelsPerSource(Layout), InCapacityLimit);
+}
+
+bool FOBVisionSourceBuffer::InitializeTexels(const int32 InMaxEntries, const int32 InTexelsPerEntry,
+                                             const int32 InCapacityLimit)
+{
+	TexelsPerEntry = FMath::Clamp(InTexelsPerEntry, 1, MaxTextureWidth);
+	const int32 HardLimit = MaxTextureWidth / TexelsPerEntry;
+	MaxSources = FMath::Clamp(InMaxEntries, 1, HardLimit);
+	CapacityLimit = FMath::Clamp(InCapacityLimit, MaxSources, HardLimit);
+	StagingRing = MakeShared<TOBUploadRing<FLinearColor>, ESPMode::ThreadSafe>();
+	return CreateTexture();
+}
+
+bool FOBVisionSourceBuffer::EnsureCapacity(const int32 NumSources)
+{
+	if (NumSources <= MaxSources || MaxSources >= CapacityLimit)
+	{
+		return false;
+	}
+
+	MaxSources = FMath::Min(static_cast<int32>(FMath::RoundUpToPowerOfTwo(NumSources)), CapacityLimit);
+	return CreateTexture();
+}
+
+void FOBVisionSourceBuffer::SetCapacityLimit(const int32 InCapacityLimit)
+{
+	CapacityLimit = FMath::Clamp(InCapacityLimit, MaxSources, MaxTextureWidth / TexelsPerEntry);
+}
+
+bool FOBVisionSourceBuffer::CreateTexture()
+{
+	const int32 TextureWidth = MaxSources * TexelsPerEntry;
+	Texture = UTexture2D::CreateTransient(TextureWidth, 1, PF_A32B32G32R32F);
+	if (!Texture)
+	{
+		MaxSources = 0;
+		return false;
+	}
+
+	Texture->UpdateResource();
+	return true;
+}
+
+FVector FOBVisionSourceBuffer::ComputePackOrigin(const TConstArrayView<FTeammateVisionData> Sources)
+{
+	return Sources.IsEmpty() ? FVector::ZeroVector : Sources[0].EyeLocation.GridSnap(100.0);
+}
+
+int32 FOBVisionSourceBuffer::Pack(const EOBVisionSourceLayout Layout,
+                                  const TConstArrayView<FTeammateVisionData> Sources, const int32 MaxSources,
+                                  const FVector& Origin, TArray<FLinearColor>& OutData)
+{
+	using namespace OBVisionSourceBufferPrivate;
+
+	const int32 NumSources = FMath::Min(Sources.Num(), MaxSources);
+	const int32 TexelsPerSource = GetTexelsPerSource(Layout);
+	// Reset giữ lại bộ nhớ đã cấp phát, kể cả khi số nguồn giảm
+	OutData.Reset();
+	if (NumSources == 0)
+	{
+		// Giữ ít nhất một nguồn rỗng để lệnh upload luôn có vùng hợp lệ
+		OutData.AddZeroed(TexelsPerSource);
+		return 0;
+	}
+	OutData.AddUninitialized(NumSources * TexelsPerSource);
+
+	for (int32 i = 0; i < NumSources; ++i)
+	{
+		const FTeammateVisionData& Source = Sources[i];
+		if (Layout == EOBVisionSourceLayout::Legacy)
+		{
+			// Dữ liệu 1: Vị trí mắt (XYZ), Vị trí mặt đất (W là Z)
+			OutData[i * TexelsPerSource + 0] = FLinearColor(Source.EyeLocation.X, Source.EyeLocation.Y,
+			                                                Source.EyeLocation.Z, Source.GroundLocation.Z);
+			// Dữ liệu 2: Hướng nhìn (XYZ)
+			OutData[i * TexelsPerSource + 1] = FLinearColor(Source.ForwardVector.X, Source.ForwardVector.Y,
+			                                                Source.ForwardVector.Z, 0.0f);
+			continue;
+		}
+
+		// R, G: vị trí mắt lượng tử hóa quanh Origin, 3 trục x 21 bit
+		const FVector LocalEye = Source.EyeLocation - Origin;
+		const uint64 PackedPosition = QuantizeAxis(LocalEye.X)
+			| (QuantizeAxis(LocalEye.Y) << PositionBits)
+			| (QuantizeAxis(LocalEye.Z) << (PositionBits * 2));
+
+		// B: hướng nhìn dạng bát diện, 2 x half-precision
+		const FVector2f Oct = EncodeOctahedron(Source.ForwardVector);
+		const uint32 PackedDirection = static_cast<uint32>(FFloat16(Oct.X).Encoded)
+			| (static_cast<uint32>(FFloat16(Oct.Y).Encoded) << 16);
+
+		// A: độ cao của mắt so với mặt đất (16 bit) và cờ hợp lệ (bit 16)
+		const uint32 GroundHeight = static_cast<uint32>(FMath::Clamp<int64>(
+			FMath::RoundToInt64((Source.EyeLocation.Z - Source.GroundLocation.Z) / PositionQuantizationStep), 0,
+			MAX_uint16));
+		const uint32 PackedGround = GroundHeight | (1u << 16);
+
+		// Ghi bit thô vào texel float, shader đọc lại bằng asuint(Load())
+		const uint32 Bits[4] = {
+			static_cast<uint32>(PackedPosition), static_cast<uint32>(PackedPosition >> 32), PackedDirection, PackedGround
+		};
+		FMemory::Memcpy(&OutData[i], Bits, sizeof(Bits));
+	}
+
+	return NumSources;
+}
+
+int32 FOBVisionSourceBuffer::Upload(const TConstArrayView<FTeammateVisionData> Sources)
+{
+	if (!Texture)
+	{
+		return 0;
+	}
+
+	PackOrigin = Layout == EOBVisionSourceLayout::Packed ? ComputePackOrigin(Sources) : FVector::ZeroVector;
+
+	// Đóng gói thẳng vào slot staging kế tiếp, bộ nhớ của slot được giữ lại giữa các frame
+	uint64 Sequence;
+	TArray<FLinearColor>& StagingData = StagingRing->AcquireSlot(Sequence);
+	const int32 NumSources = Pack(Layout, Sources, MaxSources, PackOrigin, StagingData);
+
+	// Chỉ upload phần texture đang được dùng
+	SubmitStaging(Sequence, StagingData.Num());
+	return NumSources;
+}
+
+int32 FOBVisionSourceBuffer::UploadTexels(const TConstArrayView<FLinearColor> Texels)
+{
+	if (!Texture)
+	{
+		return 0;
+	}
+
+	const int32 NumEntries = FMath::Min(Texels.Num() / TexelsPerEntry, MaxSources);
+
+	uint64 Sequence;
+	TArray<FLinearColor>& StagingData = StagingRing->AcquireSlot(Sequence);
+	StagingData.Reset();
+	if (NumEntries == 0)
+	{
+		// Giữ ít nhất một phần tử rỗng để lệnh upload luôn có vùng hợp lệ
+		StagingData.AddZeroed(TexelsPerEntry);
+	}
+	else
+	{
+		StagingData.Append(Texels.GetData(), NumEntries * TexelsPerEntry);
+	}
+
+	SubmitStaging(Sequence, StagingData.Num());
+	return NumEntries;
+}
+
+void FOBVisionSourceBuffer::SubmitStaging(const uint64 Sequence, const int32 UploadWidth)
+{
+	LastUploadBytes = UploadWidth * sizeof(FLinearColor);
+
+	if (FTexture2DResource* TextureResource = static_cast<FTexture2DResource*>(Texture->GetResource()))
+	{
+		OB_FOG_RECORD_UPLOAD_BYTES(LastUploadBytes);
+		// Dữ liệu nằm trong slot của ring, lambda chỉ chép vài giá trị vào lệnh render của engine
+		ENQUEUE_RENDER_COMMAND(UpdateTeamDataTexture)(
+			[TextureResource, Ring = StagingRing, Sequence, UploadWidth](FRHICommandListImmediate& RHICmdList)
+			{
+				const int32 DataSize = UploadWidth * sizeof(FLinearColor);
+				const FUpdateTextureRegion2D Region(0, 0, 0, 0, UploadWidth, 1);
+				RHICmdList.UpdateTexture2D(TextureResource->GetTexture2DRHI(), 0, Region, DataSize,
+				                           reinterpret_cast<const uint8*>(Ring->GetSlot(Sequence).GetData()));
+				// Trả slot lại cho Game Thread sau khi đã đọc xong
+				Ring->MarkConsumed(Sequence);
+			}
+		);
+	}
+	else
+	{
+		// Không gửi được lệnh upload thì vẫn trả slot lại theo đúng thứ tự trên Render Thread
+		ENQUEUE_RENDER_COMMAND(ReleaseTeamDataStaging)(
+			[Ring = StagingRing, Sequence](FRHICommandListImmediate&)
+			{
+				Ring->MarkConsumed(Sequence);
+			}
+		);
+		LastUploadBytes = 0;
+	}
+}
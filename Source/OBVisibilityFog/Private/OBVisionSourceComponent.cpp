@@ -0,0 +1,38 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionSourceComponent.h"
+
+#include "OBVisibilityFogSubsystem.h"
+
+FTeammateVisionData UOBVisionSourceComponent::GetVisionData() const
+{
+	const AActor* OwnerActor = GetOwner();
+
+	FTeammateVisionData Data;
+	Data.EyeLocation = GetComponentLocation();
+	Data.ForwardVector = bUseOwnerForward && OwnerActor ? OwnerActor->GetActorForwardVector() : GetForwardVector();
+	// Cùng giả định mặt đất với người chơi local: vị trí của Owner
+	Data.GroundLocation = OwnerActor ? OwnerActor->GetActorLocation() : Data.EyeLocation;
+	return Data;
+}
+
+void UOBVisionSourceComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->RegisterVisionSourceComponent(this);
+	}
+}
+
+void UOBVisionSourceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UOBVisibilityFogSubsystem* FogSubsystem = GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>())
+	{
+		FogSubsystem->UnregisterVisionSourceComponent(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,180 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBVisionSpatialIndex.h"
+
+#include "Components/PrimitiveComponent.h"
+
+void FOBVisionIndexSemantics::SetElementId(const FOBVisionIndexElement& Element, const FOctreeElementId2 Id)
+{
+	Element.Index->Entries[Element.EntryIndex].ElementId = Id;
+}
+
+FOBVisionCone::FOBVisionCone(const FVector& InEyeLocation, const FVector& InForwardVector,
+                             const float HalfAngleRadians, const float InDistance, const float InMargin)
+	: EyeLocation(InEyeLocation)
+	, ForwardVector(InForwardVector.GetSafeNormal())
+	, CosHalfAngle(FMath::Cos(HalfAngleRadians))
+	, SinHalfAngle(FMath::Sin(HalfAngleRadians))
+	, Distance(InDistance)
+	, Margin(InMargin)
+	, bHemisphereOrWider(HalfAngleRadians >= UE_HALF_PI)
+{
+}
+
+bool FOBVisionCone::IntersectsSphere(const FVector& Center, const FVector::FReal Radius) const
+{
+	const FVector::FReal ExpandedRadius = Radius + Margin;
+	const FVector ToCenter = Center - EyeLocation;
+	const FVector::FReal DistanceSquared = ToCenter.SizeSquared();
+
+	if (DistanceSquared > FMath::Square(Distance + ExpandedRadius))
+	{
+		return false;
+	}
+	if (bHemisphereOrWider || DistanceSquared <= FMath::Square(ExpandedRadius))
+	{
+		return true;
+	}
+
+	// c * cos - a * sin là cận dưới của khoảng cách từ tâm tới mặt bên của hình nón
+	// (a: hình chiếu lên trục, c: khoảng cách tới trục), đúng cả khi tâm nằm sau đỉnh nón
+	const FVector::FReal Along = FVector::DotProduct(ToCenter, ForwardVector);
+	const FVector::FReal Across = FMath::Sqrt(FMath::Max(DistanceSquared - FMath::Square(Along), 0.0));
+	return Across * CosHalfAngle - Along * SinHalfAngle <= ExpandedRadius;
+}
+
+FOBVisionSpatialIndex::FOBVisionSpatialIndex(const FVector::FReal WorldExtent)
+	: Octree(FVector::ZeroVector, WorldExtent)
+{
+}
+
+int32 FOBVisionSpatialIndex::Add(AActor* Actor, UPrimitiveComponent* Component)
+{
+	const int32 EntryIndex = FreeEntries.IsEmpty() ? Entries.AddDefaulted() : FreeEntries.Pop();
+	FEntry& Entry = Entries[EntryIndex];
+	Entry.Actor = Actor;
+	Entry.Component = Component;
+	Entry.bUsed = true;
+	Entry.bDirty = false;
+	++NumEntries;
+
+	Insert(EntryIndex);
+	return EntryIndex;
+}
+
+void FOBVisionSpatialIndex::Remove(const int32 EntryIndex)
+{
+	FEntry& Entry = Entries[EntryIndex];
+	if (!Entry.bUsed)
+	{
+		return;
+	}
+
+	if (Entry.ElementId.IsValidId())
+	{
+		Octree.RemoveElement(Entry.ElementId);
+	}
+	// Entry dirty vẫn nằm trong DirtyEntries, Flush sẽ bỏ qua nó vì bUsed đã tắt
+	Entry = FEntry();
+	FreeEntries.Add(EntryIndex);
+	--NumEntries;
+}
+
+void FOBVisionSpatialIndex::MarkDirty(const int32 EntryIndex)
+{
+	FEntry& Entry = Entries[EntryIndex];
+	if (Entry.bUsed && !Entry.bDirty)
+	{
+		Entry.bDirty = true;
+		DirtyEntries.Add(EntryIndex);
+	}
+}
+
+void FOBVisionSpatialIndex::Flush()
+{
+	for (const int32 EntryIndex : DirtyEntries)
+	{
+		FEntry& Entry = Entries[EntryIndex];
+		if (!Entry.bUsed || !Entry.bDirty)
+		{
+			continue;
+		}
+		if (!Entry.Actor.IsValid() || !Entry.Component.IsValid())
+		{
+			Remove(EntryIndex);
+			continue;
+		}
+
+		Entry.bDirty = false;
+		if (Entry.ElementId.IsValidId())
+		{
+			Octree.RemoveElement(Entry.ElementId);
+			Entry.ElementId = FOctreeElementId2();
+		}
+		Insert(EntryIndex);
+	}
+	DirtyEntries.Reset();
+}
+
+void FOBVisionSpatialIndex::Insert(const int32 EntryIndex)
+{
+	const UPrimitiveComponent* Component = Entries[EntryIndex].Component.Get();
+	if (!Component)
+	{
+		return;
+	}
+
+	const FBoxSphereBounds& Bounds = Component->Bounds;
+	FOBVisionIndexElement Element;
+	Element.Bounds = FBoxCenterAndExtent(Bounds.Origin, Bounds.BoxExtent);
+	Element.SphereCenter = Bounds.Origin;
+	Element.SphereRadius = Bounds.BoxExtent.Size();
+	Element.EntryIndex = EntryIndex;
+	Element.Index = this;
+	Octree.AddElement(Element);
+}
+
+void FOBVisionSpatialIndex::QueryCone(const FOBVisionCone& Cone, TArray<int32>& OutEntries)
+{
+	Flush();
+
+	OutEntries.Reset();
+	int32 NumNodeTests = 0;
+	int32 NumElementTests = 0;
+
+	// Node không chạm hình nón thì cả cây con bị bỏ qua
+	Octree.FindNodesWithPredicate(
+		[&Cone, &NumNodeTests](FOctreeNodeIndex, FOctreeNodeIndex, const FBoxCenterAndExtent& NodeBounds)
+		{
+			++NumNodeTests;
+			const FBox NodeBox = NodeBounds.GetBox();
+			return Cone.IntersectsSphere(NodeBox.GetCenter(), NodeBox.GetExtent().Size());
+		},
+		[this, &Cone, &NumElementTests, &OutEntries](FOctreeNodeIndex, const FOctreeNodeIndex NodeIndex,
+		                                             const FBoxCenterAndExtent&)
+		{
+			for (const FOBVisionIndexElement& Element : Octree.GetElementsForNode(NodeIndex))
+			{
+				++NumElementTests;
+				if (!Cone.IntersectsSphere(Element.SphereCenter, Element.SphereRadius))
+				{
+					continue;
+				}
+
+				// Không sửa octree trong lúc duyệt: entry đã chết chỉ được đánh dấu, Flush kế tiếp sẽ bỏ nó
+				const FEntry& Entry = Entries[Element.EntryIndex];
+				if (Entry.Actor.IsValid() && Entry.Component.IsValid())
+				{
+					OutEntries.Add(Element.EntryIndex);
+				}
+				else
+				{
+					MarkDirty(Element.EntryIndex);
+				}
+			}
+		});
+
+	LastNumNodeTests = NumNodeTests;
+	LastNumElementTests = NumElementTests;
+}
@@ -0,0 +1,97 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FOBVisibilityGrid;
+
+/**
+ * @class FOBExploredLayer
+ * @brief Lớp "đã khám phá" (shroud) của một team: mọi ô từng được nhìn thấy trên FOBVisibilityGrid.
+ *
+ * Lưới được chia thành các tile 64x64 ô, khớp với word 64 bit của FOBVisibilityGrid nên mỗi hàng của tile
+ * được cộng dồn bằng một phép OR. Chỉ tile đã có ô được khám phá mới chiếm bộ nhớ (512 byte), tile đã khám phá
+ * toàn bộ được giải phóng và chỉ còn là một cờ, nên bộ nhớ tỉ lệ với đường biên của vùng đã đi qua
+ * chứ không phải kích thước bản đồ.
+ */
+class OBVISIBILITYFOG_API FOBExploredLayer
+{
+public:
+	// Kích thước cạnh của một tile (ô), bằng số bit trong một word của FOBVisibilityGrid.
+	static constexpr int32 TileSize = 64;
+
+	/** Xóa toàn bộ trạng thái và khớp kích thước với lưới tầm nhìn. */
+	void Initialize(const FOBVisibilityGrid& Grid);
+
+	/**
+	 * Cộng dồn các ô đang được nhìn thấy trong vùng Rect (tọa độ ô) của lưới.
+	 * @return Số tile có ô mới được khám phá.
+	 */
+	int32 Accumulate(const FOBVisibilityGrid& Grid, const FIntRect& Rect);
+
+	/** Ô đã từng được nhìn thấy chưa. Ngoài lưới luôn trả về false. */
+	bool IsCellExplored(const FIntPoint& Cell) const;
+
+	/** Lấy và xóa danh sách tile (chỉ số tuyến tính) có thay đổi kể từ lần gọi trước. */
+	void ConsumeDirtyTiles(TArray<int32>& OutTiles);
+
+	/** Vùng ô của một tile, đã cắt theo kích thước lưới. */
+	FIntRect GetTileRect(int32 TileIndex) const;
+
+	/** Ghi vùng Rect (nằm trong một tile) thành 1 byte mỗi ô (0 hoặc 255) vào cuối OutBytes. */
+	void AppendRectBytes(const FIntRect& Rect, TArray<uint8>& OutBytes) const;
+
+	/**
+	 * Lưu/nạp lớp đã khám phá. Chỉ các tile đã khám phá được ghi, mỗi tile chọn dạng nhỏ hơn giữa bitmap thô
+	 * và run-length theo bit, nên kích thước file tỉ lệ với độ phức tạp của vùng đã khám phá.
+	 * Khi nạp, dữ liệu được OR vào trạng thái hiện tại và mọi tile được nạp đều bị đánh dấu dirty.
+	 * Dữ liệu có kích thước lưới khác sẽ bị bỏ qua.
+	 */
+	void Serialize(FArchive& Ar);
+
+	bool IsInitialized() const { return !TileSlots.IsEmpty(); }
+	const FIntPoint& GetDimensions() const { return Dimensions; }
+	int32 GetNumAllocatedTiles() const { return Tiles.Num() - FreeTiles.Num(); }
+	SIZE_T GetAllocatedSize() const
+	{
+		return TileSlots.GetAllocatedSize() + Tiles.GetAllocatedSize() + FreeTiles.GetAllocatedSize()
+			+ DirtyTiles.GetAllocatedSize() + DirtyFlags.GetAllocatedSize();
+	}
+
+private:
+	// 64 hàng, mỗi hàng 64 ô.
+	struct FTile
+	{
+		uint64 Rows[TileSize];
+	};
+
+	// Giá trị đặc biệt của TileSlots.
+	static constexpr int32 EmptyTile = -1;
+	static constexpr int32 FullTile = -2;
+
+	/** Mask các ô hợp lệ trong một hàng của tile (tile ở mép phải có thể không đủ 64 ô). */
+	uint64 GetValidColumnMask(int32 TileX) const;
+
+	/** Số hàng hợp lệ của tile ở hàng tile TileY (tile ở mép dưới có thể không đủ 64 hàng). */
+	int32 GetNumValidRows(int32 TileY) const;
+
+	/** Lấy tile để ghi, cấp phát nếu đang rỗng. nullptr nếu tile đã đầy. */
+	FTile* GetOrAllocateTile(int32 TileIndex);
+
+	/** Giải phóng bộ nhớ của tile nếu mọi ô hợp lệ đã được khám phá. */
+	void CompactTile(int32 TileIndex);
+
+	void MarkTileDirty(int32 TileIndex);
+
+	FIntPoint Dimensions = FIntPoint::ZeroValue;
+	FIntPoint NumTiles = FIntPoint::ZeroValue;
+
+	// Mỗi tile của lưới: chỉ số trong Tiles, EmptyTile hoặc FullTile.
+	TArray<int32> TileSlots;
+	TArray<FTile> Tiles;
+	TArray<int32> FreeTiles;
+
+	TArray<int32> DirtyTiles;
+	TBitArray<> DirtyFlags;
+};
@@ -0,0 +1,84 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "UObject/ObjectKey.h"
+#include "WorldCollision.h"
+#include "OBVisibilityFogTypes.h"
+
+/**
+ * @struct FOBVisibilityPolygon
+ * @brief Đa giác tầm nhìn của một nguồn dạng quạt tia: khoảng cách không bị che theo từng góc trên mặt phẳng XY.
+ */
+struct FOBVisibilityPolygon
+{
+	// Vị trí mắt lúc bắn tia.
+	FVector Origin = FVector::ZeroVector;
+	// Góc (radian, quanh trục Z) của tia đầu tiên.
+	float StartYaw = 0.0f;
+	// Khoảng góc giữa hai tia liên tiếp (radian).
+	float YawStep = 0.0f;
+	// Khoảng cách tới vật cản đầu tiên của mỗi tia (hoặc VisionDistance nếu không trúng gì).
+	TArray<float> Distances;
+	// Actor của nguồn, để khớp đa giác giữa các batch khi thứ tự nguồn thay đổi. Rỗng thì khớp theo vị trí.
+	TObjectKey<AActor> SourceActor;
+	// Chỉ đổi khi đa giác của nguồn thay đổi quá ngưỡng (mắt hoặc khoảng cách của một tia), để lưới chỉ vẽ lại
+	// nguồn đó. Duy nhất trong solver nên hai nguồn khác nhau không bao giờ trùng Revision.
+	uint32 Revision = 0;
+
+	/** Khoảng cách không bị che theo góc Yaw (radian), nội suy giữa hai tia gần nhất. */
+	float GetDistanceAtYaw(float Yaw) const;
+};
+
+/**
+ * @class FOBLineOfSightSolver
+ * @brief Tính che khuất cho hình nón của các nguồn tầm nhìn (kể cả đồng đội, vốn không có depth capture)
+ * bằng một quạt tia xuyên tâm mỗi nguồn. Các tia được gửi hàng loạt qua AsyncLineTraceByChannel nên chạy song song
+ * trên worker thread của engine; kết quả được thu ở frame kế tiếp.
+ */
+class OBVISIBILITYFOG_API FOBLineOfSightSolver
+{
+public:
+	/**
+	 * @param InRaysPerSource Số tia trong quạt của mỗi nguồn.
+	 * @param InTraceChannel Kênh va chạm dùng cho các tia.
+	 */
+	void Configure(int32 InRaysPerSource, ECollisionChannel InTraceChannel);
+
+	/**
+	 * Gửi một batch tia bất đồng bộ cho các nguồn. Batch trước chưa thu sẽ bị bỏ.
+	 * @param SourceActors Actor của từng nguồn (cùng chỉ số với Sources, có thể rỗng hoặc chứa key rỗng):
+	 * tia của một nguồn bỏ qua chính actor đó, và đa giác được khớp với batch trước theo actor thay vì theo chỉ số.
+	 */
+	void Kick(UWorld* World, TConstArrayView<FTeammateVisionData> Sources,
+	          TConstArrayView<TObjectKey<AActor>> SourceActors, const FOBVisionRules& Rules);
+
+	/**
+	 * Thu kết quả của batch đã gửi ở frame trước và cập nhật đa giác.
+	 * Đa giác không đổi quá ngưỡng so với lần trước của cùng nguồn giữ nguyên dữ liệu và Revision cũ.
+	 * @return true nếu có ít nhất một đa giác thay đổi.
+	 */
+	bool Gather(UWorld* World);
+
+	/** Đa giác của từng nguồn, cùng thứ tự với danh sách nguồn của batch gần nhất đã thu. */
+	TConstArrayView<FOBVisibilityPolygon> GetPolygons() const { return Polygons; }
+
+	bool IsConfigured() const { return RaysPerSource > 0; }
+
+private:
+	// Số tia mỗi nguồn.
+	int32 RaysPerSource = 0;
+	ECollisionChannel TraceChannel = ECC_Visibility;
+
+	// Batch đang chờ kết quả: RaysPerSource handle liên tiếp cho mỗi nguồn.
+	TArray<FTraceHandle> PendingHandles;
+	TArray<FOBVisibilityPolygon> PendingPolygons;
+	uint64 PendingFrame = 0;
+
+	TArray<FOBVisibilityPolygon> Polygons;
+
+	// Revision cấp cho đa giác thay đổi tiếp theo.
+	uint32 NextRevision = 1;
+};
@@ -0,0 +1,65 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBVisibilityFogTypes.h"
+
+/**
+ * @class FOBServerVisibilitySolver
+ * @brief Tính tập tầm nhìn của các team trên server bằng cùng quy tắc hình nón/bán kính với shader.
+ * Mục tiêu được băm vào lưới không gian 2D, mỗi nguồn chỉ kiểm tra các mục tiêu trong những ô mà
+ * tầm nhìn của nó chạm tới, nên chi phí tỉ lệ với số cặp ở gần nhau thay vì Nguồn x Mục tiêu.
+ *
+ * Không phụ thuộc vào actor hay World để có thể chạy và đo hiệu năng headless.
+ */
+class OBVISIBILITYFOG_API FOBServerVisibilitySolver
+{
+public:
+	// Số team tối đa, mỗi team là 1 bit trong mask tầm nhìn của mục tiêu.
+	static constexpr int32 MaxTeams = 64;
+
+	struct FSource
+	{
+		FTeammateVisionData Vision;
+		FOBVisionRules Rules;
+		// Chỉ số team trong [0, MaxTeams).
+		int32 TeamIndex = 0;
+	};
+
+	struct FTarget
+	{
+		FVector Location = FVector::ZeroVector;
+		// Team sở hữu mục tiêu, luôn nhìn thấy mục tiêu. INDEX_NONE cho mục tiêu trung lập.
+		int32 TeamIndex = INDEX_NONE;
+	};
+
+	/** Kích thước ô của lưới băm (cm). Nên xấp xỉ VisionDistance phổ biến nhất. */
+	void SetCellSize(float InCellSize) { CellSize = FMath::Max(InCellSize, 100.0f); }
+	float GetCellSize() const { return CellSize; }
+
+	/**
+	 * Tính tập tầm nhìn cho mọi mục tiêu.
+	 * @param OutVisibleTeamMasks Cùng số phần tử với Targets; bit t bật nếu team t nhìn thấy mục tiêu.
+	 */
+	void Solve(TConstArrayView<FSource> Sources, TConstArrayView<FTarget> Targets, TArray<uint64>& OutVisibleTeamMasks);
+
+	/** Số phép kiểm tra nguồn - mục tiêu đã thực hiện trong lần Solve gần nhất. */
+	int32 GetLastNumTests() const { return LastNumTests; }
+
+private:
+	FIntPoint ToCell(const FVector& Location) const
+	{
+		return FIntPoint(FMath::FloorToInt32(Location.X / CellSize), FMath::FloorToInt32(Location.Y / CellSize));
+	}
+
+	float CellSize = 2000.0f;
+
+	// Chỉ số mục tiêu đã sắp xếp theo ô; CellRanges ánh xạ ô -> (vị trí bắt đầu, số lượng) trong SortedTargets.
+	// Giữ lại giữa các lần Solve để không cấp phát ở trạng thái ổn định.
+	TArray<int32> SortedTargets;
+	TArray<FIntPoint> TargetCells;
+	TMap<FIntPoint, FIntPoint> CellRanges;
+
+	int32 LastNumTests = 0;
+};
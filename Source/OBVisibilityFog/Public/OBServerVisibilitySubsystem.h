@@ -0,0 +1,147 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "OBServerVisibilitySolver.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBServerVisibilitySubsystem.generated.h"
+
+/**
+ * @class UOBServerVisibilitySubsystem
+ * @brief Tầm nhìn có thẩm quyền trên server: tính tập actor mà mỗi team nhìn thấy với tần số cố định,
+ * dùng cùng quy tắc hình nón/bán kính với sương mù phía client, để cắt replication của các actor bị che.
+ *
+ * Cách dùng cho net relevancy, trong actor cần ẩn:
+ * @code
+ * bool AMyCharacter::IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const
+ * {
+ *     return Super::IsNetRelevantFor(RealViewer, ViewTarget, SrcLocation)
+ *         && UOBServerVisibilitySubsystem::IsFogNetRelevantFor(this, RealViewer, ViewTarget);
+ * }
+ * @endcode
+ * Với Replication Graph, một node theo team có thể lấy danh sách qua GetActorsVisibleToTeam.
+ * Lưu ý NetDriver chỉ đóng channel sau RelevantTimeout giây không còn relevant.
+ *
+ * Chỉ chạy khi World không phải client (dedicated server, listen server, standalone).
+ */
+UCLASS(Config = Game)
+class OBVISIBILITYFOG_API UOBServerVisibilitySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Đăng ký actor làm nguồn tầm nhìn của team. Actor cũng được đăng ký làm mục tiêu của chính team đó. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void RegisterVisionSource(AActor* Source, int32 TeamId, const FOBVisionRules& Rules);
+
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void UnregisterVisionSource(AActor* Source);
+
+	/**
+	 * Đăng ký actor có thể bị sương mù che. TeamId là team sở hữu (luôn nhìn thấy),
+	 * hoặc INDEX_NONE cho actor trung lập.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void RegisterVisibilityTarget(AActor* Target, int32 TeamId);
+
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void UnregisterVisibilityTarget(AActor* Target);
+
+	/**
+	 * Gán team cho một viewer (thường là PlayerController) không phải nguồn tầm nhìn, ví dụ spectator.
+	 * Viewer có pawn là nguồn tầm nhìn thì không cần gọi hàm này.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void SetViewerTeam(const AActor* Viewer, int32 TeamId);
+
+	/** Team có nhìn thấy mục tiêu ở lần cập nhật gần nhất không. Actor chưa đăng ký luôn được xem là nhìn thấy. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog|Server")
+	bool IsActorVisibleToTeam(const AActor* Target, int32 TeamId) const;
+
+	/**
+	 * Mục tiêu có nên được replicate tới viewer không. Trả về true nếu mục tiêu chưa đăng ký,
+	 * không xác định được team của viewer, hoặc team của viewer đang nhìn thấy mục tiêu.
+	 */
+	bool IsNetRelevantForViewer(const AActor* Target, const AActor* RealViewer, const AActor* ViewTarget) const;
+
+	/** Tiện ích cho IsNetRelevantFor: tìm subsystem của World chứa Target và hỏi IsNetRelevantForViewer. */
+	static bool IsFogNetRelevantFor(const AActor* Target, const AActor* RealViewer, const AActor* ViewTarget);
+
+	/** Lấy mọi mục tiêu mà team đang nhìn thấy (kể cả mục tiêu của chính team), dùng cho Replication Graph. */
+	void GetActorsVisibleToTeam(int32 TeamId, TArray<AActor*>& OutActors) const;
+
+	/** Tính lại tập tầm nhìn ngay lập tức, không chờ tới lượt cập nhật kế tiếp. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void UpdateVisibility();
+
+	/** Đổi tần số cập nhật (lần/giây). <= 0 sẽ cập nhật mỗi frame. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Server")
+	void SetUpdateRate(float InUpdateRateHz) { UpdateRateHz = InUpdateRateHz; }
+
+	const FOBServerVisibilitySolver& GetSolver() const { return Solver; }
+
+	//~ Begin UWorldSubsystem Interface
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	//~ End UWorldSubsystem Interface
+
+	//~ Begin UTickableWorldSubsystem Interface
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	//~ End UTickableWorldSubsystem Interface
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	// Key được giữ riêng với con trỏ yếu, để chỉ mục vẫn trỏ đúng mục khi actor đã bị hủy mà chưa được hủy đăng ký.
+	struct FRegisteredSource
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TObjectKey<AActor> Key;
+		FOBVisionRules Rules;
+		int32 TeamId = INDEX_NONE;
+	};
+
+	struct FRegisteredTarget
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TObjectKey<AActor> Key;
+		int32 TeamId = INDEX_NONE;
+		// Bit t bật nếu team có chỉ số t đang nhìn thấy mục tiêu.
+		uint64 VisibleTeamMask = 0;
+	};
+
+	/** Chỉ số bit của team, cấp phát mới nếu cần. INDEX_NONE nếu đã hết MaxTeams. */
+	int32 FindOrAddTeamIndex(int32 TeamId);
+
+	/** Team của viewer: SetViewerTeam, rồi tới RealViewer/ViewTarget/pawn của controller là nguồn tầm nhìn. */
+	bool ResolveViewerTeam(const AActor* RealViewer, const AActor* ViewTarget, int32& OutTeamId) const;
+
+	// Số lần cập nhật mỗi giây.
+	UPROPERTY(Config)
+	float UpdateRateHz = 10.0f;
+
+	// Kích thước ô của lưới băm không gian (cm).
+	UPROPERTY(Config)
+	float HashCellSize = 2000.0f;
+
+	// Gọi ForceNetUpdate trên mục tiêu khi tập team nhìn thấy nó thay đổi, để relevancy có hiệu lực ngay.
+	UPROPERTY(Config)
+	bool bForceNetUpdateOnChange = true;
+
+	TArray<FRegisteredSource> Sources;
+	TArray<FRegisteredTarget> Targets;
+	TMap<TObjectKey<AActor>, int32> SourceIndices;
+	TMap<TObjectKey<AActor>, int32> TargetIndices;
+	TMap<TObjectKey<AActor>, int32> ViewerTeams;
+	TMap<int32, int32> TeamIndices;
+
+	FOBServerVisibilitySolver Solver;
+	TArray<FOBServerVisibilitySolver::FSource> SolverSources;
+	TArray<FOBServerVisibilitySolver::FTarget> SolverTargets;
+	TArray<uint64> SolverMasks;
+
+	float TimeSinceLastUpdate = 0.0f;
+};
@@ -0,0 +1,52 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "OBStealthComponent.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOBOnStealthVisibilityChanged, int32, TeamId);
+
+/**
+ * @class UOBStealthComponent
+ * @brief Đăng ký Owner vào registry tàng hình của UOBVisibilityFogSubsystem để gameplay biết khi nào nó bị
+ * một team phát hiện, với cùng quy tắc mà M_VisionStealthObject dùng để hiện vật thể trên màn hình.
+ * Sự kiện chỉ được phát khi trạng thái thay đổi.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class OBVISIBILITYFOG_API UOBStealthComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Team có Owner đang bị nhìn thấy ở lần đánh giá gần nhất không. Team sở hữu luôn nhìn thấy. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog|Stealth")
+	bool IsRevealedToTeam(int32 InTeamId) const;
+
+	/** Team sở hữu vật thể, INDEX_NONE nếu trung lập. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog|Stealth")
+	int32 GetTeamId() const { return TeamId; }
+
+	// Phát khi một team bắt đầu nhìn thấy Owner ("enemy spotted").
+	UPROPERTY(BlueprintAssignable, Category = "Visibility Fog|Stealth")
+	FOBOnStealthVisibilityChanged OnRevealed;
+
+	// Phát khi Owner ra khỏi tầm nhìn của một team.
+	UPROPERTY(BlueprintAssignable, Category = "Visibility Fog|Stealth")
+	FOBOnStealthVisibilityChanged OnHidden;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	friend class UOBVisibilityFogSubsystem;
+
+	// Team sở hữu vật thể, INDEX_NONE nếu trung lập.
+	UPROPERTY(EditAnywhere, Category = "Visibility Fog|Stealth")
+	int32 TeamId = INDEX_NONE;
+
+	// Chỉ số trong registry tàng hình, do subsystem quản lý.
+	int32 RegistryIndex = INDEX_NONE;
+};
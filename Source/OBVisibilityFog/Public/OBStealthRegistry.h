@@ -0,0 +1,53 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBVisibilityFogTypes.h"
+
+/**
+ * @class FOBStealthRegistry
+ * @brief Vị trí của các vật thể tàng hình dạng SoA (X, Y, Z là các mảng float riêng, được đệm tới bội số của 4)
+ * để Evaluate kiểm tra 4 vật thể một lúc bằng VectorRegister với mọi nguồn tầm nhìn trong một lượt,
+ * cùng quy tắc hình nón/hình trụ với MF_IsInVisionCone.
+ *
+ * Vị trí được lưu ở dạng float nên độ chính xác giảm dần khi đi xa gốc world (khoảng 1 mm ở 10 km).
+ */
+class OBVISIBILITYFOG_API FOBStealthRegistry
+{
+public:
+	/** Thêm một vật thể. @return Chỉ số của nó. */
+	int32 Add(const FVector& Location);
+
+	/** Xóa vật thể Index, vật thể cuối cùng được chuyển vào chỗ trống (giống TArray::RemoveAtSwap). */
+	void RemoveAtSwap(int32 Index);
+
+	void SetLocation(const int32 Index, const FVector& Location)
+	{
+		X[Index] = static_cast<float>(Location.X);
+		Y[Index] = static_cast<float>(Location.Y);
+		Z[Index] = static_cast<float>(Location.Z);
+	}
+
+	FVector GetLocation(const int32 Index) const { return FVector(X[Index], Y[Index], Z[Index]); }
+
+	int32 Num() const { return NumEntries; }
+
+	/**
+	 * Đánh giá mọi vật thể với mọi nguồn trong một lượt.
+	 * @param OutRevealed Cùng số phần tử với Num(); 1 nếu vật thể nằm trong hình nón hoặc hình trụ của ít nhất một nguồn.
+	 */
+	void Evaluate(TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	              TArray<uint8>& OutRevealed) const;
+
+	/** Cách làm vô hướng tương đương (FOBVisionRules::IsLocationVisible), dùng để đối chiếu và đo hiệu năng. */
+	void EvaluateScalar(TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	                    TArray<uint8>& OutRevealed) const;
+
+private:
+	// Số vật thể thực sự; các mảng được đệm tới bội số của 4 bằng vị trí rất xa để không bao giờ được nhìn thấy.
+	int32 NumEntries = 0;
+	TArray<float, TAlignedHeapAllocator<16>> X;
+	TArray<float, TAlignedHeapAllocator<16>> Y;
+	TArray<float, TAlignedHeapAllocator<16>> Z;
+};
@@ -0,0 +1,57 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderingThread.h"
+
+#include <atomic>
+
+/**
+ * @class TOBUploadRing
+ * @brief Vòng đệm staging (mặc định 3 slot) dùng chung giữa Game Thread và Render Thread cho các lệnh upload texture.
+ * Mỗi slot giữ lại bộ nhớ giữa các frame, nên ở trạng thái ổn định không còn new/delete cho mỗi lần upload.
+ *
+ * Game Thread ghi vào slot bằng AcquireSlot, lệnh render đọc slot rồi gọi MarkConsumed. Ring được giữ bằng
+ * TSharedRef thread-safe để lệnh render còn chờ vẫn hợp lệ khi chủ sở hữu đã bị hủy.
+ */
+template <typename ElementType, int32 NumSlots = 3>
+class TOBUploadRing
+{
+public:
+	/**
+	 * Lấy slot kế tiếp để ghi. Nếu Render Thread vẫn chưa đọc xong slot đó (Game Thread đi trước hơn NumSlots lần upload),
+	 * hàm sẽ đợi các lệnh render hoàn tất.
+	 * @param OutSequence Số thứ tự của lần upload, truyền lại vào MarkConsumed trên Render Thread.
+	 */
+	TArray<ElementType>& AcquireSlot(uint64& OutSequence)
+	{
+		OutSequence = ++SubmittedSequence;
+		if (OutSequence > NumSlots && ConsumedSequence.load(std::memory_order_acquire) < OutSequence - NumSlots)
+		{
+			FlushRenderingCommands();
+		}
+		return Slots[OutSequence % NumSlots];
+	}
+
+	/** Slot của một lần upload, dùng trên Render Thread. */
+	const TArray<ElementType>& GetSlot(const uint64 Sequence) const
+	{
+		return Slots[Sequence % NumSlots];
+	}
+
+	/** Gọi trên Render Thread sau khi đã đọc xong slot của Sequence. */
+	void MarkConsumed(const uint64 Sequence)
+	{
+		uint64 Expected = ConsumedSequence.load(std::memory_order_relaxed);
+		while (Expected < Sequence && !ConsumedSequence.compare_exchange_weak(Expected, Sequence,
+		                                                                     std::memory_order_release))
+		{
+		}
+	}
+
+private:
+	TArray<ElementType> Slots[NumSlots];
+	uint64 SubmittedSequence = 0;
+	std::atomic<uint64> ConsumedSequence{0};
+};
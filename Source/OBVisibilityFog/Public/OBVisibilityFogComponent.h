@@ -5,31 +5,14 @@
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "Components/PostProcessComponent.h"
+#include "Engine/OverlapResult.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBVisibilityReplay.h"
+#include "OBVisionDepthAtlas.h"
+#include "OBVisionMPCDeltaWriter.h"
+#include "OBVisionSourceBuffer.h"
 #include "OBVisibilityFogComponent.generated.h"
 
-/**
- * @struct FTeammateVisionData
- * @brief Struct để lưu trữ dữ liệu về tầm nhìn cần thiết của một người chơi.
- * Dữ liệu này sẽ được gửi vào texture để shader xử lý.
- */
-USTRUCT(BlueprintType)
-struct FTeammateVisionData
-{
-	GENERATED_BODY()
-
-	// Vị trí mắt (nguồn của tầm nhìn)
-	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
-	FVector EyeLocation = FVector::ZeroVector;
-
-	// Vector chỉ hướng nhìn về phía trước
-	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
-	FVector ForwardVector = FVector::ZeroVector;
-
-	// Vị trí trên mặt đất, dùng cho vùng bán kính xung quanh
-	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
-	FVector GroundLocation = FVector::ZeroVector;
-};
-
 /**
  * @class UOBVisibilityFogComponent
  * @brief Quản lý logic sương mù chiến tranh (Fog of War) cho một Actor.
@@ -56,14 +39,91 @@ public:
 
 	/**
 	 * Cập nhật dữ liệu tầm nhìn từ tất cả các nguồn (bản thân và đồng đội).
-	 * Đây là hàm chính để chạy logic mỗi frame.
+	 * Gọi mỗi frame từ game code khi bAutoUpdate tắt; khi bật, component tự gọi trong TickComponent.
 	 * @param InTeammateData Mảng chứa dữ liệu tầm nhìn của các đồng đội.
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
 	void UpdateData(const TArray<FTeammateVisionData>& InTeammateData);
 
+	/**
+	 * Trả về các actor nằm trong hình nón tầm nhìn ở lần UpdateData gần nhất.
+	 * Đây cũng chính là danh sách ShowOnlyActors được dùng cho lần capture depth map.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	TArray<AActor*> GetActorsInCone() const;
+
+	/** Buộc cache ứng viên phải truy vấn lại vật lý ở lần UpdateData kế tiếp. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void InvalidateCandidateCache();
+
+	/** Đổi team của component; nếu đang dùng tầm nhìn chung, component sẽ chuyển sang texture của team mới. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void SetTeamId(int32 NewTeamId);
+
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	int32 GetTeamId() const { return TeamId; }
+
+	/** Gom các tham số hình nón/bán kính hiện tại thành FOBVisionRules. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	FOBVisionRules GetVisionRules() const;
+
+	/**
+	 * Tính ma trận View-Projection (reversed-Z) của hình nón tầm nhìn, đúng như depth capture sử dụng.
+	 * @param AspectRatio Tỉ lệ rộng/cao của render target.
+	 */
+	static FMatrix ComputeVisionViewProjection(const FVector& EyeLocation, const FVector& ForwardVector,
+	                                           float InVisionAngleDegrees, float InVisionDistance, float AspectRatio);
+
+	/** Số lần CaptureScene đã được gọi và đã được bỏ qua bởi bộ lập lịch capture kể từ BeginPlay. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	void GetCaptureStats(int32& OutCapturesIssued, int32& OutCapturesSkipped) const;
+
+	/** Ma trận View-Projection của lần capture gần nhất, là ma trận mà depth map hiện có được chụp bằng. */
+	const FMatrix& GetCapturedViewProjection() const { return CapturedViewProjection; }
+
+	/** Thời gian tích lũy của từng giai đoạn trong UpdateData kể từ lần ResetStageTimings gần nhất. */
+	const FOBUpdateDataStageTimings& GetStageTimings() const { return StageTimings; }
+
+	void ResetStageTimings() { StageTimings = FOBUpdateDataStageTimings(); }
+
+	/** Tỉ lệ độ phân giải hiện tại của DepthRenderTarget so với kích thước gốc. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	float GetCaptureResolutionScale() const { return CaptureResolutionScale; }
+
+	/**
+	 * Bắt đầu ghi replay tầm nhìn: mỗi lần UpdateData, các nguồn, cấu hình hình nón và ActorsInCone được nối vào
+	 * một luồng nén (FOBVisibilityReplayWriter). Luồng cũ bị xóa.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Replay")
+	void StartReplayRecording();
+
+	/** Dừng ghi; khoảng trống đang chờ được ghi ra, luồng đã ghi vẫn được giữ lại cho GetReplayData. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Replay")
+	void StopReplayRecording();
+
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog|Replay")
+	bool IsRecordingReplay() const { return bIsRecordingReplay; }
+
+	/**
+	 * Sao chép phần luồng replay chưa được DrainReplayData lấy đi, đọc lại bằng FOBVisibilityReplayReader.
+	 * @return false nếu chưa có frame nào.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Replay")
+	bool GetReplayData(TArray<uint8>& OutData) const;
+
+	/**
+	 * Nối phần luồng replay ghi được từ lần gọi trước vào cuối OutData và giải phóng nó khỏi component.
+	 * Bản ghi dài nên gọi định kỳ (vd: ghi ra file), nếu không luồng được giữ toàn bộ trong bộ nhớ.
+	 * @return false nếu không có byte mới.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Replay")
+	bool DrainReplayData(UPARAM(ref) TArray<uint8>& OutData);
+
+	const FOBVisibilityReplayWriter& GetReplayWriter() const { return ReplayWriter; }
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType,
@@ -91,7 +151,59 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Dependencies")
 	TObjectPtr<UMaterialParameterCollection> VisionMPC;
 
-	/** Kênh va chạm dùng cho việc tìm các actor trong tầm nhìn. */
+	/**
+	 * Dùng dữ liệu tầm nhìn chung của team qua UOBVisibilityFogSubsystem: texture nguồn chỉ được đóng gói
+	 * và upload một lần mỗi frame cho cả team, component chỉ còn chi phí truy vấn hình nón và capture.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Config")
+	bool bUseSharedTeamVision = true;
+
+	/**
+	 * Số nguồn tầm nhìn tối đa (người chơi, ward, trụ, drone...). Texture bắt đầu với 8 nguồn và tự tăng
+	 * theo lũy thừa của 2 tới giới hạn này, các nguồn vượt quá sẽ bị bỏ qua.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Config", meta = (ClampMin = "1", ClampMax = "16384"))
+	int32 MaxVisionSources = 8;
+
+	/** Cách đóng gói dữ liệu nguồn vào TeamDataTex. Packed cần material dùng OBDecodeVisionSource. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Config")
+	EOBVisionSourceLayout SourceDataLayout = EOBVisionSourceLayout::Legacy;
+
+	/**
+	 * Gán lưới tầm nhìn CPU của team (VisibilityGridTex) vào MID để shader dùng làm nguồn tầm nhìn.
+	 * Cần bUseSharedTeamVision và lưới đã được bật qua UOBVisibilityFogSubsystem::ConfigureTeamVisibilityGrid.
+	 * Nếu team bật ConfigureTeamExploredLayer, lớp đã khám phá cũng được gán vào ExploredTex.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Config")
+	bool bUseVisibilityGridTexture = false;
+
+	/**
+	 * Trên server, đăng ký Owner làm nguồn tầm nhìn của team với UOBServerVisibilitySubsystem,
+	 * dùng cùng VisionDistance/VisionAngleDegrees/ProximityRadius/ProximityMaxHeight để cắt net relevancy.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Config")
+	bool bRegisterServerVisionSource = false;
+
+	/**
+	 * Tự cập nhật trong TickComponent (TG_PostUpdateWork, sau khi camera đã cập nhật) thay vì chờ game code gọi
+	 * UpdateData. Đồng đội được lấy từ các UOBVisionSourceComponent cùng team mà subsystem đã thu thập ở
+	 * TG_PostPhysics, tức là sau khi chúng đã di chuyển trong frame này.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Update")
+	bool bAutoUpdate = false;
+
+	/**
+	 * Số lần tự cập nhật mỗi giây khi bAutoUpdate bật, độc lập với frame rate (bước cố định theo thời gian tích lũy,
+	 * tối đa một lần mỗi frame). 0 = mỗi frame.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Update", meta = (ClampMin = "0"))
+	float FixedUpdateRate = 0.0f;
+
+	/** Cách tìm ứng viên cho ShowOnlyActors: truy vấn vật lý hoặc chỉ mục không gian dùng chung của subsystem. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Config")
+	EOBVisionCandidateQuery CandidateQuery = EOBVisionCandidateQuery::PhysicsOverlap;
+
+	/** Kênh va chạm dùng cho việc tìm các actor trong tầm nhìn (CandidateQuery = PhysicsOverlap). */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Config")
 	TEnumAsByte<ECollisionChannel> VisionTraceChannel = ECC_WorldStatic;
 
@@ -111,28 +223,255 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Config")
 	float ProximityMaxHeight = 200.0f;
 
+	/**
+	 * Bật cache ứng viên: chỉ gọi OverlapMultiByChannel (hình cầu quanh mắt, nới thêm CandidateRequeryDistance)
+	 * khi mắt di chuyển vượt ngưỡng, các frame còn lại chỉ lọc lại hình nón trên danh sách ứng viên đã có.
+	 * Kết quả giống hệt truy vấn hình cầu VisionDistance mỗi frame, trừ actor di chuyển trong CandidateCacheMaxAge.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Candidate Cache")
+	bool bUseCandidateCache = true;
+
+	/** Khoảng cách (cm) mắt được phép di chuyển trước khi cache ứng viên bị truy vấn lại. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Candidate Cache", meta = (ClampMin = "0"))
+	float CandidateRequeryDistance = 150.0f;
+
+	/**
+	 * Góc (độ) hướng nhìn được phép xoay trước khi cache ứng viên bị truy vấn lại. Chỉ dùng với SpatialIndex,
+	 * truy vấn vật lý là hình cầu quanh mắt nên không phụ thuộc hướng nhìn.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Candidate Cache",
+		meta = (ClampMin = "0", ClampMax = "180"))
+	float CandidateRequeryAngleDegrees = 20.0f;
+
+	/** Tuổi tối đa (giây) của cache, để nhận các actor mới spawn hoặc bị di chuyển. 0 = không giới hạn. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Candidate Cache", meta = (ClampMin = "0"))
+	float CandidateCacheMaxAge = 0.5f;
+
+	/**
+	 * Bỏ qua CaptureScene khi góc nhìn ổn định: mắt không vượt các ngưỡng bên dưới, tập ShowOnlyActors không đổi
+	 * và không actor nào trong đó di chuyển.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture")
+	bool bSkipCaptureWhenStable = true;
+
+	/** Khoảng cách (cm) mắt được di chuyển mà vẫn được coi là ổn định. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture", meta = (ClampMin = "0"))
+	float CaptureLocationTolerance = 1.0f;
+
+	/** Góc (độ) hướng nhìn được xoay mà vẫn được coi là ổn định. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture", meta = (ClampMin = "0"))
+	float CaptureAngleToleranceDegrees = 0.5f;
+
+	/**
+	 * Số lần capture tối đa mỗi giây. 0 = không giới hạn. Giữa hai lần capture, material đọc depth map
+	 * bằng ma trận của lần capture (MatrixRow0..3) và dùng CurrentMatrixRow0..3 cho góc nhìn hiện tại.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture", meta = (ClampMin = "0"))
+	float MaxCaptureRate = 0.0f;
+
+	/**
+	 * Tự giảm/tăng độ phân giải của DepthRenderTarget để giữ thời gian frame trong CaptureFrameTimeBudgetMs.
+	 * Lần đầu cần đổi kích thước, DepthRenderTarget được thay bằng một bản sao tạm (cùng kích thước và định dạng)
+	 * của riêng component, nên asset được gán không bao giờ bị đổi kích thước, kể cả khi bật sau BeginPlay.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture")
+	bool bDynamicCaptureResolution = false;
+
+	/** Ngân sách thời gian frame (ms, ưu tiên thời gian GPU) dùng cho độ phân giải động. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture", meta = (ClampMin = "1"))
+	float CaptureFrameTimeBudgetMs = 16.6f;
+
+	/** Tỉ lệ độ phân giải nhỏ nhất cho độ phân giải động. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Capture",
+		meta = (ClampMin = "0.1", ClampMax = "1"))
+	float MinCaptureResolutionScale = 0.25f;
+
+	/**
+	 * Render depth của đồng đội và các nguồn nhìn mọi hướng vào các tile của một depth atlas dùng chung
+	 * (DepthAtlas, AtlasTileData trong MID). Depth capture chính vẫn phục vụ hình nón của người chơi local,
+	 * người chơi local chỉ có tile khi VisionAngleDegrees vượt quá góc một tile phối cảnh phủ được.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Depth Atlas")
+	bool bUseDepthAtlas = false;
+
+	/** Kích thước (pixel) một tile vuông của atlas. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Depth Atlas",
+		meta = (ClampMin = "16", ClampMax = "4096"))
+	int32 AtlasTileSize = 256;
+
+	/** Số tile mỗi hàng; atlas chứa AtlasTilesPerRow^2 tile, bị giảm để cạnh không vượt FOBVisionDepthAtlas::MaxAtlasSize. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Visibility Fog|Depth Atlas", meta = (ClampMin = "1"))
+	int32 AtlasTilesPerRow = 4;
+
+	/** Số tile được capture mỗi lần cập nhật; các tile còn lại được làm mới xoay vòng ở các frame sau. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Depth Atlas", meta = (ClampMin = "1"))
+	int32 MaxAtlasCapturesPerFrame = 2;
+
+	/** Khoảng cách (giây) giữa hai keyframe của replay; nhỏ hơn thì tua nhanh hơn nhưng tốn byte hơn. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Replay", meta = (ClampMin = "0.1"))
+	float ReplayKeyframeInterval = 5.0f;
+
+	/**
+	 * Ngân sách trung bình (byte) mỗi phút của replay. 0 = không giới hạn. Khi cạn ngân sách, keyframe được giãn
+	 * rồi vị trí được lượng tử hóa thô dần; chỉ khi đã thô nhất frame mới bị bỏ, và reader báo lại khoảng bị bỏ.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Replay", meta = (ClampMin = "0"))
+	int32 ReplayMaxBytesPerMinute = 64 * 1024;
+
 	/** Bật/tắt hiển thị debug. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Debug")
 	bool bIsShowDebug = false;
 
-	/** Bật/tắt hiển thị thông báo debug trên màn hình. */
+	/** Hiện trên màn hình tóm tắt mỗi lần UpdateData: số nguồn, overlap, actor trong hình nón, capture và số byte upload. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Debug")
 	bool bIsShowDebugMessage = false;
 
 private:
-	// Texture dùng để chứa dữ liệu vị trí và hướng nhìn của tất cả người chơi.
+	friend class UOBVisibilityFogSubsystem;
+
+	// Một primitive được trả về từ lần truy vấn vật lý gần nhất.
+	struct FVisionCandidate
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+	};
+
+	/**
+	 * Thân của UpdateData, dùng chung cho lời gọi từ game code và TickComponent.
+	 * @param InTeammateActors Actor của từng đồng đội nếu biết (nguồn tự thu thập), rỗng khi gọi từ UpdateData.
+	 */
+	void UpdateDataInternal(TConstArrayView<FTeammateVisionData> InTeammateData,
+	                        TConstArrayView<const AActor*> InTeammateActors = {});
+
+	/** Kiểm tra ngưỡng và truy vấn lại (vật lý hoặc chỉ mục không gian) nếu cache ứng viên đã hết hạn. */
+	void RefreshCandidateCache(const FVector& EyeLocation, const FVector& ForwardVector);
+
+	/** Điền CandidateCache từ chỉ mục không gian bằng hình nón mở rộng theo các ngưỡng truy vấn lại. */
+	void QuerySpatialIndexCandidates(const FVector& EyeLocation, const FVector& ForwardVector,
+	                                 float RequeryDistance, float RequeryAngleRadians);
+
+	/**
+	 * Lọc hình nón trên cache ứng viên, rồi cập nhật ActorsInCone và ShowOnlyActors theo phần chênh lệch.
+	 * @return true nếu tập actor trong hình nón đã thay đổi.
+	 */
+	bool UpdateActorsInCone(const FVector& EyeLocation, const FVector& ForwardVector);
+
+	/** Quyết định có cần CaptureScene ở lần cập nhật này không (dirty-check và giới hạn tần suất). */
+	bool ShouldCapture(const FVector& EyeLocation, const FVector& ForwardVector, bool bActorsInConeChanged);
+
+	/** Chữ ký transform của các actor trong ShowOnlyActors, dùng để phát hiện actor di chuyển. */
+	uint32 ComputeShowOnlyActorsSignature() const;
+
+	/** Ma trận View-Projection hiện tại, chỉ tính lại khi mắt, cấu hình hoặc kích thước render target thay đổi. */
+	const FMatrix& GetCachedViewProjection(const FVector& EyeLocation, const FVector& ForwardVector);
+
+	/** Điều chỉnh độ phân giải DepthRenderTarget theo ngân sách thời gian frame. @return true nếu đã đổi kích thước. */
+	bool UpdateCaptureResolution();
+
+	/** Thay DepthRenderTarget bằng bản sao tạm của riêng component (một lần), trước khi đổi kích thước nó. */
+	void UseOwnDepthRenderTarget();
+
+	// Danh sách primitive ứng viên: trong hình cầu VisionDistance quanh mắt cộng lề di chuyển (PhysicsOverlap),
+	// hoặc trong hình nón mở rộng theo các ngưỡng (SpatialIndex).
+	TArray<FVisionCandidate> CandidateCache;
+	// Kết quả thô của truy vấn chỉ mục không gian, giữ lại giữa các lần truy vấn.
+	TArray<int32> SpatialIndexScratch;
+
+	// Trạng thái mắt và cấu hình tại thời điểm truy vấn cache gần nhất.
+	FVector CandidateQueryEye = FVector::ZeroVector;
+	FVector CandidateQueryForward = FVector::ForwardVector;
+	float CandidateQueryDistance = 0.0f;
+	float CandidateQueryAngle = 0.0f;
+	double CandidateQueryTime = 0.0;
+	bool bCandidateCacheValid = false;
+
+	// Các actor nằm trong hình nón ở lần cập nhật gần nhất.
+	TSet<TWeakObjectPtr<AActor>> ActorsInCone;
+
+	// Bộ nhớ tạm được giữ lại giữa các lần UpdateData để trạng thái ổn định không cấp phát heap.
+	// Danh sách nguồn nằm inline trong component cho tới 16 nguồn.
+	TArray<FTeammateVisionData, TInlineAllocator<16>> AllSourcesData;
+	TArray<FTeammateVisionData, TInlineAllocator<16>> GatheredTeammateData;
+	TArray<const AActor*, TInlineAllocator<16>> AllSourceActors;
+	TArray<const AActor*, TInlineAllocator<16>> GatheredTeammateActors;
+	TArray<FOverlapResult> OverlapResults;
+	TSet<TWeakObjectPtr<AActor>> ActorsInConeScratch;
+
+	// Trạng thái tại lần capture gần nhất, để bỏ qua capture khi góc nhìn ổn định.
+	FVector LastCaptureEye = FVector::ZeroVector;
+	FVector LastCaptureForward = FVector::ForwardVector;
+	float LastCaptureDistance = 0.0f;
+	float LastCaptureAngle = 0.0f;
+	uint32 LastCaptureActorsSignature = 0;
+	double LastCaptureTime = 0.0;
+	bool bHasCaptured = false;
+
+	// Thời gian của từng giai đoạn trong UpdateData.
+	FOBUpdateDataStageTimings StageTimings;
+
+	/** Gom các nguồn cần tile và cập nhật depth atlas. */
+	void UpdateDepthAtlas(const FTeammateVisionData& MyData, TConstArrayView<FTeammateVisionData> InTeammateData);
+
+	// Depth atlas của đồng đội và các nguồn nhìn mọi hướng, chỉ dùng khi bUseDepthAtlas bật.
 	UPROPERTY(Transient)
-	TObjectPtr<UTexture2D> SourceDataTexture;
+	FOBVisionDepthAtlas DepthAtlas;
+
+	// Danh sách nguồn của atlas, dùng lại giữa các lần cập nhật.
+	TArray<FOBDepthAtlasSource> AtlasSources;
+
+	// Số tile đã gán vào MID lần gần nhất.
+	int32 BoundAtlasTiles = INDEX_NONE;
+
+	// Luồng replay tầm nhìn, chỉ được ghi khi bIsRecordingReplay bật.
+	FOBVisibilityReplayWriter ReplayWriter;
+	bool bIsRecordingReplay = false;
+
+	// Ghi tham số vào VisionMPC, bỏ qua giá trị không đổi.
+	FOBVisionMPCDeltaWriter MPCDeltaWriter;
+
+	// Ma trận View-Projection tại lần capture gần nhất.
+	FMatrix CapturedViewProjection = FMatrix::Identity;
+
+	// Ma trận View-Projection đã tính và các đầu vào của nó.
+	FMatrix CachedViewProjection = FMatrix::Identity;
+	FVector CachedViewProjectionEye = FVector::ZeroVector;
+	FVector CachedViewProjectionForward = FVector::ZeroVector;
+	float CachedViewProjectionAngle = 0.0f;
+	float CachedViewProjectionDistance = 0.0f;
+	float CachedViewProjectionAspect = 0.0f;
+	bool bHasCachedViewProjection = false;
+
+	// Thống kê của bộ lập lịch capture.
+	int32 NumCapturesIssued = 0;
+	int32 NumCapturesSkipped = 0;
+
+	// Độ phân giải gốc của DepthRenderTarget và tỉ lệ hiện tại khi dùng độ phân giải động.
+	FIntPoint BaseCaptureResolution = FIntPoint::ZeroValue;
+	float CaptureResolutionScale = 1.0f;
+	// DepthRenderTarget đã là bản sao của riêng component (do UseOwnDepthRenderTarget tạo).
+	bool bOwnsDepthRenderTarget = false;
+
+	/** Gắn texture nguồn tầm nhìn (riêng hoặc của team) vào MID của Post Process. */
+	void BindSourceDataTexture();
+
+	/** Buffer nguồn tầm nhìn (riêng hoặc của team) hiện đang được shader sử dụng. */
+	const FOBVisionSourceBuffer* GetSourceBuffer() const;
+
+	// Texture riêng chứa dữ liệu vị trí và hướng nhìn, chỉ dùng khi không chia sẻ theo team.
+	UPROPERTY(Transient)
+	FOBVisionSourceBuffer SourceBuffer;
 
 	// Material Instance Dynamic của Post Process để có thể thay đổi tham số lúc runtime.
 	UPROPERTY(Transient)
 	TObjectPtr<UMaterialInstanceDynamic> PostProcessMID;
 
-	// Số lượng người chơi tối đa mà hệ thống hỗ trợ.
-	const int32 MaxTeamSize = 8;
-	// Số điểm dữ liệu cho mỗi người chơi (1 cho vị trí, 1 cho hướng nhìn).
-	const int32 DataPointsPerPlayer = 2;
+	// Team của người chơi local, dùng để chia sẻ dữ liệu tầm nhìn qua UOBVisibilityFogSubsystem.
+	UPROPERTY(EditAnywhere, Category = "Visibility Fog|Config")
+	int32 TeamId = 0;
 
 	// Cờ để đảm bảo logic chỉ chạy khi component đã sẵn sàng.
 	bool bIsReadyToUpdate = false;
+
+	// Thời gian (giây) đã tích lũy cho bước cập nhật cố định kế tiếp khi FixedUpdateRate > 0.
+	float FixedUpdateAccumulator = 0.0f;
 };
@@ -0,0 +1,377 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "OBExploredLayer.h"
+#include "OBLineOfSightSolver.h"
+#include "OBStealthRegistry.h"
+#include "OBUploadRing.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBVisibilityGrid.h"
+#include "OBVisionSourceBuffer.h"
+#include "OBVisionSpatialIndex.h"
+#include "OBVisibilityFogSubsystem.generated.h"
+
+class UOBStealthComponent;
+class UOBVisibilityFogComponent;
+class UOBVisibilityFogSubsystem;
+class UOBVisionSourceComponent;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOBOnStealthActorVisibilityChanged, AActor*, Actor, int32, TeamId);
+
+/**
+ * @struct FOBTeamVisionState
+ * @brief Dữ liệu tầm nhìn dùng chung của một team trong một frame.
+ */
+USTRUCT()
+struct FOBTeamVisionState
+{
+	GENERATED_BODY()
+
+	// Texture nguồn tầm nhìn dùng chung cho mọi component của team.
+	UPROPERTY(Transient)
+	FOBVisionSourceBuffer SourceBuffer;
+
+	// Các nguồn tầm nhìn được nộp trong frame hiện tại.
+	TArray<FTeammateVisionData> Sources;
+
+	// Actor của từng nguồn (cùng chỉ số với Sources, key rỗng nếu không biết), dùng cho che khuất.
+	TArray<TObjectKey<AActor>> SourceActors;
+
+	// Quy tắc hình nón/bán kính đi kèm với các nguồn.
+	FOBVisionRules Rules;
+
+	// Lưới tầm nhìn trên CPU, chỉ được cập nhật khi đã cấu hình qua ConfigureTeamVisibilityGrid.
+	FOBVisibilityGrid VisibilityGrid;
+
+	// Che khuất cho hình nón của các nguồn, chỉ chạy khi đã cấu hình qua ConfigureTeamLineOfSight.
+	FOBLineOfSightSolver LineOfSight;
+
+	// Texture PF_G8 phản chiếu VisibilityGrid để shader có thể dùng làm nguồn tầm nhìn (tùy chọn).
+	UPROPERTY(Transient)
+	TObjectPtr<UTexture2D> VisibilityGridTexture;
+
+	// Vòng đệm staging cho các vùng lưới được upload lên VisibilityGridTexture.
+	TSharedPtr<TOBUploadRing<uint8>, ESPMode::ThreadSafe> VisibilityGridStaging;
+
+	// Các ô từng được nhìn thấy, chỉ được cập nhật khi đã cấu hình qua ConfigureTeamExploredLayer.
+	FOBExploredLayer Explored;
+
+	// Texture PF_G8 của lớp đã khám phá (tùy chọn), cùng kích thước với lưới tầm nhìn.
+	UPROPERTY(Transient)
+	TObjectPtr<UTexture2D> ExploredTexture;
+
+	// Vòng đệm staging cho các tile được upload lên ExploredTexture.
+	TSharedPtr<TOBUploadRing<uint8>, ESPMode::ThreadSafe> ExploredStaging;
+
+	// Danh sách tile dirty dùng lại giữa các frame.
+	TArray<int32> ExploredDirtyTiles;
+
+	// Vật thể tàng hình nào đang bị team nhìn thấy, cùng chỉ số với registry tàng hình của subsystem.
+	TBitArray<> StealthRevealed;
+
+	// Các component đang dùng texture của team này.
+	TArray<TWeakObjectPtr<UOBVisibilityFogComponent>> Subscribers;
+
+	// Frame gần nhất mà team nhận được dữ liệu, để chỉ đóng gói một lần mỗi frame.
+	uint64 LastSubmitFrame = 0;
+
+	// Dữ liệu mới chưa được upload sang Render Thread.
+	bool bPendingUpload = false;
+
+	// Nguồn mới chưa được vẽ vào lưới tầm nhìn và chưa gửi tia che khuất.
+	bool bPendingGridUpdate = false;
+};
+
+/**
+ * @struct FOBGatheredVisionSource
+ * @brief Dữ liệu của một UOBVisionSourceComponent được đọc ở lần thu thập gần nhất.
+ */
+struct FOBGatheredVisionSource
+{
+	FTeammateVisionData Data;
+
+	// Owner của nguồn, để component tầm nhìn bỏ qua chính mình và depth atlas ẩn nó khỏi tile của nó.
+	AActor* Owner = nullptr;
+
+	int32 TeamId = 0;
+
+	bool bOmnidirectional = false;
+};
+
+/**
+ * @struct FOBVisionGatherTickFunction
+ * @brief Tick ở TG_PostPhysics để subsystem đọc transform của mọi UOBVisionSourceComponent song song,
+ * sau khi movement (TG_PrePhysics) và vật lý của frame đã chạy xong. Mắt của người chơi local vẫn được đọc lại
+ * khi UOBVisibilityFogComponent cập nhật ở TG_PostUpdateWork.
+ */
+USTRUCT()
+struct FOBVisionGatherTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	// Subsystem sở hữu tick function, sống lâu hơn nó.
+	UOBVisibilityFogSubsystem* Subsystem = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread,
+	                         const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template <>
+struct TStructOpsTypeTraits<FOBVisionGatherTickFunction> : public TStructOpsTypeTraitsBase2<FOBVisionGatherTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+/**
+ * @class UOBVisibilityFogSubsystem
+ * @brief Quản lý tầm nhìn ở cấp team: mỗi team chỉ đóng gói dữ liệu nguồn và upload texture một lần mỗi frame,
+ * dù có bao nhiêu UOBVisibilityFogComponent (split-screen, spectator) cùng đăng ký.
+ */
+UCLASS()
+class OBVISIBILITYFOG_API UOBVisibilityFogSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Đăng ký component vào team, tạo texture dùng chung nếu team chưa tồn tại.
+	 * Layout của team do component đăng ký đầu tiên quyết định, sức chứa tối đa là lớn nhất trong các component.
+	 */
+	void RegisterFogComponent(UOBVisibilityFogComponent* Component, int32 TeamId);
+
+	/** Hủy đăng ký component; team sẽ bị giải phóng khi không còn component nào. */
+	void UnregisterFogComponent(UOBVisibilityFogComponent* Component, int32 TeamId);
+
+	/**
+	 * Nộp danh sách nguồn tầm nhìn của team cho frame hiện tại.
+	 * Chỉ lần nộp đầu tiên trong frame được dùng, các lần sau chỉ trả về số nguồn đã có.
+	 * @param SourceActors Actor mang từng nguồn (cùng chỉ số với Sources, có thể ngắn hơn hoặc chứa nullptr),
+	 * để tia che khuất bỏ qua chính nguồn và đa giác được khớp theo actor.
+	 * @return Số nguồn sẽ được ghi vào texture của team.
+	 */
+	int32 SubmitTeamSources(int32 TeamId, TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	                        TConstArrayView<const AActor*> SourceActors = {});
+
+	/**
+	 * Bật lưới tầm nhìn trên CPU cho team. Lưới được cập nhật tăng dần mỗi khi team nộp nguồn mới.
+	 * @param Origin Góc nhỏ nhất (X, Y) của lưới trong world.
+	 * @param CellSize Kích thước một ô (cm).
+	 * @param Dimensions Số ô theo X và Y.
+	 * @param bUploadTexture Đồng thời upload lưới lên texture (VisibilityGridTex) cho shader.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void ConfigureTeamVisibilityGrid(int32 TeamId, FVector2D Origin, float CellSize, FIntPoint Dimensions,
+	                                 bool bUploadTexture);
+
+	/**
+	 * Bật che khuất cho lưới tầm nhìn của team: mỗi nguồn bắn một quạt tia bất đồng bộ trong hình nón,
+	 * kết quả (trễ một frame) cắt bớt các ô bị che trong lưới. RaysPerSource <= 1 sẽ tắt tính năng.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void ConfigureTeamLineOfSight(int32 TeamId, int32 RaysPerSource = 64,
+	                              TEnumAsByte<ECollisionChannel> TraceChannel = ECC_Visibility);
+
+	/**
+	 * Bật lớp "đã khám phá" cho team: cộng dồn mọi ô từng được nhìn thấy trên lưới tầm nhìn.
+	 * Cần gọi sau ConfigureTeamVisibilityGrid; cấu hình lại lưới sẽ xóa lớp này.
+	 * @param bUploadTexture Upload các tile thay đổi lên texture (ExploredTex) cho shader.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void ConfigureTeamExploredLayer(int32 TeamId, bool bUploadTexture);
+
+	/** Vị trí đã từng được team nhìn thấy chưa. Luôn false nếu team chưa bật lớp đã khám phá. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	bool IsLocationExploredByTeam(int32 TeamId, const FVector& Location) const;
+
+	/** Lưu/nạp lớp đã khám phá của team (save game, checkpoint của replay). Khi nạp, dữ liệu được gộp vào. */
+	void SerializeTeamExplored(int32 TeamId, FArchive& Ar);
+
+	/** Lưu lớp đã khám phá của team vào mảng byte. @return false nếu team chưa bật lớp đã khám phá. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	bool SaveTeamExplored(int32 TeamId, TArray<uint8>& OutData);
+
+	/** Gộp dữ liệu đã lưu bằng SaveTeamExplored vào lớp đã khám phá của team. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	bool LoadTeamExplored(int32 TeamId, const TArray<uint8>& Data);
+
+	/** Trả về lớp đã khám phá của team, hoặc nullptr nếu chưa được cấu hình. */
+	const FOBExploredLayer* GetTeamExploredLayer(int32 TeamId) const;
+
+	/** Trả về texture lớp đã khám phá của team, hoặc nullptr nếu không upload. */
+	UTexture2D* GetTeamExploredTexture(int32 TeamId) const;
+
+	/** O(1): vị trí có đang được team nhìn thấy không (theo lưới CPU). Luôn false nếu team chưa có lưới. */
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog")
+	bool IsLocationVisibleToTeam(int32 TeamId, const FVector& Location) const;
+
+	/** Truy vấn hàng loạt trên lưới CPU của team. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void AreLocationsVisibleToTeam(int32 TeamId, const TArray<FVector>& Locations, TArray<bool>& OutVisible) const;
+
+	/**
+	 * Trả về đa giác tầm nhìn (đã tính che khuất) của batch tia gần nhất đã thu, theo thứ tự nguồn lúc gửi batch;
+	 * khớp với nguồn hiện tại bằng FOBVisibilityPolygon::SourceActor.
+	 */
+	TConstArrayView<FOBVisibilityPolygon> GetTeamVisibilityPolygons(int32 TeamId) const;
+
+	/** Trả về lưới tầm nhìn của team, hoặc nullptr nếu chưa được cấu hình. */
+	const FOBVisibilityGrid* GetTeamVisibilityGrid(int32 TeamId) const;
+
+	/** Trả về texture lưới tầm nhìn của team, hoặc nullptr nếu không upload. */
+	UTexture2D* GetTeamVisibilityGridTexture(int32 TeamId) const;
+
+	/** Trả về texture nguồn tầm nhìn dùng chung của team, hoặc nullptr nếu team chưa được đăng ký. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	UTexture2D* GetTeamDataTexture(int32 TeamId) const;
+
+	/** Trả về buffer nguồn tầm nhìn dùng chung của team, hoặc nullptr nếu team chưa được đăng ký. */
+	const FOBVisionSourceBuffer* GetTeamSourceBuffer(int32 TeamId) const;
+
+	/** Trả về các nguồn tầm nhìn của team trong frame gần nhất. */
+	TConstArrayView<FTeammateVisionData> GetTeamSources(int32 TeamId) const;
+
+	/** Thêm nguồn tầm nhìn vào danh sách được thu thập mỗi frame. */
+	void RegisterVisionSourceComponent(UOBVisionSourceComponent* Component);
+
+	void UnregisterVisionSourceComponent(UOBVisionSourceComponent* Component);
+
+	/** Dữ liệu của mọi nguồn đã đăng ký (mọi team) ở lần thu thập gần nhất trong frame này. */
+	TConstArrayView<FOBGatheredVisionSource> GetGatheredVisionSources() const { return GatheredVisionSources; }
+
+	/** Đọc transform của mọi nguồn đã đăng ký, song song khi có nhiều nguồn. Gọi tự động ở TG_PostPhysics. */
+	void GatherVisionSources();
+
+	/** Thêm vật thể tàng hình vào registry, được đánh giá với mọi team mỗi frame. */
+	void RegisterStealthComponent(UOBStealthComponent* Component);
+
+	void UnregisterStealthComponent(UOBStealthComponent* Component);
+
+	/** Vật thể tàng hình có đang bị team nhìn thấy không (theo lần đánh giá gần nhất). */
+	bool IsStealthComponentRevealedToTeam(const UOBStealthComponent* Component, int32 TeamId) const;
+
+	/**
+	 * Thêm mọi primitive đã đăng ký của Actor vào chỉ mục không gian dùng chung, để các component ở chế độ
+	 * EOBVisionCandidateQuery::SpatialIndex tìm thấy nó mà không cần collision. Bounds tự cập nhật khi primitive di chuyển.
+	 * Primitive thêm vào Actor sau đó được nhận ở lần quét lại: Tick quét xoay vòng VisionRelevantRescansPerTick actor,
+	 * hoặc gọi RefreshVisionRelevantActor để nhận ngay.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void RegisterVisionRelevantActor(AActor* Actor);
+
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void UnregisterVisionRelevantActor(AActor* Actor);
+
+	/** Quét lại Actor đã đăng ký: thêm primitive mới được đăng ký, bỏ primitive đã bị hủy hoặc hủy đăng ký. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog")
+	void RefreshVisionRelevantActor(AActor* Actor);
+
+	/** Chỉ mục không gian của các actor đã đăng ký, dùng chung cho mọi component trong world. */
+	FOBVisionSpatialIndex& GetVisionIndex() { return VisionIndex; }
+
+	// Phát khi một vật thể tàng hình bắt đầu bị team nhìn thấy.
+	UPROPERTY(BlueprintAssignable, Category = "Visibility Fog|Stealth")
+	FOBOnStealthActorVisibilityChanged OnStealthActorRevealed;
+
+	// Phát khi một vật thể tàng hình ra khỏi tầm nhìn của team.
+	UPROPERTY(BlueprintAssignable, Category = "Visibility Fog|Stealth")
+	FOBOnStealthActorVisibilityChanged OnStealthActorHidden;
+
+	//~ Begin UTickableWorldSubsystem Interface
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	//~ End UTickableWorldSubsystem Interface
+
+private:
+	// Số actor liên quan tới tầm nhìn được quét lại mỗi Tick.
+	static constexpr int32 VisionRelevantRescansPerTick = 16;
+
+	struct FIndexedPrimitive;
+	struct FIndexedActor;
+
+	/** Gán lại texture của team vào MID của mọi component, sau khi texture được tạo lại vì tăng sức chứa. */
+	static void RebindSubscribers(const FOBTeamVisionState& Team);
+
+	/** Upload vùng đã thay đổi của lưới tầm nhìn lên texture của team. */
+	static void UploadVisibilityGrid(FOBTeamVisionState& Team);
+
+	/** Upload các tile đã thay đổi của lớp đã khám phá lên texture của team. */
+	static void UploadExploredLayer(FOBTeamVisionState& Team);
+
+	/** Tạo texture PF_G8 cùng kích thước với lưới tầm nhìn của team. */
+	static UTexture2D* CreateGridTexture(const FOBTeamVisionState& Team);
+
+	/** Cập nhật vị trí vật thể tàng hình, đánh giá với từng team và phát sự kiện cho những vật thể đổi trạng thái. */
+	void UpdateStealth();
+
+	/** Đồng bộ primitive của Actor trong chỉ mục không gian với các primitive đang được đăng ký của nó. */
+	void RescanIndexedActor(AActor& Actor, FIndexedActor& Indexed);
+
+	/** Gỡ delegate di chuyển và bỏ entry của primitive, nếu chỉ mục chưa tự bỏ nó. */
+	void UnindexPrimitive(const FIndexedPrimitive& Primitive);
+
+	/** Bỏ actor khỏi chỉ mục không gian, kể cả khi actor đã bị hủy. */
+	void RemoveIndexedActor(const TObjectKey<AActor>& Key);
+
+	/** Quét lại tối đa MaxActors actor theo vòng, bỏ những actor đã bị hủy mà không qua EndPlay. */
+	void RescanVisionRelevantActors(int32 MaxActors);
+
+	/** Primitive đã đăng ký di chuyển: đánh dấu entry để Flush đọc lại bounds. */
+	void OnIndexedPrimitiveMoved(USceneComponent* Component, EUpdateTransformFlags UpdateTransformFlags,
+	                             ETeleportType Teleport, int32 EntryIndex);
+
+	// Trạng thái tầm nhìn của từng team, khóa là TeamId.
+	UPROPERTY(Transient)
+	TMap<int32, FOBTeamVisionState> Teams;
+
+	// Frame gần nhất mà Tick đã chạy; nguồn nộp sau đó (vd: từ TG_PostUpdateWork) được upload ngay.
+	uint64 LastTickFrame = 0;
+
+	// Các nguồn tầm nhìn đã đăng ký và kết quả thu thập của chúng.
+	TArray<TWeakObjectPtr<UOBVisionSourceComponent>> VisionSourceComponents;
+	TArray<UOBVisionSourceComponent*> GatherScratch;
+	TArray<FOBGatheredVisionSource> GatheredVisionSources;
+
+	FOBVisionGatherTickFunction GatherTickFunction;
+
+	// Vị trí các vật thể tàng hình (SoA) và component tương ứng, cùng chỉ số.
+	FOBStealthRegistry StealthRegistry;
+	TArray<TWeakObjectPtr<UOBStealthComponent>> StealthComponents;
+
+	// Bộ nhớ tạm của UpdateStealth, dùng lại giữa các frame.
+	struct FStealthEvent
+	{
+		TWeakObjectPtr<UOBStealthComponent> Component;
+		int32 TeamId = INDEX_NONE;
+		bool bRevealed = false;
+	};
+	TArray<uint8> StealthScratch;
+	TArray<FStealthEvent> StealthEvents;
+
+	// Chỉ mục không gian của các actor liên quan tới tầm nhìn và các primitive đã đăng ký của từng actor.
+	struct FIndexedPrimitive
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		int32 EntryIndex = INDEX_NONE;
+		FDelegateHandle MovedHandle;
+	};
+	struct FIndexedActor
+	{
+		TArray<FIndexedPrimitive> Primitives;
+		// Vị trí của actor trong RescanOrder.
+		int32 RescanSlot = INDEX_NONE;
+	};
+	FOBVisionSpatialIndex VisionIndex;
+	TMap<TObjectKey<AActor>, FIndexedActor> IndexedActors;
+	TArray<TObjectKey<AActor>> RescanOrder;
+	int32 RescanCursor = 0;
+};
@@ -0,0 +1,133 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBVisibilityFogTypes.generated.h"
+
+/**
+ * @enum EOBVisionSourceLayout
+ * @brief Cách đóng gói dữ liệu nguồn tầm nhìn vào TeamDataTex.
+ */
+UENUM(BlueprintType)
+enum class EOBVisionSourceLayout : uint8
+{
+	// 2 texel FLinearColor mỗi nguồn (32 byte), tương thích với material gốc.
+	Legacy,
+	// 1 texel mỗi nguồn (16 byte): vị trí lượng tử hóa quanh SourceOrigin, hướng nhìn half-precision.
+	// Giải mã trong shader bằng OBDecodeVisionSource (Shaders/Private/OBVisionSourceDecode.ush).
+	Packed
+};
+
+UENUM(BlueprintType)
+enum class EOBVisionCandidateQuery : uint8
+{
+	// OverlapMultiByChannel theo VisionTraceChannel: mọi primitive có collision trên kênh đó.
+	PhysicsOverlap,
+	// Loose octree dùng chung của UOBVisibilityFogSubsystem: chỉ các actor có UOBVisionRelevantComponent
+	// (hoặc được đăng ký bằng RegisterVisionRelevantActor), không cần collision.
+	SpatialIndex
+};
+
+/**
+ * @struct FTeammateVisionData
+ * @brief Struct để lưu trữ dữ liệu về tầm nhìn cần thiết của một người chơi.
+ * Dữ liệu này sẽ được gửi vào texture để shader xử lý.
+ */
+USTRUCT(BlueprintType)
+struct FTeammateVisionData
+{
+	GENERATED_BODY()
+
+	// Vị trí mắt (nguồn của tầm nhìn)
+	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
+	FVector EyeLocation = FVector::ZeroVector;
+
+	// Vector chỉ hướng nhìn về phía trước
+	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
+	FVector ForwardVector = FVector::ZeroVector;
+
+	// Vị trí trên mặt đất, dùng cho vùng bán kính xung quanh
+	UPROPERTY(BlueprintReadWrite, Category = "Vision Data")
+	FVector GroundLocation = FVector::ZeroVector;
+};
+
+/**
+ * @struct FOBUpdateDataStageTimings
+ * @brief Thời gian tích lũy (chu kỳ CPU, đổi sang giây bằng FPlatformTime::ToSeconds64) của từng giai đoạn
+ * trong UOBVisibilityFogComponent::UpdateData, dùng cho OBFog.Bench.UpdateData.
+ */
+struct FOBUpdateDataStageTimings
+{
+	// Nộp nguồn cho subsystem hoặc đóng gói + upload texture riêng, kèm tham số MID.
+	uint64 SourceSubmitCycles = 0;
+	// Truy vấn vật lý (OverlapMultiByChannel) của cache ứng viên.
+	uint64 OverlapQueryCycles = 0;
+	// Lọc ứng viên theo hình nón và cập nhật ShowOnlyActors.
+	uint64 ConeFilterCycles = 0;
+	// Bộ lập lịch capture, CaptureScene và ma trận View-Projection.
+	uint64 CaptureSubmitCycles = 0;
+	// Ghi tham số vào Material Parameter Collection.
+	uint64 MPCWriteCycles = 0;
+	// Số lần UpdateData đã chạy hết các giai đoạn.
+	int32 NumUpdates = 0;
+};
+
+/**
+ * @struct FOBVisionRules
+ * @brief Cấu hình hình nón và vùng bán kính xung quanh, giống với các tham số gửi vào shader.
+ * Dùng để đánh giá tầm nhìn trên CPU với cùng quy tắc như post process.
+ */
+USTRUCT(BlueprintType)
+struct FOBVisionRules
+{
+	GENERATED_BODY()
+
+	// Khoảng cách tối đa của hình nón tầm nhìn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision Rules")
+	float VisionDistance = 2000.0f;
+
+	// Góc của hình nón tầm nhìn (tính bằng độ).
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision Rules")
+	float VisionAngleDegrees = 90.0f;
+
+	// Bán kính của vùng phát hiện xung quanh nguồn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision Rules")
+	float ProximityRadius = 100.0f;
+
+	// Chiều cao tối đa mà vùng bán kính xung quanh có thể ảnh hưởng.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision Rules")
+	float ProximityMaxHeight = 200.0f;
+
+	float GetVisionConeCos() const
+	{
+		return FMath::Cos(FMath::DegreesToRadians(VisionAngleDegrees * 0.5f));
+	}
+
+	/** Kiểm tra một điểm có nằm trong hình nón hoặc hình trụ bán kính xung quanh của nguồn hay không. */
+	bool IsLocationVisible(const FTeammateVisionData& Source, const FVector& Location, const float VisionConeCos) const
+	{
+		const FVector ToLocation = Location - Source.EyeLocation;
+		const FVector::FReal DistanceSquared = ToLocation.SizeSquared();
+		if (DistanceSquared <= FMath::Square(VisionDistance)
+			&& FVector::DotProduct(Source.ForwardVector, ToLocation) >= VisionConeCos * FMath::Sqrt(DistanceSquared))
+		{
+			return true;
+		}
+
+		const FVector ToGround = Location - Source.GroundLocation;
+		return ToGround.SizeSquared2D() <= FMath::Square(ProximityRadius)
+			&& FMath::Abs(ToGround.Z) <= ProximityMaxHeight;
+	}
+
+	bool operator==(const FOBVisionRules& Other) const
+	{
+		return VisionDistance == Other.VisionDistance && VisionAngleDegrees == Other.VisionAngleDegrees
+			&& ProximityRadius == Other.ProximityRadius && ProximityMaxHeight == Other.ProximityMaxHeight;
+	}
+
+	bool operator!=(const FOBVisionRules& Other) const
+	{
+		return !(*this == Other);
+	}
+};
@@ -0,0 +1,134 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+#include "OBVisibilityFogTypes.h"
+
+class AActor;
+struct FOBVisibilityPolygon;
+
+/**
+ * @class FOBVisibilityGrid
+ * @brief Lưới tầm nhìn 2D trên CPU của một team, mỗi ô là 1 bit trong một mảng phẳng.
+ * Dùng cùng quy tắc VisionDistance/VisionAngleDegrees/ProximityRadius với shader, chiếu lên mặt phẳng XY,
+ * để gameplay (AI, minimap, âm thanh, net relevancy) có thể hỏi tầm nhìn với chi phí O(1).
+ *
+ * Mỗi hàng được đệm tới bội số của 64 ô để một hàng luôn bắt đầu ở đầu một word, nhờ vậy các hàng
+ * được vẽ lại song song (ParallelFor) mà không ghi chồng lên nhau.
+ */
+class OBVISIBILITYFOG_API FOBVisibilityGrid
+{
+public:
+	/**
+	 * Cấp phát lưới và xóa toàn bộ trạng thái.
+	 * @param InOrigin Góc nhỏ nhất (X, Y) của lưới trong world.
+	 * @param InCellSize Kích thước một ô (cm).
+	 * @param InDimensions Số ô theo X và Y.
+	 */
+	void Initialize(const FVector2D& InOrigin, float InCellSize, const FIntPoint& InDimensions);
+
+	/**
+	 * Cập nhật lưới từ các nguồn tầm nhìn. Chỉ vùng bao của các nguồn đã thay đổi (vị trí cũ và mới)
+	 * được xóa và vẽ lại; nếu số nguồn hoặc quy tắc thay đổi thì vẽ lại toàn bộ.
+	 * @param Occlusion Đa giác che khuất, thường của batch tia gửi ở frame trước nên thứ tự có thể khác Sources.
+	 * @param SourceActors Actor của từng nguồn (cùng chỉ số với Sources): đa giác được khớp theo
+	 * FOBVisibilityPolygon::SourceActor; nguồn không có actor chỉ khớp với đa giác cùng chỉ số cũng không có actor.
+	 * Nguồn không khớp với đa giác nào thì không bị che.
+	 */
+	void Update(TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	            TConstArrayView<FOBVisibilityPolygon> Occlusion = {},
+	            TConstArrayView<TObjectKey<AActor>> SourceActors = {});
+
+	/** O(1): ô chứa Location có đang được nhìn thấy không. Ngoài lưới luôn trả về false. */
+	bool IsLocationVisible(const FVector& Location) const
+	{
+		FIntPoint Cell;
+		return WorldToCell(Location, Cell) && IsCellVisible(Cell);
+	}
+
+	/** Truy vấn hàng loạt, OutVisible có cùng số phần tử với Locations. */
+	void AreLocationsVisible(TConstArrayView<FVector> Locations, TArray<bool>& OutVisible) const;
+
+	bool IsCellVisible(const FIntPoint& Cell) const
+	{
+		return (Bits[Cell.Y * WordsPerRow + (Cell.X >> 6)] >> (Cell.X & 63)) & 1;
+	}
+
+	/** Chuyển vị trí world sang tọa độ ô. @return false nếu nằm ngoài lưới. */
+	bool WorldToCell(const FVector& Location, FIntPoint& OutCell) const
+	{
+		OutCell.X = FMath::FloorToInt32((Location.X - Origin.X) * InvCellSize);
+		OutCell.Y = FMath::FloorToInt32((Location.Y - Origin.Y) * InvCellSize);
+		return OutCell.X >= 0 && OutCell.Y >= 0 && OutCell.X < Dimensions.X && OutCell.Y < Dimensions.Y;
+	}
+
+	/** Ghi vùng Rect thành 1 byte mỗi ô (0 hoặc 255), dùng để upload lên texture PF_G8. */
+	void CopyRectToBytes(const FIntRect& Rect, TArray<uint8>& OutBytes) const;
+
+	/** Lấy và xóa vùng đã thay đổi kể từ lần gọi trước. @return false nếu không có gì thay đổi. */
+	bool ConsumeDirtyRect(FIntRect& OutRect);
+
+	/** Vùng được vẽ lại trong lần Update gần nhất, không bị ảnh hưởng bởi ConsumeDirtyRect. @return false nếu không có. */
+	bool GetLastUpdateRect(FIntRect& OutRect) const
+	{
+		OutRect = LastUpdateRect;
+		return bHasLastUpdateRect;
+	}
+
+	bool IsInitialized() const { return !Bits.IsEmpty(); }
+	const FVector2D& GetOrigin() const { return Origin; }
+	float GetCellSize() const { return CellSize; }
+	const FIntPoint& GetDimensions() const { return Dimensions; }
+	TConstArrayView<uint64> GetWords() const { return Bits; }
+	int32 GetWordsPerRow() const { return WordsPerRow; }
+
+private:
+	// Dữ liệu đã tính sẵn của một nguồn để vẽ lên lưới.
+	struct FSourceRaster
+	{
+		FVector2D Eye;
+		FVector2D Ground;
+		FVector2D Forward;
+		FIntRect Rect;
+		const FOBVisibilityPolygon* Polygon = nullptr;
+	};
+
+	/** Vùng ô bị ảnh hưởng bởi một nguồn (hình tròn VisionDistance và ProximityRadius), đã cắt theo lưới. */
+	FIntRect GetSourceRect(const FTeammateVisionData& Source, const FOBVisionRules& Rules) const;
+
+	/** Xóa Rect rồi vẽ lại mọi nguồn có vùng giao với Rect, song song theo hàng. */
+	void RedrawRect(const FIntRect& Rect, TConstArrayView<FSourceRaster> Rasters, const FOBVisionRules& Rules);
+
+	/** Vẽ một nguồn vào các ô [MinX, MaxX) của hàng Y. */
+	void RasterizeRow(const FSourceRaster& Raster, const FOBVisionRules& Rules, int32 Y, int32 MinX, int32 MaxX);
+
+	void MarkDirty(const FIntRect& Rect);
+
+	FVector2D Origin = FVector2D::ZeroVector;
+	float CellSize = 100.0f;
+	float InvCellSize = 0.01f;
+	FIntPoint Dimensions = FIntPoint::ZeroValue;
+	int32 WordsPerRow = 0;
+
+	// Các ô tầm nhìn, mỗi bit một ô, theo hàng.
+	TArray<uint64> Bits;
+
+	// Dữ liệu của lần cập nhật trước, để chỉ vẽ lại những nguồn đã thay đổi.
+	TArray<FTeammateVisionData> PreviousSources;
+	TArray<FIntRect> PreviousRects;
+	TArray<uint32> PreviousRevisions;
+	FOBVisionRules PreviousRules;
+
+	// Số ô tối thiểu của một vùng để vẽ lại song song.
+	static constexpr int32 ParallelCellThreshold = 4096;
+
+	// Vùng đã thay đổi chưa được upload.
+	FIntRect DirtyRect;
+	bool bHasDirtyRect = false;
+
+	// Vùng đã vẽ lại trong lần Update gần nhất.
+	FIntRect LastUpdateRect;
+	bool bHasLastUpdateRect = false;
+};
@@ -0,0 +1,241 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBVisibilityFogTypes.h"
+
+class FOBStealthRegistry;
+
+/**
+ * @struct FOBVisibilityReplayFrame
+ * @brief Một lần UpdateData đã giải mã từ luồng replay.
+ */
+struct FOBVisibilityReplayFrame
+{
+	// Thời điểm ghi (giây trong World, độ chính xác 1 ms).
+	double Time = 0.0;
+	FOBVisionRules Rules;
+	// Nguồn tầm nhìn, nguồn đầu tiên là người chơi đã ghi replay. Vị trí lượng tử hóa theo bước 2^QuantizationLevel cm.
+	TArray<FTeammateVisionData> Sources;
+	// Id của các actor trong hình nón (xem FOBVisibilityReplayReader::GetActorName), tăng dần.
+	TArray<int32> ActorsInCone;
+	// Mức lượng tử hóa writer dùng cho frame này, 0 là đầy đủ (1 cm).
+	int32 QuantizationLevel = 0;
+	// Số frame bị bỏ vì ngân sách ngay trước frame này, khi đọc tuần tự bằng ReadNextFrame.
+	int32 NumFramesDroppedBefore = 0;
+};
+
+/** Một khoảng writer đã bỏ frame vì ngân sách byte, đọc từ bản ghi khoảng trống của luồng. */
+struct FOBVisibilityReplayGap
+{
+	// Thời điểm của frame bị bỏ đầu tiên và cuối cùng (giây).
+	double StartTime = 0.0;
+	double EndTime = 0.0;
+	int32 NumFrames = 0;
+};
+
+/** Trạng thái đã lượng tử hóa của một nguồn, dùng làm giá trị dự đoán cho frame kế tiếp. */
+struct FOBReplayQuantizedSource
+{
+	FInt64Vector Eye = FInt64Vector::ZeroValue;
+	FInt64Vector Forward = FInt64Vector::ZeroValue;
+	// Mặt đất so với mắt, gần như không đổi giữa các frame.
+	FInt64Vector GroundOffset = FInt64Vector::ZeroValue;
+
+	bool operator==(const FOBReplayQuantizedSource& Other) const
+	{
+		return Eye == Other.Eye && Forward == Other.Forward && GroundOffset == Other.GroundOffset;
+	}
+};
+
+/**
+ * @class FOBVisibilityReplayWriter
+ * @brief Ghi nguồn tầm nhìn, cấu hình hình nón và tập ActorsInCone của mỗi lần cập nhật vào một luồng nhị phân
+ * chỉ nối thêm: mỗi frame là phần chênh lệch (varint, zigzag) so với frame đã ghi trước đó, kèm keyframe định kỳ
+ * để tua nhanh. Actor được đặt id theo thứ tự xuất hiện, tên (path name) chỉ được ghi một lần.
+ *
+ * Ngân sách byte dạng token bucket: khi ngân sách cạn, writer giãn khoảng keyframe (tới MaxKeyframeIntervalScale
+ * lần) rồi lượng tử hóa thô dần (bước 2^QuantizationLevel cm), và nâng lại từng bậc khi ngân sách dư. Frame delta
+ * chỉ bị bỏ khi đã ở mức thô nhất mà vẫn không vừa ngân sách; chỗ bỏ được ghi thành bản ghi khoảng trống để
+ * FOBVisibilityReplayReader báo lại. Keyframe luôn được ghi. Luồng bị cắt ngang vẫn đọc được tới bản ghi đầy đủ
+ * cuối cùng.
+ */
+class OBVISIBILITYFOG_API FOBVisibilityReplayWriter
+{
+public:
+	// Mức lượng tử hóa thô nhất: bước 16 cm cho vị trí, hướng nhìn thô hơn 16 lần.
+	static constexpr int32 MaxQuantizationLevel = 4;
+	// Khoảng keyframe được giãn tối đa bấy nhiêu lần so với giá trị của Reset.
+	static constexpr int32 MaxKeyframeIntervalScale = 8;
+
+	FOBVisibilityReplayWriter();
+
+	/**
+	 * Xóa luồng và bắt đầu lại với header mới.
+	 * @param InKeyframeInterval Khoảng cách (giây) giữa hai keyframe khi ngân sách đủ.
+	 * @param InMaxBytesPerMinute Ngân sách trung bình mỗi phút; 0 = không giới hạn.
+	 */
+	void Reset(float InKeyframeInterval, int32 InMaxBytesPerMinute);
+
+	/** @return true nếu frame đã được ghi, false nếu bị bỏ vì ngân sách (đã ở mức chất lượng thấp nhất). */
+	bool RecordFrame(double Time, TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	                 const TSet<TWeakObjectPtr<AActor>>& ActorsInCone);
+
+	/** Cùng định dạng với bản trên, cho dữ liệu không đến từ World (vd: benchmark); id actor do bên gọi quản lý. */
+	bool RecordFrame(double Time, TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules,
+	                 TConstArrayView<int32> ActorIdsInCone);
+
+	/**
+	 * Nối phần luồng ghi được từ lần Drain trước vào cuối OutData rồi giải phóng nó khỏi writer, để bản ghi dài
+	 * không giữ toàn bộ luồng trong bộ nhớ. Nối các phần theo thứ tự được đúng luồng mà reader đọc được.
+	 */
+	void DrainData(TArray<uint8>& OutData);
+
+	/** Ghi ngay bản ghi khoảng trống đang chờ (bình thường nó đi cùng frame được ghi kế tiếp), vd: khi dừng ghi. */
+	void FlushPendingGap();
+
+	/** Phần luồng chưa được DrainData lấy đi. */
+	const TArray<uint8>& GetData() const { return Data; }
+	int64 GetNumBytesWritten() const { return NumBytesDrained + Data.Num(); }
+	int32 GetNumFramesWritten() const { return NumFramesWritten; }
+	int32 GetNumFramesDropped() const { return NumFramesDropped; }
+	int32 GetQuantizationLevel() const { return QuantizationLevel; }
+	float GetKeyframeInterval() const { return KeyframeInterval; }
+
+private:
+	/** Lượng tử hóa Sources theo mức hiện tại rồi mã hóa bản ghi đầy đủ (tên, khoảng trống, frame) vào scratch. */
+	void EncodeRecord(TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules, int64 TimeMs,
+	                  bool bKeyframe);
+
+	/** Mã hóa frame hiện tại (CurrentSources, CurrentActors) vào FrameScratch. */
+	void EncodeFrame(int64 TimeMs, const FOBVisionRules& Rules, bool bKeyframe);
+
+	/** Nối bản ghi khoảng trống đang chờ (nếu có) vào Out. */
+	void WritePendingGap(TArray<uint8>& Out) const;
+
+	/** Hạ/nâng chất lượng một bậc. @return false nếu đã ở bậc thấp/cao nhất. */
+	bool DecreaseQuality(double Time);
+	bool IncreaseQuality(double Time);
+
+	/** Id của actor, cấp id mới và xếp hàng bản ghi tên nếu actor mới xuất hiện. */
+	int32 GetOrAddActorId(const AActor* Actor);
+
+	/** Lượng tử hóa Sources, kiểm tra ngân sách rồi nối frame (với CurrentActors đã sắp xếp) vào luồng. */
+	bool CommitFrame(double Time, TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules);
+
+	TArray<uint8> Data;
+	int64 NumBytesDrained = 0;
+	float BaseKeyframeInterval = 5.0f;
+	int32 MaxBytesPerMinute = 0;
+
+	// Chất lượng hiện tại: khoảng keyframe (đã giãn) và mức lượng tử hóa.
+	float KeyframeInterval = 5.0f;
+	int32 QuantizationLevel = 0;
+	double LastQualityChangeTime = 0.0;
+
+	// Trạng thái của frame đã ghi gần nhất.
+	TArray<FOBReplayQuantizedSource> PrevSources;
+	TArray<int32> PrevActors;
+	FOBVisionRules PrevRules;
+	int32 PrevQuantizationLevel = 0;
+	int64 PrevTimeMs = 0;
+	double LastKeyframeTime = 0.0;
+	bool bHasKeyframe = false;
+
+	// Token bucket của ngân sách byte.
+	double BudgetTokens = 0.0;
+	double BudgetTime = 0.0;
+
+	// Các frame bị bỏ liên tiếp chưa được ghi thành bản ghi khoảng trống.
+	int32 PendingGapFrames = 0;
+	int64 PendingGapStartMs = 0;
+	int64 PendingGapEndMs = 0;
+
+	TMap<TObjectKey<AActor>, int32> ActorIds;
+	// Tên của các actor mới, được ghi ngay trước frame kế tiếp không bị bỏ.
+	TArray<TPair<int32, FString>> PendingNames;
+
+	int32 NumFramesWritten = 0;
+	int32 NumFramesDropped = 0;
+
+	// Bộ nhớ tạm, dùng lại giữa các frame.
+	TArray<FOBReplayQuantizedSource> CurrentSources;
+	TArray<FOBReplayQuantizedSource> PredictedSources;
+	TArray<int32> CurrentActors;
+	TArray<uint8> FrameScratch;
+	TArray<uint8> HeaderScratch;
+};
+
+/**
+ * @class FOBVisibilityReplayReader
+ * @brief Đọc luồng của FOBVisibilityReplayWriter không cần World (công cụ xem lại, kiểm tra anti-cheat).
+ * Open quét luồng một lần để dựng bảng tên actor, chỉ mục keyframe và danh sách khoảng trống (frame writer đã bỏ
+ * vì ngân sách); SeekToTime giải mã từ keyframe gần nhất.
+ */
+class OBVISIBILITYFOG_API FOBVisibilityReplayReader
+{
+public:
+	/** @return false nếu header không hợp lệ hoặc khác phiên bản. Cảnh báo trong log nếu luồng có khoảng trống. */
+	bool Open(TArray<uint8> InData);
+
+	int32 GetNumFrames() const { return NumFrames; }
+	int32 GetNumFramesDropped() const { return NumFramesDropped; }
+	TConstArrayView<FOBVisibilityReplayGap> GetGaps() const { return Gaps; }
+	double GetStartTime() const { return Keyframes.IsEmpty() ? 0.0 : Keyframes[0].TimeMs / 1000.0; }
+	double GetEndTime() const { return EndTimeMs / 1000.0; }
+
+	/** Đưa frame hiện tại về frame cuối cùng có thời điểm <= Time. */
+	bool SeekToTime(double Time);
+
+	/** Giải mã frame kế tiếp. @return false khi hết luồng. */
+	bool ReadNextFrame();
+
+	const FOBVisibilityReplayFrame& GetFrame() const { return Frame; }
+
+	/** Path name của actor khi được ghi, rỗng nếu id không hợp lệ. */
+	FString GetActorName(const int32 ActorId) const
+	{
+		return ActorNames.IsValidIndex(ActorId) ? ActorNames[ActorId] : FString();
+	}
+
+	/**
+	 * Đánh giá lại các vị trí trong Targets với nguồn và cấu hình của frame hiện tại (SoA, 4 vật thể một lúc),
+	 * cùng quy tắc hình nón/hình trụ với shader.
+	 */
+	void EvaluateLocations(const FOBStealthRegistry& Targets, TArray<uint8>& OutRevealed) const;
+
+private:
+	struct FKeyframe
+	{
+		int64 TimeMs = 0;
+		// Offset của bản ghi keyframe trong Data.
+		int32 Offset = 0;
+	};
+
+	/** Giải mã bản ghi frame bắt đầu ở Offset vào Frame. @return Offset của bản ghi kế tiếp, INDEX_NONE nếu lỗi. */
+	int32 DecodeFrameRecord(int32 Offset);
+
+	/**
+	 * Offset của bản ghi frame kế tiếp từ Offset (bỏ qua bản ghi tên và khoảng trống), INDEX_NONE nếu hết luồng.
+	 * @param OutNumFramesDropped Nếu khác null, được cộng số frame của các khoảng trống đã bỏ qua.
+	 */
+	int32 SkipToFrameRecord(int32 Offset, int32* OutNumFramesDropped = nullptr) const;
+
+	TArray<uint8> Data;
+	TArray<FString> ActorNames;
+	TArray<FKeyframe> Keyframes;
+	TArray<FOBVisibilityReplayGap> Gaps;
+	int32 NumFrames = 0;
+	int32 NumFramesDropped = 0;
+	int64 EndTimeMs = 0;
+
+	// Offset của bản ghi kế tiếp sẽ được ReadNextFrame giải mã.
+	int32 ReadOffset = 0;
+	int64 FrameTimeMs = 0;
+	int32 QuantizationLevel = 0;
+	bool bHasFrame = false;
+	TArray<FOBReplayQuantizedSource> Sources;
+	FOBVisibilityReplayFrame Frame;
+	TArray<int32> ActorScratch;
+};
@@ -0,0 +1,129 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBVisionSourceBuffer.h"
+#include "OBVisionDepthAtlas.generated.h"
+
+class USceneCaptureComponent2D;
+class UTextureRenderTarget2D;
+
+/**
+ * @struct FOBDepthAtlasSource
+ * @brief Một nguồn tầm nhìn cần có tile trong depth atlas.
+ */
+struct FOBDepthAtlasSource
+{
+	FTeammateVisionData Data;
+
+	// Actor bị ẩn khỏi tile của chính nguồn để thân của nó không che mắt. Có thể null.
+	AActor* Owner = nullptr;
+
+	// Nguồn nhìn mọi hướng (cảm biến, trụ...), dùng 6 tile theo các mặt cube.
+	bool bOmnidirectional = false;
+};
+
+/**
+ * @struct FOBVisionDepthAtlas
+ * @brief Depth map của nhiều nguồn tầm nhìn trong một render target chia tile.
+ * Mỗi nguồn nhận một tile phối cảnh, hoặc 6 tile cube nếu nhìn mọi hướng hoặc góc nhìn quá rộng cho một tile.
+ * Mỗi lần Update chỉ capture tối đa MaxCapturesPerFrame tile: tile chưa có dữ liệu trước, sau đó xoay vòng.
+ *
+ * Một capture component riêng render vào TileTarget, rồi tile được copy vào AtlasTarget trên Render Thread.
+ * Ma trận của từng tile tại lần capture của nó nằm trong TileDataBuffer để shader đọc bằng
+ * OBSampleDepthAtlas (Shaders/Private/OBVisionDepthAtlas.ush), nên tile cũ vẫn được chiếu đúng.
+ */
+USTRUCT()
+struct OBVISIBILITYFOG_API FOBVisionDepthAtlas
+{
+	GENERATED_BODY()
+
+	// Góc nhìn lớn nhất một tile phối cảnh phủ được; nguồn rộng hơn dùng 6 mặt cube 90 độ.
+	static constexpr float MaxPerspectiveTileAngle = 120.0f;
+	// Số texel mỗi tile trong TileDataBuffer: 4 hàng ma trận, rồi (TileX, TileY, chỉ số nguồn, hợp lệ).
+	static constexpr int32 TexelsPerTile = 5;
+	// Cạnh lớn nhất (pixel) của atlas: 4096^2 R32F là 64 MB, mỗi tile cũng bị giới hạn theo cạnh này.
+	static constexpr int32 MaxAtlasSize = 4096;
+
+	/**
+	 * Tạo render target của atlas và của một tile, cùng capture component gắn vào Owner.
+	 * @param InTileSize Kích thước (pixel) một tile vuông.
+	 * @param InTilesPerRow Số tile mỗi hàng; atlas chứa InTilesPerRow^2 tile.
+	 * Atlas bị giảm số tile mỗi hàng (có log cảnh báo) để cạnh không vượt MaxAtlasSize.
+	 * @return true nếu mọi tài nguyên được tạo thành công.
+	 */
+	bool Initialize(AActor* Owner, int32 InTileSize, int32 InTilesPerRow);
+
+	/** Hủy capture component; render target được GC thu hồi. */
+	void Release();
+
+	/**
+	 * Gán tile cho các nguồn, capture tối đa MaxCapturesPerFrame tile và upload ma trận của các tile.
+	 * Nguồn không còn tile trống sẽ bị bỏ qua.
+	 * @return Số tile đã được capture.
+	 */
+	int32 Update(TConstArrayView<FOBDepthAtlasSource> Sources, const FOBVisionRules& Rules, int32 MaxCapturesPerFrame);
+
+	/** Ma trận View-Projection của một tile vuông, cùng quy ước với UOBVisibilityFogComponent::ComputeVisionViewProjection. */
+	static FMatrix ComputeTileViewProjection(const FVector& EyeLocation, const FVector& ForwardVector,
+	                                         const FVector& UpVector, float FOVDegrees, float Distance);
+
+	bool IsInitialized() const { return AtlasTarget != nullptr; }
+	UTextureRenderTarget2D* GetAtlasTexture() const { return AtlasTarget; }
+	UTexture2D* GetTileDataTexture() const { return TileDataBuffer.GetTexture(); }
+	int32 GetNumTiles() const { return NumActiveTiles; }
+	int32 GetTilesPerRow() const { return TilesPerRow; }
+	int32 GetLastUploadBytes() const { return TileDataBuffer.GetLastUploadBytes(); }
+
+	// Nội dung và trạng thái capture của một tile.
+	struct FTile
+	{
+		// Khóa của nội dung: nguồn (Owner, hoặc chỉ số khi không có Owner) và mặt cube (-1 nếu phối cảnh).
+		const AActor* Owner = nullptr;
+		int32 SourceKey = INDEX_NONE;
+		int32 Face = INDEX_NONE;
+
+		// Chỉ số của nguồn trong lần Update hiện tại.
+		int32 SourceIndex = INDEX_NONE;
+
+		// Ma trận tại lần capture gần nhất của tile.
+		FMatrix ViewProjection = FMatrix::Identity;
+		uint64 LastCaptureFrame = 0;
+		bool bCaptured = false;
+	};
+
+	/** Các tile đang được dùng, theo thứ tự trong atlas. */
+	TConstArrayView<FTile> GetActiveTiles() const { return MakeArrayView(Tiles.GetData(), NumActiveTiles); }
+
+private:
+	/** Capture tile TileIndex từ nguồn Source và copy kết quả vào atlas. */
+	void CaptureTile(int32 TileIndex, const FOBDepthAtlasSource& Source, float FOVDegrees, float Distance);
+
+	UPROPERTY(Transient)
+	TObjectPtr<UTextureRenderTarget2D> AtlasTarget;
+
+	// Đích render của capture component, có kích thước một tile.
+	UPROPERTY(Transient)
+	TObjectPtr<UTextureRenderTarget2D> TileTarget;
+
+	UPROPERTY(Transient)
+	TObjectPtr<USceneCaptureComponent2D> CaptureComponent;
+
+	// Ma trận và vị trí của từng tile cho shader.
+	UPROPERTY(Transient)
+	FOBVisionSourceBuffer TileDataBuffer;
+
+	// Luôn có TilesPerRow^2 phần tử, chỉ NumActiveTiles phần tử đầu đang được dùng.
+	TArray<FTile> Tiles;
+	TArray<FLinearColor> TileTexels;
+
+	int32 TileSize = 0;
+	int32 TilesPerRow = 0;
+	int32 NumActiveTiles = 0;
+	int32 RoundRobinCursor = 0;
+
+	// Ma trận của các tile đã thay đổi kể từ lần upload trước.
+	bool bTileDataDirty = true;
+};
@@ -0,0 +1,97 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UMaterialParameterCollection;
+class UMaterialParameterCollectionInstance;
+
+/**
+ * @class FOBVisionMPCDeltaWriter
+ * @brief Ghi các tham số tầm nhìn vào VisionMPC, bỏ qua những tham số không đổi.
+ * Initialize chỉ cache việc tham số có tồn tại trong collection hay không, để tham số thiếu không bị tra cứu
+ * (và cảnh báo) mỗi frame; không có chỉ số tham số nào được cache. UMaterialParameterCollectionInstance chỉ có
+ * API ghi theo tên, nên mỗi tham số đã thay đổi vẫn là một lời gọi Set*ParameterValue riêng, tra tên trong map
+ * của instance và đánh dấu dirty. Phần tiết kiệm được là các tham số không đổi: frame không có gì thay đổi
+ * hoàn toàn không chạm tới collection.
+ */
+class OBVISIBILITYFOG_API FOBVisionMPCDeltaWriter
+{
+public:
+	enum EVectorParam : uint8
+	{
+		// Ma trận View-Projection của lần capture depth map gần nhất.
+		MatrixRow0,
+		MatrixRow1,
+		MatrixRow2,
+		MatrixRow3,
+		PlayerPosition,
+		PlayerForwardVector,
+		PlayerGroundPosition,
+		// Ma trận View-Projection của góc nhìn hiện tại, cập nhật mỗi lần UpdateData.
+		CurrentMatrixRow0,
+		CurrentMatrixRow1,
+		CurrentMatrixRow2,
+		CurrentMatrixRow3,
+		// Vị trí mắt tại lần capture gần nhất.
+		CaptureEyePosition,
+		NumVectorParams
+	};
+
+	enum EScalarParam : uint8
+	{
+		VisionConeCosine,
+		VisionMaxDistance,
+		ProximityRadius,
+		ProximityMaxHeight,
+		NumScalarParams
+	};
+
+	/**
+	 * Lấy instance của collection trong World và xác định những tham số nào thực sự tồn tại.
+	 * @return false nếu không lấy được instance.
+	 */
+	bool Initialize(UWorld* World, UMaterialParameterCollection* Collection);
+
+	/** Gom giá trị cho lần WriteChanged kế tiếp. */
+	void SetVector(const EVectorParam Param, const FLinearColor& Value)
+	{
+		VectorSlots[Param].Staged = Value;
+		VectorSlots[Param].bStaged = true;
+	}
+
+	void SetScalar(const EScalarParam Param, const float Value)
+	{
+		ScalarSlots[Param].Staged = Value;
+		ScalarSlots[Param].bStaged = true;
+	}
+
+	void SetMatrix(const FMatrix& Matrix, EVectorParam FirstRow = MatrixRow0);
+
+	/**
+	 * Ghi các giá trị đã thay đổi kể từ lần ghi trước vào collection, mỗi tham số một lời gọi tra theo tên.
+	 * @return Số tham số đã được ghi.
+	 */
+	int32 WriteChanged();
+
+	bool IsInitialized() const { return Instance.IsValid(); }
+
+private:
+	template <typename ValueType>
+	struct TSlot
+	{
+		ValueType Staged{};
+		ValueType Committed{};
+		// Tham số có tồn tại trong collection không.
+		bool bExists = false;
+		// Đã có giá trị được gom chưa; slot chưa từng Set sẽ không ghi đè giá trị mặc định của collection.
+		bool bStaged = false;
+		// Đã từng được ghi chưa, để lần WriteChanged đầu luôn ghi.
+		bool bCommitted = false;
+	};
+
+	TWeakObjectPtr<UMaterialParameterCollectionInstance> Instance;
+	TSlot<FLinearColor> VectorSlots[NumVectorParams];
+	TSlot<float> ScalarSlots[NumScalarParams];
+};
@@ -0,0 +1,23 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "OBVisionRelevantComponent.generated.h"
+
+/**
+ * @class UOBVisionRelevantComponent
+ * @brief Đăng ký Owner vào chỉ mục không gian của UOBVisibilityFogSubsystem, để UOBVisibilityFogComponent
+ * ở chế độ EOBVisionCandidateQuery::SpatialIndex đưa nó vào ShowOnlyActors khi nằm trong hình nón.
+ * Primitive thêm vào Owner sau BeginPlay được subsystem nhận ở lần quét lại (xem RegisterVisionRelevantActor).
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class OBVISIBILITYFOG_API UOBVisionRelevantComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+};
@@ -0,0 +1,36 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @struct FOBVisionReprojection
+ * @brief Phép tính trên CPU tương ứng với OBVisionReprojection.ush, để depth map chụp ở tần suất thấp
+ * vẫn được đọc đúng chỗ khi góc nhìn hiện tại đã thay đổi. Không phụ thuộc GPU hay UObject.
+ * ProjectToUV tương ứng OBProjectToCapture, ReprojectClipToCapturedUV tương ứng OBReprojectClipToCapture;
+ * ComputeCurrentToCaptured chỉ chạy trên CPU (cần nghịch đảo ma trận), shader nhận sẵn kết quả của nó.
+ *
+ * Depth map luôn được đọc bằng ma trận của lần capture (MatrixRow0..3), còn ma trận của góc nhìn hiện tại
+ * (CurrentMatrixRow0..3) chỉ dùng để biết vùng nào của hình nón hiện tại nằm ngoài frustum của capture.
+ */
+struct OBVISIBILITYFOG_API FOBVisionReprojection
+{
+	/**
+	 * Chiếu vị trí world bằng ma trận View-Projection (reversed-Z) ra UV và DeviceZ của depth map.
+	 * @return false nếu vị trí nằm sau mắt hoặc ngoài các mặt bên của frustum.
+	 */
+	static bool ProjectToUV(const FMatrix& ViewProjection, const FVector& WorldLocation, FVector2D& OutUV,
+	                        float& OutDeviceZ);
+
+	/** Ma trận đưa clip space của góc nhìn hiện tại về clip space của lần capture. */
+	static FMatrix ComputeCurrentToCaptured(const FMatrix& CurrentViewProjection,
+	                                        const FMatrix& CapturedViewProjection);
+
+	/**
+	 * Chuyển một điểm clip space của góc nhìn hiện tại sang UV của depth map đã chụp.
+	 * @return false nếu điểm nằm ngoài frustum của lần capture.
+	 */
+	static bool ReprojectClipToCapturedUV(const FMatrix& CurrentToCaptured, const FVector4& CurrentClip,
+	                                      FVector2D& OutUV);
+};
@@ -0,0 +1,128 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OBUploadRing.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBVisionSourceBuffer.generated.h"
+
+class UTexture2D;
+
+/**
+ * @struct FOBVisionSourceBuffer
+ * @brief Sở hữu texture dữ liệu nguồn tầm nhìn (TeamDataTex) và việc đóng gói/upload nó sang Render Thread.
+ * Được dùng chung bởi UOBVisibilityFogComponent (chế độ riêng) và UOBVisibilityFogSubsystem (chế độ chia sẻ theo team).
+ *
+ * Texture luôn là một hàng PF_A32B32G32R32F. Sức chứa tăng theo lũy thừa của 2 khi có nhiều nguồn hơn,
+ * chỉ texture được tạo lại còn material giữ nguyên (chủ sở hữu chỉ cần gán lại tham số TeamDataTex).
+ * Khởi tạo bằng InitializeTexels, buffer chứa các phần tử texel thô (vd: ma trận của từng tile trong depth atlas).
+ */
+USTRUCT()
+struct OBVISIBILITYFOG_API FOBVisionSourceBuffer
+{
+	GENERATED_BODY()
+
+	// Số lượng nguồn mặc định mà hệ thống hỗ trợ.
+	static constexpr int32 DefaultMaxSources = 8;
+	// Giới hạn chiều rộng texture của RHI.
+	static constexpr int32 MaxTextureWidth = 16384;
+	// Bước lượng tử hóa vị trí (cm) của layout Packed.
+	static constexpr float PositionQuantizationStep = 1.0f;
+	// Số bit có dấu cho mỗi trục vị trí của layout Packed (±10.48 km quanh SourceOrigin với bước 1 cm).
+	static constexpr int32 PositionBits = 21;
+
+	/**
+	 * Tạo texture chứa được InMaxSources nguồn.
+	 * @param InMaxSources Sức chứa ban đầu.
+	 * @param InCapacityLimit Sức chứa tối đa khi tự tăng; nhỏ hơn InMaxSources nghĩa là không tăng.
+	 * @param InLayout Cách đóng gói dữ liệu.
+	 * @return true nếu texture được tạo thành công.
+	 */
+	bool Initialize(int32 InMaxSources, int32 InCapacityLimit = 0,
+	                EOBVisionSourceLayout InLayout = EOBVisionSourceLayout::Legacy);
+
+	/**
+	 * Tạo texture cho các phần tử thô, mỗi phần tử InTexelsPerEntry texel, được ghi bằng UploadTexels.
+	 * @return true nếu texture được tạo thành công.
+	 */
+	bool InitializeTexels(int32 InMaxEntries, int32 InTexelsPerEntry, int32 InCapacityLimit = 0);
+
+	/**
+	 * Đảm bảo texture chứa được NumSources nguồn (trong giới hạn sức chứa).
+	 * @return true nếu texture vừa được tạo lại và cần gán lại vào material.
+	 */
+	bool EnsureCapacity(int32 NumSources);
+
+	/** Đổi sức chứa tối đa khi tự tăng (không nhỏ hơn sức chứa hiện tại). */
+	void SetCapacityLimit(int32 InCapacityLimit);
+
+	/**
+	 * Đóng gói các nguồn tầm nhìn và gửi lệnh cập nhật texture sang Render Thread.
+	 * Các nguồn vượt quá sức chứa sẽ bị bỏ qua.
+	 * @return Số nguồn thực sự được ghi vào texture.
+	 */
+	int32 Upload(TConstArrayView<FTeammateVisionData> Sources);
+
+	/**
+	 * Upload các phần tử texel thô (GetTexelsPerEntry() texel mỗi phần tử) lên texture.
+	 * Các phần tử vượt quá sức chứa sẽ bị bỏ qua.
+	 * @return Số phần tử thực sự được ghi vào texture.
+	 */
+	int32 UploadTexels(TConstArrayView<FLinearColor> Texels);
+
+	/**
+	 * Đóng gói tối đa MaxSources nguồn vào OutData theo Layout, không chạm tới RHI.
+	 * @return Số nguồn được đóng gói.
+	 */
+	static int32 Pack(EOBVisionSourceLayout Layout, TConstArrayView<FTeammateVisionData> Sources, int32 MaxSources,
+	                  const FVector& Origin, TArray<FLinearColor>& OutData);
+
+	/** Gốc lượng tử hóa cho layout Packed: mắt của nguồn đầu tiên, làm tròn theo lưới 1 m. */
+	static FVector ComputePackOrigin(TConstArrayView<FTeammateVisionData> Sources);
+
+	/** Số texel mỗi nguồn chiếm trong texture theo Layout. */
+	static int32 GetTexelsPerSource(EOBVisionSourceLayout Layout)
+	{
+		return Layout == EOBVisionSourceLayout::Packed ? 1 : 2;
+	}
+
+	UTexture2D* GetTexture() const { return Texture; }
+	int32 GetMaxSources() const { return MaxSources; }
+	int32 GetCapacityLimit() const { return CapacityLimit; }
+	EOBVisionSourceLayout GetLayout() const { return Layout; }
+	const FVector& GetPackOrigin() const { return PackOrigin; }
+	int32 GetLastUploadBytes() const { return LastUploadBytes; }
+	int32 GetTexelsPerEntry() const { return TexelsPerEntry; }
+
+private:
+	/** Tạo texture mới theo MaxSources và TexelsPerEntry hiện tại. */
+	bool CreateTexture();
+
+	/** Gửi lệnh ghi UploadWidth texel đầu của slot staging Sequence lên texture. */
+	void SubmitStaging(uint64 Sequence, int32 UploadWidth);
+
+	// Texture dùng để chứa dữ liệu vị trí và hướng nhìn của tất cả các nguồn.
+	UPROPERTY(Transient)
+	TObjectPtr<UTexture2D> Texture;
+
+	// Số lượng nguồn tối đa mà texture hiện tại chứa được.
+	int32 MaxSources = 0;
+
+	// Sức chứa tối đa khi tự tăng.
+	int32 CapacityLimit = 0;
+
+	EOBVisionSourceLayout Layout = EOBVisionSourceLayout::Legacy;
+
+	// Số texel của một phần tử: theo Layout, hoặc do InitializeTexels quyết định.
+	int32 TexelsPerEntry = 2;
+
+	// Gốc lượng tử hóa của lần upload gần nhất (chỉ dùng cho layout Packed).
+	FVector PackOrigin = FVector::ZeroVector;
+
+	// Số byte của lần upload gần nhất.
+	int32 LastUploadBytes = 0;
+
+	// Vòng đệm staging dùng chung với Render Thread, thay cho new/delete một mảng mỗi lần upload.
+	TSharedPtr<TOBUploadRing<FLinearColor>, ESPMode::ThreadSafe> StagingRing;
+};
@@ -0,0 +1,48 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "OBVisibilityFogTypes.h"
+#include "OBVisionSourceComponent.generated.h"
+
+/**
+ * @class UOBVisionSourceComponent
+ * @brief Đánh dấu một nguồn tầm nhìn của team (đồng đội, ward, trụ, drone...). Đặt component ở vị trí mắt.
+ * UOBVisibilityFogSubsystem đọc transform của mọi nguồn đã đăng ký song song sau khi chúng di chuyển (TG_PostPhysics),
+ * và UOBVisibilityFogComponent ở chế độ bAutoUpdate dùng kết quả đó thay cho mảng truyền vào UpdateData.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class OBVISIBILITYFOG_API UOBVisionSourceComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Team của nguồn; có hiệu lực từ lần thu thập kế tiếp. */
+	UFUNCTION(BlueprintCallable, Category = "Visibility Fog|Source")
+	void SetTeamId(int32 NewTeamId) { TeamId = NewTeamId; }
+
+	UFUNCTION(BlueprintPure, Category = "Visibility Fog|Source")
+	int32 GetTeamId() const { return TeamId; }
+
+	/** Dữ liệu tầm nhìn hiện tại của nguồn. Chỉ đọc transform nên được gọi từ nhiều luồng khi thu thập. */
+	FTeammateVisionData GetVisionData() const;
+
+	/** Dùng hướng của Owner làm hướng nhìn (giống người chơi local), thay vì hướng của chính component. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Source")
+	bool bUseOwnerForward = true;
+
+	/** Nguồn nhìn mọi hướng (cảm biến, trụ); trong depth atlas nó chiếm 6 tile theo các mặt cube. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Visibility Fog|Source")
+	bool bOmnidirectional = false;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	// Team sở hữu nguồn tầm nhìn.
+	UPROPERTY(EditAnywhere, Category = "Visibility Fog|Source")
+	int32 TeamId = 0;
+};
@@ -0,0 +1,138 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/GenericOctree.h"
+
+class FOBVisionSpatialIndex;
+
+/** Phần tử trong octree: bounds của một primitive và chỉ số entry của nó trong FOBVisionSpatialIndex. */
+struct FOBVisionIndexElement
+{
+	FBoxCenterAndExtent Bounds;
+	// Tâm và bán kính hình cầu bao, dùng cho phép thử hình nón.
+	FVector SphereCenter = FVector::ZeroVector;
+	FVector::FReal SphereRadius = 0.0;
+	int32 EntryIndex = INDEX_NONE;
+	FOBVisionSpatialIndex* Index = nullptr;
+};
+
+struct FOBVisionIndexSemantics
+{
+	enum { MaxElementsPerLeaf = 16 };
+	enum { MinInclusiveElementsPerNode = 7 };
+	enum { MaxNodeDepth = 12 };
+
+	typedef TInlineAllocator<MaxElementsPerLeaf> ElementAllocator;
+
+	static const FBoxCenterAndExtent& GetBoundingBox(const FOBVisionIndexElement& Element) { return Element.Bounds; }
+
+	static bool AreElementsEqual(const FOBVisionIndexElement& A, const FOBVisionIndexElement& B)
+	{
+		return A.EntryIndex == B.EntryIndex;
+	}
+
+	static void SetElementId(const FOBVisionIndexElement& Element, FOctreeElementId2 Id);
+};
+
+/**
+ * @struct FOBVisionCone
+ * @brief Hình nón tầm nhìn cho phép thử bảo thủ với hình cầu: không bao giờ loại một vật thể thực sự chạm hình nón
+ * (mở rộng thêm Margin), có thể giữ lại một số vật thể ở sát bên ngoài.
+ */
+struct OBVISIBILITYFOG_API FOBVisionCone
+{
+	FOBVisionCone(const FVector& InEyeLocation, const FVector& InForwardVector, float HalfAngleRadians,
+	              float InDistance, float InMargin);
+
+	bool IntersectsSphere(const FVector& Center, FVector::FReal Radius) const;
+
+	FVector EyeLocation;
+	FVector ForwardVector;
+	FVector::FReal CosHalfAngle;
+	FVector::FReal SinHalfAngle;
+	FVector::FReal Distance;
+	FVector::FReal Margin;
+	// Nửa góc >= 90 độ: chỉ còn giới hạn khoảng cách.
+	bool bHemisphereOrWider;
+};
+
+/**
+ * @class FOBVisionSpatialIndex
+ * @brief Loose octree (TOctree2) chứa bounds của các primitive liên quan tới sương mù, thay cho truy vấn
+ * vật lý theo VisionTraceChannel: không phụ thuộc collision và loại cả một node khi node nằm ngoài hình nón.
+ *
+ * Primitive di chuyển chỉ được đánh dấu dirty; bounds được cập nhật theo lô ở lần truy vấn kế tiếp.
+ * Entry của actor hoặc primitive đã bị hủy (kể cả khi không qua Remove) được chỉ mục tự bỏ, nên người gọi
+ * kiểm tra IsEntryOf trước khi Remove một entry mà primitive của nó có thể đã chết.
+ */
+class OBVISIBILITYFOG_API FOBVisionSpatialIndex
+{
+public:
+	// Phần tử trong octree giữ con trỏ tới chỉ mục nên chỉ mục không được sao chép.
+	UE_NONCOPYABLE(FOBVisionSpatialIndex);
+
+	/** @param WorldExtent Nửa kích thước của vùng world được octree bao phủ (cm). */
+	explicit FOBVisionSpatialIndex(FVector::FReal WorldExtent = UE_OLD_HALF_WORLD_MAX);
+
+	/** Thêm một primitive. @return Chỉ số entry, dùng cho MarkDirty và Remove. */
+	int32 Add(AActor* Actor, UPrimitiveComponent* Component);
+
+	void Remove(int32 EntryIndex);
+
+	/** Entry còn thuộc về Component không; sai khi entry đã bị bỏ và slot được cấp lại cho primitive khác. */
+	bool IsEntryOf(const int32 EntryIndex, const TWeakObjectPtr<UPrimitiveComponent>& Component) const
+	{
+		return Entries.IsValidIndex(EntryIndex) && Entries[EntryIndex].bUsed
+			&& Entries[EntryIndex].Component == Component;
+	}
+
+	/** Bounds của entry sẽ được đọc lại ở lần Flush kế tiếp. */
+	void MarkDirty(int32 EntryIndex);
+
+	/**
+	 * Cập nhật bounds của mọi entry dirty trong octree. Entry dirty có actor hoặc primitive không còn hợp lệ
+	 * (vd: actor bị hủy mà không qua EndPlay) bị bỏ khỏi chỉ mục.
+	 */
+	void Flush();
+
+	/**
+	 * Tìm mọi entry có hình cầu bao chạm hình nón. Gọi Flush trước.
+	 * Entry có actor hoặc primitive đã bị hủy không được trả về và được đánh dấu dirty để Flush kế tiếp bỏ nó.
+	 * @param OutEntries Được Reset rồi điền chỉ số entry.
+	 */
+	void QueryCone(const FOBVisionCone& Cone, TArray<int32>& OutEntries);
+
+	AActor* GetActor(const int32 EntryIndex) const { return Entries[EntryIndex].Actor.Get(); }
+	UPrimitiveComponent* GetComponent(const int32 EntryIndex) const { return Entries[EntryIndex].Component.Get(); }
+	int32 Num() const { return NumEntries; }
+
+	/** Số node và phần tử đã được thử hình nón ở lần QueryCone gần nhất. */
+	int32 GetLastNumNodeTests() const { return LastNumNodeTests; }
+	int32 GetLastNumElementTests() const { return LastNumElementTests; }
+
+private:
+	friend struct FOBVisionIndexSemantics;
+
+	struct FEntry
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		FOctreeElementId2 ElementId;
+		bool bUsed = false;
+		bool bDirty = false;
+	};
+
+	/** Đưa entry vào octree với bounds hiện tại của primitive. */
+	void Insert(int32 EntryIndex);
+
+	TOctree2<FOBVisionIndexElement, FOBVisionIndexSemantics> Octree;
+	TArray<FEntry> Entries;
+	TArray<int32> FreeEntries;
+	TArray<int32> DirtyEntries;
+	int32 NumEntries = 0;
+
+	int32 LastNumNodeTests = 0;
+	int32 LastNumElementTests = 0;
+};
@@ -0,0 +1,26 @@
+﻿// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "Interfaces/IPluginManager.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "ShaderCore.h"
+
+/**
+ * Module nhỏ chỉ để ánh xạ thư mục Shaders của plugin. Mapping phải có trước khi shader được biên dịch,
+ * nên module này chạy ở PostConfigInit còn module runtime OBVisibilityFog vẫn nạp ở Default.
+ */
+class FOBVisibilityFogShadersModule : public IModuleInterface
+{
+public:
+	virtual void StartupModule() override
+	{
+		// Cho phép material include các hàm trong thư mục Shaders của plugin qua /Plugin/OBVisibilityFog
+		if (const TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("OBVisibilityFog")))
+		{
+			AddShaderSourceDirectoryMapping(TEXT("/Plugin/OBVisibilityFog"),
+			                                FPaths::Combine(Plugin->GetBaseDir(), TEXT("Shaders")));
+		}
+	}
+};
+
+IMPLEMENT_MODULE(FOBVisibilityFogShadersModule, OBVisibilityFogShaders)
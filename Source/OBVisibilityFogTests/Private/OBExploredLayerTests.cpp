@@ -0,0 +1,255 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Math/RandomStream.h"
+#include "OBExploredLayer.h"
+#include "OBVisibilityGrid.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace OBExploredLayerTests
+{
+	// 150x100 ô: 3x2 tile, cột tile cuối chỉ có 22 ô và hàng tile cuối chỉ có 36 hàng.
+	const FIntPoint GridDimensions(150, 100);
+	constexpr float CellSize = 100.0f;
+
+	/** Vẽ lên lưới đúng các ô trong Cells: mỗi ô một nguồn có hình nón và vùng bán kính nhỏ hơn nửa ô. */
+	void SetVisibleCells(FOBVisibilityGrid& Grid, TConstArrayView<FIntPoint> Cells)
+	{
+		FOBVisionRules Rules;
+		Rules.VisionDistance = 1.0f;
+		Rules.ProximityRadius = 40.0f;
+
+		TArray<FTeammateVisionData> Sources;
+		Sources.Reserve(Cells.Num());
+		for (const FIntPoint& Cell : Cells)
+		{
+			FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+			Source.GroundLocation = FVector((Cell.X + 0.5f) * CellSize, (Cell.Y + 0.5f) * CellSize, 0.0f);
+			Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 100.0f);
+			Source.ForwardVector = FVector::ForwardVector;
+		}
+		Grid.Update(Sources, Rules);
+	}
+
+	/** Thêm các ô của Rect vào Cells và đánh dấu chúng trong Expected. */
+	void AddRect(const FIntRect& Rect, TArray<FIntPoint>& Cells, TArray<bool>& Expected)
+	{
+		for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; ++Y)
+		{
+			for (int32 X = Rect.Min.X; X < Rect.Max.X; ++X)
+			{
+				Cells.Add(FIntPoint(X, Y));
+				Expected[Y * GridDimensions.X + X] = true;
+			}
+		}
+	}
+
+	/** So IsCellExplored của từng ô với Expected và báo vài ô sai đầu tiên. @return Số ô sai. */
+	int32 CountMismatches(FAutomationTestBase& Test, const FOBExploredLayer& Layer, const TArray<bool>& Expected,
+	                      const TCHAR* What)
+	{
+		int32 NumMismatches = 0;
+		for (int32 Y = 0; Y < GridDimensions.Y; ++Y)
+		{
+			for (int32 X = 0; X < GridDimensions.X; ++X)
+			{
+				const bool bExplored = Layer.IsCellExplored(FIntPoint(X, Y));
+				if (bExplored != Expected[Y * GridDimensions.X + X] && NumMismatches++ < 10)
+				{
+					Test.AddError(FString::Printf(TEXT("%s: ô (%d, %d) %s"), What, X, Y,
+					                              bExplored ? TEXT("thừa") : TEXT("thiếu")));
+				}
+			}
+		}
+		return NumMismatches;
+	}
+
+	TArray<uint8> Save(FOBExploredLayer& Layer)
+	{
+		TArray<uint8> Data;
+		FMemoryWriter Writer(Data);
+		Layer.Serialize(Writer);
+		return Data;
+	}
+
+	void Load(FOBExploredLayer& Layer, const TArray<uint8>& Data)
+	{
+		FMemoryReader Reader(Data);
+		Layer.Serialize(Reader);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBExploredLayerAccumulateTest, "OBVisibilityFog.ExploredLayer.Accumulate",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBExploredLayerAccumulateTest::RunTest(const FString& Parameters)
+{
+	using namespace OBExploredLayerTests;
+
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D::ZeroVector, CellSize, GridDimensions);
+	FOBExploredLayer Layer;
+	Layer.Initialize(Grid);
+	TArray<bool> Expected;
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+
+	// Vùng nằm vắt qua hai tile và ô ở góc dưới phải của lưới
+	TArray<FIntPoint> Cells;
+	AddRect(FIntRect(50, 10, 90, 30), Cells, Expected);
+	AddRect(FIntRect(149, 99, 150, 100), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	TestEqual(TEXT("Lần đầu: số tile có ô mới"),
+	          Layer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions)), 3);
+	TestEqual(TEXT("Lần đầu"), CountMismatches(*this, Layer, Expected, TEXT("Lần đầu")), 0);
+
+	// Vùng cũ không còn được nhìn thấy nhưng vẫn là đã khám phá; chỉ vùng vừa vẽ lại được cộng dồn
+	Cells.Reset();
+	AddRect(FIntRect(100, 60, 140, 100), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	FIntRect UpdateRect;
+	if (!TestTrue(TEXT("Lưới có vùng vẽ lại"), Grid.GetLastUpdateRect(UpdateRect)))
+	{
+		return false;
+	}
+	TestTrue(TEXT("Lần hai có tile thay đổi"), Layer.Accumulate(Grid, UpdateRect) > 0);
+	TestEqual(TEXT("Lần hai"), CountMismatches(*this, Layer, Expected, TEXT("Lần hai")), 0);
+	TestEqual(TEXT("Cộng dồn lại cùng dữ liệu không đổi tile nào"),
+	          Layer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions)), 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBExploredLayerEdgeCompactionTest, "OBVisibilityFog.ExploredLayer.EdgeCompaction",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBExploredLayerEdgeCompactionTest::RunTest(const FString& Parameters)
+{
+	using namespace OBExploredLayerTests;
+
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D::ZeroVector, CellSize, GridDimensions);
+	FOBExploredLayer Layer;
+	Layer.Initialize(Grid);
+	TArray<bool> Expected;
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+
+	// Cột tile bên phải và hàng tile bên dưới, gồm cả các tile chỉ có một phần ô hợp lệ
+	TArray<FIntPoint> Cells;
+	AddRect(FIntRect(128, 0, 150, 64), Cells, Expected);
+	AddRect(FIntRect(0, 64, 150, 100), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	Layer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions));
+	TestEqual(TEXT("Các tile đã khám phá hết được gộp, kể cả tile ở mép"), Layer.GetNumAllocatedTiles(), 0);
+	TestEqual(TEXT("Tile đầy"), CountMismatches(*this, Layer, Expected, TEXT("Tile đầy")), 0);
+
+	// Thiếu một ô hợp lệ thì tile ở mép không được gộp
+	FOBExploredLayer PartialLayer;
+	PartialLayer.Initialize(Grid);
+	Cells.Reset();
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+	AddRect(FIntRect(128, 64, 149, 100), Cells, Expected);
+	AddRect(FIntRect(149, 64, 150, 99), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	PartialLayer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions));
+	TestEqual(TEXT("Tile ở góc thiếu một ô vẫn giữ bộ nhớ"), PartialLayer.GetNumAllocatedTiles(), 1);
+	TestEqual(TEXT("Tile thiếu một ô"), CountMismatches(*this, PartialLayer, Expected, TEXT("Tile thiếu một ô")), 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBExploredLayerSerializeTest, "OBVisibilityFog.ExploredLayer.Serialize",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBExploredLayerSerializeTest::RunTest(const FString& Parameters)
+{
+	using namespace OBExploredLayerTests;
+
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D::ZeroVector, CellSize, GridDimensions);
+	FOBExploredLayer Layer;
+	Layer.Initialize(Grid);
+	TArray<bool> Expected;
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+
+	// Tile (0, 0) liền mạch (RunLength), tile (1, 0) lốm đốm (Raw) và tile (2, 1) ở góc đã đầy (Full)
+	TArray<FIntPoint> Cells;
+	AddRect(FIntRect(5, 5, 40, 50), Cells, Expected);
+	FRandomStream Random(1337);
+	for (int32 Index = 0; Index < 600; ++Index)
+	{
+		const FIntPoint Cell(Random.RandRange(64, 127), Random.RandRange(0, 63));
+		AddRect(FIntRect(Cell, Cell + FIntPoint(1, 1)), Cells, Expected);
+	}
+	AddRect(FIntRect(128, 64, 150, 100), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	Layer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions));
+	TestEqual(TEXT("Số tile còn bộ nhớ trước khi lưu"), Layer.GetNumAllocatedTiles(), 2);
+
+	const TArray<uint8> Data = Save(Layer);
+	// Tile lốm đốm chiếm một bitmap thô 512 byte, tile liền mạch và tile đầy nhỏ hơn nhiều
+	TestTrue(TEXT("Kích thước dữ liệu đã lưu"), Data.Num() > 512 && Data.Num() < 2 * 512);
+
+	// Nạp được OR vào trạng thái hiện tại
+	FOBExploredLayer Loaded;
+	Loaded.Initialize(Grid);
+	TArray<FIntPoint> ExistingCells;
+	AddRect(FIntRect(10, 70, 20, 80), ExistingCells, Expected);
+	SetVisibleCells(Grid, ExistingCells);
+	Loaded.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions));
+	Load(Loaded, Data);
+	TestEqual(TEXT("Nạp lại"), CountMismatches(*this, Loaded, Expected, TEXT("Nạp lại")), 0);
+	TestEqual(TEXT("Tile đầy vẫn được gộp sau khi nạp"), Loaded.GetNumAllocatedTiles(), 3);
+
+	// Lưu lại lớp vừa nạp rồi nạp vào lớp mới cho đúng các ô đó, kể cả tile có sẵn
+	FOBExploredLayer Reloaded;
+	Reloaded.Initialize(Grid);
+	Load(Reloaded, Save(Loaded));
+	TestEqual(TEXT("Lưu rồi nạp lần hai"), CountMismatches(*this, Reloaded, Expected, TEXT("Lưu rồi nạp lần hai")), 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBExploredLayerRejectTest, "OBVisibilityFog.ExploredLayer.Reject",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBExploredLayerRejectTest::RunTest(const FString& Parameters)
+{
+	using namespace OBExploredLayerTests;
+
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D::ZeroVector, CellSize, GridDimensions);
+	FOBExploredLayer Layer;
+	Layer.Initialize(Grid);
+	TArray<bool> Expected;
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+	TArray<FIntPoint> Cells;
+	AddRect(FIntRect(20, 20, 90, 80), Cells, Expected);
+	SetVisibleCells(Grid, Cells);
+	Layer.Accumulate(Grid, FIntRect(FIntPoint::ZeroValue, GridDimensions));
+	const TArray<uint8> Data = Save(Layer);
+
+	AddExpectedMessage(TEXT("FOBExploredLayer: Bỏ qua dữ liệu không tương thích"), ELogVerbosity::Warning,
+	                   EAutomationExpectedMessageFlags::Contains, 2, false);
+
+	// Lưới khác kích thước
+	FOBVisibilityGrid OtherGrid;
+	OtherGrid.Initialize(FVector2D::ZeroVector, CellSize, GridDimensions - FIntPoint(10, 0));
+	FOBExploredLayer OtherLayer;
+	OtherLayer.Initialize(OtherGrid);
+	Load(OtherLayer, Data);
+	TestEqual(TEXT("Lưới khác kích thước không nạp tile nào"), OtherLayer.GetNumAllocatedTiles(), 0);
+	TestFalse(TEXT("Lưới khác kích thước không có ô nào được khám phá"), OtherLayer.IsCellExplored(FIntPoint(50, 50)));
+
+	// Phiên bản khác: số phiên bản là uint32 đầu tiên của luồng
+	TArray<uint8> OtherVersion = Data;
+	OtherVersion[0] = 99;
+	FOBExploredLayer SameSizeLayer;
+	SameSizeLayer.Initialize(Grid);
+	Load(SameSizeLayer, OtherVersion);
+	Expected.Init(false, GridDimensions.X * GridDimensions.Y);
+	TestEqual(TEXT("Phiên bản khác"), CountMismatches(*this, SameSizeLayer, Expected, TEXT("Phiên bản khác")), 0);
+	return true;
+}
+
+#endif
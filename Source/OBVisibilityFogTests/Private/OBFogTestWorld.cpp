@@ -0,0 +1,164 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OBFogTestWorld.h"
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Components/PostProcessComponent.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/OverlapResult.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialParameterCollection.h"
+#include "OBVisibilityFogComponent.h"
+
+FOBFogTestWorld::FOBFogTestWorld()
+{
+	World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("OBFogTestWorld"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+	// Không có GameMode để gọi StartPlay, nên tự phát BeginPlay cho các actor
+	World->GetWorldSettings()->NotifyBeginPlay();
+}
+
+FOBFogTestWorld::~FOBFogTestWorld()
+{
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+}
+
+void FOBFogTestWorld::Tick(const float Seconds)
+{
+	constexpr float StepSeconds = 0.1f;
+	for (float Elapsed = 0.0f; Elapsed < Seconds; Elapsed += StepSeconds)
+	{
+		World->Tick(LEVELTICK_All, StepSeconds);
+	}
+}
+
+AStaticMeshActor* FOBFogTestWorld::SpawnCube(const FVector& Location, const FVector& Scale, const FRotator& Rotation)
+{
+	AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(Location, Rotation);
+	if (Actor)
+	{
+		Actor->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+		Actor->GetStaticMeshComponent()->SetStaticMesh(
+			LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+		Actor->SetActorScale3D(Scale);
+	}
+	return Actor;
+}
+
+UOBVisibilityFogComponent* FOBFogTestWorld::SpawnFogViewer(const FVector& Location, const FRotator& Rotation)
+{
+	return SpawnFogViewer(Location, Rotation, [](UOBVisibilityFogComponent&)
+	{
+	});
+}
+
+UOBVisibilityFogComponent* FOBFogTestWorld::SpawnFogViewer(const FVector& Location, const FRotator& Rotation,
+                                                           const TFunctionRef<void(UOBVisibilityFogComponent&)> Configure)
+{
+	UMaterialParameterCollection* VisionMPC = LoadObject<UMaterialParameterCollection>(
+		nullptr, TEXT("/OBVisibilityFog/Material/MPC_PlayerVision.MPC_PlayerVision"));
+	AActor* Viewer = World->SpawnActor<AActor>();
+	if (!VisionMPC || !Viewer)
+	{
+		return nullptr;
+	}
+
+	USceneComponent* Root = NewObject<USceneComponent>(Viewer, TEXT("Root"));
+	Viewer->SetRootComponent(Root);
+	Root->RegisterComponent();
+	Viewer->SetActorLocationAndRotation(Location, Rotation);
+
+	USceneCaptureComponent2D* Capture = NewObject<USceneCaptureComponent2D>(Viewer, TEXT("DepthCapture"));
+	Capture->SetupAttachment(Root);
+	Capture->RegisterComponent();
+
+	UPostProcessComponent* PostProcess = NewObject<UPostProcessComponent>(Viewer, TEXT("FogPostProcess"));
+	PostProcess->SetupAttachment(Root);
+	PostProcess->RegisterComponent();
+
+	UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(Viewer, TEXT("VisionDepth"));
+	RenderTarget->InitCustomFormat(256, 256, PF_R32_FLOAT, false);
+
+	UOBVisibilityFogComponent* FogComponent = NewObject<UOBVisibilityFogComponent>(Viewer, TEXT("VisibilityFog"));
+	FogComponent->InitializeFogComponents(Capture, PostProcess, UMaterial::GetDefaultMaterial(MD_PostProcess));
+	FogComponent->DepthRenderTarget = RenderTarget;
+	FogComponent->VisionMPC = VisionMPC;
+	Configure(*FogComponent);
+
+	// World đã BeginPlay nên component chạy BeginPlay ngay khi đăng ký
+	FogComponent->RegisterComponent();
+
+	// UpdateData chỉ có hiệu lực sau timer 1 giây của BeginPlay
+	Tick(1.1f);
+	return FogComponent;
+}
+
+TSet<AActor*> FOBFogTestWorld::QueryReferenceActorsInCone(const UOBVisibilityFogComponent& Component)
+{
+	const AActor* Owner = Component.GetOwner();
+	const FVector Eye = Component.DepthCaptureComponent->GetComponentLocation();
+	const FVector Forward = Owner->GetActorForwardVector();
+	const float VisionConeCos = FMath::Cos(FMath::DegreesToRadians(Component.VisionAngleDegrees * 0.5f));
+
+	TArray<FOverlapResult> OverlapResults;
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(FogOfWarTrace), false, Owner);
+	Component.GetWorld()->OverlapMultiByChannel(OverlapResults, Eye, FQuat::Identity, Component.VisionTraceChannel,
+	                                            FCollisionShape::MakeSphere(Component.VisionDistance), QueryParams);
+
+	TSet<AActor*> Result;
+	for (const FOverlapResult& Overlap : OverlapResults)
+	{
+		AActor* Actor = Overlap.GetActor();
+		if (IsValid(Actor) && FVector::DotProduct(Forward, (Actor->GetActorLocation() - Eye).GetSafeNormal())
+			>= VisionConeCos)
+		{
+			Result.Add(Actor);
+		}
+	}
+	return Result;
+}
+
+bool FOBFogTestWorld::TestActorsInCone(FAutomationTestBase& Test, const UOBVisibilityFogComponent& Component,
+                                       const FString& What)
+{
+	const TSet<AActor*> Expected = QueryReferenceActorsInCone(Component);
+	const TArray<AActor*> Actual = Component.GetActorsInCone();
+
+	bool bSame = Actual.Num() == Expected.Num();
+	for (const AActor* Actor : Actual)
+	{
+		if (!Expected.Contains(Actor))
+		{
+			Test.AddError(FString::Printf(TEXT("%s: %s nằm trong ActorsInCone nhưng không có trong truy vấn tham chiếu"),
+			                              *What, *GetNameSafe(Actor)));
+			bSame = false;
+		}
+	}
+	for (const AActor* Actor : Expected)
+	{
+		if (!Actual.Contains(Actor))
+		{
+			Test.AddError(FString::Printf(TEXT("%s: thiếu %s trong ActorsInCone"), *What, *GetNameSafe(Actor)));
+			bSame = false;
+		}
+	}
+	return bSame;
+}
+
+#endif
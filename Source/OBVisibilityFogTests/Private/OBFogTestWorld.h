@@ -0,0 +1,54 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AStaticMeshActor;
+class FAutomationTestBase;
+class UOBVisibilityFogComponent;
+class UWorld;
+
+/**
+ * @class FOBFogTestWorld
+ * @brief World game tạm cho automation test của plugin, chạy được headless (-nullrhi).
+ * World đã BeginPlay ngay sau khi tạo và bị hủy cùng đối tượng này.
+ */
+class FOBFogTestWorld
+{
+public:
+	FOBFogTestWorld();
+	~FOBFogTestWorld();
+	UE_NONCOPYABLE(FOBFogTestWorld);
+
+	UWorld* GetWorld() const { return World; }
+
+	/** Tick World theo bước 0.1 giây cho tới hết Seconds: timer, tick function và scene vật lý đều được cập nhật. */
+	void Tick(float Seconds);
+
+	/** Spawn khối lập phương 100 cm của engine (collision BlockAll, Movable). */
+	AStaticMeshActor* SpawnCube(const FVector& Location, const FVector& Scale = FVector::OneVector,
+	                            const FRotator& Rotation = FRotator::ZeroRotator);
+
+	/**
+	 * Spawn một actor mang UOBVisibilityFogComponent với đủ dependency: capture, post process, render target
+	 * 256x256 R32F riêng và MPC_PlayerVision của plugin. Configure được gọi trước BeginPlay của component.
+	 * @return Component đã qua timer khởi động, sẵn sàng nhận UpdateData; nullptr nếu không dựng được.
+	 */
+	UOBVisibilityFogComponent* SpawnFogViewer(const FVector& Location, const FRotator& Rotation,
+	                                          TFunctionRef<void(UOBVisibilityFogComponent&)> Configure);
+	UOBVisibilityFogComponent* SpawnFogViewer(const FVector& Location, const FRotator& Rotation);
+
+	/**
+	 * Tập actor trong hình nón tính độc lập với component, đúng như truy vấn gốc: OverlapMultiByChannel hình cầu
+	 * VisionDistance quanh mắt trên VisionTraceChannel (bỏ qua Owner), rồi kiểm tra góc theo pivot của actor.
+	 */
+	static TSet<AActor*> QueryReferenceActorsInCone(const UOBVisibilityFogComponent& Component);
+
+	/** So GetActorsInCone với QueryReferenceActorsInCone và báo từng actor thừa/thiếu. @return true nếu trùng nhau. */
+	static bool TestActorsInCone(FAutomationTestBase& Test, const UOBVisibilityFogComponent& Component,
+	                             const FString& What);
+
+private:
+	UWorld* World = nullptr;
+};
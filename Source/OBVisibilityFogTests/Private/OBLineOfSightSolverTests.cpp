@@ -0,0 +1,100 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "OBFogTestWorld.h"
+#include "OBLineOfSightSolver.h"
+#include "OBVisibilityGrid.h"
+
+namespace OBLineOfSightSolverTests
+{
+	// Nguồn ở độ cao 100 cm nhìn theo trục X.
+	FTeammateVisionData MakeSource(const FVector2D& Location)
+	{
+		FTeammateVisionData Source;
+		Source.GroundLocation = FVector(Location, 0.0f);
+		Source.EyeLocation = FVector(Location, 100.0f);
+		Source.ForwardVector = FVector::ForwardVector;
+		return Source;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBLineOfSightReorderedSourcesTest, "OBVisibilityFog.LineOfSight.ReorderedSources",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBLineOfSightReorderedSourcesTest::RunTest(const FString& Parameters)
+{
+	using namespace OBLineOfSightSolverTests;
+
+	FOBFogTestWorld TestWorld;
+	UWorld* World = TestWorld.GetWorld();
+
+	// Tường dày 100 cm cắt ngang hình nón của A ở X = 550; B và C nhìn ra khoảng trống
+	AStaticMeshActor* Wall = TestWorld.SpawnCube(FVector(600.0f, 0.0f, 100.0f), FVector(1.0f, 6.0f, 4.0f));
+	AActor* ActorA = World->SpawnActor<AActor>();
+	AActor* ActorB = World->SpawnActor<AActor>();
+	AActor* ActorC = World->SpawnActor<AActor>();
+	if (!TestNotNull(TEXT("Spawn tường"), Wall) || !TestNotNull(TEXT("Spawn nguồn"), ActorA)
+		|| !TestNotNull(TEXT("Spawn nguồn"), ActorB) || !TestNotNull(TEXT("Spawn nguồn"), ActorC))
+	{
+		return false;
+	}
+	const FTeammateVisionData SourceA = MakeSource(FVector2D(0.0f, 0.0f));
+	const FTeammateVisionData SourceB = MakeSource(FVector2D(0.0f, 5000.0f));
+	const FTeammateVisionData SourceC = MakeSource(FVector2D(0.0f, 2500.0f));
+
+	FOBVisionRules Rules;
+	Rules.VisionDistance = 2000.0f;
+	Rules.VisionAngleDegrees = 60.0f;
+	Rules.ProximityRadius = 100.0f;
+
+	FOBLineOfSightSolver Solver;
+	Solver.Configure(33, ECC_Visibility);
+	const FTeammateVisionData KickedSources[] = {SourceA, SourceB};
+	const TObjectKey<AActor> KickedActors[] = {TObjectKey<AActor>(ActorA), TObjectKey<AActor>(ActorB)};
+	Solver.Kick(World, KickedSources, KickedActors, Rules);
+
+	// Một frame của engine: World tick chạy các trace bất đồng bộ, GFrameCounter tăng ở cuối vòng lặp
+	TestWorld.Tick(0.1f);
+	++GFrameCounter;
+	if (!TestTrue(TEXT("Gather thu được batch"), Solver.Gather(World)))
+	{
+		return false;
+	}
+
+	const TConstArrayView<FOBVisibilityPolygon> Polygons = Solver.GetPolygons();
+	if (!TestEqual(TEXT("Số đa giác"), Polygons.Num(), 2))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Tia giữa của A dừng ở tường"), Polygons[0].GetDistanceAtYaw(0.0f), 550.0f, 5.0f);
+	TestEqual(TEXT("Tia giữa của B không bị chặn"), Polygons[1].GetDistanceAtYaw(0.0f), Rules.VisionDistance);
+
+	// Giữa Kick và Gather danh sách đã đổi: C được thêm vào giữa và A bị dời xuống cuối (như RemoveAllSwap)
+	const FTeammateVisionData Sources[] = {SourceB, SourceC, SourceA};
+	const TObjectKey<AActor> SourceActors[] = {
+		TObjectKey<AActor>(ActorB), TObjectKey<AActor>(ActorC), TObjectKey<AActor>(ActorA)
+	};
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D(-1000.0f, -1000.0f), 50.0f, FIntPoint(80, 140));
+	Grid.Update(Sources, Rules, Polygons, SourceActors);
+
+	TestTrue(TEXT("A thấy trước tường"), Grid.IsLocationVisible(FVector(300.0f, 0.0f, 0.0f)));
+	TestFalse(TEXT("A không thấy sau tường"), Grid.IsLocationVisible(FVector(1500.0f, 0.0f, 0.0f)));
+	TestTrue(TEXT("B không bị che bởi đa giác của A"), Grid.IsLocationVisible(FVector(1500.0f, 5000.0f, 0.0f)));
+	TestTrue(TEXT("C chưa có đa giác nên không bị che"), Grid.IsLocationVisible(FVector(1500.0f, 2500.0f, 0.0f)));
+
+	// Nguồn không có actor không được lấy đa giác của nguồn có actor ở cùng chỉ số
+	const FTeammateVisionData SwappedSources[] = {SourceB, SourceA};
+	const TObjectKey<AActor> SwappedActors[] = {TObjectKey<AActor>(), TObjectKey<AActor>(ActorA)};
+	Grid.Update(SwappedSources, Rules, Polygons, SwappedActors);
+	TestTrue(TEXT("Nguồn không có actor không bị che"), Grid.IsLocationVisible(FVector(1500.0f, 5000.0f, 0.0f)));
+	TestFalse(TEXT("A vẫn bị che khi khớp theo actor"), Grid.IsLocationVisible(FVector(1500.0f, 0.0f, 0.0f)));
+	return true;
+}
+
+#endif
@@ -0,0 +1,211 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Math/RandomStream.h"
+#include "OBFogTestWorld.h"
+#include "OBServerVisibilitySolver.h"
+#include "OBServerVisibilitySubsystem.h"
+
+namespace OBServerVisibilityTests
+{
+	// Tập tầm nhìn tính bằng vét cạn mọi cặp nguồn - mục tiêu với FOBVisionRules::IsLocationVisible.
+	uint64 BruteForceMask(TConstArrayView<FOBServerVisibilitySolver::FSource> Sources,
+	                      const FOBServerVisibilitySolver::FTarget& Target)
+	{
+		uint64 Mask = Target.TeamIndex != INDEX_NONE ? uint64(1) << Target.TeamIndex : 0;
+		for (const FOBServerVisibilitySolver::FSource& Source : Sources)
+		{
+			if (Source.Rules.IsLocationVisible(Source.Vision, Target.Location, Source.Rules.GetVisionConeCos()))
+			{
+				Mask |= uint64(1) << Source.TeamIndex;
+			}
+		}
+		return Mask;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBServerVisibilitySolveTest, "OBVisibilityFog.ServerVisibility.Solve",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBServerVisibilitySolveTest::RunTest(const FString& Parameters)
+{
+	using namespace OBServerVisibilityTests;
+
+	FRandomStream Random(1337);
+	FOBServerVisibilitySolver Solver;
+	TArray<uint64> Masks;
+
+	// Ô nhỏ hơn, xấp xỉ và lớn hơn tầm nhìn; cùng một solver để kiểm tra cả việc dùng lại bộ nhớ giữa các lần Solve
+	for (const float CellSize : {500.0f, 2000.0f, 7000.0f})
+	{
+		TArray<FOBServerVisibilitySolver::FSource> Sources;
+		for (int32 Index = 0; Index < 40; ++Index)
+		{
+			FOBServerVisibilitySolver::FSource& Source = Sources.AddDefaulted_GetRef();
+			Source.Vision.GroundLocation = FVector(Random.FRandRange(-8000.0f, 8000.0f),
+			                                       Random.FRandRange(-8000.0f, 8000.0f), 0.0f);
+			Source.Vision.EyeLocation = Source.Vision.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+			Source.Vision.ForwardVector = FRotator(Random.FRandRange(-20.0f, 20.0f), Random.FRandRange(-180.0f, 180.0f),
+			                                       0.0f).Vector();
+			Source.Rules.VisionDistance = Random.FRandRange(1000.0f, 4000.0f);
+			Source.Rules.VisionAngleDegrees = Random.FRandRange(30.0f, 360.0f);
+			Source.Rules.ProximityRadius = Random.FRandRange(100.0f, 900.0f);
+			Source.TeamIndex = Index % 5;
+		}
+
+		// Mục tiêu trung lập và của từng team, thêm vài mục tiêu nằm đúng trên biên ô
+		TArray<FOBServerVisibilitySolver::FTarget> Targets;
+		for (int32 Index = 0; Index < 3000; ++Index)
+		{
+			FOBServerVisibilitySolver::FTarget& Target = Targets.AddDefaulted_GetRef();
+			Target.Location = FVector(Random.FRandRange(-10000.0f, 10000.0f), Random.FRandRange(-10000.0f, 10000.0f),
+			                          Random.FRandRange(-300.0f, 300.0f));
+			if (Index % 10 == 0)
+			{
+				Target.Location.X = FMath::RoundToFloat(Target.Location.X / CellSize) * CellSize;
+			}
+			Target.TeamIndex = Index % 7 < 5 ? Index % 7 : INDEX_NONE;
+		}
+
+		Solver.SetCellSize(CellSize);
+		Solver.Solve(Sources, Targets, Masks);
+		if (!TestEqual(TEXT("Số mask"), Masks.Num(), Targets.Num()))
+		{
+			return false;
+		}
+
+		// Solver dùng đúng IsLocationVisible nên kết quả phải trùng hoàn toàn với vét cạn
+		int32 NumMismatches = 0;
+		for (int32 Index = 0; Index < Targets.Num(); ++Index)
+		{
+			const uint64 Expected = BruteForceMask(Sources, Targets[Index]);
+			if (Masks[Index] != Expected && ++NumMismatches <= 10)
+			{
+				AddError(FString::Printf(TEXT("CellSize %.0f, mục tiêu %d tại %s: Solve = %llx, vét cạn = %llx"),
+				                         CellSize, Index, *Targets[Index].Location.ToString(), Masks[Index], Expected));
+			}
+		}
+		TestEqual(FString::Printf(TEXT("CellSize %.0f: số mục tiêu sai"), CellSize), NumMismatches, 0);
+		TestTrue(FString::Printf(TEXT("CellSize %.0f: ít phép kiểm tra hơn vét cạn"), CellSize),
+		         Solver.GetLastNumTests() < Sources.Num() * Targets.Num());
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBServerVisibilityStaleEntriesTest, "OBVisibilityFog.ServerVisibility.StaleEntries",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBServerVisibilityStaleEntriesTest::RunTest(const FString& Parameters)
+{
+	using namespace OBServerVisibilityTests;
+
+	FOBFogTestWorld TestWorld;
+	UOBServerVisibilitySubsystem* Subsystem = TestWorld.GetWorld()->GetSubsystem<UOBServerVisibilitySubsystem>();
+	if (!TestNotNull(TEXT("UOBServerVisibilitySubsystem"), Subsystem))
+	{
+		return false;
+	}
+
+	FOBVisionRules Rules;
+	Rules.VisionDistance = 2000.0f;
+	Rules.ProximityRadius = 300.0f;
+
+	// Hai nguồn team 0 và 1 nhìn về hai hướng ngược nhau, mục tiêu trung lập rải quanh
+	TArray<AActor*> SourceActors;
+	for (int32 Index = 0; Index < 3; ++Index)
+	{
+		AActor* Source = TestWorld.SpawnCube(FVector(0.0f, 400.0f * Index, 0.0f), FVector::OneVector,
+		                                     FRotator(0.0f, Index % 2 == 0 ? 0.0f : 180.0f, 0.0f));
+		Subsystem->RegisterVisionSource(Source, Index % 2, Rules);
+		SourceActors.Add(Source);
+	}
+	TArray<AActor*> TargetActors;
+	for (int32 Index = 0; Index < 6; ++Index)
+	{
+		AActor* Target = TestWorld.SpawnCube(FVector(Index % 2 == 0 ? 1200.0f : -1200.0f, 300.0f * Index, 0.0f));
+		Subsystem->RegisterVisibilityTarget(Target, INDEX_NONE);
+		TargetActors.Add(Target);
+	}
+
+	// Actor cuối mỗi danh sách bị hủy mà không hủy đăng ký, rồi hủy đăng ký actor đầu: RemoveAtSwap kéo mục
+	// đã chết vào chỗ trống. Chỉ mục không được trỏ sai hay chứa key rỗng sau đó
+	SourceActors.Pop()->Destroy();
+	TargetActors.Pop()->Destroy();
+	Subsystem->UnregisterVisionSource(SourceActors[0]);
+	Subsystem->UnregisterVisibilityTarget(TargetActors[0]);
+	SourceActors.RemoveAt(0);
+	TargetActors.RemoveAt(0);
+
+	TestTrue(TEXT("Actor chưa đăng ký (nullptr) luôn được xem là nhìn thấy"),
+	         Subsystem->IsActorVisibleToTeam(nullptr, 0));
+
+	// Đăng ký thêm sau khi có mục đã chết trong danh sách
+	AActor* LateSource = TestWorld.SpawnCube(FVector(-600.0f, 0.0f, 0.0f), FVector::OneVector,
+	                                         FRotator(0.0f, 180.0f, 0.0f));
+	Subsystem->RegisterVisionSource(LateSource, 0, Rules);
+	SourceActors.Add(LateSource);
+	AActor* LateTarget = TestWorld.SpawnCube(FVector(-1500.0f, 100.0f, 0.0f));
+	Subsystem->RegisterVisibilityTarget(LateTarget, INDEX_NONE);
+	TargetActors.Add(LateTarget);
+
+	Subsystem->UpdateVisibility();
+
+	TArray<FOBServerVisibilitySolver::FSource> Sources;
+	for (const AActor* Actor : SourceActors)
+	{
+		FOBServerVisibilitySolver::FSource& Source = Sources.AddDefaulted_GetRef();
+		Source.Vision.EyeLocation = Actor->GetActorLocation();
+		Source.Vision.ForwardVector = Actor->GetActorForwardVector();
+		Source.Vision.GroundLocation = Actor->GetActorLocation();
+		Source.Rules = Rules;
+		Source.TeamIndex = Actor == LateSource ? 0 : 1;
+	}
+
+	int32 NumVisible = 0;
+	for (const AActor* Actor : TargetActors)
+	{
+		FOBServerVisibilitySolver::FTarget Target;
+		Target.Location = Actor->GetActorLocation();
+		const uint64 Expected = BruteForceMask(Sources, Target);
+		for (int32 TeamId = 0; TeamId < 2; ++TeamId)
+		{
+			const bool bExpected = (Expected >> TeamId) & 1;
+			NumVisible += bExpected ? 1 : 0;
+			TestEqual(FString::Printf(TEXT("%s nhìn thấy bởi team %d"), *Actor->GetName(), TeamId),
+			          Subsystem->IsActorVisibleToTeam(Actor, TeamId), bExpected);
+		}
+	}
+	TestTrue(TEXT("Cảnh có mục tiêu được nhìn thấy"), NumVisible > 0);
+
+	// Nguồn còn sống vẫn là mục tiêu của team mình, và danh sách cho Replication Graph không chứa actor đã chết
+	TArray<AActor*> VisibleToTeam;
+	Subsystem->GetActorsVisibleToTeam(0, VisibleToTeam);
+	TestTrue(TEXT("Nguồn đăng ký muộn có trong tập của team 0"), VisibleToTeam.Contains(LateSource));
+	for (const AActor* Actor : VisibleToTeam)
+	{
+		TestTrue(TEXT("GetActorsVisibleToTeam chỉ trả về actor còn sống"), IsValid(Actor));
+	}
+
+	// Hủy đăng ký toàn bộ phần còn lại phải xóa đúng từng mục
+	for (AActor* Actor : SourceActors)
+	{
+		Subsystem->UnregisterVisionSource(Actor);
+	}
+	for (AActor* Actor : TargetActors)
+	{
+		Subsystem->UnregisterVisibilityTarget(Actor);
+		TestTrue(FString::Printf(TEXT("%s đã hủy đăng ký được xem là nhìn thấy"), *Actor->GetName()),
+		         Subsystem->IsActorVisibleToTeam(Actor, 0) && Subsystem->IsActorVisibleToTeam(Actor, 1));
+	}
+	Subsystem->UpdateVisibility();
+	Subsystem->GetActorsVisibleToTeam(0, VisibleToTeam);
+	TestEqual(TEXT("Không còn mục tiêu nào sau khi hủy đăng ký"), VisibleToTeam.Num(), 0);
+	return true;
+}
+
+#endif
@@ -0,0 +1,90 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Math/RandomStream.h"
+#include "OBStealthRegistry.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBStealthRegistryEvaluateTest, "OBVisibilityFog.Stealth.Evaluate",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBStealthRegistryEvaluateTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Random(1337);
+	TArray<FTeammateVisionData> Sources;
+	for (int32 Index = 0; Index < 16; ++Index)
+	{
+		FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+		Source.GroundLocation = FVector(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 0.0f);
+		Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+		Source.ForwardVector = Random.GetUnitVector();
+	}
+
+	// Số vật thể không chia hết cho 4 để kiểm tra cả phần đệm; xóa vài vật thể để kiểm tra RemoveAtSwap
+	FOBStealthRegistry Registry;
+	TArray<FVector> Locations;
+	for (int32 Index = 0; Index < 2003; ++Index)
+	{
+		Locations.Add(FVector(Random.FRandRange(-6000.0f, 6000.0f), Random.FRandRange(-6000.0f, 6000.0f),
+		                      Random.FRandRange(-300.0f, 300.0f)));
+		Registry.Add(Locations.Last());
+	}
+	for (const int32 Index : {7, 1000, 1500})
+	{
+		Registry.RemoveAtSwap(Index);
+		Locations.RemoveAtSwap(Index);
+	}
+	if (!TestEqual(TEXT("Num"), Registry.Num(), Locations.Num()))
+	{
+		return false;
+	}
+
+	FOBVisionRules Rules;
+	Rules.VisionDistance = 3000.0f;
+	Rules.ProximityRadius = 800.0f;
+
+	TArray<uint8> Revealed;
+	Registry.Evaluate(Sources, Rules, Revealed);
+	if (!TestEqual(TEXT("Số kết quả"), Revealed.Num(), Locations.Num()))
+	{
+		return false;
+	}
+
+	// Đối chiếu với FOBVisionRules::IsLocationVisible. Registry lưu float, nên điểm nằm sát biên (trong 1 cm)
+	// được chấp nhận theo cả hai cách: chỉ bắt buộc khi kết quả không đổi với quy tắc co lại và nới ra
+	FOBVisionRules InnerRules = Rules;
+	InnerRules.VisionDistance -= 1.0f;
+	InnerRules.VisionAngleDegrees -= 0.01f;
+	InnerRules.ProximityRadius -= 1.0f;
+	InnerRules.ProximityMaxHeight -= 1.0f;
+	FOBVisionRules OuterRules = Rules;
+	OuterRules.VisionDistance += 1.0f;
+	OuterRules.VisionAngleDegrees += 0.01f;
+	OuterRules.ProximityRadius += 1.0f;
+	OuterRules.ProximityMaxHeight += 1.0f;
+
+	int32 NumRevealed = 0;
+	for (int32 Index = 0; Index < Locations.Num(); ++Index)
+	{
+		bool bInside = false;
+		bool bOutside = true;
+		for (const FTeammateVisionData& Source : Sources)
+		{
+			bInside |= InnerRules.IsLocationVisible(Source, Locations[Index], InnerRules.GetVisionConeCos());
+			bOutside &= !OuterRules.IsLocationVisible(Source, Locations[Index], OuterRules.GetVisionConeCos());
+		}
+		if ((bInside && !Revealed[Index]) || (bOutside && Revealed[Index]))
+		{
+			AddError(FString::Printf(TEXT("Vật thể %d tại %s: Evaluate = %d"), Index, *Locations[Index].ToString(),
+			                         Revealed[Index]));
+		}
+		NumRevealed += Revealed[Index];
+	}
+	TestTrue(TEXT("Có vật thể bị phát hiện"), NumRevealed > 0);
+	TestTrue(TEXT("Có vật thể không bị phát hiện"), NumRevealed < Locations.Num());
+	return true;
+}
+
+#endif
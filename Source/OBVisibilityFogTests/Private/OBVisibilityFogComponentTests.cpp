@@ -0,0 +1,312 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+// Kiểm tra UOBVisibilityFogComponent trong một World tạm, chạy headless:
+//   UnrealEditor-Cmd <Project> -game -nullrhi -ExecCmds="Automation RunTests OBVisibilityFog.Component; Quit"
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
+#include "Math/RandomStream.h"
+#include "OBFogTestWorld.h"
+#include "OBVisibilityFogComponent.h"
+#include "RenderingThread.h"
+
+namespace OBVisibilityFogComponentTests
+{
+	// Chiếu vị trí world bằng ma trận View-Projection ra NDC. @return false nếu vị trí nằm sau mắt.
+	bool ProjectToNdc(const FMatrix& ViewProjection, const FVector& WorldLocation, FVector& OutNdc)
+	{
+		const FVector4 Clip = ViewProjection.TransformFVector4(FVector4(WorldLocation, 1.0));
+		if (Clip.W <= UE_SMALL_NUMBER)
+		{
+			return false;
+		}
+		OutNdc = FVector(Clip.X, Clip.Y, Clip.Z) / Clip.W;
+		return true;
+	}
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	// Số byte đang được giữ dưới tag LLM của plugin (tag này được định nghĩa trong module OBVisibilityFog).
+	int64 GetFogTagBytes()
+	{
+		// Lệnh render được cấp phát dưới tag của plugin và giải phóng trên Render Thread, nên đợi chúng chạy xong
+		FlushRenderingCommands();
+		FLowLevelMemTracker::Get().UpdateStatsPerFrame();
+		return FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, FName(TEXT("OBVisibilityFog")),
+		                                                         ELLMTagSet::None);
+	}
+#endif
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityFogViewProjectionTest, "OBVisibilityFog.Component.ViewProjection",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityFogViewProjectionTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisibilityFogComponentTests;
+
+	FOBFogTestWorld TestWorld;
+	// Render target không vuông để kiểm tra FOV dọc được suy ra từ FOV ngang và tỉ lệ khung hình
+	UOBVisibilityFogComponent* FogComponent = TestWorld.SpawnFogViewer(
+		FVector(100.0f, 200.0f, 150.0f), FRotator(0.0f, 30.0f, 0.0f), [](UOBVisibilityFogComponent& Component)
+		{
+			Component.DepthRenderTarget->InitCustomFormat(256, 128, PF_R32_FLOAT, false);
+			Component.VisionAngleDegrees = 90.0f;
+			Component.VisionDistance = 2000.0f;
+		});
+	if (!TestNotNull(TEXT("UOBVisibilityFogComponent"), FogComponent))
+	{
+		return false;
+	}
+
+	const AActor* Viewer = FogComponent->GetOwner();
+	for (const float Yaw : {30.0f, 75.0f, -140.0f})
+	{
+		FogComponent->GetOwner()->SetActorRotation(FRotator(0.0f, Yaw, 0.0f));
+		FogComponent->UpdateData({});
+
+		const FString What = FString::Printf(TEXT("Yaw %.0f"), Yaw);
+		const FMatrix& ViewProjection = FogComponent->GetCapturedViewProjection();
+		const FVector Eye = FogComponent->DepthCaptureComponent->GetComponentLocation();
+		const FVector Forward = Viewer->GetActorForwardVector();
+		const FVector Right = Viewer->GetActorRightVector();
+		const FVector Up = Viewer->GetActorUpVector();
+
+		// Trục nhìn về giữa màn hình
+		FVector Ndc;
+		TestTrue(What + TEXT(": trục nhìn nằm trước mắt"), ProjectToNdc(ViewProjection, Eye + Forward * 1000.0f, Ndc));
+		TestEqual(What + TEXT(": trục nhìn NDC.X"), Ndc.X, 0.0, 1.0e-4);
+		TestEqual(What + TEXT(": trục nhìn NDC.Y"), Ndc.Y, 0.0, 1.0e-4);
+
+		// Nửa góc ngang 45 độ chạm đúng mép trái/phải
+		ProjectToNdc(ViewProjection, Eye + (Forward + Right) * 500.0f, Ndc);
+		TestEqual(What + TEXT(": mép phải NDC.X"), Ndc.X, 1.0, 1.0e-4);
+		TestEqual(What + TEXT(": mép phải NDC.Y"), Ndc.Y, 0.0, 1.0e-4);
+		ProjectToNdc(ViewProjection, Eye + (Forward - Right) * 500.0f, Ndc);
+		TestEqual(What + TEXT(": mép trái NDC.X"), Ndc.X, -1.0, 1.0e-4);
+
+		// Tỉ lệ 2:1 nên tan(nửa góc dọc) = tan(45 độ) / 2
+		ProjectToNdc(ViewProjection, Eye + (Forward + Up * 0.5f) * 500.0f, Ndc);
+		TestEqual(What + TEXT(": mép trên NDC.X"), Ndc.X, 0.0, 1.0e-4);
+		TestEqual(What + TEXT(": mép trên NDC.Y"), Ndc.Y, 1.0, 1.0e-4);
+
+		// Reversed-Z không có far plane, near plane ở VisionDistance: DeviceZ = VisionDistance / khoảng cách
+		ProjectToNdc(ViewProjection, Eye + Forward * FogComponent->VisionDistance, Ndc);
+		TestEqual(What + TEXT(": DeviceZ tại VisionDistance"), Ndc.Z, 1.0, 1.0e-4);
+		ProjectToNdc(ViewProjection, Eye + Forward * FogComponent->VisionDistance * 2.0f, Ndc);
+		TestEqual(What + TEXT(": DeviceZ tại 2 x VisionDistance"), Ndc.Z, 0.5, 1.0e-4);
+
+		// MPC phải chứa đúng ma trận của lần capture
+		const UMaterialParameterCollectionInstance* Instance =
+			TestWorld.GetWorld()->GetParameterCollectionInstance(FogComponent->VisionMPC);
+		if (!TestNotNull(TEXT("Instance của VisionMPC"), Instance))
+		{
+			return false;
+		}
+		for (int32 Row = 0; Row < 4; ++Row)
+		{
+			FLinearColor Value;
+			TestTrue(What + FString::Printf(TEXT(": MPC có MatrixRow%d"), Row),
+			         Instance->GetVectorParameterValue(FName(*FString::Printf(TEXT("MatrixRow%d"), Row)), Value));
+			TestTrue(What + FString::Printf(TEXT(": MatrixRow%d khớp ma trận capture"), Row),
+			         Value.Equals(FLinearColor(ViewProjection.M[Row][0], ViewProjection.M[Row][1],
+			                                   ViewProjection.M[Row][2], ViewProjection.M[Row][3]), 1.0e-4f));
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityFogActorsInConeTest, "OBVisibilityFog.Component.ActorsInCone",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityFogActorsInConeTest::RunTest(const FString& Parameters)
+{
+	FOBFogTestWorld TestWorld;
+	UOBVisibilityFogComponent* FogComponent = TestWorld.SpawnFogViewer(FVector(0.0f, 0.0f, 50.0f), FRotator::ZeroRotator);
+	if (!TestNotNull(TEXT("UOBVisibilityFogComponent"), FogComponent))
+	{
+		return false;
+	}
+
+	// Cảnh lặp lại được: khối lập phương rải quanh mắt, chừa chỗ cho người xem
+	FRandomStream Random(1337);
+	for (int32 Index = 0; Index < 120; ++Index)
+	{
+		FVector Location(Random.FRandRange(-3000.0f, 3000.0f), Random.FRandRange(-3000.0f, 3000.0f), 0.0f);
+		if (Location.Size2D() > 200.0f)
+		{
+			TestWorld.SpawnCube(Location);
+		}
+	}
+	// Cập nhật scene vật lý để truy vấn thấy các actor mới
+	TestWorld.Tick(0.1f);
+
+	// Xen kẽ bước nhỏ (dùng lại cache ứng viên) và bước lớn (vượt ngưỡng truy vấn lại)
+	int32 NumInCone = 0;
+	FVector Location = FogComponent->GetOwner()->GetActorLocation();
+	float Yaw = 0.0f;
+	for (int32 Step = 0; Step < 40; ++Step)
+	{
+		const bool bSmallStep = Step % 2 == 0;
+		Yaw += bSmallStep ? Random.FRandRange(-10.0f, 10.0f) : Random.FRandRange(-90.0f, 90.0f);
+		const float MoveDistance = bSmallStep ? 50.0f : 600.0f;
+		Location += FVector(Random.FRandRange(-MoveDistance, MoveDistance), Random.FRandRange(-MoveDistance, MoveDistance),
+		                    0.0f);
+		FogComponent->GetOwner()->SetActorLocationAndRotation(Location, FRotator(0.0f, Yaw, 0.0f));
+		FogComponent->UpdateData({});
+
+		FOBFogTestWorld::TestActorsInCone(*this, *FogComponent, FString::Printf(TEXT("Bước %d"), Step));
+		NumInCone += FogComponent->GetActorsInCone().Num();
+	}
+	TestTrue(TEXT("Cảnh có actor trong hình nón"), NumInCone > 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityFogCandidateCacheTest, "OBVisibilityFog.Component.CandidateCache",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityFogCandidateCacheTest::RunTest(const FString& Parameters)
+{
+	FOBFogTestWorld TestWorld;
+	UOBVisibilityFogComponent* FogComponent = TestWorld.SpawnFogViewer(FVector(0.0f, 0.0f, 50.0f), FRotator::ZeroRotator);
+	if (!TestNotNull(TEXT("UOBVisibilityFogComponent"), FogComponent))
+	{
+		return false;
+	}
+
+	// Thanh dài có pivot trong hình nón (38 độ, cách mắt 48 m) nhưng chỉ chạm hình cầu VisionDistance ở cạnh mắt,
+	// ngoài hình cầu bao hình quạt nhìn: truy vấn gốc tìm thấy nó
+	const AStaticMeshActor* Beam = TestWorld.SpawnCube(FVector(3750.0f, 3000.0f, 0.0f), FVector(84.48f, 0.2f, 1.0f),
+	                                                   FRotator(0.0f, 16.5f, 0.0f));
+	// Khối xoay 45 độ có bounds chạm hình cầu VisionDistance nhưng hình dạng va chạm thì không: truy vấn gốc bỏ qua nó
+	const AStaticMeshActor* Diamond = TestWorld.SpawnCube(FRotator(0.0f, 35.0f, 0.0f).Vector() * 2350.0f,
+	                                                      FVector(4.0f, 4.0f, 1.0f), FRotator(0.0f, 45.0f, 0.0f));
+
+	// Thêm các khối ngẫu nhiên có kích thước và hướng khác nhau
+	FRandomStream Random(4242);
+	for (int32 Index = 0; Index < 150; ++Index)
+	{
+		const FVector Location(Random.FRandRange(-4000.0f, 4000.0f), Random.FRandRange(-4000.0f, 4000.0f), 0.0f);
+		if (Location.Size2D() > 300.0f)
+		{
+			TestWorld.SpawnCube(Location, FVector(Random.FRandRange(0.5f, 6.0f), Random.FRandRange(0.5f, 6.0f), 1.0f),
+			                    FRotator(0.0f, Random.FRandRange(0.0f, 90.0f), 0.0f));
+		}
+	}
+	TestWorld.Tick(0.1f);
+
+	FogComponent->UpdateData({});
+	const TArray<AActor*> InitialActors = FogComponent->GetActorsInCone();
+	TestTrue(TEXT("Thanh dài chạm hình cầu cạnh mắt nằm trong ActorsInCone"), InitialActors.Contains(Beam));
+	TestFalse(TEXT("Khối chỉ có bounds chạm hình cầu không nằm trong ActorsInCone"), InitialActors.Contains(Diamond));
+	FOBFogTestWorld::TestActorsInCone(*this, *FogComponent, TEXT("Ban đầu"));
+
+	// Kết quả phải giống truy vấn gốc mỗi frame dù cache được dùng lại: xoay tại chỗ, di chuyển trong
+	// và vượt CandidateRequeryDistance
+	FVector Location = FogComponent->GetOwner()->GetActorLocation();
+	float Yaw = 0.0f;
+	for (int32 Step = 0; Step < 60; ++Step)
+	{
+		switch (Step % 3)
+		{
+		case 0:
+			Yaw += Random.FRandRange(-120.0f, 120.0f);
+			break;
+		case 1:
+			Location += FVector(Random.FRandRange(-100.0f, 100.0f), Random.FRandRange(-100.0f, 100.0f), 0.0f);
+			break;
+		default:
+			Location += FVector(Random.FRandRange(-500.0f, 500.0f), Random.FRandRange(-500.0f, 500.0f), 0.0f);
+			Yaw += Random.FRandRange(-15.0f, 15.0f);
+			break;
+		}
+		FogComponent->GetOwner()->SetActorLocationAndRotation(Location, FRotator(0.0f, Yaw, 0.0f));
+		FogComponent->UpdateData({});
+		FOBFogTestWorld::TestActorsInCone(*this, *FogComponent, FString::Printf(TEXT("Bước %d"), Step));
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityFogSteadyStateAllocationTest,
+                                 "OBVisibilityFog.Component.SteadyStateAllocations",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityFogSteadyStateAllocationTest::RunTest(const FString& Parameters)
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	using namespace OBVisibilityFogComponentTests;
+
+	if (!FLowLevelMemTracker::IsEnabled())
+	{
+		AddInfo(TEXT("LLM chưa bật, cần chạy với -llm để kiểm tra cấp phát của UpdateData"));
+		return true;
+	}
+
+	// Texture nguồn riêng của component, để mỗi lần UpdateData đều đóng gói và upload qua vòng staging
+	FOBFogTestWorld TestWorld;
+	UOBVisibilityFogComponent* FogComponent = TestWorld.SpawnFogViewer(
+		FVector(0.0f, 0.0f, 50.0f), FRotator::ZeroRotator, [](UOBVisibilityFogComponent& Component)
+		{
+			Component.bUseSharedTeamVision = false;
+		});
+	if (!TestNotNull(TEXT("UOBVisibilityFogComponent"), FogComponent))
+	{
+		return false;
+	}
+
+	FRandomStream Random(7);
+	for (int32 Index = 0; Index < 60; ++Index)
+	{
+		FVector Location(Random.FRandRange(-2500.0f, 2500.0f), Random.FRandRange(-2500.0f, 2500.0f), 0.0f);
+		if (Location.Size2D() > 200.0f)
+		{
+			TestWorld.SpawnCube(Location);
+		}
+	}
+	TestWorld.Tick(0.1f);
+
+	TArray<FTeammateVisionData> Teammates;
+	for (int32 Index = 0; Index < 3; ++Index)
+	{
+		FTeammateVisionData& Teammate = Teammates.AddDefaulted_GetRef();
+		Teammate.EyeLocation = FVector(-500.0f * (Index + 1), 300.0f * Index, 150.0f);
+		Teammate.ForwardVector = FRotator(0.0f, 40.0f * Index, 0.0f).Vector();
+		Teammate.GroundLocation = Teammate.EyeLocation - FVector(0.0f, 0.0f, 150.0f);
+	}
+
+	// Trạng thái ổn định: người xem dao động giữa hai tư thế gần nhau, nguồn và cảnh không đổi
+	AActor* Viewer = FogComponent->GetOwner();
+	const FVector Location = Viewer->GetActorLocation();
+	auto RunUpdates = [&](const int32 NumUpdates)
+	{
+		for (int32 Update = 0; Update < NumUpdates; ++Update)
+		{
+			const bool bEven = Update % 2 == 0;
+			Viewer->SetActorLocationAndRotation(Location + FVector(bEven ? 0.0f : 20.0f, 0.0f, 0.0f),
+			                                    FRotator(0.0f, bEven ? -5.0f : 5.0f, 0.0f));
+			FogComponent->UpdateData(Teammates);
+		}
+	};
+
+	// Lượt đầu cho các buffer và slot staging đạt kích thước ổn định
+	RunUpdates(16);
+	const int64 BytesBefore = GetFogTagBytes();
+	RunUpdates(64);
+	const int64 BytesAfter = GetFogTagBytes();
+
+	TestEqual(TEXT("Số byte dưới tag LLM OBVisibilityFog sau 64 lần UpdateData ổn định"), BytesAfter - BytesBefore,
+	          static_cast<int64>(0));
+#else
+	AddInfo(TEXT("Build không có LLM, bỏ qua kiểm tra cấp phát của UpdateData"));
+#endif
+	return true;
+}
+
+#endif
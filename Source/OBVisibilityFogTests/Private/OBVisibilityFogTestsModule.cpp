@@ -0,0 +1,7 @@
+﻿// Copyright Epic Games, Inc. All Rights Reserved.
+
+// Module chỉ chứa automation test của OBVisibilityFog (Session Frontend hoặc -ExecCmds="Automation RunTests OBVisibilityFog").
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, OBVisibilityFogTests)
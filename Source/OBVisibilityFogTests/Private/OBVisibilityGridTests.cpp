@@ -0,0 +1,163 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Math/RandomStream.h"
+#include "OBVisibilityGrid.h"
+
+namespace OBVisibilityGridTests
+{
+	// Quy tắc lệch đi một chút, để bỏ qua các ô nằm sát biên mà sai số làm tròn có thể quyết định.
+	FOBVisionRules OffsetRules(const FOBVisionRules& Rules, const float Sign)
+	{
+		FOBVisionRules Result = Rules;
+		Result.VisionDistance += Sign;
+		Result.VisionAngleDegrees += Sign * 0.01f;
+		Result.ProximityRadius += Sign;
+		return Result;
+	}
+
+	// Tâm ô có được nguồn nào nhìn thấy theo FOBVisionRules::IsLocationVisible không, ở độ cao của mắt nguồn.
+	bool IsCellVisibleBruteForce(const FOBVisibilityGrid& Grid, TConstArrayView<FTeammateVisionData> Sources,
+	                             const FOBVisionRules& Rules, const FIntPoint& Cell)
+	{
+		const FVector2D Center = Grid.GetOrigin() + (FVector2D(Cell) + 0.5) * Grid.GetCellSize();
+		const float VisionConeCos = Rules.GetVisionConeCos();
+		for (const FTeammateVisionData& Source : Sources)
+		{
+			if (Rules.IsLocationVisible(Source, FVector(Center, Source.EyeLocation.Z), VisionConeCos))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * So từng ô của lưới với đánh giá vét cạn. Ô chỉ bị tính là sai khi quy tắc thu hẹp và nới rộng cùng cho
+	 * một kết quả mà lưới khác kết quả đó. @return Số ô sai.
+	 */
+	int32 CountMismatches(FAutomationTestBase& Test, const FOBVisibilityGrid& Grid,
+	                      TConstArrayView<FTeammateVisionData> Sources, const FOBVisionRules& Rules, const TCHAR* What)
+	{
+		const FOBVisionRules Inner = OffsetRules(Rules, -1.0f);
+		const FOBVisionRules Outer = OffsetRules(Rules, 1.0f);
+		int32 NumMismatches = 0;
+		int32 NumVisible = 0;
+		for (int32 Y = 0; Y < Grid.GetDimensions().Y; ++Y)
+		{
+			for (int32 X = 0; X < Grid.GetDimensions().X; ++X)
+			{
+				const FIntPoint Cell(X, Y);
+				const bool bVisible = Grid.IsCellVisible(Cell);
+				NumVisible += bVisible ? 1 : 0;
+				if ((bVisible && !IsCellVisibleBruteForce(Grid, Sources, Outer, Cell))
+					|| (!bVisible && IsCellVisibleBruteForce(Grid, Sources, Inner, Cell)))
+				{
+					if (NumMismatches++ < 10)
+					{
+						Test.AddError(FString::Printf(TEXT("%s: ô (%d, %d) là %s nhưng đánh giá vét cạn khác"),
+						                              What, X, Y, bVisible ? TEXT("thấy") : TEXT("không thấy")));
+					}
+				}
+			}
+		}
+		Test.TestTrue(FString::Printf(TEXT("%s: có ô được nhìn thấy"), What), NumVisible > 0);
+		return NumMismatches;
+	}
+
+	TArray<FTeammateVisionData> MakeSources(FRandomStream& Random, const FOBVisibilityGrid& Grid, const int32 Num)
+	{
+		const FVector2D Extent = FVector2D(Grid.GetDimensions()) * Grid.GetCellSize();
+		TArray<FTeammateVisionData> Sources;
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+			// Một phần nguồn nằm ngoài lưới để vùng của chúng bị cắt ở biên
+			Source.GroundLocation = FVector(Grid.GetOrigin() + FVector2D(Random.FRandRange(-0.1f, 1.1f) * Extent.X,
+			                                                             Random.FRandRange(-0.1f, 1.1f) * Extent.Y),
+			                                0.0f);
+			Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+			// Hướng nằm ngang để hình nón 3D của quy tắc trùng với hình chiếu lên lưới
+			Source.ForwardVector = FRotator(0.0f, Random.FRandRange(-180.0f, 180.0f), 0.0f).Vector();
+		}
+		return Sources;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityGridReinitializeTest, "OBVisibilityFog.Grid.Reinitialize",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityGridReinitializeTest::RunTest(const FString& Parameters)
+{
+	FTeammateVisionData Source;
+	Source.GroundLocation = FVector(3200.0f, 3200.0f, 0.0f);
+	Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+	Source.ForwardVector = FVector::ForwardVector;
+
+	// Kích thước giống nhau và nhỏ hơn: cả hai đều giữ lại bộ nhớ của lần trước
+	for (const FIntPoint Dimensions : {FIntPoint(64, 64), FIntPoint(40, 50)})
+	{
+		FOBVisibilityGrid Grid;
+		Grid.Initialize(FVector2D::ZeroVector, 100.0f, FIntPoint(64, 64));
+		Grid.Update(MakeArrayView(&Source, 1), FOBVisionRules(), {});
+		TestTrue(TEXT("Ô của nguồn được nhìn thấy"), Grid.IsCellVisible(FIntPoint(33, 32)));
+
+		Grid.Initialize(FVector2D::ZeroVector, 100.0f, Dimensions);
+		int32 NumVisible = 0;
+		for (int32 Y = 0; Y < Dimensions.Y; ++Y)
+		{
+			for (int32 X = 0; X < Dimensions.X; ++X)
+			{
+				NumVisible += Grid.IsCellVisible(FIntPoint(X, Y)) ? 1 : 0;
+			}
+		}
+		TestEqual(FString::Printf(TEXT("%dx%d: không còn ô nào từ lần khởi tạo trước"), Dimensions.X, Dimensions.Y),
+		          NumVisible, 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityGridBruteForceTest, "OBVisibilityFog.Grid.BruteForce",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityGridBruteForceTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisibilityGridTests;
+
+	FRandomStream Random(1337);
+	FOBVisionRules Rules;
+	Rules.VisionDistance = 1500.0f;
+	Rules.VisionAngleDegrees = 75.0f;
+	Rules.ProximityRadius = 450.0f;
+
+	// Chiều rộng không phải bội số của 64 để word cuối của mỗi hàng có phần đệm
+	FOBVisibilityGrid Grid;
+	Grid.Initialize(FVector2D(-500.0f, -300.0f), 60.0f, FIntPoint(100, 90));
+	TArray<FTeammateVisionData> Sources = MakeSources(Random, Grid, 8);
+	Grid.Update(Sources, Rules);
+	TestEqual(TEXT("Vẽ toàn bộ khớp với đánh giá vét cạn"), CountMismatches(*this, Grid, Sources, Rules,
+	                                                                         TEXT("Vẽ toàn bộ")), 0);
+
+	// Một nguồn di chuyển và một nguồn xoay: chỉ vùng của hai nguồn đó được vẽ lại
+	Sources[2].GroundLocation += FVector(700.0f, -350.0f, 0.0f);
+	Sources[2].EyeLocation += FVector(700.0f, -350.0f, 0.0f);
+	Sources[5].ForwardVector = FRotator(0.0f, Random.FRandRange(-180.0f, 180.0f), 0.0f).Vector();
+	Grid.Update(Sources, Rules);
+	FIntRect UpdateRect;
+	TestTrue(TEXT("Lần cập nhật thứ hai có vẽ lại"), Grid.GetLastUpdateRect(UpdateRect));
+	TestEqual(TEXT("Vẽ lại từng phần khớp với đánh giá vét cạn"), CountMismatches(*this, Grid, Sources, Rules,
+	                                                                               TEXT("Vẽ lại từng phần")), 0);
+
+	// Lưới mới vẽ toàn bộ từ cùng các nguồn phải giống hệt từng bit
+	FOBVisibilityGrid FullGrid;
+	FullGrid.Initialize(Grid.GetOrigin(), Grid.GetCellSize(), Grid.GetDimensions());
+	FullGrid.Update(Sources, Rules);
+	TestTrue(TEXT("Vẽ lại từng phần giống hệt vẽ toàn bộ"),
+	         TArray<uint64>(Grid.GetWords()) == TArray<uint64>(FullGrid.GetWords()));
+	return true;
+}
+
+#endif
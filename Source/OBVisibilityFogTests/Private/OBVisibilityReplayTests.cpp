@@ -0,0 +1,272 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Math/RandomStream.h"
+#include "OBStealthRegistry.h"
+#include "OBVisibilityReplay.h"
+
+namespace OBVisibilityReplayTests
+{
+	// Một frame đã được writer ghi, cùng số frame bị bỏ ngay trước nó.
+	struct FRecordedFrame
+	{
+		double Time = 0.0;
+		TArray<FTeammateVisionData> Sources;
+		TArray<int32> ActorsInCone;
+		int32 NumDroppedBefore = 0;
+	};
+
+	// Kết quả ghi: các frame đã ghi, số frame bị bỏ ở cuối và số frame bị bỏ khi chưa ở bậc chất lượng thấp nhất.
+	struct FRecording
+	{
+		TArray<FRecordedFrame> Written;
+		int32 NumTrailingDropped = 0;
+		int32 NumDroppedAboveFloor = 0;
+	};
+
+	// Như OBFog.Bench.Replay: các nguồn đi bộ 400 cm/s và đổi hướng tối đa 90 độ/s giữa 500 vật thể, 30 lần/giây.
+	// Nếu OutStream khác null, luồng được DrainData sang nó sau mỗi 10 giây.
+	FRecording Record(FOBVisibilityReplayWriter& Writer, const int32 NumFrames, TArray<uint8>* OutStream = nullptr)
+	{
+		constexpr int32 NumSources = 5;
+		constexpr float UpdateRate = 30.0f;
+		constexpr float ArenaHalfExtent = 5000.0f;
+
+		FRandomStream Random(1337);
+		FOBStealthRegistry Targets;
+		for (int32 Index = 0; Index < 500; ++Index)
+		{
+			Targets.Add(FVector(Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent),
+			                    Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent), 0.0f));
+		}
+
+		TArray<FTeammateVisionData> Sources;
+		TArray<float> Headings;
+		for (int32 Index = 0; Index < NumSources; ++Index)
+		{
+			FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+			Source.GroundLocation = FVector(Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent),
+			                                Random.FRandRange(-ArenaHalfExtent, ArenaHalfExtent), 0.0f);
+			Headings.Add(Random.FRandRange(0.0f, 360.0f));
+		}
+
+		const FOBVisionRules Rules;
+		FRecording Recording;
+		TArray<uint8> Revealed;
+		TArray<int32> ActorsInCone;
+		int32 NumDropped = 0;
+		const float DeltaTime = 1.0f / UpdateRate;
+		for (int32 FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+		{
+			for (int32 Index = 0; Index < NumSources; ++Index)
+			{
+				FTeammateVisionData& Source = Sources[Index];
+				Headings[Index] += Random.FRandRange(-90.0f, 90.0f) * DeltaTime;
+				Source.ForwardVector = FRotator(0.0f, Headings[Index], 0.0f).Vector();
+				Source.GroundLocation = (Source.GroundLocation + Source.ForwardVector * 400.0f * DeltaTime)
+					.BoundToCube(ArenaHalfExtent);
+				Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, 170.0f);
+			}
+
+			Targets.Evaluate(MakeArrayView(Sources.GetData(), 1), Rules, Revealed);
+			ActorsInCone.Reset();
+			for (int32 Index = 0; Index < Revealed.Num(); ++Index)
+			{
+				if (Revealed[Index])
+				{
+					ActorsInCone.Add(Index);
+				}
+			}
+
+			const double Time = FrameIndex * DeltaTime;
+			if (Writer.RecordFrame(Time, Sources, Rules, ActorsInCone))
+			{
+				Recording.Written.Add({Time, Sources, ActorsInCone, NumDropped});
+				NumDropped = 0;
+			}
+			else
+			{
+				++NumDropped;
+				const bool bAtFloor = Writer.GetQuantizationLevel() == FOBVisibilityReplayWriter::MaxQuantizationLevel
+					&& Writer.GetKeyframeInterval() >= 5.0f * FOBVisibilityReplayWriter::MaxKeyframeIntervalScale;
+				Recording.NumDroppedAboveFloor += bAtFloor ? 0 : 1;
+			}
+
+			if (OutStream && FrameIndex % 300 == 299)
+			{
+				Writer.DrainData(*OutStream);
+			}
+		}
+
+		Writer.FlushPendingGap();
+		if (OutStream)
+		{
+			Writer.DrainData(*OutStream);
+		}
+		Recording.NumTrailingDropped = NumDropped;
+		return Recording;
+	}
+
+	// So frame đọc lại với frame đã ghi; vị trí sai tối đa nửa đường chéo của ô lượng tử hóa.
+	void TestFrame(FAutomationTestBase& Test, const FOBVisibilityReplayFrame& Frame, const FRecordedFrame& Expected,
+	               const int32 FrameIndex)
+	{
+		const FString What = FString::Printf(TEXT("Frame %d"), FrameIndex);
+		Test.TestEqual(What + TEXT(": thời điểm"), Frame.Time, Expected.Time, 0.0006);
+		Test.TestTrue(What + TEXT(": ActorsInCone"), Frame.ActorsInCone == Expected.ActorsInCone);
+		if (!Test.TestEqual(What + TEXT(": số nguồn"), Frame.Sources.Num(), Expected.Sources.Num()))
+		{
+			return;
+		}
+
+		const double PositionTolerance = static_cast<double>(int64(1) << Frame.QuantizationLevel) * 0.87 + 0.01;
+		const double ForwardTolerance = static_cast<double>(int64(1) << Frame.QuantizationLevel) / 4095.0 * 2.0;
+		for (int32 Index = 0; Index < Expected.Sources.Num(); ++Index)
+		{
+			const FTeammateVisionData& Decoded = Frame.Sources[Index];
+			const FTeammateVisionData& Source = Expected.Sources[Index];
+			if (FVector::Dist(Decoded.EyeLocation, Source.EyeLocation) > PositionTolerance
+				|| FVector::Dist(Decoded.GroundLocation, Source.GroundLocation) > PositionTolerance * 2.0
+				|| FVector::Dist(Decoded.ForwardVector, Source.ForwardVector) > ForwardTolerance)
+			{
+				Test.AddError(FString::Printf(TEXT("%s: nguồn %d đọc lại sai (mức lượng tử hóa %d)"), *What, Index,
+				                              Frame.QuantizationLevel));
+			}
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityReplayRoundTripTest, "OBVisibilityFog.Replay.RoundTrip",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityReplayRoundTripTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisibilityReplayTests;
+
+	// Không giới hạn ngân sách: mọi frame được ghi ở mức đầy đủ. Luồng được lấy ra từng phần bằng DrainData
+	FOBVisibilityReplayWriter Writer;
+	Writer.Reset(5.0f, 0);
+	TArray<uint8> Stream;
+	constexpr int32 NumFrames = 1800;
+	const FRecording Recording = Record(Writer, NumFrames, &Stream);
+	TestEqual(TEXT("Số frame đã ghi"), Recording.Written.Num(), NumFrames);
+	TestEqual(TEXT("Không frame nào bị bỏ"), Writer.GetNumFramesDropped(), 0);
+	TestTrue(TEXT("Writer không giữ lại dữ liệu đã Drain"), Writer.GetData().IsEmpty());
+	TestEqual(TEXT("Tổng byte đã ghi bằng luồng đã Drain"), Writer.GetNumBytesWritten(),
+	          static_cast<int64>(Stream.Num()));
+
+	FOBVisibilityReplayReader Reader;
+	if (!TestTrue(TEXT("Mở luồng ghép từ các phần đã Drain"), Reader.Open(Stream)))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Số frame trong luồng"), Reader.GetNumFrames(), NumFrames);
+	TestEqual(TEXT("Không có khoảng trống"), Reader.GetGaps().Num(), 0);
+
+	int32 NumDecoded = 0;
+	while (Reader.ReadNextFrame())
+	{
+		if (!Recording.Written.IsValidIndex(NumDecoded))
+		{
+			AddError(TEXT("Đọc được nhiều frame hơn số đã ghi"));
+			break;
+		}
+		const FOBVisibilityReplayFrame& Frame = Reader.GetFrame();
+		TestEqual(TEXT("Mức lượng tử hóa khi không giới hạn ngân sách"), Frame.QuantizationLevel, 0);
+		TestFrame(*this, Frame, Recording.Written[NumDecoded], NumDecoded);
+		++NumDecoded;
+	}
+	TestEqual(TEXT("Số frame đọc lại"), NumDecoded, NumFrames);
+
+	// Tua tới frame cuối cùng có thời điểm (ms) không muộn hơn thời điểm tua
+	FRandomStream Random(7);
+	for (int32 SeekIndex = 0; SeekIndex < 50; ++SeekIndex)
+	{
+		const double SeekTime = Random.FRandRange(Reader.GetStartTime(), Reader.GetEndTime());
+		const int64 SeekMs = FMath::RoundToInt64(SeekTime * 1000.0);
+		int32 ExpectedIndex = 0;
+		while (Recording.Written.IsValidIndex(ExpectedIndex + 1)
+			&& FMath::RoundToInt64(Recording.Written[ExpectedIndex + 1].Time * 1000.0) <= SeekMs)
+		{
+			++ExpectedIndex;
+		}
+
+		if (TestTrue(FString::Printf(TEXT("Tua tới %.3f giây"), SeekTime), Reader.SeekToTime(SeekTime)))
+		{
+			TestFrame(*this, Reader.GetFrame(), Recording.Written[ExpectedIndex], ExpectedIndex);
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisibilityReplayBudgetTest, "OBVisibilityFog.Replay.Budget",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisibilityReplayBudgetTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisibilityReplayTests;
+
+	// Ngân sách thấp hơn nhiều so với lượng dữ liệu, để writer phải hạ hết chất lượng rồi mới bỏ frame
+	constexpr int32 MaxBytesPerMinute = 4 * 1024;
+	constexpr int32 NumFrames = 3 * 60 * 30;
+	FOBVisibilityReplayWriter Writer;
+	Writer.Reset(5.0f, MaxBytesPerMinute);
+	const FRecording Recording = Record(Writer, NumFrames);
+
+	TestEqual(TEXT("Không frame nào bị bỏ trước khi hạ hết chất lượng"), Recording.NumDroppedAboveFloor, 0);
+	TestTrue(TEXT("Ngân sách này phải buộc writer bỏ frame"), Writer.GetNumFramesDropped() > 0);
+	TestEqual(TEXT("Mức lượng tử hóa cuối"), Writer.GetQuantizationLevel(),
+	          FOBVisibilityReplayWriter::MaxQuantizationLevel);
+	TestEqual(TEXT("Khoảng keyframe cuối"), Writer.GetKeyframeInterval(),
+	          5.0f * FOBVisibilityReplayWriter::MaxKeyframeIntervalScale);
+
+	// Byte ghi ra không vượt ngân sách của cả bản ghi cộng phần dồn 10 giây ban đầu và một keyframe vượt mức
+	const double MaxBytes = MaxBytesPerMinute * 3.0 + MaxBytesPerMinute / 6.0 + 1024.0;
+	TestTrue(FString::Printf(TEXT("Luồng %lld byte vượt ngân sách %.0f byte"), Writer.GetNumBytesWritten(), MaxBytes),
+	         Writer.GetNumBytesWritten() <= MaxBytes);
+
+	FOBVisibilityReplayReader Reader;
+	if (!TestTrue(TEXT("Mở luồng"), Reader.Open(Writer.GetData())))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Số frame trong luồng"), Reader.GetNumFrames(), Recording.Written.Num());
+	TestEqual(TEXT("Reader báo đúng số frame bị bỏ"), Reader.GetNumFramesDropped(), Writer.GetNumFramesDropped());
+
+	int32 NumGapFrames = 0;
+	for (const FOBVisibilityReplayGap& Gap : Reader.GetGaps())
+	{
+		TestTrue(TEXT("Khoảng trống có frame"), Gap.NumFrames > 0);
+		TestTrue(TEXT("Khoảng trống không kết thúc trước khi bắt đầu"), Gap.EndTime >= Gap.StartTime);
+		NumGapFrames += Gap.NumFrames;
+	}
+	TestEqual(TEXT("Tổng frame của các khoảng trống"), NumGapFrames, Writer.GetNumFramesDropped());
+
+	// Frame đọc tuần tự báo đúng số frame bị bỏ ngay trước nó; khoảng ở cuối được FlushPendingGap ghi ra
+	int32 NumDecoded = 0;
+	int32 NumDroppedBeforeFrames = 0;
+	while (Reader.ReadNextFrame())
+	{
+		if (!Recording.Written.IsValidIndex(NumDecoded))
+		{
+			AddError(TEXT("Đọc được nhiều frame hơn số đã ghi"));
+			break;
+		}
+		const FOBVisibilityReplayFrame& Frame = Reader.GetFrame();
+		const FRecordedFrame& Expected = Recording.Written[NumDecoded];
+		TestEqual(FString::Printf(TEXT("Frame %d: số frame bị bỏ trước nó"), NumDecoded), Frame.NumFramesDroppedBefore,
+		          Expected.NumDroppedBefore);
+		TestFrame(*this, Frame, Expected, NumDecoded);
+		NumDroppedBeforeFrames += Frame.NumFramesDroppedBefore;
+		++NumDecoded;
+	}
+	TestEqual(TEXT("Số frame đọc lại"), NumDecoded, Recording.Written.Num());
+	TestEqual(TEXT("Frame bị bỏ trước các frame và ở cuối"), NumDroppedBeforeFrames + Recording.NumTrailingDropped,
+	          Writer.GetNumFramesDropped());
+	return true;
+}
+
+#endif
@@ -0,0 +1,245 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Math/RandomStream.h"
+#include "OBFogTestWorld.h"
+#include "OBVisionDepthAtlas.h"
+
+namespace OBVisionDepthAtlasTests
+{
+	// Chiếu Location bằng ma trận View-Projection, OutDepth là clip.w (độ sâu tuyến tính mà shader dùng).
+	// @return false nếu điểm nằm sau mắt.
+	bool Project(const FMatrix& ViewProjection, const FVector& Location, FVector2D& OutNDC, double& OutDepth)
+	{
+		const FVector4 Clip = ViewProjection.TransformFVector4(FVector4(Location, 1.0f));
+		if (Clip.W <= 0.0f)
+		{
+			return false;
+		}
+		OutNDC = FVector2D(Clip.X, Clip.Y) / Clip.W;
+		OutDepth = Clip.W;
+		return true;
+	}
+
+	FOBDepthAtlasSource MakeSource(AActor* Owner, const FVector& EyeLocation, const bool bOmnidirectional = false)
+	{
+		FOBDepthAtlasSource Source;
+		Source.Data.EyeLocation = EyeLocation;
+		Source.Data.GroundLocation = EyeLocation - FVector(0.0f, 0.0f, 170.0f);
+		Source.Data.ForwardVector = FVector::ForwardVector;
+		Source.Owner = Owner;
+		Source.bOmnidirectional = bOmnidirectional;
+		return Source;
+	}
+
+	// Chỉ số các tile được capture trong frame hiện tại.
+	TArray<int32> GetTilesCapturedThisFrame(const FOBVisionDepthAtlas& Atlas)
+	{
+		TArray<int32> Result;
+		const TConstArrayView<FOBVisionDepthAtlas::FTile> Tiles = Atlas.GetActiveTiles();
+		for (int32 TileIndex = 0; TileIndex < Tiles.Num(); ++TileIndex)
+		{
+			if (Tiles[TileIndex].LastCaptureFrame == GFrameCounter)
+			{
+				Result.Add(TileIndex);
+			}
+		}
+		return Result;
+	}
+
+	// Một frame của engine mới: tile đã capture ở frame trước lại được xoay vòng.
+	int32 UpdateNextFrame(FOBVisionDepthAtlas& Atlas, TConstArrayView<FOBDepthAtlasSource> Sources,
+	                      const FOBVisionRules& Rules, const int32 MaxCapturesPerFrame)
+	{
+		++GFrameCounter;
+		return Atlas.Update(Sources, Rules, MaxCapturesPerFrame);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionDepthAtlasTileAssignmentTest, "OBVisibilityFog.DepthAtlas.TileAssignment",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionDepthAtlasTileAssignmentTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionDepthAtlasTests;
+
+	FOBFogTestWorld TestWorld;
+	AActor* AtlasOwner = TestWorld.SpawnCube(FVector(0.0f, 0.0f, -1000.0f));
+	TArray<AActor*> Owners;
+	for (int32 Index = 0; Index < 4; ++Index)
+	{
+		Owners.Add(TestWorld.GetWorld()->SpawnActor<AActor>());
+	}
+	FOBVisionDepthAtlas Atlas;
+	if (!TestNotNull(TEXT("Spawn owner"), AtlasOwner)
+		|| !TestTrue(TEXT("Initialize"), Atlas.Initialize(AtlasOwner, 16, 4)))
+	{
+		return false;
+	}
+
+	// Góc nhìn vừa một tile: mỗi nguồn một tile phối cảnh, nguồn nhìn mọi hướng 6 tile cube
+	FOBVisionRules Rules;
+	Rules.VisionAngleDegrees = 100.0f;
+	const FOBDepthAtlasSource Sources[] = {
+		MakeSource(Owners[0], FVector(0.0f, 0.0f, 170.0f)), MakeSource(Owners[1], FVector(500.0f, 0.0f, 170.0f), true),
+		MakeSource(Owners[2], FVector(1000.0f, 0.0f, 170.0f))
+	};
+	Atlas.Update(Sources, Rules, 0);
+	const TArray<int32> ExpectedSources = {0, 1, 1, 1, 1, 1, 1, 2};
+	const TArray<int32> ExpectedFaces = {INDEX_NONE, 0, 1, 2, 3, 4, 5, INDEX_NONE};
+	TConstArrayView<FOBVisionDepthAtlas::FTile> Tiles = Atlas.GetActiveTiles();
+	if (TestEqual(TEXT("Số tile: 1 + 6 + 1"), Tiles.Num(), ExpectedSources.Num()))
+	{
+		for (int32 TileIndex = 0; TileIndex < Tiles.Num(); ++TileIndex)
+		{
+			TestEqual(FString::Printf(TEXT("Nguồn của tile %d"), TileIndex), Tiles[TileIndex].SourceIndex,
+			          ExpectedSources[TileIndex]);
+			TestEqual(FString::Printf(TEXT("Mặt cube của tile %d"), TileIndex), Tiles[TileIndex].Face,
+			          ExpectedFaces[TileIndex]);
+			TestFalse(FString::Printf(TEXT("Tile %d chưa được capture khi ngân sách bằng 0"), TileIndex),
+			          Tiles[TileIndex].bCaptured);
+		}
+	}
+
+	// Góc nhìn rộng hơn MaxPerspectiveTileAngle: mọi nguồn dùng 6 tile; nguồn thứ ba không còn đủ 6 tile trống
+	Rules.VisionAngleDegrees = FOBVisionDepthAtlas::MaxPerspectiveTileAngle + 10.0f;
+	Atlas.Update(Sources, Rules, 0);
+	Tiles = Atlas.GetActiveTiles();
+	if (TestEqual(TEXT("Số tile khi góc nhìn rộng"), Tiles.Num(), 12))
+	{
+		for (int32 TileIndex = 0; TileIndex < Tiles.Num(); ++TileIndex)
+		{
+			TestEqual(FString::Printf(TEXT("Góc rộng: nguồn của tile %d"), TileIndex), Tiles[TileIndex].SourceIndex,
+			          TileIndex / 6);
+			TestEqual(FString::Printf(TEXT("Góc rộng: mặt cube của tile %d"), TileIndex), Tiles[TileIndex].Face,
+			          TileIndex % 6);
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionDepthAtlasCaptureBudgetTest, "OBVisibilityFog.DepthAtlas.CaptureBudget",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionDepthAtlasCaptureBudgetTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionDepthAtlasTests;
+
+	FOBFogTestWorld TestWorld;
+	AActor* AtlasOwner = TestWorld.SpawnCube(FVector(0.0f, 0.0f, -1000.0f));
+	TArray<AActor*> Owners;
+	for (int32 Index = 0; Index < 4; ++Index)
+	{
+		Owners.Add(TestWorld.GetWorld()->SpawnActor<AActor>());
+	}
+	FOBVisionDepthAtlas Atlas;
+	if (!TestNotNull(TEXT("Spawn owner"), AtlasOwner)
+		|| !TestTrue(TEXT("Initialize"), Atlas.Initialize(AtlasOwner, 16, 4)))
+	{
+		return false;
+	}
+
+	FOBVisionRules Rules;
+	Rules.VisionAngleDegrees = 90.0f;
+	TArray<FOBDepthAtlasSource> Sources = {
+		MakeSource(Owners[0], FVector(0.0f, 0.0f, 170.0f)),
+		MakeSource(Owners[1], FVector(500.0f, 0.0f, 170.0f)),
+		MakeSource(Owners[2], FVector(1000.0f, 0.0f, 170.0f)),
+		MakeSource(Owners[3], FVector(0.0f, 500.0f, 170.0f), true)
+	};
+
+	// 9 tile, 4 capture mỗi frame: tile chưa có dữ liệu trước, rồi xoay vòng từ đầu
+	const TArray<TArray<int32>> ExpectedCaptures = {{0, 1, 2, 3}, {4, 5, 6, 7}, {0, 1, 2, 8}, {3, 4, 5, 6}};
+	for (int32 Frame = 0; Frame < ExpectedCaptures.Num(); ++Frame)
+	{
+		TestEqual(FString::Printf(TEXT("Frame %d: số capture"), Frame), UpdateNextFrame(Atlas, Sources, Rules, 4), 4);
+		TestEqual(*FString::Printf(TEXT("Frame %d: các tile được capture"), Frame),
+		          GetTilesCapturedThisFrame(Atlas), ExpectedCaptures[Frame]);
+	}
+
+	// Ma trận của tile phối cảnh là ma trận tại lần capture của nó
+	const FOBDepthAtlasSource& First = Sources[0];
+	TestTrue(TEXT("Ma trận của tile 0"), Atlas.GetActiveTiles()[0].ViewProjection.Equals(
+		         FOBVisionDepthAtlas::ComputeTileViewProjection(First.Data.EyeLocation, First.Data.ForwardVector,
+		                                                        FVector::UpVector, Rules.VisionAngleDegrees,
+		                                                        Rules.VisionDistance)));
+
+	// Bỏ nguồn nhìn mọi hướng: còn 3 tile, con trỏ xoay vòng (đang ở tile 7) được quấn về tile 1
+	Sources.Pop();
+	const TArray<TArray<int32>> ExpectedAfterShrink = {{1}, {2}, {0}, {1}};
+	for (int32 Frame = 0; Frame < ExpectedAfterShrink.Num(); ++Frame)
+	{
+		TestEqual(FString::Printf(TEXT("Sau khi bớt nguồn, frame %d: số capture"), Frame),
+		          UpdateNextFrame(Atlas, Sources, Rules, 1), 1);
+		TestEqual(*FString::Printf(TEXT("Sau khi bớt nguồn, frame %d: tile được capture"), Frame),
+		          GetTilesCapturedThisFrame(Atlas), ExpectedAfterShrink[Frame]);
+	}
+	TestEqual(TEXT("Số tile sau khi bớt nguồn"), Atlas.GetNumTiles(), 3);
+
+	// Ngân sách lớn hơn số tile: mỗi tile chỉ được capture một lần mỗi frame
+	TestEqual(TEXT("Ngân sách lớn hơn số tile"), UpdateNextFrame(Atlas, Sources, Rules, 10), 3);
+	TestEqual(TEXT("Ngân sách bằng 0"), UpdateNextFrame(Atlas, Sources, Rules, 0), 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionDepthAtlasCubeFacesTest, "OBVisibilityFog.DepthAtlas.CubeFaces",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionDepthAtlasCubeFacesTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionDepthAtlasTests;
+
+	// Cùng hướng nhìn và hướng lên với các mặt cube của atlas
+	const FVector Forward[6] = {
+		FVector(1, 0, 0), FVector(-1, 0, 0), FVector(0, 1, 0), FVector(0, -1, 0), FVector(0, 0, 1), FVector(0, 0, -1)
+	};
+	const FVector Up[6] = {
+		FVector(0, 0, 1), FVector(0, 0, 1), FVector(0, 0, 1), FVector(0, 0, 1), FVector(-1, 0, 0), FVector(1, 0, 0)
+	};
+	const FVector Eye(300.0f, -200.0f, 170.0f);
+	constexpr float Distance = 2000.0f;
+
+	FMatrix Faces[6];
+	for (int32 Face = 0; Face < 6; ++Face)
+	{
+		Faces[Face] = FOBVisionDepthAtlas::ComputeTileViewProjection(Eye, Forward[Face], Up[Face], 90.0f, Distance);
+
+		// Tâm của mặt ở giữa tile với độ sâu bằng khoảng cách, hướng lên ở mép trên của tile
+		FVector2D NDC;
+		double Depth = 0.0;
+		TestTrue(FString::Printf(TEXT("Mặt %d: tâm nằm trước mắt"), Face),
+		         Project(Faces[Face], Eye + Forward[Face] * Distance, NDC, Depth));
+		TestTrue(FString::Printf(TEXT("Mặt %d: tâm ở giữa tile"), Face), NDC.IsNearlyZero(1.0e-4f));
+		TestEqual(FString::Printf(TEXT("Mặt %d: độ sâu của tâm"), Face), Depth, static_cast<double>(Distance),
+		          1.0e-2);
+		Project(Faces[Face], Eye + (Forward[Face] + Up[Face]) * 500.0f, NDC, Depth);
+		TestEqual(FString::Printf(TEXT("Mặt %d: hướng lên ở mép trên"), Face), NDC.Y, 1.0, 1.0e-4);
+		TestEqual(FString::Printf(TEXT("Mặt %d: hướng lên ở giữa theo chiều ngang"), Face), NDC.X, 0.0, 1.0e-4);
+	}
+
+	// 6 mặt 90 độ phủ kín mọi hướng: mỗi hướng nằm trong tile của ít nhất một mặt
+	FRandomStream Random(1337);
+	int32 NumUncovered = 0;
+	for (int32 Index = 0; Index < 1000; ++Index)
+	{
+		const FVector Location = Eye + Random.GetUnitVector() * Random.FRandRange(10.0f, Distance);
+		bool bCovered = false;
+		for (int32 Face = 0; Face < 6 && !bCovered; ++Face)
+		{
+			FVector2D NDC;
+			double Depth = 0.0;
+			bCovered = Project(Faces[Face], Location, NDC, Depth) && FMath::Abs(NDC.X) <= 1.0 + 1.0e-4
+				&& FMath::Abs(NDC.Y) <= 1.0 + 1.0e-4 && Depth <= Distance + 1.0e-2;
+		}
+		NumUncovered += bCovered ? 0 : 1;
+	}
+	TestEqual(TEXT("Số hướng không mặt nào phủ"), NumUncovered, 0);
+	return true;
+}
+
+#endif
@@ -0,0 +1,136 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Math/RandomStream.h"
+#include "Math/RotationMatrix.h"
+#include "OBVisibilityFogComponent.h"
+#include "OBVisionReprojection.h"
+
+namespace OBVisionReprojectionTests
+{
+	constexpr float VisionAngleDegrees = 90.0f;
+	constexpr float VisionDistance = 2000.0f;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionReprojectionProjectToUVTest, "OBVisibilityFog.Reprojection.ProjectToUV",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionReprojectionProjectToUVTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionReprojectionTests;
+
+	const FVector Eye(300.0f, -200.0f, 150.0f);
+	const FRotator Rotation(0.0f, 30.0f, 0.0f);
+	const FRotationMatrix Axes(Rotation);
+	const FVector Forward = Axes.GetUnitAxis(EAxis::X);
+	const FVector Right = Axes.GetUnitAxis(EAxis::Y);
+	const FVector Up = Axes.GetUnitAxis(EAxis::Z);
+	const FMatrix ViewProjection = UOBVisibilityFogComponent::ComputeVisionViewProjection(
+		Eye, Forward, VisionAngleDegrees, VisionDistance, 1.0f);
+
+	struct FCase
+	{
+		const TCHAR* What;
+		FVector Location;
+		bool bInside;
+		FVector2D UV;
+		float DeviceZ;
+	};
+	// Ma trận reversed-Z vô hạn với near plane ở VisionDistance: DeviceZ = VisionDistance / khoảng cách,
+	// nên mọi điểm gần hơn VisionDistance có DeviceZ > 1 mà vẫn phải nằm trong frustum (lỗi đã sửa ở ClipToUV)
+	const FCase Cases[] = {
+		{TEXT("Trục nhìn, nửa VisionDistance"), Eye + Forward * 1000.0f, true, FVector2D(0.5, 0.5), 2.0f},
+		{TEXT("Trục nhìn, rất gần mắt"), Eye + Forward * 50.0f, true, FVector2D(0.5, 0.5), 40.0f},
+		{TEXT("Trục nhìn, đúng VisionDistance"), Eye + Forward * VisionDistance, true, FVector2D(0.5, 0.5), 1.0f},
+		{TEXT("Trục nhìn, gấp đôi VisionDistance"), Eye + Forward * 4000.0f, true, FVector2D(0.5, 0.5), 0.5f},
+		{TEXT("Lệch phải"), Eye + Forward * 1000.0f + Right * 900.0f, true, FVector2D(0.95, 0.5), 2.0f},
+		{TEXT("Lệch lên (V hướng xuống)"), Eye + Forward * 1000.0f + Up * 900.0f, true, FVector2D(0.5, 0.05), 2.0f},
+		{TEXT("Ngoài mặt bên phải"), Eye + Forward * 1000.0f + Right * 1100.0f, false, FVector2D::ZeroVector, 0.0f},
+		{TEXT("Ngoài mặt dưới"), Eye + Forward * 500.0f - Up * 600.0f, false, FVector2D::ZeroVector, 0.0f},
+		{TEXT("Sau mắt"), Eye - Forward * 500.0f, false, FVector2D::ZeroVector, 0.0f},
+	};
+
+	for (const FCase& Case : Cases)
+	{
+		FVector2D UV;
+		float DeviceZ = 0.0f;
+		const bool bInside = FOBVisionReprojection::ProjectToUV(ViewProjection, Case.Location, UV, DeviceZ);
+		TestEqual(FString::Printf(TEXT("%s: trong frustum"), Case.What), bInside, Case.bInside);
+		if (Case.bInside && bInside)
+		{
+			TestTrue(FString::Printf(TEXT("%s: UV %s, cần %s"), Case.What, *UV.ToString(), *Case.UV.ToString()),
+			         UV.Equals(Case.UV, 1.0e-4));
+			TestEqual(FString::Printf(TEXT("%s: DeviceZ"), Case.What), DeviceZ, Case.DeviceZ, 1.0e-4f * Case.DeviceZ);
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionReprojectionCurrentToCapturedTest,
+                                 "OBVisibilityFog.Reprojection.CurrentToCaptured",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionReprojectionCurrentToCapturedTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionReprojectionTests;
+
+	const FVector CapturedEye(0.0f, 0.0f, 100.0f);
+	const FVector CapturedForward = FRotator(0.0f, 20.0f, 0.0f).Vector();
+	const FVector CurrentEye = CapturedEye + FVector(150.0f, -80.0f, 10.0f);
+	const FVector CurrentForward = FRotator(-5.0f, 35.0f, 0.0f).Vector();
+	const float AspectRatio = 16.0f / 9.0f;
+	const FMatrix CapturedViewProjection = UOBVisibilityFogComponent::ComputeVisionViewProjection(
+		CapturedEye, CapturedForward, VisionAngleDegrees, VisionDistance, AspectRatio);
+	const FMatrix CurrentViewProjection = UOBVisibilityFogComponent::ComputeVisionViewProjection(
+		CurrentEye, CurrentForward, VisionAngleDegrees, VisionDistance, AspectRatio);
+
+	// Cùng một góc nhìn thì ma trận chuyển đổi là đơn vị
+	const FMatrix SameView = FOBVisionReprojection::ComputeCurrentToCaptured(CapturedViewProjection,
+	                                                                         CapturedViewProjection);
+	TestTrue(TEXT("Cùng góc nhìn cho ma trận đơn vị"), SameView.Equals(FMatrix::Identity, 1.0e-6));
+
+	// Mỗi điểm world nhìn qua góc hiện tại phải rơi vào đúng UV mà ProjectToUV cho với ma trận của lần capture
+	const FMatrix CurrentToCaptured = FOBVisionReprojection::ComputeCurrentToCaptured(CurrentViewProjection,
+	                                                                                  CapturedViewProjection);
+	FRandomStream Random(1337);
+	int32 NumInsideCloserThanVision = 0;
+	for (int32 Index = 0; Index < 500; ++Index)
+	{
+		const FVector Direction = FRotator(Random.FRandRange(-25.0f, 25.0f), Random.FRandRange(-10.0f, 80.0f),
+		                                   0.0f).Vector();
+		const FVector Location = CurrentEye + Direction * Random.FRandRange(20.0f, 6000.0f);
+
+		// Điểm nằm sát mặt bên của capture có thể rơi về hai phía do sai số làm tròn
+		const FVector4 CapturedClip = CapturedViewProjection.TransformFVector4(FVector4(Location, 1.0));
+		if (CapturedClip.W > UE_SMALL_NUMBER && FMath::IsNearlyEqual(
+			FMath::Max(FMath::Abs(CapturedClip.X), FMath::Abs(CapturedClip.Y)) / CapturedClip.W, 1.0, 1.0e-4))
+		{
+			continue;
+		}
+
+		FVector2D ExpectedUV = FVector2D::ZeroVector;
+		float ExpectedDeviceZ = 0.0f;
+		const bool bExpectedInside = FOBVisionReprojection::ProjectToUV(CapturedViewProjection, Location, ExpectedUV,
+		                                                                ExpectedDeviceZ);
+
+		const FVector4 CurrentClip = CurrentViewProjection.TransformFVector4(FVector4(Location, 1.0));
+		FVector2D UV;
+		const bool bInside = FOBVisionReprojection::ReprojectClipToCapturedUV(CurrentToCaptured, CurrentClip, UV);
+		const FString What = FString::Printf(TEXT("Điểm %d tại %s"), Index, *Location.ToString());
+		TestEqual(What + TEXT(": trong frustum của capture"), bInside, bExpectedInside);
+		if (bInside && bExpectedInside)
+		{
+			TestTrue(FString::Printf(TEXT("%s: UV %s, cần %s"), *What, *UV.ToString(), *ExpectedUV.ToString()),
+			         UV.Equals(ExpectedUV, 1.0e-4));
+			NumInsideCloserThanVision += ExpectedDeviceZ > 1.0f ? 1 : 0;
+		}
+	}
+	TestTrue(TEXT("Có điểm gần hơn VisionDistance (DeviceZ > 1) nằm trong frustum của capture"),
+	         NumInsideCloserThanVision > 0);
+	return true;
+}
+
+#endif
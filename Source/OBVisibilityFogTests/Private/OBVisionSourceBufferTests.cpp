@@ -0,0 +1,149 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/Texture2D.h"
+#include "Math/Float16.h"
+#include "Math/RandomStream.h"
+#include "OBVisionSourceBuffer.h"
+
+namespace OBVisionSourceBufferTests
+{
+	// Giải mã một texel Packed giống OBDecodeVisionSource trong OBVisionSourceDecode.ush.
+	FTeammateVisionData DecodePacked(const FLinearColor& Texel, const FVector& Origin, bool& bOutValid)
+	{
+		uint32 Bits[4];
+		FMemory::Memcpy(Bits, &Texel, sizeof(Bits));
+
+		constexpr int32 PositionBits = FOBVisionSourceBuffer::PositionBits;
+		constexpr uint32 Mask = (1u << PositionBits) - 1u;
+		const uint32 Quantized[3] = {
+			Bits[0] & Mask,
+			((Bits[0] >> PositionBits) | (Bits[1] << (32 - PositionBits))) & Mask,
+			(Bits[1] >> (PositionBits * 2 - 32)) & Mask
+		};
+		FVector LocalEye;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			const int32 Signed = static_cast<int32>(Quantized[Axis] << (32 - PositionBits)) >> (32 - PositionBits);
+			LocalEye[Axis] = Signed * FOBVisionSourceBuffer::PositionQuantizationStep;
+		}
+
+		FFloat16 OctX;
+		FFloat16 OctY;
+		OctX.Encoded = static_cast<uint16>(Bits[2] & 0xFFFFu);
+		OctY.Encoded = static_cast<uint16>(Bits[2] >> 16);
+		FVector Forward(OctX.GetFloat(), OctY.GetFloat(), 0.0);
+		Forward.Z = 1.0 - FMath::Abs(Forward.X) - FMath::Abs(Forward.Y);
+		if (Forward.Z < 0.0)
+		{
+			Forward = FVector((1.0 - FMath::Abs(Forward.Y)) * (Forward.X >= 0.0 ? 1.0 : -1.0),
+			                  (1.0 - FMath::Abs(Forward.X)) * (Forward.Y >= 0.0 ? 1.0 : -1.0), Forward.Z);
+		}
+
+		FTeammateVisionData Source;
+		Source.EyeLocation = Origin + LocalEye;
+		Source.ForwardVector = Forward.GetSafeNormal();
+		Source.GroundLocation = FVector(Source.EyeLocation.X, Source.EyeLocation.Y,
+		                                Source.EyeLocation.Z - (Bits[3] & 0xFFFFu)
+		                                * FOBVisionSourceBuffer::PositionQuantizationStep);
+		bOutValid = (Bits[3] & 0x10000u) != 0;
+		return Source;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionSourcePackTest, "OBVisibilityFog.SourceBuffer.Pack",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionSourcePackTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionSourceBufferTests;
+
+	// Nguồn rải trong ±10 km quanh nguồn đầu tiên, vượt xa MaxTeamSize = 8 cũ
+	FRandomStream Random(1337);
+	TArray<FTeammateVisionData> Sources;
+	for (int32 Index = 0; Index < 300; ++Index)
+	{
+		FTeammateVisionData& Source = Sources.AddDefaulted_GetRef();
+		Source.GroundLocation = FVector(Random.FRandRange(-10000.0f, 10000.0f), Random.FRandRange(-10000.0f, 10000.0f),
+		                                Random.FRandRange(-500.0f, 500.0f)) + FVector(123456.0, -65432.0, 0.0);
+		Source.EyeLocation = Source.GroundLocation + FVector(0.0f, 0.0f, Random.FRandRange(0.0f, 300.0f));
+		Source.ForwardVector = Random.GetUnitVector();
+	}
+	Sources[0].GroundLocation = FVector(123456.0, -65432.0, 0.0);
+	Sources[0].EyeLocation = Sources[0].GroundLocation + FVector(0.0, 0.0, 170.0);
+
+	TArray<FLinearColor> Packed;
+	const int32 NumLegacy = FOBVisionSourceBuffer::Pack(EOBVisionSourceLayout::Legacy, Sources, 256, FVector::ZeroVector,
+	                                                    Packed);
+	TestEqual(TEXT("Legacy: số nguồn bị giới hạn bởi sức chứa"), NumLegacy, 256);
+	TestEqual(TEXT("Legacy: số texel"), Packed.Num(), 256 * FOBVisionSourceBuffer::GetTexelsPerSource(
+		          EOBVisionSourceLayout::Legacy));
+	for (int32 Index = 0; Index < NumLegacy; ++Index)
+	{
+		const FLinearColor& Eye = Packed[Index * 2];
+		const FLinearColor& Forward = Packed[Index * 2 + 1];
+		if (!FVector(Eye.R, Eye.G, Eye.B).Equals(Sources[Index].EyeLocation, 0.02)
+			|| !FMath::IsNearlyEqual(Eye.A, Sources[Index].GroundLocation.Z, 0.02)
+			|| !FVector(Forward.R, Forward.G, Forward.B).Equals(Sources[Index].ForwardVector, 1.0e-5))
+		{
+			AddError(FString::Printf(TEXT("Legacy: nguồn %d không khớp"), Index));
+		}
+	}
+
+	const FVector Origin = FOBVisionSourceBuffer::ComputePackOrigin(Sources);
+	const int32 NumPacked = FOBVisionSourceBuffer::Pack(EOBVisionSourceLayout::Packed, Sources, Sources.Num(), Origin,
+	                                                    Packed);
+	TestEqual(TEXT("Packed: số nguồn"), NumPacked, Sources.Num());
+	TestEqual(TEXT("Packed: một texel mỗi nguồn"), Packed.Num(), Sources.Num());
+	for (int32 Index = 0; Index < NumPacked; ++Index)
+	{
+		bool bValid;
+		const FTeammateVisionData Decoded = DecodePacked(Packed[Index], Origin, bValid);
+		const FTeammateVisionData& Source = Sources[Index];
+		// Sai số lượng tử hóa nửa bước mỗi trục, hướng nhìn mã hóa bát diện half-precision
+		if (!bValid || !Decoded.EyeLocation.Equals(Source.EyeLocation, 0.5 + UE_KINDA_SMALL_NUMBER)
+			|| FVector::DotProduct(Decoded.ForwardVector, Source.ForwardVector) < FMath::Cos(FMath::DegreesToRadians(0.2f))
+			|| !FMath::IsNearlyEqual(Decoded.GroundLocation.Z, Source.GroundLocation.Z, 1.0))
+		{
+			AddError(FString::Printf(TEXT("Packed: nguồn %d giải mã thành %s / %s, mong đợi %s / %s"), Index,
+			                         *Decoded.EyeLocation.ToString(), *Decoded.ForwardVector.ToString(),
+			                         *Source.EyeLocation.ToString(), *Source.ForwardVector.ToString()));
+		}
+	}
+
+	// Không có nguồn: vẫn có một texel rỗng (không hợp lệ) để lệnh upload luôn có vùng hợp lệ
+	TestEqual(TEXT("Rỗng: số nguồn"), FOBVisionSourceBuffer::Pack(EOBVisionSourceLayout::Packed, {}, 8, Origin, Packed), 0);
+	bool bValid = true;
+	if (TestEqual(TEXT("Rỗng: số texel"), Packed.Num(), 1))
+	{
+		DecodePacked(Packed[0], Origin, bValid);
+	}
+	TestFalse(TEXT("Rỗng: texel không hợp lệ"), bValid);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionSourceCapacityTest, "OBVisibilityFog.SourceBuffer.Capacity",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionSourceCapacityTest::RunTest(const FString& Parameters)
+{
+	FOBVisionSourceBuffer Buffer;
+	if (!TestTrue(TEXT("Initialize"), Buffer.Initialize(8, 100, EOBVisionSourceLayout::Packed)))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Sức chứa ban đầu"), Buffer.GetMaxSources(), 8);
+	TestFalse(TEXT("Không tạo lại khi còn chỗ"), Buffer.EnsureCapacity(8));
+	TestTrue(TEXT("Tạo lại khi vượt sức chứa"), Buffer.EnsureCapacity(9));
+	TestEqual(TEXT("Tăng theo lũy thừa của 2"), Buffer.GetMaxSources(), 16);
+	TestTrue(TEXT("Tăng tới giới hạn"), Buffer.EnsureCapacity(1000));
+	TestEqual(TEXT("Dừng ở giới hạn"), Buffer.GetMaxSources(), 100);
+	TestFalse(TEXT("Không tăng quá giới hạn"), Buffer.EnsureCapacity(1000));
+	TestEqual(TEXT("Chiều rộng texture"), Buffer.GetTexture() ? Buffer.GetTexture()->GetSizeX() : 0, 100);
+	return true;
+}
+
+#endif
@@ -0,0 +1,215 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Math/RandomStream.h"
+#include "OBFogTestWorld.h"
+#include "OBVisibilityFogSubsystem.h"
+#include "OBVisionSpatialIndex.h"
+
+namespace OBVisionSpatialIndexTests
+{
+	// Hình nón bao quanh mọi khối của test: nửa góc 180 độ và tầm nhìn phủ cả cảnh.
+	FOBVisionCone MakeWholeSceneCone()
+	{
+		return FOBVisionCone(FVector::ZeroVector, FVector::ForwardVector, UE_PI, 100000.0f, 0.0f);
+	}
+
+	// Chỉ mục có trả về primitive này cho hình nón phủ cả cảnh không.
+	bool IndexContains(FOBVisionSpatialIndex& VisionIndex, const UPrimitiveComponent* Component)
+	{
+		TArray<int32> Entries;
+		VisionIndex.QueryCone(MakeWholeSceneCone(), Entries);
+		return Entries.ContainsByPredicate([&VisionIndex, Component](const int32 EntryIndex)
+		{
+			return VisionIndex.GetComponent(EntryIndex) == Component;
+		});
+	}
+
+	// Thêm một khối lập phương vào actor sau khi actor đã được đăng ký với subsystem.
+	UStaticMeshComponent* AddCubeComponent(AActor& Actor, const FVector& RelativeLocation)
+	{
+		UStaticMeshComponent* Component = NewObject<UStaticMeshComponent>(&Actor);
+		Component->SetMobility(EComponentMobility::Movable);
+		Component->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+		Component->SetupAttachment(Actor.GetRootComponent());
+		Component->SetRelativeLocation(RelativeLocation);
+		Component->RegisterComponent();
+		return Component;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionSpatialIndexQueryConeTest, "OBVisibilityFog.SpatialIndex.QueryCone",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionSpatialIndexQueryConeTest::RunTest(const FString& Parameters)
+{
+	FOBFogTestWorld TestWorld;
+	FRandomStream Random(1337);
+
+	// Mật độ như OBFog.Bench.SpatialIndex: một actor mỗi 4 m x 4 m
+	constexpr int32 NumActors = 400;
+	const float SceneHalfExtent = 200.0f * FMath::Sqrt(static_cast<float>(NumActors));
+	TArray<AStaticMeshActor*> Actors;
+	TArray<int32> EntryIndices;
+	FOBVisionSpatialIndex VisionIndex;
+	for (int32 Index = 0; Index < NumActors; ++Index)
+	{
+		const FVector Location(Random.FRandRange(-SceneHalfExtent, SceneHalfExtent),
+		                       Random.FRandRange(-SceneHalfExtent, SceneHalfExtent), Random.FRandRange(0.0f, 300.0f));
+		AStaticMeshActor* Actor = TestWorld.SpawnCube(Location, FVector(Random.FRandRange(0.2f, 3.0f)));
+		if (!TestNotNull(TEXT("Spawn khối"), Actor))
+		{
+			return false;
+		}
+		Actors.Add(Actor);
+		EntryIndices.Add(VisionIndex.Add(Actor, Actor->GetStaticMeshComponent()));
+	}
+
+	// Di chuyển 10% actor: bounds mới chỉ được đọc ở Flush trong QueryCone
+	for (int32 Index = 0; Index < Actors.Num(); Index += 10)
+	{
+		Actors[Index]->SetActorLocation(Actors[Index]->GetActorLocation() + FVector(300.0f, -150.0f, 0.0f));
+		VisionIndex.MarkDirty(EntryIndices[Index]);
+	}
+
+	TArray<int32> Entries;
+	for (int32 QueryIndex = 0; QueryIndex < 100; ++QueryIndex)
+	{
+		const FVector Eye(Random.FRandRange(-SceneHalfExtent, SceneHalfExtent),
+		                  Random.FRandRange(-SceneHalfExtent, SceneHalfExtent), 170.0f);
+		const FVector Forward = FRotator(Random.FRandRange(-30.0f, 30.0f), Random.FRandRange(0.0f, 360.0f), 0.0f)
+			.Vector();
+		const float HalfAngle = FMath::DegreesToRadians(Random.FRandRange(10.0f, 200.0f));
+		const float Distance = Random.FRandRange(500.0f, 4000.0f);
+		const FOBVisionCone Cone(Eye, Forward, HalfAngle, Distance, Random.FRandRange(0.0f, 200.0f));
+		VisionIndex.QueryCone(Cone, Entries);
+
+		// Octree chỉ được loại node, kết quả phải trùng với phép thử hình cầu trên từng primitive
+		TBitArray<> Found(false, EntryIndices.Num());
+		for (const int32 EntryIndex : Entries)
+		{
+			const int32 ActorIndex = EntryIndices.IndexOfByKey(EntryIndex);
+			if (TestTrue(TEXT("Entry trả về thuộc một actor của test"), ActorIndex != INDEX_NONE))
+			{
+				TestFalse(FString::Printf(TEXT("Truy vấn %d: entry %d bị trả về hai lần"), QueryIndex, EntryIndex),
+				          Found[ActorIndex]);
+				Found[ActorIndex] = true;
+			}
+		}
+		for (int32 ActorIndex = 0; ActorIndex < Actors.Num(); ++ActorIndex)
+		{
+			const FBoxSphereBounds& Bounds = Actors[ActorIndex]->GetStaticMeshComponent()->Bounds;
+			const bool bExpected = Cone.IntersectsSphere(Bounds.Origin, Bounds.BoxExtent.Size());
+			if (bExpected != Found[ActorIndex])
+			{
+				AddError(FString::Printf(TEXT("Truy vấn %d: %s %s"), QueryIndex, *Actors[ActorIndex]->GetName(),
+				                         bExpected ? TEXT("bị bỏ sót") : TEXT("bị trả về dù nằm ngoài hình nón")));
+			}
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionSpatialIndexStaleEntriesTest, "OBVisibilityFog.SpatialIndex.StaleEntries",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionSpatialIndexStaleEntriesTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionSpatialIndexTests;
+
+	FOBFogTestWorld TestWorld;
+	FOBVisionSpatialIndex VisionIndex;
+	TArray<AStaticMeshActor*> Actors;
+	TArray<int32> EntryIndices;
+	for (int32 Index = 0; Index < 8; ++Index)
+	{
+		AStaticMeshActor* Actor = TestWorld.SpawnCube(FVector(300.0f * Index, 0.0f, 0.0f));
+		if (!TestNotNull(TEXT("Spawn khối"), Actor))
+		{
+			return false;
+		}
+		Actors.Add(Actor);
+		EntryIndices.Add(VisionIndex.Add(Actor, Actor->GetStaticMeshComponent()));
+	}
+
+	// Hủy actor mà không Remove khỏi chỉ mục, như actor bị hủy không qua EndPlay
+	const TWeakObjectPtr<UPrimitiveComponent> DestroyedComponent = Actors[2]->GetStaticMeshComponent();
+	Actors[2]->Destroy();
+	Actors[5]->Destroy();
+
+	TArray<int32> Entries;
+	VisionIndex.QueryCone(MakeWholeSceneCone(), Entries);
+	TestEqual(TEXT("Truy vấn không trả về entry của actor đã bị hủy"), Entries.Num(), 6);
+	for (const int32 EntryIndex : Entries)
+	{
+		TestTrue(TEXT("Actor của entry trả về còn hợp lệ"), IsValid(VisionIndex.GetActor(EntryIndex)));
+	}
+
+	// Lần truy vấn kế tiếp Flush và bỏ hai entry đã chết
+	VisionIndex.QueryCone(MakeWholeSceneCone(), Entries);
+	TestEqual(TEXT("Số entry sau Flush"), VisionIndex.Num(), 6);
+	TestEqual(TEXT("Số entry trả về sau Flush"), Entries.Num(), 6);
+
+	// Slot đã bỏ được cấp lại, người giữ chỉ số cũ phải nhận ra entry không còn là của mình
+	AStaticMeshActor* NewActor = TestWorld.SpawnCube(FVector(0.0f, 500.0f, 0.0f));
+	const int32 NewEntry = VisionIndex.Add(NewActor, NewActor->GetStaticMeshComponent());
+	TestTrue(TEXT("Slot của entry đã bỏ được dùng lại"), NewEntry == EntryIndices[2] || NewEntry == EntryIndices[5]);
+	TestFalse(TEXT("Entry cũ không còn thuộc primitive đã hủy"),
+	          VisionIndex.IsEntryOf(EntryIndices[2], DestroyedComponent));
+	TestTrue(TEXT("Entry mới thuộc primitive mới"),
+	         VisionIndex.IsEntryOf(NewEntry, NewActor->GetStaticMeshComponent()));
+	TestTrue(TEXT("Primitive mới được tìm thấy"), IndexContains(VisionIndex, NewActor->GetStaticMeshComponent()));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOBVisionSpatialIndexLateComponentsTest, "OBVisibilityFog.SpatialIndex.LateComponents",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOBVisionSpatialIndexLateComponentsTest::RunTest(const FString& Parameters)
+{
+	using namespace OBVisionSpatialIndexTests;
+
+	FOBFogTestWorld TestWorld;
+	UOBVisibilityFogSubsystem* FogSubsystem = TestWorld.GetWorld()->GetSubsystem<UOBVisibilityFogSubsystem>();
+	AStaticMeshActor* Actor = TestWorld.SpawnCube(FVector(500.0f, 0.0f, 0.0f));
+	if (!TestNotNull(TEXT("Subsystem"), FogSubsystem) || !TestNotNull(TEXT("Spawn khối"), Actor))
+	{
+		return false;
+	}
+
+	FOBVisionSpatialIndex& VisionIndex = FogSubsystem->GetVisionIndex();
+	FogSubsystem->RegisterVisionRelevantActor(Actor);
+	TestEqual(TEXT("Số entry sau khi đăng ký"), VisionIndex.Num(), 1);
+
+	// Quét lại tường minh nhận ngay primitive thêm sau
+	UStaticMeshComponent* First = AddCubeComponent(*Actor, FVector(0.0f, 300.0f, 0.0f));
+	FogSubsystem->RefreshVisionRelevantActor(Actor);
+	TestEqual(TEXT("Số entry sau RefreshVisionRelevantActor"), VisionIndex.Num(), 2);
+	TestTrue(TEXT("Primitive thêm sau được tìm thấy"), IndexContains(VisionIndex, First));
+
+	// Không gọi gì: Tick của subsystem quét lại actor theo vòng
+	UStaticMeshComponent* Second = AddCubeComponent(*Actor, FVector(0.0f, -300.0f, 0.0f));
+	FogSubsystem->Tick(0.1f);
+	TestEqual(TEXT("Số entry sau Tick"), VisionIndex.Num(), 3);
+	TestTrue(TEXT("Primitive thêm sau được Tick nhận"), IndexContains(VisionIndex, Second));
+
+	// Primitive bị hủy được bỏ khi quét lại
+	First->DestroyComponent();
+	FogSubsystem->RefreshVisionRelevantActor(Actor);
+	TestEqual(TEXT("Số entry sau khi hủy một primitive"), VisionIndex.Num(), 2);
+
+	// Actor bị hủy mà không hủy đăng ký: Tick bỏ nó cùng mọi entry
+	Actor->Destroy();
+	FogSubsystem->Tick(0.1f);
+	TestEqual(TEXT("Số entry sau khi actor bị hủy"), VisionIndex.Num(), 0);
+	return true;
+}
+
+#endif